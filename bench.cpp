@@ -0,0 +1,471 @@
+// Micro-benchmarks of the GTK-free core: loading and saving files in each encoding, language
+// detection, build planning, project builds and the job pipeline, on synthetic inputs from 1 KB to 1 GB. Prints
+// one JSON document to stdout, progress goes to stderr.
+//
+//   ./mint_pad_bench [--max-size 64M] [--runs 5] [--dir /tmp]
+#include "core.h"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <unistd.h>
+
+namespace 
+{
+
+struct Settings 
+{
+  uint64_t max_size = 1ULL << 30;
+  int runs = 5;
+  std::string dir = temp_directory();
+};
+
+double now_ms() 
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// "64M" -> 67108864; K, M and G are powers of 1024
+uint64_t parse_size(const std::string& text) 
+{
+  char* end = nullptr;
+  uint64_t value = strtoull(text.c_str(), &end, 10);
+  switch (end && *end ? toupper(*end) : 0) 
+  {
+    case 'G': return value << 30;
+    case 'M': return value << 20;
+    case 'K': return value << 10;
+    default: return value;
+  }
+}
+
+std::string size_label(uint64_t bytes) 
+{
+  if (bytes >= (1ULL << 30)) return std::to_string(bytes >> 30) + " GB";
+  if (bytes >= (1ULL << 20)) return std::to_string(bytes >> 20) + " MB";
+  return std::to_string(bytes >> 10) + " KB";
+}
+
+// Source-like text of exactly size bytes whose comments carry accented letters, in encoding
+std::string make_text(uint64_t size, const std::string& encoding) 
+{
+  static const char* lines[] = {
+    "#include <vector>\n",
+    "int sum(const std::vector<int>& values) \n",
+    "{\n",
+    "  int total = 0; // r\xc3\xa9sum\xc3\xa9 of the caf\xc3\xa9 na\xc3\xafve\n",
+    "  for (int value : values) total += value;\n",
+    "  return total;\n",
+    "}\n",
+  };
+  std::string pattern;
+  for (const char* line : lines) pattern += line;
+  if (encoding != "UTF-8") 
+  {
+    size_t unencodable = 0;
+    pattern = encode_text(pattern, encoding, unencodable);
+  }
+  std::string text;
+  text.reserve(size);
+  while (text.size() + pattern.size() <= size) text += pattern;
+  text.append(size - text.size(), '\n');
+  return text;
+}
+
+// Strings are escaped, counts written as integers and measurements with all 17 digits a double holds
+class JsonWriter 
+{
+  public:
+    JsonWriter() { m_out << std::setprecision(17); }
+
+    void begin_result(const std::string& name) 
+    {
+      m_out << (m_results++ ? ",\n" : "") << "    {\"name\": " << quote(name);
+    }
+
+    void field(const std::string& key, const std::string& value) { m_out << ", " << quote(key) << ": " << quote(value); }
+    void field(const std::string& key, uint64_t value) { m_out << ", " << quote(key) << ": " << value; }
+    void field(const std::string& key, int value) { m_out << ", " << quote(key) << ": " << value; }
+    void field(const std::string& key, double value) { m_out << ", " << quote(key) << ": " << value; }
+
+    void stats(const std::string& key, const std::vector<double>& samples) 
+    {
+      SampleStats s = compute_stats(samples);
+      m_out << ", " << quote(key) << ": {\"min\": " << s.min << ", \"median\": " << s.median << ", \"p95\": " << s.p95
+            << ", \"mean\": " << s.mean << ", \"stddev\": " << s.stddev << ", \"runs\": " << samples.size() << "}";
+    }
+
+    static std::string quote(const std::string& text) 
+    {
+      std::string out = "\"";
+      for (unsigned char c : text) 
+      {
+        if (c == '"' || c == '\\') 
+        {
+          out += '\\';
+          out += c;
+        } 
+        else if (c < 0x20) 
+        {
+          char escape[8];
+          snprintf(escape, sizeof(escape), "\\u%04x", c);
+          out += escape;
+        } 
+        else 
+        {
+          out += c;
+        }
+      }
+      return out + "\"";
+    }
+
+    void end_result() { m_out << "}"; }
+
+    std::string str(const Settings& settings) const 
+    {
+      std::ostringstream doc;
+      doc << "{\n  \"cpus\": " << std::thread::hardware_concurrency() << ",\n  \"max_size\": " << settings.max_size
+          << ",\n  \"runs\": " << settings.runs << ",\n  \"results\": [\n" << m_out.str() << "\n  ]\n}\n";
+      return doc.str();
+    }
+
+  private:
+    std::ostringstream m_out;
+    int m_results = 0;
+};
+
+std::vector<double> measure(int runs, const std::function<void()>& fn) 
+{
+  std::vector<double> samples;
+  for (int i = 0; i < runs; ++i) 
+  {
+    double start = now_ms();
+    fn();
+    samples.push_back(now_ms() - start);
+  }
+  return samples;
+}
+
+// The biggest inputs take seconds per run and need no averaging
+int runs_for(const Settings& settings, uint64_t size) 
+{
+  return size >= (256ULL << 20) ? std::min(settings.runs, 2) : settings.runs;
+}
+
+void add_throughput(JsonWriter& json, uint64_t bytes, const std::vector<double>& samples) 
+{
+  double median = compute_stats(samples).median;
+  json.field("mb_per_s", median > 0 ? bytes / (1024.0 * 1024.0) / (median / 1000.0) : 0);
+}
+
+// Open: map, detect the encoding and decode to UTF-8, as EditorTab does before filling its buffer.
+// Save: encode back and write through a temporary file, fsync and rename.
+void bench_files(const Settings& settings, const std::vector<uint64_t>& sizes, JsonWriter& json) 
+{
+  for (const std::string encoding : {"UTF-8", "Windows-1252"}) 
+  {
+    for (uint64_t size : sizes) 
+    {
+      int runs = runs_for(settings, size);
+      std::string path = settings.dir + "/mint_pad_bench_" + std::to_string(getpid()) + ".txt";
+      std::cerr << "load/save " << encoding << " " << size_label(size) << "\n";
+      std::string text = make_text(size, encoding);
+      std::string error = write_file_atomically(path, text);
+      if (!error.empty()) 
+      {
+        std::cerr << "cannot write " << path << ": " << error << "\n";
+        continue;
+      }
+      text.clear();
+      text.shrink_to_fit();
+
+      std::string decoded;
+      std::string detected;
+      auto load = measure(runs, [&] 
+      {
+        MappedFile file;
+        if (!file.open(path)) return;
+        detected = detect_encoding(file.data(), file.size());
+        decoded = decode_text(file.data(), file.size(), detected);
+      });
+      json.begin_result("load");
+      json.field("encoding", encoding);
+      json.field("detected", detected);
+      json.field("bytes", size);
+      json.stats("ms", load);
+      add_throughput(json, size, load);
+      json.end_result();
+
+      auto save = measure(runs, [&] 
+      {
+        size_t unencodable = 0;
+        write_file_atomically(path, encode_text(decoded, encoding, unencodable));
+      });
+      json.begin_result("save");
+      json.field("encoding", encoding);
+      json.field("bytes", size);
+      json.stats("ms", save);
+      add_throughput(json, size, save);
+      json.end_result();
+      unlink(path.c_str());
+    }
+  }
+}
+
+void bench_language(const Settings& settings, JsonWriter& json) 
+{
+  const std::vector<std::string> paths = {"main.cpp", "core.h", "tools/gen.py", "src/list.c", "README", "a/b/c/deep/file.cc"};
+  const size_t calls = 1000000;
+  size_t python = 0; // Keeps the calls from being optimized away
+  auto samples = measure(settings.runs, [&] 
+  {
+    for (size_t i = 0; i < calls; ++i) python += detect_language_from_path(paths[i % paths.size()]) == "python";
+  });
+  json.begin_result("detect_language");
+  json.field("calls", calls);
+  json.field("python", python);
+  json.stats("ms", samples);
+  json.field("ns_per_call", compute_stats(samples).median * 1e6 / calls);
+  json.end_result();
+}
+
+// What a Run costs before anything starts: the build cache key over the whole source, and the steps
+void bench_build_plan(const Settings& settings, const std::vector<uint64_t>& sizes, JsonWriter& json) 
+{
+  for (uint64_t size : sizes) 
+  {
+    if (size > (64ULL << 20)) break; // Nobody compiles a gigabyte of source
+    std::string source = make_text(size, "UTF-8");
+    auto samples = measure(settings.runs, [&] 
+    {
+      std::string key = BuildCache::make_key(source, "cpp", "g++ " + profile_flags("release"));
+      for (bool pgo : {false, true}) 
+      {
+        BuildPlan plan;
+        plan.work_dir = settings.dir + "/mint_pad-job-bench";
+        plan.source_path = plan.work_dir + "/main.cpp";
+        plan.run_cwd = settings.dir;
+        add_build_steps(plan, "g++", profile_flags(pgo ? "pgo" : "release"), pgo, "/dev/null", settings.dir + "/" + key, "");
+      }
+    });
+    json.begin_result("build_plan");
+    json.field("bytes", size);
+    json.stats("ms", samples);
+    add_throughput(json, size, samples);
+    json.end_result();
+  }
+}
+
+// A JobScheduler dispatched on this thread, as the editor does on its main loop
+class JobRunner 
+{
+  public:
+    JobRunner() : m_woken(false), m_scheduler(1, [this] 
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_woken = true;
+      m_wake.notify_one();
+    }) 
+    {
+    }
+
+    // Runs steps as one job and waits for it; returns the wall time, and whether it succeeded in ok
+    double run(std::vector<Job::Step> steps, bool* ok = nullptr) 
+    {
+      double start = now_ms();
+      auto job = m_scheduler.submit(nullptr, "bench", "", std::move(steps));
+      while (job->is_active()) 
+      {
+        {
+          std::unique_lock<std::mutex> lock(m_mutex);
+          m_wake.wait(lock, [this] { return m_woken; });
+          m_woken = false;
+        }
+        m_scheduler.dispatch();
+      }
+      if (ok) *ok = job->state == Job::JOB_SUCCEEDED;
+      return now_ms() - start;
+    }
+
+  private:
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_woken;
+    JobScheduler m_scheduler; // Last, its wakeup uses the members above
+};
+
+// Launch latency of a program that does nothing and of a Python script, and output throughput of one
+// that writes size bytes
+void bench_jobs(const Settings& settings, const std::vector<uint64_t>& sizes, JsonWriter& json) 
+{
+  std::string true_path = find_program("true");
+  std::string head_path = find_program("head");
+  if (true_path.empty() || head_path.empty()) 
+  {
+    std::cerr << "true or head not found, skipping the job benchmarks\n";
+    return;
+  }
+
+  JobRunner runner;
+  std::cerr << "job latency\n";
+  std::vector<double> latency;
+  for (int i = 0; i < std::max(settings.runs, 20); ++i) 
+  {
+    Job::Step step;
+    step.label = "Running";
+    step.options.argv = {true_path};
+    latency.push_back(runner.run({step}));
+  }
+  json.begin_result("job_latency");
+  json.stats("ms", latency);
+  json.end_result();
+
+  // A trivial script in a fresh python3, then forked from a warm PythonZygote
+  PythonZygote zygote;
+  std::string script = settings.dir + "/mint_pad_bench_" + std::to_string(getpid()) + ".py";
+  if (!find_program("python3").empty() && zygote.start("python3", {}) && write_file_atomically(script, "import sys\n").empty()) 
+  {
+    std::cerr << "python runs\n";
+    std::string socket;
+    for (int i = 0; i < 10000 && (socket = zygote.socket_path()).empty(); ++i) usleep(1000);
+    for (const std::string mode : {"python3", "zygote"}) 
+    {
+      std::vector<double> samples;
+      for (int i = 0; i < std::max(settings.runs, 20); ++i) 
+      {
+        Job::Step step;
+        step.label = "Running";
+        step.options.argv = {"python3", "-u", script};
+        step.options.zygote_socket = mode == "zygote" ? socket : "";
+        samples.push_back(runner.run({step}));
+      }
+      json.begin_result("python_run");
+      json.field("mode", mode);
+      json.stats("ms", samples);
+      json.end_result();
+    }
+    unlink(script.c_str());
+  }
+
+  for (uint64_t size : sizes) 
+  {
+    std::cerr << "job output " << size_label(size) << "\n";
+    std::vector<double> samples;
+    for (int i = 0; i < runs_for(settings, size); ++i) 
+    {
+      Job::Step step;
+      step.label = "Running";
+      step.options.argv = {head_path, "-c", std::to_string(size), "/dev/zero"};
+      samples.push_back(runner.run({step}));
+    }
+    json.begin_result("job_output");
+    json.field("bytes", size);
+    json.stats("ms", samples);
+    add_throughput(json, size, samples);
+    json.end_result();
+  }
+}
+
+// A project of 50 translation units sharing a header: a full build, a build with nothing to do,
+// and the rebuild after editing one file, which should cost one compile and the link
+void bench_project(const Settings& settings, JsonWriter& json) 
+{
+  if (find_program("g++").empty()) 
+  {
+    std::cerr << "g++ not found, skipping the project build benchmark\n";
+    return;
+  }
+  const int units = 50;
+  std::string dir = settings.dir + "/mint_pad_bench_project_" + std::to_string(getpid());
+  std::string object_dir = dir + "/objects/project";
+  make_directories(dir);
+  write_file_atomically(dir + "/common.h", "#pragma once\n#include <vector>\n#include <string>\nint scale();\n");
+  std::string main_source = "#include <cstdio>\n#include \"common.h\"\n";
+  std::string calls;
+  for (int i = 1; i < units; ++i) 
+  {
+    std::string name = "f" + std::to_string(i);
+    write_file_atomically(dir + "/unit" + std::to_string(i) + ".cpp", "#include \"common.h\"\nint " + name + "(int x)\n{\n  std::vector<std::string> words(x, \"" + name + 
+                          "\");\n  return static_cast<int>(words.size()) * scale();\n}\n");
+    main_source += "int " + name + "(int);\n";
+    calls += "  total += " + name + "(" + std::to_string(i) + ");\n";
+  }
+  main_source += "int scale() { return 2; }\nint main()\n{\n  long total = 0;\n" + calls + "  printf(\"%ld\\n\", total);\n}\n";
+  write_file_atomically(dir + "/main.cpp", main_source);
+
+  std::cerr << "project build\n";
+  JobRunner runner;
+  BuildPlan plan;
+  add_project_build_steps(plan, dir, profile_flags("release"), object_dir, object_dir + "/program", std::thread::hardware_concurrency());
+  auto build = [&](const std::string& kind, const std::function<void()>& before) 
+  {
+    std::vector<double> samples;
+    for (int i = 0; i < (kind == "full" ? 1 : settings.runs); ++i) 
+    {
+      before();
+      bool ok = false;
+      samples.push_back(runner.run(plan.build_steps, &ok));
+      if (!ok) std::cerr << "project build failed\n";
+    }
+    json.begin_result("project_build");
+    json.field("kind", kind);
+    json.field("units", units);
+    json.stats("ms", samples);
+    json.end_result();
+  };
+  build("full", [] {});
+  build("no_change", [] {});
+  int edits = 0;
+  build("one_edit", [&] 
+  {
+    std::ofstream(dir + "/unit1.cpp", std::ios::app) << "// edit " << ++edits << "\n";
+  });
+  remove_tree(dir);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) 
+{
+  if (argc > 1 && std::string(argv[1]) == Subprocess::launcher_flag) 
+  {
+    return Subprocess::launcher_main(argc, argv);
+  }
+  if (argc > 1 && std::string(argv[1]) == project_build_flag) 
+  {
+    return project_build_main(argc, argv);
+  }
+
+  Settings settings;
+  for (int i = 1; i + 1 < argc; i += 2) 
+  {
+    std::string option = argv[i];
+    if (option == "--max-size") settings.max_size = parse_size(argv[i + 1]);
+    else if (option == "--runs") settings.runs = std::max(1, atoi(argv[i + 1]));
+    else if (option == "--dir") settings.dir = argv[i + 1];
+    else 
+    {
+      std::cerr << "usage: " << argv[0] << " [--max-size 64M] [--runs 5] [--dir /tmp]\n";
+      return 2;
+    }
+  }
+  if (argc % 2 == 0) 
+  {
+    std::cerr << "usage: " << argv[0] << " [--max-size 64M] [--runs 5] [--dir /tmp]\n";
+    return 2;
+  }
+
+  std::vector<uint64_t> sizes;
+  for (uint64_t size : {1ULL << 10, 1ULL << 20, 64ULL << 20, 1ULL << 30}) 
+  {
+    if (size <= settings.max_size) sizes.push_back(size);
+  }
+
+  JsonWriter json;
+  bench_files(settings, sizes, json);
+  bench_language(settings, json);
+  bench_build_plan(settings, sizes, json);
+  bench_jobs(settings, sizes, json);
+  bench_project(settings, json);
+  std::cout << std::setprecision(6) << json.str(settings);
+  return 0;
+}
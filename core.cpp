@@ -0,0 +1,2199 @@
+// Implementations of core.h
+#include "core.h"
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <future>
+#include <fstream>
+#include <sstream>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <climits>
+#include <dirent.h>
+#include <ftw.h>
+#include <spawn.h>
+#include <utime.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <linux/perf_event.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+bool MappedFile::open(const std::string& path) 
+{
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) 
+  {
+    ::close(fd);
+    return false;
+  }
+
+  if (st.st_size > 0) // mmap() refuses zero-length mappings, an empty file simply has no data
+  {
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) 
+    {
+      ::close(fd);
+      return false;
+    }
+    madvise(addr, st.st_size, MADV_SEQUENTIAL); // We read it front to back exactly once
+    m_data = static_cast<const char*>(addr);
+    m_size = st.st_size;
+  }
+  ::close(fd); // The mapping stays valid after the descriptor is closed
+  return true;
+}
+
+void MappedFile::close() 
+{
+  if (m_data) 
+  {
+    munmap(const_cast<char*>(m_data), m_size);
+  }
+  m_data = nullptr;
+  m_size = 0;
+}
+
+std::string write_file_atomically(const std::string& path, const std::vector<std::pair<const char*, size_t>>& spans) 
+{
+  size_t slash = path.find_last_of('/');
+  std::string dir = (slash == std::string::npos) ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+  std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+  std::string temp_path = dir + "/." + name + ".XXXXXX";
+
+  std::vector<char> temp_template(temp_path.begin(), temp_path.end());
+  temp_template.push_back('\0');
+  int fd = mkostemp(temp_template.data(), O_CLOEXEC);
+  if (fd < 0) 
+  {
+    return "Could not create a temporary file in " + dir + ": " + std::strerror(errno);
+  }
+  temp_path = temp_template.data();
+
+  struct stat st;
+  fchmod(fd, stat(path.c_str(), &st) == 0 ? (st.st_mode & 07777) : 0644); // Keep the permissions of the file we replace
+
+  auto fail = [&](const std::string& what) 
+  {
+    std::string message = what + " " + temp_path + ": " + std::strerror(errno);
+    if (fd >= 0) ::close(fd);
+    unlink(temp_path.c_str());
+    return message;
+  };
+
+  for (const auto& span : spans) 
+  {
+    size_t written = 0;
+    while (written < span.second) 
+    {
+      ssize_t n = ::write(fd, span.first + written, span.second - written);
+      if (n < 0) 
+      {
+        if (errno == EINTR) continue;
+        return fail("Could not write");
+      }
+      written += n;
+    }
+  }
+  if (fsync(fd) != 0) return fail("Could not sync");
+  int close_result = ::close(fd);
+  fd = -1;
+  if (close_result != 0) return fail("Could not close");
+  if (rename(temp_path.c_str(), path.c_str()) != 0) return fail("Could not rename");
+
+  int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC); // Persists the rename itself
+  if (dir_fd >= 0) 
+  {
+    fsync(dir_fd);
+    ::close(dir_fd);
+  }
+  return "";
+}
+
+std::string write_file_atomically(const std::string& path, const std::string& data) 
+{
+  return write_file_atomically(path, {{data.data(), data.size()}});
+}
+
+SaveEngine::~SaveEngine() 
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_wake.notify_all();
+  m_worker.join(); // Queued saves are still written before the thread exits
+}
+
+std::deque<SaveEngine::Result> SaveEngine::take_results() 
+{
+  std::deque<Result> results;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  results.swap(m_results);
+  return results;
+}
+
+void SaveEngine::submit(Request request) 
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queue.push_back(std::move(request));
+  }
+  m_wake.notify_one();
+}
+
+void SaveEngine::wait_idle() 
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_idle.wait(lock, [this] { return m_queue.empty() && !m_busy; });
+}
+
+std::vector<SaveEngine::Result> SaveEngine::write_all(std::vector<Request> requests) 
+{
+  std::vector<std::future<Result>> pending;
+  for (auto& request : requests) 
+  {
+    pending.push_back(std::async(std::launch::async, [&request] { return write(request); }));
+  }
+  std::vector<Result> results;
+  for (auto& future : pending) 
+  {
+    results.push_back(future.get());
+  }
+  return results;
+}
+
+SaveEngine::Result SaveEngine::write(const Request& request) 
+{
+  auto start = std::chrono::steady_clock::now();
+  Result result;
+  result.owner = request.owner;
+  result.path = request.path;
+  result.error = request.spans.empty() ? write_file_atomically(request.path, request.data) : write_file_atomically(request.path, request.spans);
+  result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  return result;
+}
+
+void SaveEngine::run() 
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) 
+  {
+    m_wake.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+    if (m_queue.empty()) break; // Stopping, and nothing left to write
+
+    Request request = std::move(m_queue.front());
+    m_queue.pop_front();
+    m_busy = true;
+    lock.unlock();
+
+    Result result = write(request);
+
+    lock.lock();
+    m_busy = false;
+    m_results.push_back(std::move(result));
+    m_wakeup();
+    m_idle.notify_all();
+  }
+}
+
+bool make_directories(const std::string& path) 
+{
+  for (size_t pos = 1; pos <= path.size(); ++pos) 
+  {
+    if (pos == path.size() || path[pos] == '/') 
+    {
+      std::string prefix = path.substr(0, pos);
+      if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) 
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+BuildCache::BuildCache(const std::string& dir, uint64_t max_bytes) :
+  m_dir(dir),
+  m_max_bytes(max_bytes),
+  m_bytes(0),
+  m_hits(0),
+  m_misses(0),
+  m_evict_pending(true), // Measure what earlier sessions left behind
+  m_stop(false)
+{
+  make_directories(m_dir);
+  m_worker = std::thread(&BuildCache::run, this);
+}
+
+BuildCache::~BuildCache() 
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_wake.notify_all();
+  m_worker.join();
+}
+
+std::string BuildCache::make_key(const std::string& source, const std::string& language, const std::string& command) 
+{
+  uint64_t lanes[2] = {14695981039346656037ULL, 0x9e3779b97f4a7c15ULL}; // A zero seed would let leading NULs vanish
+  auto step = [&lanes](unsigned char c) 
+  {
+    lanes[0] = (lanes[0] ^ c) * 1099511628211ULL;
+    lanes[1] = (((lanes[1] << 5) | (lanes[1] >> 59)) ^ c) * 0x517cc1b727220a95ULL;
+  };
+  auto feed = [&step](const std::string& text) 
+  {
+    for (unsigned char c : text) step(c);
+    step(0xff); // Field separator, "ab"+"c" differs from "a"+"bc"
+  };
+  feed(language);
+  feed(command);
+  feed(source);
+  lanes[1] ^= lanes[1] >> 33;
+  lanes[1] *= 0xff51afd7ed558ccdULL;
+  lanes[1] ^= lanes[1] >> 33;
+  lanes[1] *= 0xc4ceb9fe1a85ec53ULL;
+  lanes[1] ^= lanes[1] >> 33;
+
+  char hex[33];
+  snprintf(hex, sizeof(hex), "%016llx%016llx", (unsigned long long)lanes[0], (unsigned long long)lanes[1]);
+  return hex;
+}
+
+bool BuildCache::lookup(const std::string& key) 
+{
+  std::string path = path_for(key);
+  if (access(path.c_str(), X_OK) == 0) 
+  {
+    utime(path.c_str(), nullptr); // mtime doubles as the LRU timestamp, so recency survives restarts
+    ++m_hits;
+    return true;
+  }
+  ++m_misses;
+  return false;
+}
+
+void BuildCache::added() 
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_evict_pending = true;
+  }
+  m_wake.notify_one();
+}
+
+void BuildCache::run() 
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) 
+  {
+    m_wake.wait(lock, [this] { return m_stop || m_evict_pending; });
+    if (m_stop) break;
+    m_evict_pending = false;
+    lock.unlock();
+    evict();
+    lock.lock();
+  }
+}
+
+void BuildCache::evict() 
+{
+  struct Entry { std::string path; time_t used; uint64_t size; };
+  std::vector<Entry> entries;
+  uint64_t total = 0;
+
+  DIR* dir = opendir(m_dir.c_str());
+  if (!dir) return;
+  while (struct dirent* ent = readdir(dir)) 
+  {
+    if (ent->d_name[0] == '.') continue;
+    std::string path = m_dir + "/" + ent->d_name;
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) 
+    {
+      entries.push_back({path, st.st_mtime, (uint64_t)st.st_size});
+      total += st.st_size;
+    }
+  }
+  closedir(dir);
+
+  if (total > m_max_bytes) 
+  {
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+    for (const auto& entry : entries) 
+    {
+      if (total <= m_max_bytes) break;
+      if (unlink(entry.path.c_str()) == 0) total -= entry.size;
+    }
+  }
+  m_bytes = total;
+}
+
+std::string file_identity(const std::string& path) 
+{
+  struct stat st;
+  if (path.empty() || stat(path.c_str(), &st) != 0) 
+  {
+    return path;
+  }
+  return path + ":" + std::to_string(st.st_size) + ":" + std::to_string(st.st_mtime);
+}
+
+std::string disk_stamp(const std::string& path) 
+{
+  struct stat st;
+  if (path.empty() || stat(path.c_str(), &st) != 0) 
+  {
+    return "";
+  }
+  return std::to_string(st.st_ino) + ":" + std::to_string(st.st_size) + ":" + std::to_string(st.st_mtim.tv_sec) + "." + std::to_string(st.st_mtim.tv_nsec);
+}
+
+std::string find_program(const std::string& name) 
+{
+  if (name.find('/') != std::string::npos) return access(name.c_str(), X_OK) == 0 ? name : "";
+  const char* path = getenv("PATH");
+  std::istringstream dirs(path ? path : "/usr/local/bin:/usr/bin:/bin");
+  std::string dir;
+  while (std::getline(dirs, dir, ':')) 
+  {
+    std::string candidate = (dir.empty() ? "." : dir) + "/" + name;
+    struct stat st;
+    if (stat(candidate.c_str(), &st) == 0 && S_ISREG(st.st_mode) && access(candidate.c_str(), X_OK) == 0) return candidate;
+  }
+  return "";
+}
+
+std::string temp_directory() 
+{
+  const char* dir = getenv("TMPDIR");
+  return dir && *dir ? dir : "/tmp";
+}
+
+std::string compiler_identity(const std::string& compiler) 
+{
+  std::string path = find_program(compiler);
+  return path.empty() ? compiler : file_identity(path);
+}
+
+std::string profile_flags(const std::string& profile) 
+{
+  if (profile == "release") return "-O2";
+  if (profile == "max") return "-O3 -march=native -flto";
+  if (profile == "pgo") return "-O2";
+  return "-O0 -g"; // "debug"
+}
+
+int run_quietly(const std::vector<std::string>& args, std::atomic<int>* child) 
+{
+  std::vector<char*> argv;
+  for (const auto& arg : args) 
+  {
+    argv.push_back(const_cast<char*>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+  posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+  pid_t pid;
+  int spawned = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+  posix_spawn_file_actions_destroy(&actions);
+  if (spawned != 0) return -1;
+  if (child) *child = pid;
+
+  int status = 0;
+  int waited;
+  while ((waited = waitpid(pid, &status, 0)) < 0 && errno == EINTR) {}
+  if (child) *child = 0;
+  if (waited < 0) return -1;
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+std::vector<std::string> split_flags(const std::string& flags) 
+{
+  std::vector<std::string> result;
+  std::istringstream stream(flags);
+  std::string flag;
+  while (stream >> flag) 
+  {
+    result.push_back(flag);
+  }
+  return result;
+}
+
+std::vector<std::string> scan_include_preamble(const std::string& code) 
+{
+  std::set<std::string> headers;
+  std::istringstream stream(code);
+  std::string line;
+  bool in_comment = false;
+  while (std::getline(stream, line)) 
+  {
+    size_t start = line.find_first_not_of(" \t\r");
+    if (start == std::string::npos) continue; // Blank line
+    std::string text = line.substr(start);
+
+    if (in_comment || text.compare(0, 2, "/*") == 0) 
+    {
+      in_comment = text.find("*/") == std::string::npos;
+      continue;
+    }
+    if (text.compare(0, 2, "//") == 0) continue;
+    if (text[0] != '#') break; // First real code
+
+    size_t word = text.find_first_not_of(" \t", 1);
+    if (word == std::string::npos || text.compare(word, 7, "include") != 0) break; // #define, #pragma...
+    size_t open = text.find_first_not_of(" \t", word + 7);
+    size_t close = text.find('>', open);
+    if (open == std::string::npos || text[open] != '<' || close == std::string::npos) break; // Local "header.h"
+    headers.insert(text.substr(open, close - open + 1));
+  }
+  return std::vector<std::string>(headers.begin(), headers.end());
+}
+
+// Length of the run of ASCII bytes at the start of data, 16 bytes per step with SSE2
+void RingBuffer::write(const char* data, size_t length) 
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  size_t capacity = m_data.size();
+  if (length > capacity) // Only the tail can survive anyway
+  {
+    m_total += length - capacity;
+    data += length - capacity;
+    length = capacity;
+  }
+  size_t start = m_total % capacity;
+  size_t first = std::min(length, capacity - start);
+  memcpy(m_data.data() + start, data, first);
+  memcpy(m_data.data(), data + first, length - first);
+  m_total += length;
+}
+
+uint64_t RingBuffer::read_since(uint64_t position, std::string& out, size_t max_bytes, uint64_t& skipped) const 
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  size_t capacity = m_data.size();
+  uint64_t oldest = m_total > capacity ? m_total - capacity : 0;
+  uint64_t from = std::max(position, oldest);
+  if (m_total - from > max_bytes) 
+  {
+    from = m_total - max_bytes;
+  }
+  skipped = from - std::min(position, from);
+
+  for (uint64_t at = from; at < m_total; ) 
+  {
+    size_t start = at % capacity;
+    size_t length = std::min<uint64_t>(m_total - at, capacity - start);
+    out.append(m_data.data() + start, length);
+    at += length;
+  }
+  return m_total;
+}
+
+uint64_t RingBuffer::total() const 
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_total;
+}
+
+static size_t ascii_prefix(const char* data, size_t size) 
+{
+  size_t i = 0;
+#if defined(__x86_64__)
+  for (; i + 16 <= size; i += 16) 
+  {
+    int mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+    if (mask) return i + __builtin_ctz(mask);
+  }
+#endif
+  while (i < size && static_cast<unsigned char>(data[i]) < 0x80) ++i;
+  return i;
+}
+
+// Decodes the UTF-8 sequence at p, moving p past it. Returns false, and moves p one byte, for an
+// invalid or truncated sequence, an overlong form or a surrogate.
+static bool decode_utf8(const unsigned char*& p, const unsigned char* end, uint32_t& code_point) 
+{
+  unsigned char c = *p;
+  size_t length = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xE ? 3 : (c >> 3) == 0x1E ? 4 : 0;
+  if (length == 0 || static_cast<size_t>(end - p) < length) 
+  {
+    ++p;
+    return false;
+  }
+  static const uint32_t minimum[] = {0, 0, 0x80, 0x800, 0x10000};
+  uint32_t value = length == 1 ? c : c & (0x7F >> length);
+  for (size_t i = 1; i < length; ++i) 
+  {
+    if ((p[i] & 0xC0) != 0x80) 
+    {
+      ++p;
+      return false;
+    }
+    value = (value << 6) | (p[i] & 0x3F);
+  }
+  if (value < minimum[length] || value > 0x10FFFF || (value >= 0xD800 && value <= 0xDFFF)) 
+  {
+    ++p;
+    return false;
+  }
+  p += length;
+  code_point = value;
+  return true;
+}
+
+static char* append_utf8(char* out, uint32_t code_point) 
+{
+  if (code_point < 0x80) 
+  {
+    *out++ = code_point;
+  } 
+  else if (code_point < 0x800) 
+  {
+    *out++ = 0xC0 | (code_point >> 6);
+    *out++ = 0x80 | (code_point & 0x3F);
+  } 
+  else if (code_point < 0x10000) 
+  {
+    *out++ = 0xE0 | (code_point >> 12);
+    *out++ = 0x80 | ((code_point >> 6) & 0x3F);
+    *out++ = 0x80 | (code_point & 0x3F);
+  } 
+  else 
+  {
+    *out++ = 0xF0 | (code_point >> 18);
+    *out++ = 0x80 | ((code_point >> 12) & 0x3F);
+    *out++ = 0x80 | ((code_point >> 6) & 0x3F);
+    *out++ = 0x80 | (code_point & 0x3F);
+  }
+  return out;
+}
+
+#if defined(__x86_64__)
+// Keiser and Lemire's UTF-8 validation ("Validating UTF-8 In Less Than One Instruction Per Byte"):
+// three 16-entry table lookups, on the nibbles of each byte and of the byte before it, flag every
+// invalid pair of bytes at once, and shifted compares check that 3 and 4 byte sequences have
+// their continuation bytes. Blocks of plain ASCII skip all of it.
+__attribute__((target("avx2"))) static bool valid_utf8_avx2(const char* data, size_t size) 
+{
+  const __m256i nibble = _mm256_set1_epi8(0x0F);
+  // Bits of the error classes, named as in the paper
+  const char too_short = 0x01, too_long = 0x02, overlong_3 = 0x04, too_large = 0x08, surrogate = 0x10, overlong_2 = 0x20, too_large_1000 = 0x40, overlong_4 = 0x40, two_conts = char(0x80);
+  const char carry = too_short | too_long | two_conts;
+  const __m256i byte_1_high = _mm256_setr_epi8(
+    too_long, too_long, too_long, too_long, too_long, too_long, too_long, too_long, two_conts, two_conts, two_conts, two_conts,
+    too_short | overlong_2, too_short, too_short | overlong_3 | surrogate, too_short | too_large | too_large_1000 | overlong_4,
+    too_long, too_long, too_long, too_long, too_long, too_long, too_long, too_long, two_conts, two_conts, two_conts, two_conts,
+    too_short | overlong_2, too_short, too_short | overlong_3 | surrogate, too_short | too_large | too_large_1000 | overlong_4);
+  const char large = carry | too_large | too_large_1000;
+  const __m256i byte_1_low = _mm256_setr_epi8(
+    carry | overlong_3 | overlong_2 | overlong_4, carry | overlong_2, carry, carry, carry | too_large, large, large, large,
+    large, large, large, large, large, large | surrogate, large, large,
+    carry | overlong_3 | overlong_2 | overlong_4, carry | overlong_2, carry, carry, carry | too_large, large, large, large,
+    large, large, large, large, large, large | surrogate, large, large);
+  const char continuation_8 = too_long | overlong_2 | two_conts | overlong_3 | too_large_1000 | overlong_4;
+  const char continuation_9 = too_long | overlong_2 | two_conts | overlong_3 | too_large;
+  const char continuation_ab = too_long | overlong_2 | two_conts | surrogate | too_large;
+  const __m256i byte_2_high = _mm256_setr_epi8(
+    too_short, too_short, too_short, too_short, too_short, too_short, too_short, too_short,
+    continuation_8, continuation_9, continuation_ab, continuation_ab, too_short, too_short, too_short, too_short,
+    too_short, too_short, too_short, too_short, too_short, too_short, too_short, too_short,
+    continuation_8, continuation_9, continuation_ab, continuation_ab, too_short, too_short, too_short, too_short);
+  // A block ending in the lead byte of a sequence needs continuation bytes from the next one
+  const __m256i incomplete_limit = _mm256_setr_epi8(
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, char(0xF0 - 1), char(0xE0 - 1), char(0xC0 - 1));
+
+  __m256i error = _mm256_setzero_si256();
+  __m256i previous = _mm256_setzero_si256();
+  __m256i previous_incomplete = _mm256_setzero_si256();
+  for (size_t i = 0; i < size; i += 32) 
+  {
+    __m256i input;
+    if (i + 32 <= size) 
+    {
+      input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    } 
+    else 
+    {
+      char tail[32] = {}; // Padded with NULs, which end any sequence left open
+      memcpy(tail, data + i, size - i);
+      input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(tail));
+    }
+    if (_mm256_movemask_epi8(input) == 0) 
+    {
+      error = _mm256_or_si256(error, previous_incomplete);
+    } 
+    else 
+    {
+      __m256i shifted = _mm256_permute2x128_si256(previous, input, 0x21); // Previous high lane, current low lane
+      __m256i previous_1 = _mm256_alignr_epi8(input, shifted, 15);
+      __m256i previous_2 = _mm256_alignr_epi8(input, shifted, 14);
+      __m256i previous_3 = _mm256_alignr_epi8(input, shifted, 13);
+      __m256i special = _mm256_and_si256(_mm256_and_si256(
+        _mm256_shuffle_epi8(byte_1_high, _mm256_and_si256(_mm256_srli_epi16(previous_1, 4), nibble)),
+        _mm256_shuffle_epi8(byte_1_low, _mm256_and_si256(previous_1, nibble))),
+        _mm256_shuffle_epi8(byte_2_high, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+      __m256i third = _mm256_subs_epu8(previous_2, _mm256_set1_epi8(0xE0 - 0x80)); // High bit set where a continuation must be
+      __m256i fourth = _mm256_subs_epu8(previous_3, _mm256_set1_epi8(0xF0 - 0x80));
+      __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(char(0x80)));
+      error = _mm256_or_si256(error, _mm256_xor_si256(must_continue, special));
+      previous_incomplete = _mm256_subs_epu8(input, incomplete_limit);
+    }
+    previous = input;
+  }
+  error = _mm256_or_si256(error, previous_incomplete);
+  return _mm256_testz_si256(error, error);
+}
+#endif
+
+bool is_valid_utf8(const char* data, size_t size) 
+{
+#if defined(__x86_64__)
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  if (avx2) return valid_utf8_avx2(data, size);
+#endif
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+  const unsigned char* end = p + size;
+  uint32_t code_point;
+  while (p < end) 
+  {
+    p += ascii_prefix(reinterpret_cast<const char*>(p), end - p);
+    if (p < end && !decode_utf8(p, end, code_point)) return false;
+  }
+  return true;
+}
+
+// Code points of the Windows-1252 bytes 0x80-0x9F; the five it leaves undefined map to the C1
+// control of the same number, as in Latin-1, so any byte survives a load and a save
+static const uint16_t windows_1252_high[32] = {
+  0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021, 0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+  0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014, 0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178};
+
+std::string detect_encoding(const char* data, size_t size) 
+{
+  if (size >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0) return "UTF-8 BOM";
+  if (size >= 2 && memcmp(data, "\xFF\xFE", 2) == 0) return "UTF-16LE BOM";
+  if (size >= 2 && memcmp(data, "\xFE\xFF", 2) == 0) return "UTF-16BE BOM";
+
+  // Mostly ASCII UTF-16 has a NUL in every other byte, which UTF-8 text has nowhere
+  size_t sample = std::min<size_t>(size, 64 * 1024) & ~size_t(1);
+  size_t even_nuls = 0;
+  size_t odd_nuls = 0;
+  for (size_t i = 0; i < sample; i += 2) 
+  {
+    even_nuls += data[i] == 0;
+    odd_nuls += data[i + 1] == 0;
+  }
+  size_t pairs = sample / 2;
+  if (size % 2 == 0 && pairs > 0) 
+  {
+    if (odd_nuls * 10 >= pairs * 3 && even_nuls * 20 <= pairs) return "UTF-16LE";
+    if (even_nuls * 10 >= pairs * 3 && odd_nuls * 20 <= pairs) return "UTF-16BE";
+  }
+  return is_valid_utf8(data, size) ? "UTF-8" : "Windows-1252";
+}
+
+std::string decode_text(const char* data, size_t size, const std::string& encoding) 
+{
+  bool bom = encoding.size() > 4 && encoding.compare(encoding.size() - 4, 4, " BOM") == 0;
+  if (encoding.compare(0, 6, "UTF-16") == 0) 
+  {
+    bool big_endian = encoding.compare(0, 8, "UTF-16BE") == 0;
+    size_t i = bom ? 2 : 0;
+    std::unique_ptr<char[]> buffer(new char[(size - i) / 2 * 3 + 3]); // Not zeroed, unlike a std::string
+    char* out = buffer.get();
+    auto unit = [&](size_t at) -> uint32_t 
+    {
+      unsigned char a = data[at], b = data[at + 1];
+      return big_endian ? (a << 8 | b) : (b << 8 | a);
+    };
+    while (i + 2 <= size) 
+    {
+#if defined(__x86_64__)
+      // Eight ASCII characters at once: their 16-bit units narrowed to bytes
+      const __m128i high_bits = _mm_set1_epi16(static_cast<short>(0xFF80));
+      while (i + 16 <= size) 
+      {
+        __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        if (big_endian) units = _mm_or_si128(_mm_slli_epi16(units, 8), _mm_srli_epi16(units, 8));
+        __m128i ascii = _mm_cmpeq_epi16(_mm_and_si128(units, high_bits), _mm_setzero_si128());
+        if (_mm_movemask_epi8(ascii) != 0xFFFF) break;
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(units, units));
+        out += 8;
+        i += 16;
+      }
+      if (i + 2 > size) break;
+#endif
+      uint32_t code_point = unit(i);
+      i += 2;
+      if (code_point >= 0xD800 && code_point <= 0xDBFF && i + 2 <= size && unit(i) >= 0xDC00 && unit(i) <= 0xDFFF) 
+      {
+        code_point = 0x10000 + ((code_point - 0xD800) << 10) + (unit(i) - 0xDC00);
+        i += 2;
+      } 
+      else if (code_point >= 0xD800 && code_point <= 0xDFFF) 
+      {
+        code_point = 0xFFFD;
+      }
+      out = append_utf8(out, code_point);
+    }
+    if (i < size) out = append_utf8(out, 0xFFFD);
+    return std::string(buffer.get(), out);
+  }
+
+  if (encoding == "Windows-1252") 
+  {
+    std::unique_ptr<char[]> buffer(new char[size * 3]);
+    char* out = buffer.get();
+    for (size_t i = 0; i < size;) 
+    {
+      size_t ascii = ascii_prefix(data + i, size - i);
+      memcpy(out, data + i, ascii);
+      out += ascii;
+      i += ascii;
+      if (i == size) break;
+      unsigned char c = data[i++];
+      out = append_utf8(out, c < 0xA0 ? windows_1252_high[c - 0x80] : c);
+    }
+    return std::string(buffer.get(), out);
+  }
+
+  size_t skip = bom ? 3 : 0; // UTF-8, possibly with a byte order mark
+  if (is_valid_utf8(data + skip, size - skip)) return std::string(data + skip, size - skip);
+  std::unique_ptr<char[]> buffer(new char[(size - skip) * 3]);
+  char* out = buffer.get();
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(data + skip);
+  const unsigned char* end = reinterpret_cast<const unsigned char*>(data + size);
+  while (p < end) 
+  {
+    uint32_t code_point;
+    out = append_utf8(out, decode_utf8(p, end, code_point) ? code_point : 0xFFFD);
+  }
+  return std::string(buffer.get(), out);
+}
+
+std::string encode_text(const std::string& text, const std::string& encoding, size_t& unencodable) 
+{
+  unencodable = 0;
+  bool bom = encoding.size() > 4 && encoding.compare(encoding.size() - 4, 4, " BOM") == 0;
+  const char* data = text.data();
+  size_t size = text.size();
+  const unsigned char* end = reinterpret_cast<const unsigned char*>(data + size);
+  if (encoding.compare(0, 6, "UTF-16") == 0) 
+  {
+    bool big_endian = encoding.compare(0, 8, "UTF-16BE") == 0;
+    std::unique_ptr<char[]> buffer(new char[size * 2 + 2]);
+    char* out = buffer.get();
+    auto put = [&](uint32_t unit) 
+    {
+      *out++ = big_endian ? unit >> 8 : unit & 0xFF;
+      *out++ = big_endian ? unit & 0xFF : unit >> 8;
+    };
+    if (bom) put(0xFEFF);
+    for (size_t i = 0; i < size;) 
+    {
+#if defined(__x86_64__)
+      // Sixteen ASCII characters at once, widened to 16-bit units
+      while (i + 16 <= size) 
+      {
+        __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        if (_mm_movemask_epi8(chars)) break;
+        __m128i zero = _mm_setzero_si128();
+        __m128i low = big_endian ? _mm_unpacklo_epi8(zero, chars) : _mm_unpacklo_epi8(chars, zero);
+        __m128i high = big_endian ? _mm_unpackhi_epi8(zero, chars) : _mm_unpackhi_epi8(chars, zero);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), low);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), high);
+        out += 32;
+        i += 16;
+      }
+      if (i == size) break;
+#endif
+      const unsigned char* p = reinterpret_cast<const unsigned char*>(data + i);
+      uint32_t code_point;
+      if (!decode_utf8(p, end, code_point)) code_point = 0xFFFD;
+      i = reinterpret_cast<const char*>(p) - data;
+      if (code_point >= 0x10000) 
+      {
+        put(0xD800 + ((code_point - 0x10000) >> 10));
+        put(0xDC00 + ((code_point - 0x10000) & 0x3FF));
+      } 
+      else 
+      {
+        put(code_point);
+      }
+    }
+    return std::string(buffer.get(), out);
+  }
+
+  if (encoding == "Windows-1252") 
+  {
+    std::unique_ptr<char[]> buffer(new char[size]);
+    char* out = buffer.get();
+    for (size_t i = 0; i < size;) 
+    {
+      size_t ascii = ascii_prefix(data + i, size - i);
+      memcpy(out, data + i, ascii);
+      out += ascii;
+      i += ascii;
+      if (i == size) break;
+      const unsigned char* p = reinterpret_cast<const unsigned char*>(data + i);
+      uint32_t code_point = 0;
+      bool valid = decode_utf8(p, end, code_point);
+      i = reinterpret_cast<const char*>(p) - data;
+      const uint16_t* found = std::find(windows_1252_high, windows_1252_high + 32, code_point);
+      if (valid && code_point >= 0xA0 && code_point <= 0xFF) *out++ = code_point;
+      else if (valid && found != windows_1252_high + 32) *out++ = 0x80 + (found - windows_1252_high);
+      else 
+      {
+        *out++ = '?';
+        ++unencodable;
+      }
+    }
+    return std::string(buffer.get(), out);
+  }
+
+  return bom ? "\xEF\xBB\xBF" + text : text;
+}
+
+std::string make_valid_utf8(std::string& carry, const std::string& chunk) 
+{
+  if (carry.empty() && is_valid_utf8(chunk.data(), chunk.size())) return chunk; // The usual case
+  std::string input = carry + chunk;
+  std::string output;
+  output.reserve(input.size());
+  carry.clear();
+
+  size_t i = 0;
+  while (i < input.size()) 
+  {
+    unsigned char c = input[i];
+    size_t length = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xE ? 3 : (c >> 3) == 0x1E ? 4 : 0;
+    if (length == 0 || (length == 2 && c < 0xC2) || (length == 4 && c > 0xF4)) 
+    {
+      output += '?';
+      ++i;
+      continue;
+    }
+    if (i + length > input.size()) // Possibly cut in half, wait for the rest
+    {
+      bool prefix_ok = true;
+      for (size_t j = i + 1; j < input.size(); ++j) prefix_ok &= (static_cast<unsigned char>(input[j]) & 0xC0) == 0x80;
+      if (prefix_ok) 
+      {
+        carry = input.substr(i);
+        break;
+      }
+    }
+    bool valid = i + length <= input.size();
+    for (size_t j = 1; valid && j < length; ++j) 
+    {
+      valid = (static_cast<unsigned char>(input[i + j]) & 0xC0) == 0x80;
+    }
+    if (valid && length == 3) // No overlong forms or UTF-16 surrogates
+    {
+      unsigned char next = input[i + 1];
+      valid = !(c == 0xE0 && next < 0xA0) && !(c == 0xED && next >= 0xA0);
+    }
+    if (valid && length == 4) 
+    {
+      unsigned char next = input[i + 1];
+      valid = !(c == 0xF0 && next < 0x90) && !(c == 0xF4 && next >= 0x90);
+    }
+    if (!valid) 
+    {
+      output += '?';
+      ++i;
+      continue;
+    }
+    output.append(input, i, length);
+    i += length;
+  }
+  return output;
+}
+
+// The zygote itself: python3 -c zygote_source socket_path module,module... The socket is bound under
+// a temporary name and renamed once the imports are done, so connecting succeeds only when it is ready.
+// Requests are one SOCK_SEQPACKET message, "cwd\0cpu\0memory\0file size\0argv...", with the run's
+// stdin, stdout and stderr attached; the replies are "pid N" and then "exit status utime stime ...".
+static const char* zygote_source = R"PY(
+import array, builtins, io, os, resource, signal, socket, sys, traceback, types
+
+def preload(names):
+    for name in names:
+        try:
+            __import__(name)
+        except BaseException as error:
+            print('--- Python zygote cannot preload %s: %s ---' % (name, error), file=sys.stderr)
+
+def receive(conn):
+    data, ancdata, _, _ = conn.recvmsg(65536, socket.CMSG_SPACE(3 * 4))
+    fds = array.array('i')
+    for level, kind, payload in ancdata:
+        if level == socket.SOL_SOCKET and kind == socket.SCM_RIGHTS:
+            fds.frombytes(payload[:len(payload) - len(payload) % 4])
+    fields = data.decode('utf-8', 'surrogateescape').split('\0')
+    if len(fds) != 3 or len(fields) < 5:
+        raise ValueError('bad request')
+    return fields[0], [int(limit) for limit in fields[1:4]], fields[4:], list(fds)
+
+# Forks the run, reaps it and reports back; returns only in the run's process, with its request
+def supervise(conn):
+    signal.signal(signal.SIGCHLD, signal.SIG_DFL)
+    request = receive(conn)
+    pid = os.fork()
+    if pid == 0:
+        conn.close()
+        return request
+    for fd in request[3]:
+        os.close(fd)
+    try:
+        os.setpgid(pid, pid) # Also in the child, whichever runs first
+    except OSError:
+        pass
+    conn.send(b'pid %d' % pid)
+    _, status, usage = os.wait4(pid, 0)
+    conn.send(('exit %d %d %d %d %d %d %d %d' % (status, usage.ru_utime * 1e6, usage.ru_stime * 1e6, usage.ru_maxrss, 
+                                                  usage.ru_minflt, usage.ru_majflt, usage.ru_nvcsw, usage.ru_nivcsw)).encode())
+    os._exit(0)
+
+# Accepts runs forever; returns only in a forked run, with the request it is to run
+def serve(path):
+    server = socket.socket(socket.AF_UNIX, socket.SOCK_SEQPACKET)
+    server.bind(path + '.part')
+    os.rename(path + '.part', path)
+    server.listen(64)
+    signal.signal(signal.SIGCHLD, signal.SIG_IGN) # Supervisors are reaped by the kernel
+    while True:
+        conn, _ = server.accept()
+        if os.fork() != 0:
+            conn.close()
+            continue
+        server.close()
+        try:
+            return supervise(conn)
+        except BaseException:
+            os._exit(1) # The launcher sees the connection close and runs python3 itself
+
+def run(cwd, limits, argv, fds):
+    os.setpgid(0, 0) # Own process group, so stopping a run also stops whatever it spawned
+    for target, fd in enumerate(fds):
+        os.dup2(fd, target)
+        os.close(fd)
+    for kind, limit in zip((resource.RLIMIT_CPU, resource.RLIMIT_AS, resource.RLIMIT_FSIZE), limits):
+        if limit:
+            resource.setrlimit(kind, (limit, limit + 1 if kind == resource.RLIMIT_CPU else limit))
+    os.chdir(cwd)
+    while len(argv) > 1 and argv[1].startswith('-'):
+        argv.pop(1) # Interpreter options, -u is what the streams below do anyway
+    script = argv[1]
+    sys.argv = argv[1:]
+    sys.path[0] = os.path.dirname(os.path.abspath(script))
+    # Unbuffered like python3 -u, so output shows up as it is printed
+    sys.stdin = sys.__stdin__ = io.TextIOWrapper(io.BufferedReader(io.FileIO(0, 'r', closefd=False)))
+    sys.stdout = sys.__stdout__ = io.TextIOWrapper(io.FileIO(1, 'w', closefd=False), write_through=True)
+    sys.stderr = sys.__stderr__ = io.TextIOWrapper(io.FileIO(2, 'w', closefd=False), errors='backslashreplace', write_through=True)
+    main = types.ModuleType('__main__')
+    main.__file__ = script
+    main.__builtins__ = builtins
+    sys.modules['__main__'] = main
+    try:
+        with open(script, 'rb') as source:
+            code = compile(source.read(), script, 'exec')
+        exec(code, main.__dict__)
+    except SystemExit:
+        raise
+    except BaseException as error:
+        traceback.print_exception(type(error), error, error.__traceback__.tb_next) # Without this frame
+        sys.exit(1)
+
+preload([name for name in sys.argv[2].split(',') if name])
+run(*serve(sys.argv[1]))
+)PY";
+
+bool PythonZygote::start(const std::string& python, const std::vector<std::string>& modules) 
+{
+  stop();
+  m_python = python;
+  m_modules = modules;
+  m_socket = temp_directory() + "/mint_pad-zygote-" + std::to_string(getpid()) + "-" + std::to_string(++m_generation);
+  std::string module_list;
+  for (const auto& module : modules) module_list += (module_list.empty() ? "" : ",") + module;
+
+  std::vector<std::string> args = {python, "-c", zygote_source, m_socket, module_list};
+  std::vector<char*> argv;
+  for (const auto& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+  argv.push_back(nullptr);
+  pid_t parent = getpid();
+  pid_t pid = fork();
+  if (pid == 0) 
+  {
+    // Child: only async-signal-safe calls from here on
+    prctl(PR_SET_PDEATHSIG, SIGTERM); // Sent when the thread that forked exits, the main thread here
+    if (getppid() != parent) _exit(0);
+    int null_fd = ::open("/dev/null", O_RDONLY);
+    if (null_fd >= 0) dup2(null_fd, STDIN_FILENO);
+    signal(SIGPIPE, SIG_DFL);
+    execvp(argv[0], argv.data());
+    _exit(127);
+  }
+  if (pid < 0) return false;
+  m_pid = pid;
+  return true;
+}
+
+void PythonZygote::stop() 
+{
+  if (m_pid <= 0) return;
+  ::kill(m_pid, SIGTERM); // Runs in progress belong to their supervisors and carry on
+  while (waitpid(m_pid, nullptr, 0) < 0 && errno == EINTR) {}
+  m_pid = 0;
+  unlink(m_socket.c_str());
+  unlink((m_socket + ".part").c_str());
+}
+
+std::string PythonZygote::socket_path() 
+{
+  if (m_pid <= 0) return "";
+  int status;
+  if (waitpid(m_pid, &status, WNOHANG) == m_pid) // Died, e.g. a preloaded module crashed it or it was killed
+  {
+    m_pid = 0;
+    unlink(m_socket.c_str());
+    start(m_python, m_modules);
+    return "";
+  }
+  return access(m_socket.c_str(), F_OK) == 0 ? m_socket : "";
+}
+
+int PythonZygote::start_program(const std::string& socket_name, char** argv, const rlim_t limits[3], pid_t& pid) 
+{
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socket_name.size() >= sizeof(address.sun_path)) return -1;
+  memcpy(address.sun_path, socket_name.c_str(), socket_name.size());
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+  if (connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) 
+  {
+    ::close(fd);
+    return -1;
+  }
+
+  char cwd[PATH_MAX];
+  if (!getcwd(cwd, sizeof(cwd))) cwd[0] = '\0';
+  std::string request = std::string(cwd) + '\0' + std::to_string(limits[0]) + '\0' + std::to_string(limits[1]) + '\0' + std::to_string(limits[2]);
+  for (char** arg = argv; *arg; ++arg) request += std::string(1, '\0') + *arg;
+
+  int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+  char control[CMSG_SPACE(sizeof(fds))];
+  memset(control, 0, sizeof(control));
+  struct iovec data = {const_cast<char*>(request.data()), request.size()};
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &data;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+  header->cmsg_level = SOL_SOCKET;
+  header->cmsg_type = SCM_RIGHTS;
+  header->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+  char reply[64];
+  ssize_t got = -1;
+  if (sendmsg(fd, &message, MSG_NOSIGNAL) == static_cast<ssize_t>(request.size())) 
+  {
+    while ((got = recv(fd, reply, sizeof(reply) - 1, 0)) < 0 && errno == EINTR) {}
+  }
+  if (got <= 0) // The zygote is exiting or could not fork, nothing has run yet
+  {
+    ::close(fd);
+    return -1;
+  }
+  reply[got] = '\0';
+  if (sscanf(reply, "pid %d", &pid) != 1) 
+  {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+bool PythonZygote::wait_program(int connection, int& status, struct rusage& usage) 
+{
+  char reply[256];
+  ssize_t got;
+  while ((got = recv(connection, reply, sizeof(reply) - 1, 0)) < 0 && errno == EINTR) {}
+  ::close(connection);
+  if (got <= 0) return false;
+  reply[got] = '\0';
+  long long utime_us, stime_us, fields[5];
+  if (sscanf(reply, "exit %d %lld %lld %lld %lld %lld %lld %lld", &status, &utime_us, &stime_us, &fields[0], &fields[1], &fields[2], &fields[3], &fields[4]) != 8) 
+  {
+    return false;
+  }
+  memset(&usage, 0, sizeof(usage));
+  usage.ru_utime = {static_cast<time_t>(utime_us / 1000000), static_cast<suseconds_t>(utime_us % 1000000)};
+  usage.ru_stime = {static_cast<time_t>(stime_us / 1000000), static_cast<suseconds_t>(stime_us % 1000000)};
+  usage.ru_maxrss = fields[0];
+  usage.ru_minflt = fields[1];
+  usage.ru_majflt = fields[2];
+  usage.ru_nvcsw = fields[3];
+  usage.ru_nivcsw = fields[4];
+  return true;
+}
+
+// Samples the instruction pointer of a process, its threads and children with perf_event_open, the
+// way "perf record" does, for when perf itself is not installed. Only user space is sampled, which
+// the default perf_event_paranoid setting allows for one's own processes. The kernel only maps ring
+// buffers of inherited events per CPU, so there is one event and ring buffer per CPU.
+class ProfileSampler 
+{
+  public:
+    ProfileSampler() : m_lost(0) {}
+
+    ~ProfileSampler() 
+    {
+      for (const auto& ring : m_rings) 
+      {
+        munmap(ring.map, ring_size());
+        ::close(ring.fd);
+      }
+    }
+
+    ProfileSampler(const ProfileSampler&) = delete;
+    ProfileSampler& operator=(const ProfileSampler&) = delete;
+
+    // Starts sampling pid at its next exec, frequency times per second of CPU time. Returns false
+    // with errno set if the kernel refuses.
+    bool attach(pid_t pid, unsigned frequency) 
+    {
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = PERF_COUNT_HW_CPU_CYCLES;
+      attr.sample_type = PERF_SAMPLE_IP;
+      attr.freq = 1;
+      attr.sample_freq = frequency;
+      attr.disabled = 1;
+      attr.enable_on_exec = 1;
+      attr.inherit = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+
+      int error = ENODEV;
+      long cpus = sysconf(_SC_NPROCESSORS_CONF);
+      for (int cpu = 0; cpu < cpus; ++cpu) 
+      {
+        int fd = syscall(SYS_perf_event_open, &attr, pid, cpu, -1, PERF_FLAG_FD_CLOEXEC);
+        if (fd < 0 && attr.type == PERF_TYPE_HARDWARE && (errno == ENOENT || errno == EOPNOTSUPP)) // No cycle counter, e.g. in a VM
+        {
+          attr.type = PERF_TYPE_SOFTWARE;
+          attr.config = PERF_COUNT_SW_CPU_CLOCK;
+          fd = syscall(SYS_perf_event_open, &attr, pid, cpu, -1, PERF_FLAG_FD_CLOEXEC);
+        }
+        if (fd < 0) // E.g. an offline CPU
+        {
+          error = errno;
+          continue;
+        }
+        void* map = mmap(nullptr, ring_size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) 
+        {
+          error = errno;
+          ::close(fd);
+          continue;
+        }
+        m_rings.push_back({fd, map});
+      }
+      errno = error;
+      return !m_rings.empty();
+    }
+
+    bool attached() const { return !m_rings.empty(); }
+
+    // Waits up to timeout_ms for a ring buffer to fill up halfway
+    void wait(int timeout_ms) const 
+    {
+      std::vector<struct pollfd> fds;
+      for (const auto& ring : m_rings) fds.push_back({ring.fd, POLLIN, 0});
+      poll(fds.data(), fds.size(), timeout_ms);
+    }
+
+    // Moves the samples out of the ring buffers into the counts
+    void drain() 
+    {
+      for (const auto& ring : m_rings) 
+      {
+        auto* control = static_cast<struct perf_event_mmap_page*>(ring.map);
+        uint64_t head = __atomic_load_n(&control->data_head, __ATOMIC_ACQUIRE);
+        uint64_t tail = control->data_tail;
+        while (head - tail >= sizeof(struct perf_event_header)) 
+        {
+          struct perf_event_header event;
+          copy_out(ring, tail, &event, sizeof(event));
+          if (event.size < sizeof(event) || head - tail < event.size) break;
+          if (event.type == PERF_RECORD_SAMPLE) 
+          {
+            uint64_t ip;
+            copy_out(ring, tail + sizeof(event), &ip, sizeof(ip));
+            ++m_counts[ip];
+          } 
+          else if (event.type == PERF_RECORD_LOST) 
+          {
+            uint64_t lost[2]; // id, count
+            copy_out(ring, tail + sizeof(event), lost, sizeof(lost));
+            m_lost += lost[1];
+          }
+          tail += event.size;
+        }
+        __atomic_store_n(&control->data_tail, tail, __ATOMIC_RELEASE); // Frees the space for the kernel
+      }
+    }
+
+    uint64_t lost() const { return m_lost; }
+
+    // One "address count" line per sampled address, the address in hex
+    bool write(const std::string& path) const 
+    {
+      std::ofstream out(path);
+      for (const auto& count : m_counts) out << std::hex << count.first << std::dec << " " << count.second << "\n";
+      return static_cast<bool>(out);
+    }
+
+  private:
+    struct Ring 
+    {
+      int fd;
+      void* map; // Control page, then the data area
+    };
+
+    static size_t ring_size() { return (1 + 32) * sysconf(_SC_PAGESIZE); } // 128 KB of data per CPU
+
+    // Copies len bytes at position of a ring's data area, which wraps around
+    static void copy_out(const Ring& ring, uint64_t position, void* out, size_t len) 
+    {
+      size_t page = sysconf(_SC_PAGESIZE);
+      const char* data = static_cast<const char*>(ring.map) + page;
+      size_t data_size = ring_size() - page;
+      size_t offset = position % data_size;
+      size_t first = std::min(len, data_size - offset);
+      memcpy(out, data + offset, first);
+      memcpy(static_cast<char*>(out) + first, data, len - first);
+    }
+
+    std::vector<Ring> m_rings;
+    uint64_t m_lost;
+    std::unordered_map<uint64_t, uint64_t> m_counts;
+};
+
+Subprocess::~Subprocess() 
+{
+  kill();
+  if (m_reader.joinable()) m_reader.join();
+  close_stdin();
+}
+
+bool Subprocess::start(const Options& options, std::string& error) 
+{
+  int in[2], out[2], err[2], exec_status[2], report[2];
+  if (pipe2(in, O_CLOEXEC) != 0) { error = std::strerror(errno); return false; }
+  if (pipe2(out, O_CLOEXEC) != 0 || pipe2(err, O_CLOEXEC) != 0 || pipe2(exec_status, O_CLOEXEC) != 0 || pipe2(report, O_CLOEXEC) != 0) 
+  {
+    error = std::strerror(errno);
+    return false; // Descriptor exhaustion, the few leaked here are the least of the problems
+  }
+
+  std::vector<std::string> args = {"/proc/self/exe", launcher_flag, std::to_string(exec_status[1]), std::to_string(report[1]), 
+                                   std::to_string(options.cpu_limit_seconds), std::to_string(options.memory_limit_bytes), 
+                                   std::to_string(options.file_size_limit_bytes), options.sample_path.empty() ? "-" : options.sample_path, 
+                                   options.zygote_socket.empty() ? "-" : options.zygote_socket};
+  args.insert(args.end(), options.argv.begin(), options.argv.end());
+  std::vector<char*> argv;
+  for (const auto& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+  argv.push_back(nullptr);
+
+  m_start = std::chrono::steady_clock::now();
+  pid_t pid = fork();
+  if (pid == 0) 
+  {
+    // Child: only async-signal-safe calls from here on
+    auto fail = [&exec_status]() 
+    {
+      int code = errno;
+      ssize_t ignored = ::write(exec_status[1], &code, sizeof(code)); // Tells the parent why it did not start
+      (void)ignored;
+      _exit(127);
+    };
+    int stdin_fd = options.stdin_path.empty() ? in[0] : ::open(options.stdin_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (stdin_fd < 0) fail();
+    int stdout_fd = options.stdout_path.empty() ? out[1] : ::open(options.stdout_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (stdout_fd < 0) fail();
+    dup2(stdin_fd, STDIN_FILENO);
+    dup2(stdout_fd, STDOUT_FILENO);
+    dup2(err[1], STDERR_FILENO);
+    if (!options.cwd.empty() && chdir(options.cwd.c_str()) != 0) fail();
+    fcntl(exec_status[1], F_SETFD, 0); // Both stay open in the launcher
+    fcntl(report[1], F_SETFD, 0);
+    execv(argv[0], argv.data());
+    fail();
+  }
+
+  ::close(in[0]);
+  ::close(out[1]);
+  ::close(err[1]);
+  ::close(exec_status[1]);
+  ::close(report[1]);
+  if (pid < 0) 
+  {
+    error = std::strerror(errno);
+    ::close(in[1]); ::close(out[0]); ::close(err[0]); ::close(exec_status[0]); ::close(report[0]);
+    return false;
+  }
+
+  // EOF without data means the program was exec'd; by then the launcher has sent its pid
+  int exec_errno = 0;
+  ssize_t got;
+  while ((got = ::read(exec_status[0], &exec_errno, sizeof(exec_errno))) < 0 && errno == EINTR) {}
+  ::close(exec_status[0]);
+  pid_t program_pid = 0;
+  if (got <= 0) 
+  {
+    while ((got = ::read(report[0], &program_pid, sizeof(program_pid))) < 0 && errno == EINTR) {}
+    if (got != sizeof(program_pid)) 
+    {
+      got = 1;
+      exec_errno = ECHILD; // The launcher died before forking
+    } 
+    else 
+    {
+      got = 0;
+    }
+  }
+  if (got > 0) 
+  {
+    error = "Could not run " + options.argv[0] + ": " + std::strerror(exec_errno);
+    while (waitpid(pid, nullptr, 0) < 0 && errno == EINTR) {}
+    ::close(in[1]); ::close(out[0]); ::close(err[0]); ::close(report[0]);
+    return false;
+  }
+
+  m_pid = program_pid;
+  m_launcher_pid = pid;
+  m_stdin_fd = in[1];
+  m_report_fd = report[0];
+  m_reader = std::thread(&Subprocess::read_output, this, out[0], err[0]);
+  return true;
+}
+
+int Subprocess::launcher_main(int argc, char** argv) 
+{
+  if (argc < 10) return 127;
+  int exec_status_fd = atoi(argv[2]);
+  int report_fd = atoi(argv[3]);
+  rlim_t limits[3] = {strtoull(argv[4], nullptr, 10), strtoull(argv[5], nullptr, 10), strtoull(argv[6], nullptr, 10)};
+  int resources[3] = {RLIMIT_CPU, RLIMIT_AS, RLIMIT_FSIZE};
+  fcntl(exec_status_fd, F_SETFD, FD_CLOEXEC);
+  fcntl(report_fd, F_SETFD, FD_CLOEXEC);
+  std::string sample_path = argv[7]; // "-" for none
+  std::string zygote_socket = argv[8]; // "-" for none
+  int hold[2] = {-1, -1}; // Keeps the program from exec'ing until the sampler is attached
+  if (sample_path != "-" && pipe2(hold, O_CLOEXEC) != 0) sample_path = "-";
+
+  auto start = std::chrono::steady_clock::now();
+  pid_t pid = 0;
+  int zygote = zygote_socket == "-" ? -1 : PythonZygote::start_program(zygote_socket, argv + 9, limits, pid);
+  if (zygote >= 0) 
+  {
+    ssize_t ignored = ::write(report_fd, &pid, sizeof(pid));
+    ::close(exec_status_fd);
+    LaunchReport report;
+    memset(&report, 0, sizeof(report));
+    if (!PythonZygote::wait_program(zygote, report.status, report.usage)) 
+    {
+      report.status = SIGKILL; // Reads as killed, the best there is without the zygote
+    }
+    report.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    ignored = ::write(report_fd, &report, sizeof(report));
+    (void)ignored;
+    return 0;
+  }
+
+  pid = fork();
+  if (pid == 0) 
+  {
+    setpgid(0, 0); // Own process group, so stopping a run also stops whatever it spawned
+    signal(SIGPIPE, SIG_DFL); // The editor ignores it, programs should not inherit that
+    for (int i = 0; i < 3; ++i) 
+    {
+      if (limits[i] == 0) continue;
+      // SIGKILL a second after SIGXCPU, for programs that ignore it
+      struct rlimit limit = {limits[i], resources[i] == RLIMIT_CPU ? limits[i] + 1 : limits[i]};
+      setrlimit(resources[i], &limit);
+    }
+    if (hold[0] >= 0) 
+    {
+      ::close(hold[1]);
+      char byte;
+      while (::read(hold[0], &byte, 1) < 0 && errno == EINTR) {} // EOF once the launcher lets go
+    }
+    execvp(argv[9], argv + 9);
+  }
+  if (pid <= 0) // Either fork() or, in the program's process, exec failed
+  {
+    int code = errno;
+    ssize_t ignored = ::write(exec_status_fd, &code, sizeof(code));
+    (void)ignored;
+    _exit(127);
+  }
+  ProfileSampler sampler;
+  if (hold[0] >= 0) 
+  {
+    if (!sampler.attach(pid, 4000)) fprintf(stderr, "--- Cannot sample the program: %s ---\n", strerror(errno));
+    ::close(hold[0]);
+    ::close(hold[1]);
+  }
+  ssize_t ignored = ::write(report_fd, &pid, sizeof(pid));
+  ::close(exec_status_fd); // The parent sees EOF once the program has exec'd too
+
+  LaunchReport report;
+  memset(&report, 0, sizeof(report));
+  if (sampler.attached()) // Drains the samples as they come, a full ring buffer drops them
+  {
+    pid_t reaped;
+    while ((reaped = waitpid(pid, &report.status, WNOHANG)) == 0 || (reaped < 0 && errno == EINTR)) 
+    {
+      sampler.wait(100);
+      sampler.drain();
+    }
+    sampler.drain();
+    sampler.write(sample_path);
+    if (sampler.lost()) fprintf(stderr, "--- %llu samples lost ---\n", static_cast<unsigned long long>(sampler.lost()));
+  } 
+  else 
+  {
+    while (waitpid(pid, &report.status, 0) < 0 && errno == EINTR) {}
+  }
+  report.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  getrusage(RUSAGE_CHILDREN, &report.usage);
+  ignored = ::write(report_fd, &report, sizeof(report)); // Below PIPE_BUF, so never torn
+  (void)ignored;
+  return 0;
+}
+
+void Subprocess::write_stdin(const std::string& text) 
+{
+  if (m_stdin_fd < 0) return;
+  size_t written = 0;
+  while (written < text.size()) 
+  {
+    ssize_t n = ::write(m_stdin_fd, text.data() + written, text.size() - written);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break; // Child closed its stdin
+    written += n;
+  }
+}
+
+void Subprocess::close_stdin() 
+{
+  if (m_stdin_fd >= 0) ::close(m_stdin_fd);
+  m_stdin_fd = -1;
+}
+
+void Subprocess::kill() 
+{
+  if (m_pid > 0 && !m_finished) 
+  {
+    ::kill(-m_pid, SIGKILL); // The launcher outlives it and still reports
+  }
+}
+
+void Subprocess::read_output(int out_fd, int err_fd) 
+{
+  // The report comes once the program has been reaped. Output is read until then, or until both
+  // pipes close, but not waited for after it: a descendant that left the process group (setsid)
+  // could hold the pipes open forever, and then the job would never finish and Stop could not end it.
+  struct pollfd fds[3] = {{out_fd, POLLIN, 0}, {err_fd, POLLIN, 0}, {m_report_fd, POLLIN, 0}};
+  int open_fds = 2;
+  std::vector<char> chunk(64 * 1024);
+  LaunchReport report;
+  ssize_t got = -1;
+  auto read_ready = [&]() 
+  {
+    bool any = false;
+    for (int i = 0; i < 2; ++i) 
+    {
+      auto& fd = fds[i];
+      if (fd.fd < 0 || !(fd.revents & (POLLIN | POLLHUP | POLLERR))) continue;
+      ssize_t n = ::read(fd.fd, chunk.data(), chunk.size());
+      if (n > 0) 
+      {
+        m_output->write(chunk.data(), n);
+        any = true;
+      } 
+      else if (n == 0 || errno != EINTR) 
+      {
+        ::close(fd.fd);
+        fd.fd = -1; // poll() ignores negative descriptors
+        --open_fds;
+      }
+    }
+    return any;
+  };
+  while (open_fds > 0 && got < 0) 
+  {
+    if (poll(fds, 3, -1) < 0) 
+    {
+      if (errno == EINTR) continue;
+      break;
+    }
+    read_ready();
+    if (fds[2].revents & (POLLIN | POLLHUP | POLLERR)) 
+    {
+      while ((got = ::read(m_report_fd, &report, sizeof(report))) < 0 && errno == EINTR) {}
+      got = std::max<ssize_t>(got, 0); // EOF without a report still ends the wait
+    }
+  }
+  // What the program wrote before it exited is already in the pipes; a bounded drain also stops
+  // a descendant that keeps writing from holding up the job
+  for (int round = 0; round < 64 && open_fds > 0; ++round) 
+  {
+    if (poll(fds, 2, 0) <= 0 || !read_ready()) break;
+  }
+  for (int i = 0; i < 2; ++i) 
+  {
+    if (fds[i].fd >= 0) ::close(fds[i].fd);
+  }
+  if (got < 0) // Both pipes closed first, the report follows
+  {
+    while ((got = ::read(m_report_fd, &report, sizeof(report))) < 0 && errno == EINTR) {}
+  }
+  ::close(m_report_fd);
+  m_report_fd = -1;
+  int status = 0;
+  while (wait4(m_launcher_pid, &status, 0, &m_exit.usage) < 0 && errno == EINTR) {}
+  m_exit.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count();
+  if (got == sizeof(report)) 
+  {
+    status = report.status;
+    m_exit.usage = report.usage;
+    m_exit.wall_ms = report.wall_ms;
+  } 
+  // else the launcher itself was killed, its own status and usage are the best there is
+  m_exit.exited = WIFEXITED(status);
+  m_exit.code = m_exit.exited ? WEXITSTATUS(status) : -1;
+  m_exit.signal = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+  m_finished = true;
+  if (m_exit_callback) m_exit_callback();
+}
+
+std::string detect_language_from_path(const std::string& path) 
+{
+  if (path.length() > 2 && path.substr(path.length() - 2) == ".c") 
+  {
+    return "c";
+  } 
+  else if (path.length() > 3 && path.substr(path.length() - 3) == ".py") 
+  {
+    return "python";
+  }
+  return "cpp";
+}
+
+std::string describe_exit(const Subprocess::ExitInfo& info) 
+{
+  if (info.exited) 
+  {
+    return "exited with code " + std::to_string(info.code);
+  }
+  return "killed by signal " + std::to_string(info.signal) + " (" + strsignal(info.signal) + ")";
+}
+
+void remove_tree(const std::string& path) 
+{
+  nftw(path.c_str(), [](const char* file, const struct stat*, int, struct FTW*) { return remove(file); }, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+void Job::note(const std::string& text) 
+{
+  std::string line = text + "\n";
+  output->write(line.data(), line.size());
+}
+
+double Job::elapsed_ms() const 
+{
+  auto end = is_active() ? std::chrono::steady_clock::now() : finished;
+  auto begin = state == JOB_QUEUED ? end : started;
+  return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+std::string Job::describe() const 
+{
+  static const char* state_names[] = {"Queued", "", "Done", "Failed", "Cancelled"};
+  std::ostringstream text;
+  text.precision(1);
+  text << std::fixed << "#" << id << " " << name << ": ";
+  if (state == JOB_RUNNING) 
+  {
+    text << steps[current_step].label << " (pid " << pid() << ", " << elapsed_ms() / 1000.0 << " s)";
+  } 
+  else 
+  {
+    text << state_names[state];
+    if (!is_active()) text << " (" << elapsed_ms() / 1000.0 << " s)";
+  }
+  return text.str();
+}
+
+JobScheduler::~JobScheduler() 
+{
+  for (auto& job : m_jobs) 
+  {
+    job->process.reset(); // Kills and reaps
+    remove_tree(job->work_dir);
+  }
+}
+
+std::string JobScheduler::make_work_dir() 
+{
+  std::string pattern = temp_directory() + "/mint_pad-job-XXXXXX";
+  std::vector<char> buffer(pattern.begin(), pattern.end());
+  buffer.push_back('\0');
+  return mkdtemp(buffer.data()) ? std::string(buffer.data()) : "";
+}
+
+std::shared_ptr<Job> JobScheduler::submit(const void* owner, const std::string& name, const std::string& work_dir, std::vector<Job::Step> steps) 
+{
+  auto job = std::make_shared<Job>(m_next_id++, owner, name, work_dir, std::move(steps));
+  m_jobs.push_back(job);
+  prune_history();
+  notify(job->id);
+  pump();
+  return job;
+}
+
+void JobScheduler::cancel(unsigned id) 
+{
+  auto job = find(id);
+  if (!job || !job->is_active()) return;
+  job->cancel_requested = true;
+  if (job->state == Job::JOB_QUEUED) 
+  {
+    finish(*job, Job::JOB_CANCELLED);
+    return;
+  }
+  if (job->process) job->process->kill(); // Finished through the usual exit path
+}
+
+std::shared_ptr<Job> JobScheduler::find(unsigned id) const 
+{
+  for (const auto& job : m_jobs) 
+  {
+    if (job->id == id) return job;
+  }
+  return nullptr;
+}
+
+std::shared_ptr<Job> JobScheduler::latest_for(const void* owner) const 
+{
+  for (auto it = m_jobs.rbegin(); it != m_jobs.rend(); ++it) 
+  {
+    if ((*it)->owner == owner) return *it;
+  }
+  return nullptr;
+}
+
+void JobScheduler::dispatch() 
+{
+  // Collected first: on_exit callbacks may submit() jobs, and submit() prunes the list
+  std::vector<std::shared_ptr<Job>> exited;
+  for (const auto& job : m_jobs) 
+  {
+    if (job->state == Job::JOB_RUNNING && job->process && job->process->finished()) exited.push_back(job);
+  }
+  for (const auto& job : exited) 
+  {
+    job->last_exit = job->process->exit_info();
+    job->step_ms.push_back(job->last_exit.wall_ms);
+    job->process.reset();
+
+    Job::Step& step = job->steps[job->current_step];
+    bool proceed = step.on_exit ? step.on_exit(*job, job->last_exit) : (job->last_exit.exited && job->last_exit.code == 0);
+    if (job->cancel_requested) 
+    {
+      finish(*job, Job::JOB_CANCELLED);
+    } 
+    else if (!proceed) 
+    {
+      finish(*job, Job::JOB_FAILED);
+    } 
+    else if (++job->current_step < job->steps.size()) 
+    {
+      start_step(*job);
+    } 
+    else 
+    {
+      finish(*job, job->last_exit.exited && job->last_exit.code == 0 ? Job::JOB_SUCCEEDED : Job::JOB_FAILED);
+    }
+  }
+  pump();
+}
+
+void JobScheduler::notify(unsigned id) 
+{
+  if (m_job_changed) m_job_changed(id);
+}
+
+size_t JobScheduler::running_count() const 
+{
+  size_t count = 0;
+  for (const auto& job : m_jobs) 
+  {
+    if (job->state == Job::JOB_RUNNING) ++count;
+  }
+  return count;
+}
+
+void JobScheduler::pump() 
+{
+  size_t running = running_count();
+  for (auto& job : m_jobs) 
+  {
+    if (running >= m_max_parallel) break;
+    if (job->state != Job::JOB_QUEUED) continue;
+    job->state = Job::JOB_RUNNING;
+    job->started = std::chrono::steady_clock::now();
+    ++running;
+    start_step(*job);
+  }
+}
+
+void JobScheduler::start_step(Job& job) 
+{
+  while (job.current_step < job.steps.size()) 
+  {
+    auto process = std::make_unique<Subprocess>(job.output);
+    process->set_exit_callback(m_wakeup);
+    std::string error;
+    if (process->start(job.steps[job.current_step].options, error)) 
+    {
+      job.process = std::move(process);
+      notify(job.id);
+      return;
+    }
+    job.note(error);
+    finish(job, Job::JOB_FAILED);
+    return;
+  }
+}
+
+void JobScheduler::finish(Job& job, Job::State state) 
+{
+  job.finished = std::chrono::steady_clock::now();
+  if (job.state == Job::JOB_QUEUED) job.started = job.finished; // Never ran
+  job.state = state;
+  if (state == Job::JOB_CANCELLED) job.note("--- " + job.name + " cancelled ---");
+  notify(job.id);
+}
+
+void JobScheduler::prune_history() 
+{
+  const size_t max_finished = 32;
+  size_t finished = 0;
+  for (auto it = m_jobs.rbegin(); it != m_jobs.rend(); ++it) 
+  {
+    if (!(*it)->is_active()) ++finished;
+  }
+  for (auto it = m_jobs.begin(); it != m_jobs.end() && finished > max_finished; ) 
+  {
+    if ((*it)->is_active()) 
+    {
+      ++it;
+      continue;
+    }
+    remove_tree((*it)->work_dir);
+    it = m_jobs.erase(it);
+    --finished;
+  }
+}
+
+SampleStats compute_stats(std::vector<double> samples) 
+{
+  SampleStats stats = {0, 0, 0, 0, 0};
+  if (samples.empty()) return stats;
+  std::sort(samples.begin(), samples.end());
+  size_t n = samples.size();
+  stats.min = samples.front();
+  stats.median = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+  stats.p95 = samples[std::min(n - 1, static_cast<size_t>(std::ceil(0.95 * n)) - 1)];
+  for (double sample : samples) stats.mean += sample;
+  stats.mean /= n;
+  for (double sample : samples) stats.stddev += (sample - stats.mean) * (sample - stats.mean);
+  stats.stddev = n > 1 ? std::sqrt(stats.stddev / (n - 1)) : 0;
+  return stats;
+}
+
+double timeval_ms(const struct timeval& tv) 
+{
+  return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+void add_build_steps(BuildPlan& plan, const std::string& compiler, const std::string& compile_flags, bool pgo, const std::string& training_input, 
+                     const std::string& binary, const std::string& pch_header, std::function<void()> on_installed) 
+{
+  std::string partial_filepath = binary + ".part" + std::to_string(getpid()) + "_" + plan.work_dir.substr(plan.work_dir.rfind('/') + 1);
+  std::vector<std::string> compiler_argv = {compiler};
+  for (const auto& flag : split_flags(compile_flags)) compiler_argv.push_back(flag);
+  Job::Step build;
+  build.label = "Compiling";
+  build.options.cwd = plan.work_dir;
+  build.options.argv = compiler_argv;
+
+  if (pgo) 
+  {
+    // Compile and link separately, so both stages use the same object name and the
+    // optimized compile finds the counters of the training run in work_dir/main.gcda
+    std::string object_path = plan.work_dir + "/main.o";
+    std::string instrumented_path = plan.work_dir + "/main-instrumented";
+    auto must_succeed = [](Job& job, const Subprocess::ExitInfo& info) 
+    {
+      if (info.exited && info.code == 0) return true;
+      job.note("--- COMPILATION FAILED ---");
+      return false;
+    };
+
+    Job::Step instrument = build;
+    instrument.label = "Compiling instrumented";
+    instrument.options.argv.insert(instrument.options.argv.end(), {"-fprofile-generate", "-c", plan.source_path, "-o", object_path});
+    instrument.on_exit = must_succeed;
+    plan.build_steps.push_back(instrument);
+
+    Job::Step link = build;
+    link.label = "Linking instrumented";
+    link.options.argv.insert(link.options.argv.end(), {"-fprofile-generate", object_path, "-o", instrumented_path});
+    link.on_exit = must_succeed;
+    plan.build_steps.push_back(link);
+
+    Job::Step training;
+    training.label = "Training run";
+    training.options.argv = {instrumented_path};
+    training.options.cwd = plan.run_cwd;
+    training.options.stdin_path = training_input;
+    training.on_exit = [training_input](Job& job, const Subprocess::ExitInfo& info) 
+    {
+      if (!info.exited) // Counters are only written by a normal exit
+      {
+        job.note("--- Training run " + describe_exit(info) + ", no profile to optimize with ---");
+        return false;
+      }
+      job.note("--- Training run on " + training_input + " " + describe_exit(info) + ", rebuilding with the profile ---");
+      return true;
+    };
+    plan.build_steps.push_back(training);
+
+    Job::Step optimize = build;
+    optimize.label = "Compiling with profile";
+    optimize.options.argv.insert(optimize.options.argv.end(), {"-fprofile-use", "-fprofile-correction", "-c", plan.source_path, "-o", object_path});
+    optimize.on_exit = must_succeed;
+    plan.build_steps.push_back(optimize);
+
+    build.label = "Linking";
+    build.options.argv.insert(build.options.argv.end(), {object_path, "-o", partial_filepath});
+  } 
+  else 
+  {
+    if (!pch_header.empty()) 
+    {
+      build.options.argv.insert(build.options.argv.end(), {"-include", pch_header, "-Winvalid-pch"});
+    }
+    build.options.argv.insert(build.options.argv.end(), {plan.source_path, "-o", partial_filepath});
+  }
+  build.on_exit = [partial_filepath, binary, on_installed](Job& job, const Subprocess::ExitInfo& info) 
+  {
+    if (info.exited && info.code == 0 && rename(partial_filepath.c_str(), binary.c_str()) == 0) 
+    {
+      if (on_installed) on_installed();
+      return true;
+    }
+    unlink(partial_filepath.c_str());
+    job.note("--- COMPILATION FAILED ---");
+    return false;
+  };
+  plan.build_steps.push_back(build);
+}
+
+std::vector<std::string> find_translation_units(const std::string& dir) 
+{
+  static const char* extensions[] = {".c", ".cc", ".cpp", ".cxx"};
+  std::vector<std::string> units;
+  DIR* handle = opendir(dir.c_str());
+  if (!handle) return units;
+  while (struct dirent* ent = readdir(handle)) 
+  {
+    std::string name = ent->d_name;
+    size_t dot = name.rfind('.');
+    if (name[0] == '.' || dot == std::string::npos) continue;
+    for (const char* extension : extensions) 
+    {
+      if (name.compare(dot, std::string::npos, extension) != 0) continue;
+      struct stat st;
+      std::string path = dir + "/" + name;
+      if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) units.push_back(path);
+    }
+  }
+  closedir(handle);
+  std::sort(units.begin(), units.end());
+  return units;
+}
+
+void add_project_build_steps(BuildPlan& plan, const std::string& dir, const std::string& compile_flags, const std::string& object_dir, 
+                             const std::string& binary, unsigned jobs) 
+{
+  Job::Step build;
+  build.label = "Building project";
+  build.options.argv = {"/proc/self/exe", project_build_flag, dir, object_dir, binary, std::to_string(std::max(1u, jobs)), compile_flags};
+  build.options.cwd = dir;
+  build.on_exit = [](Job& job, const Subprocess::ExitInfo& info) 
+  {
+    if (info.exited && info.code == 0) return true;
+    job.note("--- BUILD FAILED ---");
+    return false;
+  };
+  plan.build_steps.push_back(build);
+}
+
+// The prerequisites of the rule gcc -MMD writes, "object: source header header...", with its
+// line continuations and escaped spaces undone
+static std::vector<std::string> read_dependency_file(const std::string& path) 
+{
+  std::ifstream in(path);
+  std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  std::vector<std::string> dependencies;
+  size_t colon = text.find(": ");
+  if (colon == std::string::npos) return dependencies;
+  std::string current;
+  for (size_t i = colon + 1; i < text.size(); ++i) 
+  {
+    char c = text[i];
+    if (c == '\\' && i + 1 < text.size() && (text[i + 1] == '\n' || text[i + 1] == ' ' || text[i + 1] == '\\')) 
+    {
+      if (text[i + 1] != '\n') current += text[i + 1];
+      ++i;
+      continue;
+    }
+    if (c == '$' && i + 1 < text.size() && text[i + 1] == '$') 
+    {
+      current += '$';
+      ++i;
+      continue;
+    }
+    if (c == ' ' || c == '\t' || c == '\n') 
+    {
+      if (!current.empty()) dependencies.push_back(current);
+      current.clear();
+      if (c == '\n') break; // End of the rule
+      continue;
+    }
+    current += c;
+  }
+  if (!current.empty()) dependencies.push_back(current);
+  return dependencies;
+}
+
+// An object is current while every file its last compile read still has the stamp recorded then.
+// Stamps rather than mtime comparisons, so a header restored to an older version also counts as changed.
+static bool object_up_to_date(const std::string& object) 
+{
+  if (access(object.c_str(), R_OK) != 0) return false;
+  std::ifstream stamps(object + ".stamps");
+  std::string line;
+  bool any = false;
+  while (std::getline(stamps, line)) 
+  {
+    size_t tab = line.find('\t');
+    if (tab == std::string::npos || disk_stamp(line.substr(tab + 1)) != line.substr(0, tab)) return false;
+    any = true;
+  }
+  return any;
+}
+
+// Object directories of projects not built for a while go, beyond the newest few
+static void prune_object_dirs(const std::string& root, const std::string& keep) 
+{
+  const size_t max_projects = 16;
+  std::vector<std::pair<time_t, std::string>> dirs;
+  DIR* handle = opendir(root.c_str());
+  if (!handle) return;
+  while (struct dirent* ent = readdir(handle)) 
+  {
+    std::string path = root + "/" + ent->d_name;
+    struct stat st;
+    if (ent->d_name[0] != '.' && path != keep && stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) dirs.push_back({st.st_mtime, path});
+  }
+  closedir(handle);
+  if (dirs.size() < max_projects) return;
+  std::sort(dirs.begin(), dirs.end());
+  for (size_t i = 0; i + max_projects - 1 < dirs.size(); ++i) remove_tree(dirs[i].second);
+}
+
+// Starts a compiler with the build's own stdout and stderr, so its messages land in the job output
+static pid_t spawn_visible(const std::vector<std::string>& args) 
+{
+  std::vector<char*> argv;
+  for (const auto& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+  argv.push_back(nullptr);
+  pid_t pid;
+  int error = posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ);
+  if (error == 0) return pid;
+  fprintf(stderr, "Cannot run %s: %s\n", argv[0], strerror(error));
+  return -1;
+}
+
+int project_build_main(int argc, char** argv) 
+{
+  if (argc < 7) return 2;
+  std::string dir = argv[2];
+  std::string object_dir = argv[3];
+  std::string binary = argv[4];
+  size_t jobs = std::max(1, atoi(argv[5]));
+  std::vector<std::string> flags = split_flags(argv[6]);
+  auto start = std::chrono::steady_clock::now();
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+
+  if (!make_directories(object_dir)) 
+  {
+    fprintf(stderr, "Cannot create %s: %s\n", object_dir.c_str(), strerror(errno));
+    return 1;
+  }
+  int lock = ::open((object_dir + "/.lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (lock >= 0) flock(lock, LOCK_EX); // Two runs of the same project take turns
+  utime(object_dir.c_str(), nullptr); // Recency for pruning
+
+  std::vector<std::string> units = find_translation_units(dir);
+  if (units.empty()) 
+  {
+    fprintf(stderr, "No C or C++ files in %s\n", dir.c_str());
+    return 1;
+  }
+  bool any_cpp = false;
+  std::vector<std::string> objects;
+  std::vector<size_t> stale;
+  for (size_t i = 0; i < units.size(); ++i) 
+  {
+    bool is_c = units[i].compare(units[i].size() - 2, 2, ".c") == 0;
+    any_cpp |= !is_c;
+    objects.push_back(object_dir + "/" + units[i].substr(units[i].rfind('/') + 1) + ".o");
+    if (!object_up_to_date(objects[i])) stale.push_back(i);
+  }
+
+  // Compiles the stale units, at most jobs at a time, each to a temporary name renamed on success
+  std::map<pid_t, size_t> running;
+  size_t next = 0, done = 0;
+  bool failed = false;
+  auto reap = [&]() 
+  {
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0) return;
+    auto it = running.find(pid);
+    if (it == running.end()) return;
+    const std::string& object = objects[it->second];
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0 && rename((object + ".part").c_str(), object.c_str()) == 0) 
+    {
+      std::string stamps;
+      for (const auto& dependency : read_dependency_file(object + ".d")) 
+      {
+        stamps += disk_stamp(dependency) + "\t" + dependency + "\n";
+      }
+      write_file_atomically(object + ".stamps", stamps);
+    } 
+    else 
+    {
+      unlink((object + ".part").c_str());
+      unlink((object + ".stamps").c_str());
+      failed = true;
+    }
+    unlink((object + ".d").c_str());
+    running.erase(it);
+  };
+  while ((next < stale.size() && !failed) || !running.empty()) 
+  {
+    if (next < stale.size() && !failed && running.size() < jobs) 
+    {
+      size_t unit = stale[next++];
+      bool is_c = units[unit].compare(units[unit].size() - 2, 2, ".c") == 0;
+      std::vector<std::string> args = {is_c ? "gcc" : "g++"};
+      args.insert(args.end(), flags.begin(), flags.end());
+      args.insert(args.end(), {"-c", units[unit], "-o", objects[unit] + ".part", "-MMD", "-MF", objects[unit] + ".d"});
+      printf("[%zu/%zu] Compiling %s\n", ++done, stale.size(), units[unit].substr(units[unit].rfind('/') + 1).c_str());
+      pid_t pid = spawn_visible(args);
+      if (pid < 0) 
+      {
+        failed = true;
+        continue;
+      }
+      running[pid] = unit;
+      continue;
+    }
+    reap();
+  }
+  if (failed) return 1;
+
+  // Links when an object changed, or the set of units did, since the binary was made
+  std::string link_stamps;
+  for (const auto& object : objects) link_stamps += disk_stamp(object) + "\t" + object + "\n";
+  std::ifstream previous(binary + ".stamps");
+  std::string recorded((std::istreambuf_iterator<char>(previous)), std::istreambuf_iterator<char>());
+  bool linked = false;
+  if (recorded != link_stamps || access(binary.c_str(), X_OK) != 0) 
+  {
+    printf("Linking %zu objects\n", objects.size());
+    std::vector<std::string> args = {any_cpp ? "g++" : "gcc"};
+    args.insert(args.end(), flags.begin(), flags.end()); // -flto and -no-pie need to reach the link too
+    args.insert(args.end(), objects.begin(), objects.end());
+    args.insert(args.end(), {"-o", binary + ".part"});
+    pid_t pid = spawn_visible(args);
+    int status = -1;
+    while (pid > 0 && waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || rename((binary + ".part").c_str(), binary.c_str()) != 0) 
+    {
+      unlink((binary + ".part").c_str());
+      return 1;
+    }
+    write_file_atomically(binary + ".stamps", link_stamps);
+    linked = true;
+  }
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("--- %zu of %zu files compiled, %zu up to date%s, %.2f s ---\n", stale.size(), units.size(), units.size() - stale.size(), 
+         linked ? ", linked" : ", nothing to link", seconds);
+  prune_object_dirs(object_dir.substr(0, object_dir.rfind('/')), object_dir);
+  return 0;
+}
@@ -0,0 +1,531 @@
+// GTK-free core of Mint_Pad: loading and saving files, text encodings, language detection, build
+// commands and the job pipeline that runs programs. The editor (main.cpp) and the benchmark suite
+// (bench.cpp) both build on it, so nothing here may touch GTK or a main loop: classes that work in
+// the background call a wakeup function from their threads, and the owner collects the results
+// on its own thread.
+#ifndef MINT_PAD_CORE_H
+#define MINT_PAD_CORE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+// Read-only memory mapping of a whole file, released on destruction
+class MappedFile 
+{
+  public:
+    MappedFile() : m_data(nullptr), m_size(0) {}
+    ~MappedFile() { close(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    const char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+  private:
+    const char* m_data;
+    size_t m_size;
+};
+
+// Files from this size on open in large-file mode: a PieceTable over the mapping shown by a
+// LargeFileView, instead of a Gsv::Buffer holding the whole text
+constexpr size_t large_file_threshold = 32 * 1024 * 1024;
+
+// Writes the spans, one after another, to path through a temporary file in the same directory, fsync
+// and rename, so the file on disk always holds either the old or the new contents. Returns an error
+// message, or "" on success.
+std::string write_file_atomically(const std::string& path, const std::vector<std::pair<const char*, size_t>>& spans);
+std::string write_file_atomically(const std::string& path, const std::string& data);
+
+// Writes buffer snapshots to disk on a worker thread. wakeup is called on the worker after each
+// save; the owner then collects the results with take_results() on its own thread.
+class SaveEngine 
+{
+  public:
+    struct Request 
+    {
+      const void* owner; // Tab that asked for the save, only ever compared, never dereferenced here
+      std::string path;
+      std::string data;
+      std::vector<std::pair<const char*, size_t>> spans; // Written instead of data if not empty, e.g. a large file
+      std::shared_ptr<const void> keep_alive; // Owns what the spans point into
+    };
+
+    struct Result 
+    {
+      const void* owner;
+      std::string path;
+      std::string error; // Empty on success
+      double milliseconds;
+    };
+
+    explicit SaveEngine(std::function<void()> wakeup) : m_wakeup(wakeup), m_stop(false), m_busy(false) 
+    {
+      m_worker = std::thread(&SaveEngine::run, this);
+    }
+
+    ~SaveEngine();
+
+    // Saves finished since the last call, oldest first
+    std::deque<Result> take_results();
+    void submit(Request request);
+
+    // Blocks until every queued save has hit the disk
+    void wait_idle();
+
+    // Writes all requests at once, one thread each, and waits for them. Used when quitting.
+    static std::vector<Result> write_all(std::vector<Request> requests);
+    static Result write(const Request& request);
+
+  private:
+    void run();
+    std::function<void()> m_wakeup;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_idle;
+    std::deque<Request> m_queue;
+    std::deque<Result> m_results;
+    bool m_stop;
+    bool m_busy;
+    std::thread m_worker;
+};
+
+// Creates a directory and any missing parents, like mkdir -p
+bool make_directories(const std::string& path);
+
+// Compiled binaries keyed by a hash of everything that affects the output, so an unchanged
+// program is never rebuilt. Least recently used entries are evicted above a size cap.
+class BuildCache 
+{
+  public:
+    BuildCache(const std::string& dir, uint64_t max_bytes);
+    ~BuildCache();
+
+    // 128-bit key over the source, language and full compiler command: 64-bit FNV-1a in one half and,
+    // so the halves do not share structure, a rotate-xor-multiply hash (FxHash's step, with a
+    // MurmurHash3 finalizer) in the other
+    static std::string make_key(const std::string& source, const std::string& language, const std::string& command);
+
+    std::string path_for(const std::string& key) const { return m_dir + "/" + key; }
+
+    // True if a binary for the key exists; bumps its recency and the hit/miss counters
+    bool lookup(const std::string& key);
+
+    // Called after a binary was renamed into the cache; the scan and any deletions run on the cache's
+    // own thread, and requests that arrive while one is pending are folded into it
+    void added();
+
+    unsigned long hits() const { return m_hits; }
+    unsigned long misses() const { return m_misses; }
+    uint64_t bytes() const { return m_bytes; } // Size as of the last eviction pass
+
+  private:
+    void run();
+
+    // Deletes least recently used binaries until the cache fits under its cap
+    void evict();
+
+    std::string m_dir;
+    uint64_t m_max_bytes;
+    std::atomic<uint64_t> m_bytes; // Written by the eviction thread, read for the status line
+    unsigned long m_hits;
+    unsigned long m_misses;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_evict_pending;
+    bool m_stop;
+    std::thread m_worker;
+};
+
+// Identifies the compiler binary on PATH by location, size and mtime, so an upgrade invalidates cached builds
+std::string file_identity(const std::string& path);
+
+// Changes whenever the file is written or replaced; "" if it does not exist
+std::string disk_stamp(const std::string& path);
+
+// Full path of a program as the shell would find it on PATH, "" if there is none
+std::string find_program(const std::string& name);
+
+// The temporary directory, $TMPDIR or /tmp
+std::string temp_directory();
+
+// The file_identity() of the compiler found on PATH, just its name if there is none
+std::string compiler_identity(const std::string& compiler);
+
+// Compiler flags of a build profile. "pgo" builds twice with these, instrumented and then with the profile.
+std::string profile_flags(const std::string& profile);
+
+// Runs a program with its output discarded and waits for it. Returns the exit status, or -1 if it could not run.
+// The pid is published through child while it runs, so another thread can kill it.
+int run_quietly(const std::vector<std::string>& args, std::atomic<int>* child = nullptr);
+
+// Splits a flag string like "-O2 -g" on spaces
+std::vector<std::string> split_flags(const std::string& flags);
+
+// System headers (<...>) included at the very top of a C/C++ source, before any other code or
+// directive. Only these can be moved into a precompiled header without changing the meaning of the file.
+std::vector<std::string> scan_include_preamble(const std::string& code);
+
+// Fixed-size byte ring that keeps only the newest output, so a program printing gigabytes
+// costs a constant amount of memory. Written by reader threads, read by the main loop.
+class RingBuffer 
+{
+  public:
+    explicit RingBuffer(size_t capacity) : m_data(capacity), m_total(0) {}
+
+    void write(const char* data, size_t length);
+
+    // Appends what was written after position to out, at most max_bytes of the newest data.
+    // Returns the new position; skipped counts the bytes that were overwritten or left out.
+    uint64_t read_since(uint64_t position, std::string& out, size_t max_bytes, uint64_t& skipped) const;
+
+    uint64_t total() const;
+
+  private:
+    mutable std::mutex m_mutex;
+    std::vector<char> m_data;
+    uint64_t m_total; // Bytes ever written, the write position is m_total % capacity
+};
+
+// Text encodings. Buffers always hold UTF-8; a file in another encoding is decoded on load and the
+// tab remembers the encoding, so saving writes the file back the way it came. The names are
+// "UTF-8", "UTF-8 BOM", "UTF-16LE", "UTF-16BE" (each with or without " BOM") and "Windows-1252",
+// which stands in for Latin-1 and any other single-byte legacy encoding, since every byte decodes
+// to a character of its own and encodes back to the same byte.
+
+// Whether data is entirely valid UTF-8, at memory speed where the CPU has AVX2
+bool is_valid_utf8(const char* data, size_t size);
+
+// Works out the encoding of a file from its byte order mark, the NULs of UTF-16 text without one,
+// and whether it is valid UTF-8
+std::string detect_encoding(const char* data, size_t size);
+
+// The text of a file in encoding, as UTF-8 without a byte order mark. Broken UTF-16 (unpaired
+// surrogates, an odd last byte) and invalid UTF-8 decode to U+FFFD.
+std::string decode_text(const char* data, size_t size, const std::string& encoding);
+
+// UTF-8 text encoded for a file in encoding. Characters that Windows-1252 has no byte for become
+// '?' and are counted in unencodable.
+std::string encode_text(const std::string& text, const std::string& encoding, size_t& unencodable);
+
+// Replaces invalid UTF-8 with '?' so the text can go into a Gtk::TextBuffer. An incomplete
+// sequence at the end is held back in carry and completed by the next chunk.
+std::string make_valid_utf8(std::string& carry, const std::string& chunk);
+
+// A python3 kept running with a set of modules already imported, so a Python Run forks from it
+// instead of starting an interpreter and importing everything again. The launcher hands the run's
+// stdin, stdout and stderr to the zygote over a Unix socket (SCM_RIGHTS); the zygote forks a
+// supervisor, which forks the child that runs the script in a fresh __main__, reaps it and
+// reports its status and usage back. The zygote dies with the thread that started it.
+class PythonZygote 
+{
+  public:
+    PythonZygote() : m_pid(0), m_generation(0) {}
+    ~PythonZygote() { stop(); }
+    PythonZygote(const PythonZygote&) = delete;
+    PythonZygote& operator=(const PythonZygote&) = delete;
+
+    // (Re)starts the zygote with python importing modules; modules that fail to import are reported
+    // on its stderr and skipped. Returns false if it could not be started at all.
+    bool start(const std::string& python, const std::vector<std::string>& modules);
+    void stop();
+
+    // Socket for Subprocess::Options::zygote_socket, "" while the zygote is still importing or not
+    // running. A zygote that died is restarted for the runs after this one.
+    std::string socket_path();
+    bool running() const { return m_pid > 0; }
+    const std::vector<std::string>& modules() const { return m_modules; }
+
+    // Launcher side: asks the zygote at socket to run argv ("python3 -u script args...") in cwd with
+    // the caller's stdin, stdout and stderr and the given rlimits (0 for none). Returns the connection
+    // and sets pid once the script's process exists, -1 if the zygote cannot be reached.
+    static int start_program(const std::string& socket, char** argv, const rlim_t limits[3], pid_t& pid);
+    // Waits on a connection from start_program() for the script's wait status and resource usage;
+    // false if the zygote went away first
+    static bool wait_program(int connection, int& status, struct rusage& usage);
+
+  private:
+    pid_t m_pid;
+    unsigned m_generation; // Each start gets a fresh socket, runs still connecting to the old one fail over
+    std::string m_socket;
+    std::string m_python;
+    std::vector<std::string> m_modules;
+};
+
+// A child process with piped stdin/stdout/stderr. A reader thread copies stdout and stderr into a
+// RingBuffer as they arrive, then collects the exit status and resource usage.
+//
+// Programs are not forked from the editor itself: Linux carries the peak RSS of a forked copy of
+// the editor into ru_maxrss across exec, which would bury the program's own number. Instead the
+// child execs this binary again as a small launcher (see launcher_main()), which forks the program,
+// reaps it and reports its status and usage over a pipe.
+class Subprocess 
+{
+  public:
+    struct Options 
+    {
+      std::vector<std::string> argv;
+      std::string cwd; // Empty to inherit
+      std::string stdin_path; // File to read stdin from instead of the pipe, e.g. /dev/null
+      std::string stdout_path; // File to write stdout to instead of the output ring, stderr still goes there
+      rlim_t cpu_limit_seconds = 0; // RLIMIT_CPU, SIGXCPU once used up; 0 for none
+      rlim_t memory_limit_bytes = 0; // RLIMIT_AS; 0 for none
+      rlim_t file_size_limit_bytes = 0; // RLIMIT_FSIZE, bounds stdout_path; 0 for none
+      std::string sample_path; // Profiles the program with a ProfileSampler into this file; empty for none
+      std::string zygote_socket; // Runs argv in this PythonZygote, or as usual if it is gone; empty for none
+    };
+
+    struct ExitInfo 
+    {
+      bool exited;    // Normal exit, code is valid
+      int code;
+      int signal;     // Terminating signal when !exited
+      double wall_ms;
+      struct rusage usage;
+    };
+
+    static constexpr const char* launcher_flag = "--mint-pad-launch";
+
+    explicit Subprocess(std::shared_ptr<RingBuffer> output) :
+      m_output(output),
+      m_pid(0),
+      m_launcher_pid(0),
+      m_stdin_fd(-1),
+      m_report_fd(-1),
+      m_finished(false)
+    {
+      memset(&m_exit, 0, sizeof(m_exit));
+    }
+
+    ~Subprocess();
+    Subprocess(const Subprocess&) = delete;
+    Subprocess& operator=(const Subprocess&) = delete;
+
+    // Called on the reader thread once the process has been reaped
+    void set_exit_callback(std::function<void()> callback) { m_exit_callback = callback; }
+
+    // Forks and execs; returns false with a message if the program could not be started
+    bool start(const Options& options, std::string& error);
+
+    // Entry point of the launcher, run from main() when argv[1] is launcher_flag:
+    // launcher_flag exec_status_fd report_fd cpu_limit memory_limit file_size_limit sample_path zygote_socket program args...
+    // Sends the program's pid, then {wait status, wall ms, rusage} once it has been reaped.
+    static int launcher_main(int argc, char** argv);
+
+    pid_t pid() const { return m_pid; }
+    bool finished() const { return m_finished; }
+    const ExitInfo& exit_info() const { return m_exit; } // Valid once finished()
+
+    void write_stdin(const std::string& text);
+    void close_stdin();
+    void kill();
+
+  private:
+    void read_output(int out_fd, int err_fd);
+
+    struct LaunchReport 
+    {
+      int status;
+      double wall_ms;
+      struct rusage usage;
+    };
+
+    std::shared_ptr<RingBuffer> m_output;
+    pid_t m_pid; // The program, also its process group
+    pid_t m_launcher_pid;
+    int m_stdin_fd;
+    int m_report_fd;
+    std::atomic<bool> m_finished;
+    ExitInfo m_exit;
+    std::chrono::steady_clock::time_point m_start;
+    std::function<void()> m_exit_callback;
+    std::thread m_reader;
+};
+
+// Language id for a file based on its extension, cpp by default
+std::string detect_language_from_path(const std::string& path);
+
+// Human readable end of a process, e.g. "exited with code 0" or "killed by signal 11 (Segmentation fault)"
+std::string describe_exit(const Subprocess::ExitInfo& info);
+
+// Deletes a directory and everything below it, like rm -rf
+void remove_tree(const std::string& path);
+
+// One Run of a tab: a private work directory and a chain of steps (build, then run) executed
+// one after another, each output going into the job's own ring buffer
+class Job 
+{
+  public:
+    enum State { JOB_QUEUED, JOB_RUNNING, JOB_SUCCEEDED, JOB_FAILED, JOB_CANCELLED };
+
+    struct Step 
+    {
+      std::string label; // "Compiling", "Running"...
+      Subprocess::Options options;
+      // Runs on the main loop after the step exits; returning false ends the job as failed
+      std::function<bool(Job&, const Subprocess::ExitInfo&)> on_exit;
+    };
+
+    Job(unsigned id, const void* owner, const std::string& name, const std::string& work_dir, std::vector<Step> steps) :
+      id(id),
+      owner(owner),
+      name(name),
+      work_dir(work_dir),
+      steps(std::move(steps)),
+      state(JOB_QUEUED),
+      current_step(0),
+      cancel_requested(false),
+      output(std::make_shared<RingBuffer>(4 * 1024 * 1024)), // Newest 4 MB of output are kept
+      created(std::chrono::steady_clock::now()) 
+    {
+      memset(&last_exit, 0, sizeof(last_exit));
+    }
+
+    // Editor notes between process output, like "--- COMPILATION FAILED ---"
+    void note(const std::string& text);
+
+    bool is_active() const { return state == JOB_QUEUED || state == JOB_RUNNING; }
+    pid_t pid() const { return process ? process->pid() : 0; }
+
+    double elapsed_ms() const;
+
+    // e.g. "#3 sort.cpp: Running (pid 4242, 1.2 s)"
+    std::string describe() const;
+
+    const unsigned id;
+    const void* owner; // Tab that started the job, only ever compared
+    const std::string name;
+    const std::string work_dir;
+    std::vector<Step> steps;
+    State state;
+    size_t current_step;
+    bool cancel_requested;
+    std::shared_ptr<RingBuffer> output;
+    std::unique_ptr<Subprocess> process; // The current step's process
+    Subprocess::ExitInfo last_exit;
+    std::vector<double> step_ms; // Wall time of every finished step
+    std::chrono::steady_clock::time_point created;
+    std::chrono::steady_clock::time_point started;
+    std::chrono::steady_clock::time_point finished;
+};
+
+// Runs jobs from all tabs side by side, at most one per core at a time, and keeps a short history.
+// wakeup is called on a reader thread whenever a process exits; the owner then calls dispatch()
+// on its own thread to move the jobs on.
+class JobScheduler 
+{
+  public:
+    JobScheduler(size_t max_parallel, std::function<void()> wakeup) :
+      m_max_parallel(std::max<size_t>(1, max_parallel)),
+      m_next_id(1),
+      m_wakeup(wakeup)
+    {
+    }
+
+    ~JobScheduler();
+
+    // A fresh private directory for a job's sources and scratch files, "" on failure
+    static std::string make_work_dir();
+
+    // Called on the dispatching thread with the id of a job that changed state or step
+    void set_job_changed(std::function<void(unsigned)> callback) { m_job_changed = callback; }
+
+    std::shared_ptr<Job> submit(const void* owner, const std::string& name, const std::string& work_dir, std::vector<Job::Step> steps);
+
+    // Kills a running job or drops a queued one
+    void cancel(unsigned id);
+    std::shared_ptr<Job> find(unsigned id) const;
+
+    // Most recent job started by owner, if any
+    std::shared_ptr<Job> latest_for(const void* owner) const;
+
+    const std::vector<std::shared_ptr<Job>>& jobs() const { return m_jobs; }
+    size_t max_parallel() const { return m_max_parallel; }
+
+    // Advances every job whose current process has exited
+    void dispatch();
+
+  private:
+    void notify(unsigned id);
+    size_t running_count() const;
+
+    // Starts queued jobs, oldest first, while cores are free
+    void pump();
+    void start_step(Job& job);
+    void finish(Job& job, Job::State state);
+
+    // Finished jobs beyond the newest few are forgotten along with their work directories
+    void prune_history();
+
+    size_t m_max_parallel;
+    unsigned m_next_id;
+    std::vector<std::shared_ptr<Job>> m_jobs;
+    std::function<void()> m_wakeup;
+    std::function<void(unsigned)> m_job_changed;
+};
+
+// One Run of a source, as worked out by the editor's prepare_build()
+struct BuildPlan 
+{
+  std::string work_dir;
+  std::string source_path;
+  std::vector<Job::Step> build_steps; // Empty on a build cache hit or for Python
+  std::vector<std::string> run_argv;
+  std::string run_cwd;
+  std::string run_zygote; // PythonZygote socket for the Run, "" to exec run_argv as usual
+};
+
+// Appends the steps that compile plan.source_path into binary with compile_flags: one compile, with
+// "-include pch_header" unless that is empty, or for PGO an instrumented build, a training run on
+// training_input and a build with the profile. The binary is written under a temporary name and
+// renamed into place only on success, so a failed or interrupted build never leaves a bad one behind.
+// on_installed, if set, runs after that rename, e.g. to let a BuildCache trim itself.
+void add_build_steps(BuildPlan& plan, const std::string& compiler, const std::string& compile_flags, bool pgo, const std::string& training_input, 
+                     const std::string& binary, const std::string& pch_header, std::function<void()> on_installed = nullptr);
+
+// Project builds: every C/C++ translation unit in one directory, compiled to objects in object_dir
+// and linked into binary. A unit is recompiled only when it or one of the headers gcc -MMD listed
+// for it has changed since its object was built, and up to jobs compilers run at once.
+constexpr const char* project_build_flag = "--mint-pad-build";
+
+// The .c, .cc, .cpp and .cxx files directly in dir, sorted
+std::vector<std::string> find_translation_units(const std::string& dir);
+
+// Appends the one step that brings the project in dir up to date: this binary run again with
+// project_build_flag, so compiles run in parallel inside a single job and Stop ends all of them
+void add_project_build_steps(BuildPlan& plan, const std::string& dir, const std::string& compile_flags, const std::string& object_dir, 
+                             const std::string& binary, unsigned jobs);
+
+// Entry point of a project build, run from main() when argv[1] is project_build_flag:
+// project_build_flag dir object_dir binary jobs compile_flags. Exits with 0 once binary is up to date.
+int project_build_main(int argc, char** argv);
+
+// Summary of a series of measurements
+struct SampleStats 
+{
+  double min;
+  double median;
+  double p95; // Nearest-rank 95th percentile
+  double mean;
+  double stddev; // Sample standard deviation
+};
+
+SampleStats compute_stats(std::vector<double> samples);
+double timeval_ms(const struct timeval& tv);
+
+#endif // MINT_PAD_CORE_H
@@ -13,818 +13,8430 @@
 #include <vector>
 #include <list> 
 #include <cstdlib>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <atomic>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <dirent.h>
+#include <utime.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <set>
+#include <map>
+#include <functional>
+#include <poll.h>
+#include <sys/resource.h>
+#include <ftw.h>
+#include <cmath>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <regex.h>
+#include <fnmatch.h>
+#include <sys/inotify.h>
+#include <unordered_map>
+#include <sys/file.h>
+#include <elf.h>
+#include "core.h"
 
-// Forward declaration of the class
-class IdeWindow;
-
-// A custom widget to hold one editor tab and its associated controls
-class EditorTab : public Gtk::ScrolledWindow 
+// Builds precompiled headers for the include preamble of C/C++ sources on a background thread,
+// one per compiler, flag set and include set, and hands out the ones that are ready
+class PchServer 
 {
   public:
-    // Passing a reference to the main window for callbacks
-    EditorTab(IdeWindow& parent_window):
-      m_parent_window(parent_window),
-      m_file_path(""),
-      m_language_id("cpp"),
-      m_tab_box(Gtk::ORIENTATION_HORIZONTAL)
+    struct Info 
     {
-      m_source_view.set_show_line_numbers(true);
-      m_source_view.set_highlight_current_line(true);
-      m_source_view.set_auto_indent(true);
-      m_source_view.set_smart_home_end(Gsv::SMART_HOME_END_ALWAYS);
-      m_source_view.set_insert_spaces_instead_of_tabs(true);
-      m_source_view.set_indent_width(4);
-      m_source_view.set_name("my-ide-editor");
-      add(m_source_view); // Adds the view to the ScrolledWindow
+      std::string label; // The include set, e.g. "<iostream> <vector>"
+      double build_ms;   // Time to build the .gch
+      double parse_ms;   // Compile time of the headers without the PCH
+      double pch_ms;     // Compile time of the headers with the PCH
+    };
 
-      // Custom tab label widget (Label + Close Button with Icon)
-      m_tab_label.set_text("Untitled");
-      m_tab_box.pack_start(m_tab_label, Gtk::PACK_SHRINK); 
+    PchServer(const std::string& dir) : m_dir(dir), m_stop(false), m_child(0) 
+    {
+      make_directories(m_dir);
+      m_dispatcher.connect(sigc::mem_fun(*this, &PchServer::on_dispatch));
+      m_worker = std::thread(&PchServer::run, this);
+    }
 
-      // Close button
-      Gtk::Image* close_icon = Gtk::manage(new Gtk::Image());
-      close_icon->set_from_icon_name("window-close-symbolic", Gtk::ICON_SIZE_SMALL_TOOLBAR); // Standard small 'x' icon
-      m_close_button.set_image(*close_icon);
-      m_close_button.set_relief(Gtk::RELIEF_NONE); 
-      m_close_button.set_tooltip_text("Close Tab");
+    ~PchServer() 
+    {
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_queue.clear(); // An unfinished PCH is simply rebuilt next time
+      }
+      if (m_child > 0) 
+      {
+        kill(m_child, SIGKILL); // Do not hold up quitting for a compiler run
+      }
+      m_wake.notify_all();
+      m_worker.join();
+    }
 
-      m_tab_box.pack_start(m_close_button, Gtk::PACK_SHRINK); 
-      m_tab_box.show_all();
+    // Called on the main loop when a PCH finishes building
+    sigc::signal<void, const Info&>& signal_ready() { return m_signal_ready; }
 
-      // Connecting the close button signal
-      m_close_button.signal_clicked().connect(sigc::mem_fun(*this, &EditorTab::on_close_button_clicked));
+    // Header to pass with -include if a PCH for these includes is ready, otherwise "" after queuing
+    // a build so the next compile can use it. Fills info when a header is returned.
+    std::string header_for(const std::vector<std::string>& includes, const std::string& language, 
+                           const std::string& compiler, const std::string& flags, Info* info = nullptr) 
+    {
+      if (includes.empty()) return "";
+      Job job{BuildCache::make_key(join(includes), language, compiler_identity(compiler) + " " + flags), includes, language, compiler, flags};
+      std::string header = m_dir + "/" + job.key + ".h";
 
-      // Connecting buffer modified signal to update tab label
-      if(auto buffer = m_source_view.get_source_buffer()) 
+      Info ready;
+      if (read_info(job.key, ready)) 
       {
-      	buffer->signal_modified_changed().connect(sigc::mem_fun(*this, &EditorTab::update_tab_label_widget));
+        utime((header + ".gch").c_str(), nullptr); // Recency for pruning
+        if (info) *info = ready;
+        return header;
       }
+
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_pending.insert(job.key).second) 
+        {
+          m_queue.push_back(std::move(job));
+        }
+      }
+      m_wake.notify_one();
+      return "";
     }
 
-    // Getters
-    Gsv::View& get_view() { return m_source_view; }
-    std::string get_path() const { return m_file_path; }
-    std::string get_language() const { return m_language_id; }
-    Gtk::Widget& get_tab_widget() { return m_tab_box; }
+  private:
+    struct Job 
+    {
+      std::string key;
+      std::vector<std::string> includes;
+      std::string language;
+      std::string compiler;
+      std::string flags;
+    };
 
-    std::string get_base_filename() const 
+    static std::string join(const std::vector<std::string>& includes) 
     {
-      if (m_file_path.empty()) 
+      std::string text;
+      for (const auto& include : includes) 
       {
-        return "Untitled";
+        text += (text.empty() ? "" : " ") + include;
       }
-      size_t pos = m_file_path.find_last_of("/");
-      return (pos == std::string::npos) ? m_file_path : m_file_path.substr(pos + 1);
+      return text;
     }
 
-    bool is_modified() const 
+    // The .meta file is written last, so its presence means the .gch is complete
+    bool read_info(const std::string& key, Info& info) 
     {
-      if(auto buffer = m_source_view.get_source_buffer()) 
-      {
-        return buffer->get_modified();
-      }
-      return false;
+      std::ifstream meta(m_dir + "/" + key + ".meta");
+      if (!(meta >> info.build_ms >> info.parse_ms >> info.pch_ms)) return false;
+      meta >> std::ws;
+      std::getline(meta, info.label);
+      return access((m_dir + "/" + key + ".h.gch").c_str(), R_OK) == 0;
     }
 
-    // Setters
-    void set_path(const std::string& path) 
+    double time_ms(const std::vector<std::string>& args, bool& ok) 
     {
-      m_file_path = path;
-      update_tab_label_widget();
+      auto start = std::chrono::steady_clock::now();
+      ok = run_quietly(args, &m_child) == 0 && !m_stop;
+      return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
     }
 
-    void set_language(const std::string& lang_id) 
+    void build(const Job& job) 
     {
-      m_language_id = lang_id;
-      auto lang_manager = Gsv::LanguageManager::get_default();
-      auto lang = lang_manager->get_language(m_language_id);
-      if(auto buffer = m_source_view.get_source_buffer()) 
+      std::string base = m_dir + "/" + job.key;
+      std::string header = base + ".h";
+      std::string gch = header + ".gch";
+      std::string partial = gch + ".part";
+      bool is_c = job.language == "c";
+
+      std::ofstream out(header);
+      for (const auto& include : job.includes) 
       {
-        buffer->set_language(lang);
-        buffer->set_modified(buffer->get_modified()); // Treats language change similar to loading new content regarding modification
+        out << "#include " << include << "\n";
       }
-      update_tab_label_widget(); // Ensure label updates
-    }
+      out.close();
 
-    void set_font(const std::string& font_desc) 
-    {
-      m_source_view.override_font(Pango::FontDescription(font_desc));
+      std::vector<std::string> flags = split_flags(job.flags);
+      auto command = [&](std::initializer_list<std::string> extra) 
+      {
+        std::vector<std::string> args{job.compiler};
+        args.insert(args.end(), flags.begin(), flags.end());
+        args.insert(args.end(), extra.begin(), extra.end());
+        return args;
+      };
+
+      bool ok = false;
+      Info info;
+      info.label = join(job.includes);
+      info.build_ms = time_ms(command({"-x", is_c ? "c-header" : "c++-header", header, "-o", partial}), ok);
+      if (!ok || rename(partial.c_str(), gch.c_str()) != 0) 
+      {
+        unlink(partial.c_str());
+        return; // Broken header set, the run simply compiles without a PCH
+      }
+      // What the PCH saves: parsing the headers from scratch versus loading them precompiled
+      info.parse_ms = time_ms(command({"-fsyntax-only", "-x", is_c ? "c" : "c++", header}), ok);
+      info.pch_ms = time_ms(command({"-fsyntax-only", "-include", header, "-Winvalid-pch", "-x", is_c ? "c" : "c++", "/dev/null"}), ok);
+      if (m_stop) return;
+
+      std::ofstream meta(base + ".meta");
+      meta << info.build_ms << " " << info.parse_ms << " " << info.pch_ms << "\n" << info.label << "\n";
+      meta.close();
+
+      prune();
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_ready.push_back(info);
+      m_dispatcher.emit();
     }
-    
-    // File Operations
-    bool load_file(const std::string& path) 
+
+    // Precompiled headers run to 100 MB and more, so only the most recently used few are kept
+    void prune() 
     {
-      std::ifstream infile(path);
-      if (infile.is_open()) 
+      const size_t max_headers = 8;
+      std::vector<std::pair<time_t, std::string>> entries;
+      DIR* dir = opendir(m_dir.c_str());
+      if (!dir) return;
+      while (struct dirent* ent = readdir(dir)) 
       {
-        std::stringstream sstr;
-        sstr << infile.rdbuf();
-        if(auto buffer = m_source_view.get_source_buffer()) 
+        std::string name = ent->d_name;
+        if (name.size() > 6 && name.compare(name.size() - 6, 6, ".h.gch") == 0) 
         {
-          buffer->set_text(sstr.str());
-          buffer->set_modified(false); // File loaded, not modified
+          struct stat st;
+          if (stat((m_dir + "/" + name).c_str(), &st) == 0) 
+          {
+            entries.push_back({st.st_mtime, name.substr(0, name.size() - 6)});
+          }
         }
-        infile.close();
-        set_path(path); 
+      }
+      closedir(dir);
 
-        // Setting language based on file extension
-        if (path.length() > 2 && path.substr(path.length() - 2) == ".c") 
-        {
-          set_language("c");
-        } 
-        else if (path.length() > 3 && path.substr(path.length() - 3) == ".py") 
-        {
-          set_language("python");
-        } 
-        else 
-        { 
-          set_language("cpp"); //cpp by default
-        }
-        return true;
+      if (entries.size() <= max_headers) return;
+      std::sort(entries.begin(), entries.end());
+      for (size_t i = 0; i + max_headers < entries.size(); ++i) 
+      {
+        std::string base = m_dir + "/" + entries[i].second;
+        unlink((base + ".meta").c_str());
+        unlink((base + ".h.gch").c_str());
+        unlink((base + ".h").c_str());
       }
-      return false;
     }
 
-    bool save_file(const std::string& path) 
+    void run() 
     {
-      if(auto buffer = m_source_view.get_source_buffer()) 
+      std::unique_lock<std::mutex> lock(m_mutex);
+      while (true) 
       {
-        std::string code = buffer->get_text();
-        std::ofstream outfile(path);
-        if (outfile.is_open()) 
-        {
-          outfile << code;
-          outfile.close();
-          set_path(path); // Update path after successful save
-	  buffer->set_modified(false); // Mark as saved
-          update_tab_label_widget();
-          return true;
-        }
+        m_wake.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+        if (m_stop) break;
+
+        Job job = std::move(m_queue.front());
+        m_queue.pop_front();
+        lock.unlock();
+        build(job);
+        lock.lock();
+        m_pending.erase(job.key);
       }
-      return false;
     }
 
-    // Signal Handlers
-    void on_close_button_clicked(); // Implementation requires IdeWindow, defined later
-
-    // Updates the Gtk::Label in the tab widget
-    void update_tab_label_widget() 
+    void on_dispatch() 
     {
-      std::string label_text = get_base_filename();
-      if (is_modified()) 
+      std::vector<Info> ready; 
       {
-        label_text += "*"; // Adds * for modified files
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ready.swap(m_ready);
+      }
+      for (const auto& info : ready) 
+      {
+        m_signal_ready.emit(info);
       }
-      m_tab_label.set_text(label_text);
     }
 
-  protected:
-    IdeWindow& m_parent_window; // References to parent
-    Gsv::View m_source_view;
-    std::string m_file_path;
-    std::string m_language_id;
-
-    // Widgets for the custom tab label
-    Gtk::Box m_tab_box;
-    Gtk::Label m_tab_label;
-    Gtk::Button m_close_button;
+    std::string m_dir;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<Job> m_queue;
+    std::set<std::string> m_pending;
+    std::vector<Info> m_ready;
+    std::atomic<bool> m_stop;
+    std::atomic<int> m_child; // Compiler currently running, 0 if none
+    Glib::Dispatcher m_dispatcher;
+    sigc::signal<void, const Info&> m_signal_ready;
+    std::thread m_worker;
 };
 
-// Main application window
-class IdeWindow : public Gtk::Window 
+
+// Output pane under the editor. Shows the output of one job at a time, drained from the job's
+// ring buffer into the text view at most once per frame.
+class OutputPanel : public Gtk::Box 
 {
   public:
-    IdeWindow();
-    void close_tab(EditorTab* tab_to_close); // Close tab
+    OutputPanel(JobScheduler& scheduler) :
+      Gtk::Box(Gtk::ORIENTATION_VERTICAL),
+      m_scheduler(scheduler),
+      m_toolbar(Gtk::ORIENTATION_HORIZONTAL),
+      m_stop_button("Stop"),
+      m_clear_button("Clear"),
+      m_eof_button("Send EOF"),
+      m_input_box(Gtk::ORIENTATION_HORIZONTAL),
+      m_job_id(0),
+      m_read_position(0),
+      m_tick_id(0),
+      m_updating_combo(false)
+    {
+      m_job_combo.set_tooltip_text("Job shown below");
+      m_stop_button.set_relief(Gtk::RELIEF_NONE);
+      m_clear_button.set_relief(Gtk::RELIEF_NONE);
+      m_stop_button.set_tooltip_text("Kill the selected job");
+      m_toolbar.pack_start(m_job_combo, true, true, 4);
+      m_toolbar.pack_end(m_clear_button, Gtk::PACK_SHRINK);
+      m_toolbar.pack_end(m_stop_button, Gtk::PACK_SHRINK);
+      pack_start(m_toolbar, Gtk::PACK_SHRINK);
 
-  protected:
-    // Override the window delete event for save prompts
-    bool on_delete_event(GdkEventAny* event) override;
+      m_view.set_editable(false);
+      m_view.set_monospace(true);
+      m_view.set_cursor_visible(false);
+      m_view.set_name("my-ide-output");
+      m_scroll.add(m_view);
+      m_scroll.set_policy(Gtk::POLICY_AUTOMATIC, Gtk::POLICY_AUTOMATIC);
+      pack_start(m_scroll, true, true, 0);
 
-    // Signal handlers
-    void on_run_button_clicked();
-    void on_language_changed();
-    void on_new_clicked();
-    void on_open_clicked();
-    void on_save_clicked();
-    void on_save_as_clicked();
-    void on_exit_clicked();
-    void on_quit_button_clicked(); 
-    void on_dark_theme_toggled();
-    void on_font_clicked();
-    void on_cursor_position_changed(const Gtk::TextBuffer::iterator& iter, const Glib::RefPtr<Gtk::TextBuffer::Mark>& mark);
-    void on_tab_changed(Gtk::Widget* page, guint page_num);
+      auto buffer = m_view.get_buffer();
+      m_end_mark = buffer->create_mark(buffer->end(), false); // Right gravity, stays at the end for autoscroll
+      m_note_tag = buffer->create_tag();
+      m_note_tag->property_foreground().set_value(Glib::ustring("#4a90d9"));
 
-    // Helper functions
-    EditorTab* get_current_tab();
-    void create_new_tab(const std::string& file_path = "");
-    void update_title();
-    void update_statusbar();
-    bool save_current_tab_if_needed(EditorTab* tab); // Helper for save logic
-    
-    // Child Widgets
-    Gtk::HeaderBar m_header_bar;
-    Gtk::Button m_run_button;
-    Gtk::ComboBoxText m_language_combo;
-    Gtk::MenuButton m_file_menu_button;
-    Gtk::Popover m_file_popover;
-    Gtk::Box m_file_menu_box;
-    Gtk::ModelButton m_new_button;
-    Gtk::ModelButton m_open_button;
-    Gtk::ModelButton m_save_button;
-    Gtk::ModelButton m_save_as_button;
-    Gtk::ModelButton m_dark_theme_button;
-    Gtk::ModelButton m_font_button;
-    Gtk::ModelButton m_exit_button;
-    Gtk::Button m_quit_button;
-    Gtk::Box m_main_box;
+      m_input_entry.set_placeholder_text("Input to the running program, Enter sends a line");
+      m_input_box.pack_start(m_input_entry, true, true, 0);
+      m_input_box.pack_start(m_eof_button, Gtk::PACK_SHRINK);
+      pack_start(m_input_box, Gtk::PACK_SHRINK);
 
-    Gtk::Notebook m_notebook;
-    Gtk::Statusbar m_statusbar;
+      m_job_combo.signal_changed().connect(sigc::mem_fun(*this, &OutputPanel::on_job_selected));
+      m_stop_button.signal_clicked().connect(sigc::mem_fun(*this, &OutputPanel::on_stop_clicked));
+      m_clear_button.signal_clicked().connect(sigc::mem_fun(*this, &OutputPanel::clear));
+      m_eof_button.signal_clicked().connect(sigc::mem_fun(*this, &OutputPanel::on_eof_clicked));
+      m_input_entry.signal_activate().connect(sigc::mem_fun(*this, &OutputPanel::on_input_activate));
+      m_scheduler.set_job_changed(sigc::mem_fun(*this, &OutputPanel::on_job_changed));
+      update_controls();
+    }
 
-    // State variables
-    std::string m_font_desc;
-    bool m_dark_theme_active;
-    Glib::RefPtr<Gtk::CssProvider> m_css_provider;
-};
+    // Switches the view to a job, replaying whatever of its output is still in its ring
+    void show_job(unsigned id) 
+    {
+      if (id == m_job_id) return;
+      m_job_id = id;
+      m_read_position = 0;
+      m_utf8_carry.clear();
+      m_view.get_buffer()->set_text("");
+      refresh_combo();
+      update_controls();
+      ensure_flushing();
+    }
 
-// IdeWindow Implementation
-IdeWindow::IdeWindow() :
-  m_main_box(Gtk::ORIENTATION_VERTICAL),
-  m_run_button("Run"),
-  m_file_menu_box(Gtk::ORIENTATION_VERTICAL),
-  m_dark_theme_active(false)
-{
-  set_default_size(800, 600);
-  set_titlebar(m_header_bar);
+    void clear() 
+    {
+      flush(); // Drops anything pending along with the visible text
+      m_view.get_buffer()->set_text("");
+    }
 
-  // "File" Menu Setup
-  m_file_menu_button.set_label("File");
-  m_new_button.set_label("New");
-  m_open_button.set_label("Open...");
-  m_save_button.set_label("Save");
-  m_save_as_button.set_label("Save As...");
-  m_dark_theme_button.set_label("Toggle Dark Theme");
-  m_font_button.set_label("Preferences...");
-  m_exit_button.set_label("Exit");
+  private:
+    static constexpr size_t view_max_chars = 2 * 1024 * 1024; // Older text is trimmed from the view
+    static constexpr size_t flush_max_bytes = 256 * 1024; // Per frame, anything older is skipped
 
-  m_file_menu_button.set_popover(m_file_popover);
-  m_file_popover.add(m_file_menu_box);
-  m_file_menu_box.pack_start(m_new_button, true, true, 0);
-  m_file_menu_box.pack_start(m_open_button, true, true, 0);
-  m_file_menu_box.pack_start(m_save_button, true, true, 0);
-  m_file_menu_box.pack_start(m_save_as_button, true, true, 0);
-  m_file_menu_box.pack_start(m_dark_theme_button, true, true, 0);
-  m_file_menu_box.pack_start(m_font_button, true, true, 0);
-  m_file_menu_box.pack_start(m_exit_button, true, true, 0);
+    std::shared_ptr<Job> current_job() const { return m_scheduler.find(m_job_id); }
 
-  m_new_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_new_clicked));
-  m_open_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_open_clicked));
-  m_save_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_save_clicked));
-  m_save_as_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_save_as_clicked));
-  m_dark_theme_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_dark_theme_toggled));
-  m_font_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_font_clicked));
-  m_exit_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_exit_clicked));
-  m_file_menu_box.show_all();
+    void on_job_changed(unsigned id) 
+    {
+      refresh_combo();
+      if (id == m_job_id) 
+      {
+        update_controls();
+        ensure_flushing();
+      }
+    }
 
-  // Language Selector
-  m_language_combo.append("cpp", "C++");
-  m_language_combo.append("c", "C");
-  m_language_combo.append("python", "Python");
-  m_language_combo.signal_changed().connect(sigc::mem_fun(*this, &IdeWindow::on_language_changed));
+    // Lists the jobs newest first, keeping the selection
+    void refresh_combo() 
+    {
+      m_updating_combo = true;
+      m_job_combo.remove_all();
+      const auto& jobs = m_scheduler.jobs();
+      for (auto it = jobs.rbegin(); it != jobs.rend(); ++it) 
+      {
+        m_job_combo.append(std::to_string((*it)->id), (*it)->describe());
+      }
+      m_job_combo.set_active_id(std::to_string(m_job_id));
+      m_updating_combo = false;
+    }
 
-  // Quit Button
-  Gtk::Image* quit_icon = Gtk::manage(new Gtk::Image());
-  quit_icon->set_from_icon_name("window-close-symbolic", Gtk::ICON_SIZE_BUTTON); 
-  m_quit_button.set_image(*quit_icon);
-  m_quit_button.set_relief(Gtk::RELIEF_NONE);
-  m_quit_button.set_tooltip_text("Quit Application");
+    void on_job_selected() 
+    {
+      if (m_updating_combo) return;
+      std::string id = m_job_combo.get_active_id();
+      if (!id.empty()) show_job(std::stoul(id));
+    }
 
-  // HeaderBar Layout
-  m_header_bar.pack_start(m_file_menu_button);
-  m_header_bar.pack_start(m_language_combo);
-  m_header_bar.pack_start(m_run_button); 
-  m_header_bar.pack_end(m_quit_button); 
-  m_run_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_run_button_clicked));
-  m_quit_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_quit_button_clicked)); // Connecting quit
+    void update_controls() 
+    {
+      auto job = current_job();
+      bool running = job && job->state == Job::JOB_RUNNING;
+      m_stop_button.set_sensitive(job && job->is_active());
+      m_input_box.set_sensitive(running && job->process);
+    }
 
-  add(m_main_box);
+    void ensure_flushing() 
+    {
+      if (m_tick_id == 0) 
+      {
+        m_tick_id = m_view.add_tick_callback(sigc::mem_fun(*this, &OutputPanel::on_tick));
+      }
+    }
 
-  // Notebook (Tabs) Setup 
-  m_notebook.set_scrollable(true);
-  m_notebook.signal_switch_page().connect(sigc::mem_fun(*this, &IdeWindow::on_tab_changed));
+    // One flush per frame; the callback removes itself once the shown job can produce nothing more
+    bool on_tick(const Glib::RefPtr<Gdk::FrameClock>& clock) 
+    {
+      flush();
+      auto job = current_job();
+      if (job && (job->is_active() || job->output->total() != m_read_position)) 
+      {
+        return true;
+      }
+      m_tick_id = 0;
+      return false;
+    }
 
-  m_main_box.pack_start(m_notebook, true, true, 0);
-  m_main_box.pack_start(m_statusbar, false, false, 0);
+    void flush() 
+    {
+      auto job = current_job();
+      if (!job) return;
 
-  m_css_provider = Gtk::CssProvider::create();
+      std::string chunk;
+      uint64_t skipped = 0;
+      m_read_position = job->output->read_since(m_read_position, chunk, flush_max_bytes, skipped);
+      if (chunk.empty() && skipped == 0) return;
 
-  create_new_tab(); // Creates the first tab
+      auto buffer = m_view.get_buffer();
+      auto adjustment = m_scroll.get_vadjustment();
+      bool at_bottom = adjustment->get_value() >= adjustment->get_upper() - adjustment->get_page_size() - 1;
 
-  show_all_children();
-}
+      if (skipped > 0) 
+      {
+        m_utf8_carry.clear();
+        buffer->insert_with_tag(buffer->end(), "\n[... " + std::to_string(skipped) + " bytes of output skipped ...]\n", m_note_tag);
+      }
+      buffer->insert(buffer->end(), make_valid_utf8(m_utf8_carry, chunk));
 
-// Overrides delete event (called when window close button is pressed or hide() is called)
-bool IdeWindow::on_delete_event(GdkEventAny* event) 
+      int excess = buffer->get_char_count() - static_cast<int>(view_max_chars);
+      if (excess > 0) 
+      {
+        auto cut = buffer->get_iter_at_offset(excess);
+        cut.forward_line(); // Trim whole lines
+        buffer->erase(buffer->begin(), cut);
+      }
+      if (at_bottom) 
+      {
+        m_view.scroll_to(m_end_mark);
+      }
+    }
+
+    void on_stop_clicked() 
+    {
+      m_scheduler.cancel(m_job_id);
+    }
+
+    void on_input_activate() 
+    {
+      auto job = current_job();
+      if (!job || !job->process) return;
+      job->process->write_stdin(m_input_entry.get_text() + "\n");
+      m_input_entry.set_text("");
+    }
+
+    void on_eof_clicked() 
+    {
+      auto job = current_job();
+      if (job && job->process) job->process->close_stdin();
+    }
+
+    JobScheduler& m_scheduler;
+    Gtk::Box m_toolbar;
+    Gtk::ComboBoxText m_job_combo;
+    Gtk::Button m_stop_button;
+    Gtk::Button m_clear_button;
+    Gtk::Button m_eof_button;
+    Gtk::ScrolledWindow m_scroll;
+    Gtk::TextView m_view;
+    Gtk::Box m_input_box;
+    Gtk::Entry m_input_entry;
+    Glib::RefPtr<Gtk::TextBuffer::Mark> m_end_mark;
+    Glib::RefPtr<Gtk::TextBuffer::Tag> m_note_tag;
+
+    unsigned m_job_id; // Job shown, 0 for none
+    uint64_t m_read_position;
+    std::string m_utf8_carry;
+    guint m_tick_id;
+    bool m_updating_combo;
+};
+
+// Table of benchmark statistics, one row per metric
+class BenchmarkResultsWindow : public Gtk::Window 
+{
+  public:
+    BenchmarkResultsWindow(Gtk::Window& parent, const std::string& name, const std::vector<Subprocess::ExitInfo>& runs) :
+      m_box(Gtk::ORIENTATION_VERTICAL)
+    {
+      set_title("Benchmark: " + name);
+      set_transient_for(parent);
+      set_default_size(640, 300);
+
+      m_store = Gtk::ListStore::create(m_columns);
+      m_tree.set_model(m_store);
+      m_tree.append_column("Metric", m_columns.metric);
+      m_tree.append_column("Min", m_columns.min);
+      m_tree.append_column("Median", m_columns.median);
+      m_tree.append_column("p95", m_columns.p95);
+      m_tree.append_column("Mean", m_columns.mean);
+      m_tree.append_column("Std dev", m_columns.stddev);
+
+      auto metric = [&](const std::string& label, const std::string& unit, std::function<double(const Subprocess::ExitInfo&)> value) 
+      {
+        std::vector<double> samples;
+        for (const auto& run : runs) samples.push_back(value(run));
+        SampleStats stats = compute_stats(samples);
+        auto format = [&unit](double number) 
+        {
+          std::ostringstream text;
+          text.precision(unit == "ms" ? 3 : 1);
+          text << std::fixed << number << " " << unit;
+          return text.str();
+        };
+        auto row = *m_store->append();
+        row[m_columns.metric] = label;
+        row[m_columns.min] = format(stats.min);
+        row[m_columns.median] = format(stats.median);
+        row[m_columns.p95] = format(stats.p95);
+        row[m_columns.mean] = format(stats.mean);
+        row[m_columns.stddev] = format(stats.stddev);
+      };
+      metric("Wall time", "ms", [](const Subprocess::ExitInfo& r) { return r.wall_ms; });
+      metric("User CPU", "ms", [](const Subprocess::ExitInfo& r) { return timeval_ms(r.usage.ru_utime); });
+      metric("System CPU", "ms", [](const Subprocess::ExitInfo& r) { return timeval_ms(r.usage.ru_stime); });
+      metric("Max RSS", "KB", [](const Subprocess::ExitInfo& r) { return static_cast<double>(r.usage.ru_maxrss); });
+      metric("Minor page faults", "", [](const Subprocess::ExitInfo& r) { return static_cast<double>(r.usage.ru_minflt); });
+      metric("Major page faults", "", [](const Subprocess::ExitInfo& r) { return static_cast<double>(r.usage.ru_majflt); });
+      metric("Voluntary context switches", "", [](const Subprocess::ExitInfo& r) { return static_cast<double>(r.usage.ru_nvcsw); });
+      metric("Involuntary context switches", "", [](const Subprocess::ExitInfo& r) { return static_cast<double>(r.usage.ru_nivcsw); });
+
+      m_summary.set_text(std::to_string(runs.size()) + " measured runs");
+      m_summary.set_xalign(0);
+      m_box.pack_start(m_summary, Gtk::PACK_SHRINK, 6);
+      m_scroll.add(m_tree);
+      m_box.pack_start(m_scroll, true, true, 0);
+      add(m_box);
+      show_all_children();
+    }
+
+  private:
+    class Columns : public Gtk::TreeModel::ColumnRecord 
+    {
+      public:
+        Columns() 
+        {
+          add(metric); add(min); add(median); add(p95); add(mean); add(stddev);
+        }
+        Gtk::TreeModelColumn<Glib::ustring> metric, min, median, p95, mean, stddev;
+    };
+
+    Columns m_columns;
+    Glib::RefPtr<Gtk::ListStore> m_store;
+    Gtk::Box m_box;
+    Gtk::Label m_summary;
+    Gtk::ScrolledWindow m_scroll;
+    Gtk::TreeView m_tree;
+};
+
+// One test of a batch: an input file and the output the program should produce for it
+struct TestCase 
+{
+  enum Verdict { TEST_PENDING, TEST_RUNNING, TEST_PASSED, TEST_FAILED, TEST_TLE, TEST_MLE, TEST_ERROR };
+
+  std::string name; // Input file name without its extension
+  std::string input_path;
+  std::string expected_path;
+  Verdict verdict = TEST_PENDING;
+  std::string detail; // What went wrong, for anything but a pass
+  Subprocess::ExitInfo exit = {};
+};
+
+// Pairs up the test files in dir: name.in with name.out, name.ans or name.expected, and
+// inputN.txt with outputN.txt. Cases come back in natural order, so 2 sorts before 10.
+static std::vector<TestCase> find_test_cases(const std::string& dir) 
+{
+  std::set<std::string> files;
+  DIR* handle = opendir(dir.c_str());
+  if (!handle) return {};
+  while (struct dirent* entry = readdir(handle)) 
+  {
+    files.insert(entry->d_name);
+  }
+  closedir(handle);
+
+  std::vector<TestCase> cases;
+  for (const auto& file : files) 
+  {
+    std::string name;
+    std::vector<std::string> expected_names;
+    if (file.size() > 3 && file.compare(file.size() - 3, 3, ".in") == 0) 
+    {
+      name = file.substr(0, file.size() - 3);
+      expected_names = {name + ".out", name + ".ans", name + ".expected"};
+    } 
+    else if (file.compare(0, 5, "input") == 0) 
+    {
+      name = file.substr(0, file.rfind('.'));
+      expected_names = {"output" + file.substr(5)};
+    }
+    for (const auto& expected : expected_names) 
+    {
+      if (!files.count(expected)) continue;
+      TestCase test;
+      test.name = name;
+      test.input_path = dir + "/" + file;
+      test.expected_path = dir + "/" + expected;
+      cases.push_back(test);
+      break;
+    }
+  }
+  std::sort(cases.begin(), cases.end(), [](const TestCase& a, const TestCase& b) { return strverscmp(a.name.c_str(), b.name.c_str()) < 0; });
+  return cases;
+}
+
+// Compares output line by line the way most judges do: trailing whitespace on a line and
+// trailing blank lines do not matter. On a mismatch, detail tells where.
+static bool outputs_match(const MappedFile& expected, const MappedFile& actual, std::string& detail) 
+{
+  auto next_line = [](const MappedFile& file, size_t& pos, std::string& line) 
+  {
+    line.clear();
+    if (pos >= file.size()) return false;
+    const char* start = file.data() + pos;
+    const char* newline = static_cast<const char*>(memchr(start, '\n', file.size() - pos));
+    size_t length = newline ? newline - start : file.size() - pos;
+    line.assign(start, length);
+    pos += length + 1;
+    while (!line.empty() && isspace(static_cast<unsigned char>(line.back()))) line.pop_back();
+    return true;
+  };
+  auto clip = [](const std::string& line) { return line.size() > 60 ? line.substr(0, 60) + "..." : line; };
+
+  std::string want, got;
+  size_t want_pos = 0, got_pos = 0;
+  for (size_t number = 1; ; ++number) 
+  {
+    bool has_want = next_line(expected, want_pos, want);
+    bool has_got = next_line(actual, got_pos, got);
+    if (!has_want && !has_got) return true;
+    if (want == got) continue; // Also a blank line past the end of the other
+    if (!has_got) 
+    {
+      detail = "Output ends before line " + std::to_string(number) + ", expected \"" + clip(want) + "\"";
+    } 
+    else 
+    {
+      detail = "Line " + std::to_string(number) + ": expected \"" + clip(want) + "\", got \"" + clip(got) + "\"";
+    }
+    return false;
+  }
+}
+
+// Runs one program over a set of test cases, as many at a time as there are cores. Each run reads
+// its case's input file, has its own CPU time and address space limits and a wall clock timeout,
+// and is judged against the expected output once it exits.
+class TestBatch 
+{
+  public:
+    struct Limits
+    {
+      int cpu_seconds;
+      int memory_mb;
+      double wall_seconds;
+    };
+
+    // Outputs are written to output_dir, which the batch deletes along with itself
+    TestBatch(std::vector<TestCase> cases, const std::vector<std::string>& argv, const std::string& cwd, const std::string& output_dir, Limits limits) :
+      m_cases(std::move(cases)),
+      m_runs(m_cases.size()),
+      m_argv(argv),
+      m_cwd(cwd),
+      m_output_dir(output_dir),
+      m_limits(limits),
+      m_max_parallel(std::max(1u, std::thread::hardware_concurrency())),
+      m_next(0),
+      m_running(0),
+      m_started(false)
+    {
+      m_dispatcher.connect(sigc::mem_fun(*this, &TestBatch::on_dispatch));
+    }
+
+    ~TestBatch() 
+    {
+      m_watchdog.disconnect();
+      m_runs.clear(); // Kills and reaps whatever still runs
+      remove_tree(m_output_dir);
+    }
+
+    TestBatch(const TestBatch&) = delete;
+    TestBatch& operator=(const TestBatch&) = delete;
+
+    // Called on the main loop with a case's index whenever its verdict changes
+    sigc::signal<void, size_t>& signal_case_changed() { return m_signal_case_changed; }
+
+    const std::vector<TestCase>& cases() const { return m_cases; }
+    bool finished() const { return m_started && m_next == m_cases.size() && m_running == 0; }
+
+    void start() 
+    {
+      m_started = true;
+      pump();
+      if (!finished()) 
+      {
+        m_watchdog = Glib::signal_timeout().connect(sigc::mem_fun(*this, &TestBatch::on_watchdog), 50);
+      }
+    }
+
+  private:
+    static constexpr rlim_t max_output_bytes = 256 * 1024 * 1024; // Stops runaway output before it fills the disk
+
+    struct Run 
+    {
+      std::unique_ptr<Subprocess> process;
+      std::shared_ptr<RingBuffer> errors; // The program's stderr
+      std::chrono::steady_clock::time_point deadline;
+      bool timed_out = false;
+    };
+
+    std::string output_path(size_t index) const { return m_output_dir + "/test" + std::to_string(index) + ".out"; }
+
+    // Starts waiting cases while cores are free
+    void pump() 
+    {
+      while (m_running < m_max_parallel && m_next < m_cases.size()) 
+      {
+        size_t index = m_next++;
+        TestCase& test = m_cases[index];
+        Run& run = m_runs[index];
+
+        Subprocess::Options options;
+        options.argv = m_argv;
+        options.cwd = m_cwd;
+        options.stdin_path = test.input_path;
+        options.stdout_path = output_path(index);
+        options.cpu_limit_seconds = m_limits.cpu_seconds;
+        options.memory_limit_bytes = static_cast<rlim_t>(m_limits.memory_mb) * 1024 * 1024;
+        options.file_size_limit_bytes = max_output_bytes;
+        run.errors = std::make_shared<RingBuffer>(64 * 1024);
+        run.process = std::make_unique<Subprocess>(run.errors);
+        run.process->set_exit_callback([this] { m_dispatcher.emit(); });
+        std::string error;
+        if (run.process->start(options, error)) 
+        {
+          auto timeout = std::chrono::duration<double>(m_limits.wall_seconds);
+          run.deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout);
+          test.verdict = TestCase::TEST_RUNNING;
+          ++m_running;
+        } 
+        else 
+        {
+          run.process.reset();
+          test.verdict = TestCase::TEST_ERROR;
+          test.detail = error;
+        }
+        m_signal_case_changed.emit(index);
+      }
+    }
+
+    // Judges every case whose process has exited
+    void on_dispatch() 
+    {
+      for (size_t i = 0; i < m_runs.size(); ++i) 
+      {
+        Run& run = m_runs[i];
+        if (!run.process || !run.process->finished()) continue;
+        m_cases[i].exit = run.process->exit_info();
+        run.process.reset();
+        --m_running;
+        judge(i);
+        m_signal_case_changed.emit(i);
+      }
+      pump();
+      if (finished()) m_watchdog.disconnect();
+    }
+
+    bool on_watchdog() 
+    {
+      auto now = std::chrono::steady_clock::now();
+      for (auto& run : m_runs) 
+      {
+        if (run.process && !run.timed_out && now >= run.deadline) 
+        {
+          run.timed_out = true;
+          run.process->kill();
+        }
+      }
+      return true;
+    }
+
+    void judge(size_t index) 
+    {
+      TestCase& test = m_cases[index];
+      Run& run = m_runs[index];
+      const auto& info = test.exit;
+      bool clean_exit = info.exited && info.code == 0;
+      double cpu_ms = timeval_ms(info.usage.ru_utime) + timeval_ms(info.usage.ru_stime);
+
+      std::string errors;
+      uint64_t skipped = 0;
+      run.errors->read_since(0, errors, 64 * 1024, skipped);
+      run.errors.reset();
+      double memory_bytes = m_limits.memory_mb * 1024.0 * 1024.0;
+      // Running out of address space shows up as a failed allocation, not as a signal of its own
+      bool out_of_memory = errors.find("bad_alloc") != std::string::npos || errors.find("MemoryError") != std::string::npos ||
+                           errors.find("Cannot allocate memory") != std::string::npos || info.usage.ru_maxrss * 1024.0 >= 0.9 * memory_bytes;
+
+      if (run.timed_out) 
+      {
+        test.verdict = TestCase::TEST_TLE;
+        test.detail = "Wall clock timeout";
+      } 
+      else if (!clean_exit && ((!info.exited && info.signal == SIGXCPU) || cpu_ms >= m_limits.cpu_seconds * 1000.0)) 
+      {
+        test.verdict = TestCase::TEST_TLE;
+        test.detail = "CPU time limit";
+      } 
+      else if (!clean_exit && out_of_memory) 
+      {
+        test.verdict = TestCase::TEST_MLE;
+        test.detail = describe_exit(info);
+      } 
+      else if (!clean_exit) 
+      {
+        test.verdict = TestCase::TEST_ERROR;
+        test.detail = !info.exited && info.signal == SIGXFSZ ? "Output limit exceeded" : describe_exit(info);
+        if (!errors.empty()) test.detail += ": " + errors.substr(0, std::min<size_t>(errors.find('\n'), 120));
+      } 
+      else 
+      {
+        MappedFile expected, actual;
+        if (!expected.open(test.expected_path) || !actual.open(output_path(index))) 
+        {
+          test.verdict = TestCase::TEST_ERROR;
+          test.detail = "Could not read the output files";
+        } 
+        else 
+        {
+          test.verdict = outputs_match(expected, actual, test.detail) ? TestCase::TEST_PASSED : TestCase::TEST_FAILED;
+        }
+      }
+      unlink(output_path(index).c_str());
+    }
+
+    std::vector<TestCase> m_cases;
+    std::vector<Run> m_runs; // Parallel to m_cases
+    std::vector<std::string> m_argv;
+    std::string m_cwd;
+    std::string m_output_dir;
+    Limits m_limits;
+    size_t m_max_parallel;
+    size_t m_next; // First case not started yet
+    size_t m_running;
+    bool m_started;
+    Glib::Dispatcher m_dispatcher;
+    sigc::connection m_watchdog;
+    sigc::signal<void, size_t> m_signal_case_changed;
+};
+
+// Grid of test results, one row per case, filled in as the batch runs
+class TestResultsWindow : public Gtk::Window 
+{
+  public:
+    TestResultsWindow(Gtk::Window& parent, const std::string& name, TestBatch& batch) :
+      m_batch(batch),
+      m_box(Gtk::ORIENTATION_VERTICAL)
+    {
+      set_title("Tests: " + name);
+      set_transient_for(parent);
+      set_default_size(760, 420);
+
+      m_store = Gtk::ListStore::create(m_columns);
+      m_tree.set_model(m_store);
+      m_tree.append_column("Case", m_columns.name);
+      int verdict_columns = m_tree.append_column("Verdict", m_columns.verdict);
+      if (auto column = m_tree.get_column(verdict_columns - 1)) // Verdicts are coloured
+      {
+        auto renderer = static_cast<Gtk::CellRendererText*>(column->get_first_cell());
+        column->add_attribute(renderer->property_foreground(), m_columns.color);
+      }
+      m_tree.append_column("Time", m_columns.time);
+      m_tree.append_column("CPU", m_columns.cpu);
+      m_tree.append_column("Peak memory", m_columns.memory);
+      m_tree.append_column("Details", m_columns.detail);
+
+      for (size_t i = 0; i < batch.cases().size(); ++i) 
+      {
+        m_rows.push_back(m_store->append());
+        update_row(i);
+      }
+      m_summary.set_text("Building...");
+      batch.signal_case_changed().connect(sigc::mem_fun(*this, &TestResultsWindow::on_case_changed));
+
+      m_summary.set_xalign(0);
+      m_box.pack_start(m_summary, Gtk::PACK_SHRINK, 6);
+      m_scroll.add(m_tree);
+      m_box.pack_start(m_scroll, true, true, 0);
+      add(m_box);
+      show_all_children();
+    }
+
+    // For news from before the batch starts, e.g. a failed build
+    void set_status(const std::string& text) { m_summary.set_text(text); }
+
+  private:
+    void on_case_changed(size_t index)
+    {
+      update_row(index);
+      update_summary();
+    }
+
+    void update_row(size_t index) 
+    {
+      static const char* verdicts[] = {"Pending", "Running", "Pass", "Fail", "TLE", "MLE", "Error"};
+      static const char* colors[] = {"#888888", "#4a90d9", "#2e9e44", "#d93b3b", "#d98b1a", "#d98b1a", "#9b4fd9"};
+      const TestCase& test = m_batch.cases()[index];
+      auto row = *m_rows[index];
+      std::string carry;
+      row[m_columns.name] = make_valid_utf8(carry, test.name);
+      row[m_columns.verdict] = verdicts[test.verdict];
+      row[m_columns.color] = colors[test.verdict];
+      carry.clear();
+      row[m_columns.detail] = make_valid_utf8(carry, test.detail);
+
+      bool ran = test.verdict >= TestCase::TEST_PASSED && test.exit.wall_ms > 0;
+      std::ostringstream time, cpu, memory;
+      time.precision(1);
+      cpu.precision(1);
+      memory.precision(1);
+      time << std::fixed << test.exit.wall_ms << " ms";
+      cpu << std::fixed << timeval_ms(test.exit.usage.ru_utime) + timeval_ms(test.exit.usage.ru_stime) << " ms";
+      memory << std::fixed << test.exit.usage.ru_maxrss / 1024.0 << " MB";
+      row[m_columns.time] = ran ? time.str() : "";
+      row[m_columns.cpu] = ran ? cpu.str() : "";
+      row[m_columns.memory] = ran ? memory.str() : "";
+    }
+
+    void update_summary() 
+    {
+      size_t counts[7] = {0, 0, 0, 0, 0, 0, 0};
+      for (const auto& test : m_batch.cases()) ++counts[test.verdict];
+      std::ostringstream summary;
+      summary << counts[TestCase::TEST_PASSED] << "/" << m_batch.cases().size() << " passed";
+      if (counts[TestCase::TEST_FAILED]) summary << ", " << counts[TestCase::TEST_FAILED] << " failed";
+      if (counts[TestCase::TEST_TLE]) summary << ", " << counts[TestCase::TEST_TLE] << " TLE";
+      if (counts[TestCase::TEST_MLE]) summary << ", " << counts[TestCase::TEST_MLE] << " MLE";
+      if (counts[TestCase::TEST_ERROR]) summary << ", " << counts[TestCase::TEST_ERROR] << " errors";
+      if (!m_batch.finished()) summary << " (" << counts[TestCase::TEST_RUNNING] << " running, " << counts[TestCase::TEST_PENDING] << " waiting)";
+      m_summary.set_text(summary.str());
+    }
+
+    class Columns : public Gtk::TreeModel::ColumnRecord 
+    {
+      public:
+        Columns()
+        {
+          add(name); add(verdict); add(color); add(time); add(cpu); add(memory); add(detail);
+        }
+        Gtk::TreeModelColumn<Glib::ustring> name, verdict, color, time, cpu, memory, detail;
+    };
+
+    TestBatch& m_batch;
+    Columns m_columns;
+    Glib::RefPtr<Gtk::ListStore> m_store;
+    std::vector<Gtk::TreeModel::iterator> m_rows; // ListStore iterators stay valid
+    Gtk::Box m_box;
+    Gtk::Label m_summary;
+    Gtk::ScrolledWindow m_scroll;
+    Gtk::TreeView m_tree;
+};
+
+// Where the samples of a profiled run landed in its source
+struct ProfileReport 
+{
+  struct Function 
+  {
+    std::string name;
+    uint64_t samples;
+    int hottest_line; // 0-based, -1 if none of its samples map to the source
+  };
+  std::map<int, uint64_t> line_samples; // 0-based lines of the source that have samples
+  std::vector<Function> functions; // Hottest first
+  uint64_t total = 0; // Every sample of the run, also those in libraries
+  uint64_t in_source = 0; // Those that map to a line of the source
+};
+
+// Adds up sample counts, one "address [count]" per line with the address in hex: the file of a
+// ProfileSampler, or the output of "perf script -F ip", which has one line per sample
+static bool read_sample_counts(const std::string& path, std::map<uint64_t, uint64_t>& counts) 
+{
+  std::ifstream in(path);
+  if (!in) return false;
+  std::string line;
+  while (std::getline(in, line)) 
+  {
+    char* end;
+    uint64_t address = strtoull(line.c_str(), &end, 16);
+    if (end == line.c_str()) continue;
+    uint64_t count = strtoull(end, nullptr, 10);
+    counts[address] += count ? count : 1;
+  }
+  return true;
+}
+
+// Address range of the executable segments of an ELF binary, to tell its samples from those in
+// libraries. Only meaningful for binaries linked with -no-pie, whose addresses are fixed.
+static bool executable_range(const std::string& path, uint64_t& begin, uint64_t& end) 
+{
+  MappedFile file;
+  if (!file.open(path) || file.size() < sizeof(Elf64_Ehdr)) return false;
+  Elf64_Ehdr header;
+  memcpy(&header, file.data(), sizeof(header));
+  if (memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 || header.e_ident[EI_CLASS] != ELFCLASS64) return false;
+  begin = UINT64_MAX;
+  end = 0;
+  for (size_t i = 0; i < header.e_phnum; ++i) 
+  {
+    size_t offset = header.e_phoff + i * header.e_phentsize;
+    if (offset + sizeof(Elf64_Phdr) > file.size()) return false;
+    Elf64_Phdr segment;
+    memcpy(&segment, file.data() + offset, sizeof(segment));
+    if (segment.p_type != PT_LOAD || !(segment.p_flags & PF_X)) continue;
+    begin = std::min<uint64_t>(begin, segment.p_vaddr);
+    end = std::max<uint64_t>(end, segment.p_vaddr + segment.p_memsz);
+  }
+  return begin < end;
+}
+
+// Maps sample counts to lines and functions of source_name. symbols is the output of
+// "addr2line -a -f -i -C" for the addresses inside the binary: per address a "0x..." line, then
+// a function and a file:line line for every inlined call, innermost first. A sample counts for
+// the innermost call in the source, so time in inlined library code lands on the line calling it.
+static ProfileReport make_profile_report(const std::map<uint64_t, uint64_t>& counts, const std::string& symbols, const std::string& source_name) 
+{
+  ProfileReport report;
+  for (const auto& count : counts) report.total += count.second;
+  std::map<std::string, std::map<int, uint64_t>> functions; // Samples per line of each function, -1 for outside the source
+  uint64_t in_binary = 0;
+  uint64_t samples = 0; // Of the address being read
+  std::vector<std::pair<std::string, std::string>> frames; // Function and location
+  auto place = [&]() 
+  {
+    if (frames.empty() || samples == 0) return;
+    in_binary += samples;
+    for (const auto& frame : frames) 
+    {
+      std::string file = frame.second.substr(0, frame.second.find(" (")); // "main.cpp:12 (discriminator 3)"
+      size_t colon = file.rfind(':');
+      int line = colon == std::string::npos ? 0 : atoi(file.c_str() + colon + 1);
+      file = file.substr(0, colon);
+      if (line <= 0 || (file != source_name && !(file.size() > source_name.size() && file.compare(file.size() - source_name.size() - 1, std::string::npos, "/" + source_name) == 0))) 
+      {
+        continue;
+      }
+      report.line_samples[line - 1] += samples;
+      report.in_source += samples;
+      functions[frame.first][line - 1] += samples;
+      return;
+    }
+    functions[frames.back().first == "??" ? "[no debug info]" : frames.back().first][-1] += samples;
+  };
+
+  std::istringstream in(symbols);
+  std::string line;
+  while (std::getline(in, line)) 
+  {
+    if (line.compare(0, 2, "0x") == 0) 
+    {
+      place();
+      frames.clear();
+      auto count = counts.find(strtoull(line.c_str(), nullptr, 16));
+      samples = count == counts.end() ? 0 : count->second;
+      continue;
+    }
+    std::string location;
+    if (!std::getline(in, location)) break;
+    frames.emplace_back(line, location);
+  }
+  place();
+  if (report.total > in_binary) functions["[shared libraries]"][-1] += report.total - in_binary;
+
+  for (const auto& function : functions) 
+  {
+    ProfileReport::Function entry = {function.first, 0, -1};
+    uint64_t hottest = 0;
+    for (const auto& line_count : function.second) 
+    {
+      entry.samples += line_count.second;
+      if (line_count.first >= 0 && line_count.second > hottest) 
+      {
+        hottest = line_count.second;
+        entry.hottest_line = line_count.first;
+      }
+    }
+    report.functions.push_back(entry);
+  }
+  std::sort(report.functions.begin(), report.functions.end(), [](const ProfileReport::Function& a, const ProfileReport::Function& b) { return a.samples > b.samples; });
+  return report;
+}
+
+// Table of the functions a profiled run spent its samples in, sortable by any column. Activating
+// a function goes to its hottest line.
+class ProfileResultsWindow : public Gtk::Window 
+{
+  public:
+    ProfileResultsWindow(Gtk::Window& parent, const std::string& name, const std::string& sampler, const ProfileReport& report) :
+      m_box(Gtk::ORIENTATION_VERTICAL)
+    {
+      set_title("Profile: " + name);
+      set_transient_for(parent);
+      set_default_size(640, 360);
+
+      m_store = Gtk::ListStore::create(m_columns);
+      m_tree.set_model(m_store);
+      m_tree.append_column("Function", m_columns.name);
+      m_tree.append_column("Samples", m_columns.samples);
+      m_tree.append_column("Self", m_columns.percent);
+      m_tree.append_column("Hottest line", m_columns.line_text);
+      const Gtk::TreeModelColumnBase* sort_by[] = {&m_columns.name, &m_columns.samples, &m_columns.samples, &m_columns.line};
+      for (int i = 0; i < 4; ++i) m_tree.get_column(i)->set_sort_column(*sort_by[i]);
+      m_store->set_sort_column(m_columns.samples, Gtk::SORT_DESCENDING);
+
+      for (const auto& function : report.functions) 
+      {
+        std::ostringstream percent;
+        percent.precision(1);
+        percent << std::fixed << 100.0 * function.samples / report.total << " %";
+        std::string carry;
+        auto row = *m_store->append();
+        row[m_columns.name] = make_valid_utf8(carry, function.name);
+        row[m_columns.samples] = function.samples;
+        row[m_columns.percent] = percent.str();
+        row[m_columns.line] = function.hottest_line + 1;
+        row[m_columns.line_text] = function.hottest_line < 0 ? "" : std::to_string(function.hottest_line + 1);
+      }
+      m_tree.signal_row_activated().connect([this](const Gtk::TreeModel::Path& path, Gtk::TreeViewColumn*) 
+      {
+        int line = (*m_store->get_iter(path))[m_columns.line];
+        if (line > 0) m_signal_line_activated.emit(line - 1);
+      });
+
+      std::ostringstream summary;
+      summary.precision(1);
+      summary << std::fixed << report.total << " samples with " << sampler << ", " << 100.0 * report.in_source / std::max<uint64_t>(1, report.total) 
+              << " % in " << name << ". Double-click a function to go to its hottest line.";
+      m_summary.set_text(summary.str());
+      m_summary.set_xalign(0);
+      m_box.pack_start(m_summary, Gtk::PACK_SHRINK, 6);
+      m_scroll.add(m_tree);
+      m_box.pack_start(m_scroll, true, true, 0);
+      add(m_box);
+      show_all_children();
+    }
+
+    sigc::signal<void, int>& signal_line_activated() { return m_signal_line_activated; } // 0-based line
+
+  private:
+    class Columns : public Gtk::TreeModel::ColumnRecord 
+    {
+      public:
+        Columns() 
+        {
+          add(name); add(samples); add(percent); add(line); add(line_text);
+        }
+        Gtk::TreeModelColumn<Glib::ustring> name, percent, line_text;
+        Gtk::TreeModelColumn<unsigned long> samples;
+        Gtk::TreeModelColumn<int> line; // 1-based, 0 for none
+    };
+
+    Columns m_columns;
+    Glib::RefPtr<Gtk::ListStore> m_store;
+    Gtk::Box m_box;
+    Gtk::Label m_summary;
+    Gtk::ScrolledWindow m_scroll;
+    Gtk::TreeView m_tree;
+    sigc::signal<void, int> m_signal_line_activated;
+};
+
+// The .gitignore rules of one directory, chained to those of the directories above it. Covers the
+// common subset: globs, "!" negation, a trailing "/" for directories and patterns anchored by a "/".
+class IgnoreRules 
+{
+  public:
+    // Rules for dir (relative_dir is its path below the search root, "" or ending in "/"). Returns
+    // parent itself when the directory has no .gitignore of its own.
+    static std::shared_ptr<const IgnoreRules> load(const std::shared_ptr<const IgnoreRules>& parent, const std::string& dir, const std::string& relative_dir) 
+    {
+      std::ifstream file(dir + "/.gitignore");
+      if (!file) return parent;
+      auto rules = std::make_shared<IgnoreRules>();
+      rules->m_parent = parent;
+      rules->m_base = relative_dir;
+      std::string line;
+      while (std::getline(file, line)) 
+      {
+        while (!line.empty() && (line.back() == ' ' || line.back() == '\r' || line.back() == '\t')) line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        Rule rule;
+        rule.negated = line[0] == '!';
+        if (rule.negated) line.erase(0, 1);
+        rule.directory_only = !line.empty() && line.back() == '/';
+        if (rule.directory_only) line.pop_back();
+        if (line.compare(0, 3, "**/") == 0 && line.find('/', 3) == std::string::npos) line.erase(0, 3); // Same as no slash at all
+        rule.anchored = line.find('/') != std::string::npos;
+        if (rule.anchored && line[0] == '/') line.erase(0, 1);
+        rule.flags = line.find("**") != std::string::npos ? 0 : rule.anchored ? FNM_PATHNAME : 0; // Lets ** cross directories
+        rule.pattern = line;
+        if (!rule.pattern.empty()) rules->m_rules.push_back(rule);
+      }
+      return rules->m_rules.empty() ? parent : rules;
+    }
+
+    bool ignored(const std::string& relative_path, bool is_directory) const 
+    {
+      bool ignored = false;
+      apply(relative_path, is_directory, ignored);
+      return ignored;
+    }
+
+  private:
+    struct Rule 
+    {
+      std::string pattern;
+      int flags;
+      bool negated;
+      bool directory_only;
+      bool anchored;
+    };
+
+    // Outer rules first, so deeper .gitignore files and later lines win, as in git
+    void apply(const std::string& relative_path, bool is_directory, bool& ignored) const 
+    {
+      if (m_parent) m_parent->apply(relative_path, is_directory, ignored);
+      std::string below = relative_path.substr(m_base.size());
+      const char* name = relative_path.c_str() + relative_path.rfind('/') + 1; // rfind gives npos + 1 == 0 without a slash
+      for (const auto& rule : m_rules) 
+      {
+        if (rule.directory_only && !is_directory) continue;
+        if (fnmatch(rule.pattern.c_str(), rule.anchored ? below.c_str() : name, rule.flags) == 0) ignored = !rule.negated;
+      }
+    }
+
+    std::shared_ptr<const IgnoreRules> m_parent;
+    std::string m_base; // Directory of the .gitignore, relative to the search root
+    std::vector<Rule> m_rules;
+};
+
+// Searches a directory tree on a pool of worker threads. Large files are memory-mapped; literals are
+// found with memmem()/memchr(), which glibc vectorizes, and everything else with a POSIX regex run
+// over the whole mapping at once (REG_STARTEND). Binary files, .git and .gitignore'd paths are skipped.
+// Matches are handed to the main loop in batches as they are found.
+class FileSearch 
+{
+  public:
+    struct Query 
+    {
+      std::string pattern;
+      bool regex;
+      bool match_case;
+    };
+
+    struct Match 
+    {
+      std::string file; // Relative to the search root
+      int line; // 0-based
+      int column; // In characters
+      std::string text; // The matching line, trimmed and valid UTF-8
+    };
+
+    // Starts searching right away. Check error() for a pattern that did not compile.
+    FileSearch(const std::string& root, const Query& query) :
+      m_root(root),
+      m_query(query),
+      m_cancelled(false),
+      m_busy(0),
+      m_workers_left(0),
+      m_files_searched(0),
+      m_files_matched(0),
+      m_match_count(0),
+      m_first_result_us(-1),
+      m_truncated(false),
+      m_finished(false),
+      m_start(std::chrono::steady_clock::now()),
+      m_notified(false)
+    {
+      m_dispatcher.connect([this] { m_signal_results.emit(); });
+      regex_t test;
+      if (!compile(test)) return;
+      regfree(&test);
+
+      m_tasks.push_back({"", IgnoreRules::load(nullptr, root, ""), true});
+      unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+      m_workers_left = workers;
+      for (unsigned i = 0; i < workers; ++i) 
+      {
+        m_workers.emplace_back(&FileSearch::worker, this);
+      }
+    }
+
+    ~FileSearch() 
+    {
+      cancel();
+      for (auto& worker : m_workers) worker.join();
+    }
+
+    FileSearch(const FileSearch&) = delete;
+    FileSearch& operator=(const FileSearch&) = delete;
+
+    // Emitted on the main loop when take_results() has something new, or the search has finished
+    sigc::signal<void>& signal_results() { return m_signal_results; }
+
+    const std::string& error() const { return m_error; }
+    const std::string& root() const { return m_root; }
+
+    std::vector<Match> take_results() 
+    {
+      std::lock_guard<std::mutex> lock(m_results_mutex);
+      m_notified = false;
+      return std::move(m_results);
+    }
+
+    void cancel() 
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_cancelled = true;
+      m_wake.notify_all();
+    }
+
+    bool finished() const { return m_finished || !m_error.empty(); }
+    bool truncated() const { return m_truncated; }
+    size_t files_searched() const { return m_files_searched; }
+    size_t files_matched() const { return m_files_matched; }
+    size_t match_count() const { return m_match_count; }
+    double elapsed_ms() const { return std::chrono::duration<double, std::milli>((m_finished ? m_end : std::chrono::steady_clock::now()) - m_start).count(); }
+    double first_result_ms() const { return m_first_result_us / 1000.0; } // Negative before the first match
+
+  private:
+    static constexpr size_t max_matches = 20000; // A list longer than this helps nobody
+    static constexpr size_t binary_probe_bytes = 8192; // A NUL byte in here makes a file binary, as for git and grep
+    static constexpr size_t max_line_chars = 240;
+    static constexpr size_t small_file_bytes = 128 * 1024;
+
+    struct Task 
+    {
+      std::string relative; // Path below the root, "" for the root itself
+      std::shared_ptr<const IgnoreRules> rules; // Those that apply inside a directory, or to a file's directory
+      bool is_directory;
+    };
+
+    // Every worker has a regex of its own, glibc serializes regexec() calls on a shared one
+    bool compile(regex_t& regex) 
+    {
+      std::string pattern = m_query.pattern;
+      if (!m_query.regex) // A literal that needs the regex engine for case folding
+      {
+        pattern.clear();
+        for (char c : m_query.pattern) 
+        {
+          if (strchr("\\^$.[]|()*+?{}", c)) pattern += '\\';
+          pattern += c;
+        }
+      }
+      int result = regcomp(&regex, pattern.c_str(), REG_EXTENDED | REG_NEWLINE | (m_query.match_case ? 0 : REG_ICASE));
+      if (result != 0) 
+      {
+        char message[256];
+        regerror(result, &regex, message, sizeof(message));
+        m_error = message;
+        return false;
+      }
+      return true;
+    }
+
+    void worker() 
+    {
+      regex_t regex;
+      bool literal = !m_query.regex && m_query.match_case;
+      bool compiled = !literal && compile(regex);
+      std::vector<char> buffer;
+      std::unique_lock<std::mutex> lock(m_mutex);
+      while (true) 
+      {
+        m_wake.wait(lock, [this] { return m_cancelled || !m_tasks.empty() || m_busy == 0; });
+        if (m_cancelled || m_tasks.empty()) break; // Cancelled, or nothing queued and nobody left to queue more
+        Task task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+        ++m_busy;
+        lock.unlock();
+        if (task.is_directory) read_directory(task);
+        else search_file(task.relative, literal, compiled ? &regex : nullptr, buffer);
+        lock.lock();
+        --m_busy;
+        if (m_tasks.empty() && m_busy == 0) m_wake.notify_all(); // Done, wakes the idle workers to exit
+      }
+      lock.unlock();
+      if (compiled) regfree(&regex);
+
+      if (--m_workers_left == 0) 
+      {
+        m_end = std::chrono::steady_clock::now();
+        m_finished = true;
+        m_dispatcher.emit();
+      }
+    }
+
+    // Queues the directory's files ahead of everything so results come early, subdirectories behind
+    void read_directory(const Task& task) 
+    {
+      std::string dir = task.relative.empty() ? m_root : m_root + "/" + task.relative;
+      DIR* handle = opendir(dir.c_str());
+      if (!handle) return;
+      std::vector<Task> files, directories;
+      while (struct dirent* entry = readdir(handle)) 
+      {
+        const char* name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || strcmp(name, ".git") == 0) continue;
+        std::string relative = task.relative.empty() ? name : task.relative + "/" + name;
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN || type == DT_LNK) // Symlinks are followed to files, but not to directories, which could loop
+        {
+          struct stat st;
+          bool is_link = type == DT_LNK;
+          if (stat((m_root + "/" + relative).c_str(), &st) != 0) continue;
+          type = S_ISDIR(st.st_mode) ? (is_link ? DT_LNK : DT_DIR) : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+        if (type != DT_DIR && type != DT_REG) continue;
+        if (task.rules && task.rules->ignored(relative, type == DT_DIR)) continue;
+        if (type == DT_DIR) 
+        {
+          directories.push_back({relative, IgnoreRules::load(task.rules, m_root + "/" + relative, relative + "/"), true});
+        } 
+        else 
+        {
+          files.push_back({std::move(relative), nullptr, false});
+        }
+      }
+      closedir(handle);
+
+      std::lock_guard<std::mutex> lock(m_mutex);
+      for (auto& file : files) m_tasks.push_front(std::move(file));
+      for (auto& directory : directories) m_tasks.push_back(std::move(directory));
+      if (!files.empty() || !directories.empty()) m_wake.notify_all();
+    }
+
+    // Small files, most of a source tree, are read into the worker's buffer: for them mapping and
+    // unmapping costs more system time than the copy
+    void search_file(const std::string& relative, bool literal, regex_t* regex, std::vector<char>& buffer) 
+    {
+      std::string path = m_root + "/" + relative;
+      int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0) return;
+      struct stat st;
+      if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) 
+      {
+        ::close(fd);
+        return;
+      }
+      MappedFile file;
+      const char* data = buffer.data();
+      size_t size = 0;
+      if (static_cast<size_t>(st.st_size) <= small_file_bytes) 
+      {
+        buffer.resize(std::max<size_t>(st.st_size, 1));
+        ssize_t got;
+        while (size < buffer.size() && (got = read(fd, buffer.data() + size, buffer.size() - size)) > 0) size += got;
+        data = buffer.data();
+        ::close(fd);
+      } 
+      else 
+      {
+        ::close(fd);
+        if (!file.open(path)) return;
+        data = file.data();
+        size = file.size();
+      }
+      ++m_files_searched;
+      if (size == 0 || memchr(data, '\0', std::min(size, binary_probe_bytes))) return;
+
+      std::vector<Match> matches;
+      const char* end = data + size;
+      const char* position = data;
+      const char* counted = data; // Lines are counted up to here
+      int line = 0;
+      while (position < end && !m_cancelled) 
+      {
+        const char* hit;
+        if (literal) 
+        {
+          hit = static_cast<const char*>(memmem(position, end - position, m_query.pattern.data(), m_query.pattern.size()));
+        } 
+        else 
+        {
+          regmatch_t range;
+          range.rm_so = position - data;
+          range.rm_eo = size;
+          hit = regexec(regex, data, 1, &range, REG_STARTEND) == 0 ? data + range.rm_so : nullptr;
+        }
+        if (!hit) break;
+
+        for (const char* newline = counted; (newline = static_cast<const char*>(memchr(newline, '\n', hit - newline))); ++newline) ++line;
+        counted = hit;
+        const char* line_start = static_cast<const char*>(memrchr(data, '\n', hit - data));
+        line_start = line_start ? line_start + 1 : data;
+        const char* line_end = static_cast<const char*>(memchr(hit, '\n', end - hit));
+        if (!line_end) line_end = end;
+
+        Match match;
+        match.file = relative;
+        match.line = line;
+        match.column = 0;
+        for (const char* c = line_start; c < hit; ++c) match.column += (static_cast<unsigned char>(*c) & 0xC0) != 0x80;
+        const char* text = line_start;
+        while (text < line_end && (*text == ' ' || *text == '\t')) ++text;
+        std::string carry;
+        match.text = make_valid_utf8(carry, std::string(text, std::min<size_t>(line_end - text, max_line_chars)));
+        matches.push_back(std::move(match));
+        position = line_end + 1; // One match per line, like grep
+      }
+      if (matches.empty()) return;
+
+      int64_t no_result = -1;
+      m_first_result_us.compare_exchange_strong(no_result, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count());
+      ++m_files_matched;
+      if ((m_match_count += matches.size()) >= max_matches) 
+      {
+        m_truncated = true;
+        cancel();
+      }
+      std::lock_guard<std::mutex> lock(m_results_mutex);
+      std::move(matches.begin(), matches.end(), std::back_inserter(m_results));
+      if (!m_notified) // One wakeup per batch the main loop picks up, not one per file
+      {
+        m_notified = true;
+        m_dispatcher.emit();
+      }
+    }
+
+    std::string m_root;
+    Query m_query;
+    std::string m_error;
+
+    std::mutex m_mutex; // Guards the task queue
+    std::condition_variable m_wake;
+    std::deque<Task> m_tasks;
+    bool m_cancelled;
+    unsigned m_busy; // Workers in the middle of a task, which may queue more
+    std::atomic<unsigned> m_workers_left;
+    std::vector<std::thread> m_workers;
+
+    std::atomic<size_t> m_files_searched;
+    std::atomic<size_t> m_files_matched;
+    std::atomic<size_t> m_match_count;
+    std::atomic<int64_t> m_first_result_us;
+    std::atomic<bool> m_truncated;
+    std::atomic<bool> m_finished;
+    std::chrono::steady_clock::time_point m_start, m_end;
+
+    std::mutex m_results_mutex;
+    std::vector<Match> m_results; // Not yet taken by the main loop
+    bool m_notified;
+    Glib::Dispatcher m_dispatcher;
+    sigc::signal<void> m_signal_results;
+};
+
+// Find in Files: a folder, a pattern and the matches as they stream in. Activating a match asks
+// for the file to be opened at its line.
+class FindInFilesPanel : public Gtk::Box 
+{
+  public:
+    FindInFilesPanel() :
+      Gtk::Box(Gtk::ORIENTATION_VERTICAL),
+      m_toolbar(Gtk::ORIENTATION_HORIZONTAL),
+      m_folder_button("Choose the folder to search", Gtk::FILE_CHOOSER_ACTION_SELECT_FOLDER),
+      m_regex_check("Regex"),
+      m_case_check("Match case"),
+      m_search_button("Search")
+    {
+      m_folder_button.set_filename(Glib::get_current_dir());
+      m_pattern_entry.set_placeholder_text("Text to find, Enter searches");
+      m_toolbar.pack_start(m_folder_button, Gtk::PACK_SHRINK, 4);
+      m_toolbar.pack_start(m_pattern_entry, true, true, 4);
+      m_toolbar.pack_start(m_regex_check, Gtk::PACK_SHRINK, 4);
+      m_toolbar.pack_start(m_case_check, Gtk::PACK_SHRINK, 4);
+      m_toolbar.pack_start(m_search_button, Gtk::PACK_SHRINK, 4);
+      pack_start(m_toolbar, Gtk::PACK_SHRINK);
+
+      m_store = Gtk::ListStore::create(m_columns);
+      m_tree.set_model(m_store);
+      m_tree.append_column("File", m_columns.file);
+      m_tree.append_column("Line", m_columns.line);
+      m_tree.append_column("Text", m_columns.text);
+      m_tree.set_tooltip_text("Double-click a match to open it");
+      m_scroll.add(m_tree);
+      m_scroll.set_policy(Gtk::POLICY_AUTOMATIC, Gtk::POLICY_AUTOMATIC);
+      pack_start(m_scroll, true, true, 0);
+      m_status.set_xalign(0);
+      pack_start(m_status, Gtk::PACK_SHRINK, 2);
+
+      m_pattern_entry.signal_activate().connect(sigc::mem_fun(*this, &FindInFilesPanel::start_search));
+      m_search_button.signal_clicked().connect(sigc::mem_fun(*this, &FindInFilesPanel::on_search_clicked));
+      m_tree.signal_row_activated().connect(sigc::mem_fun(*this, &FindInFilesPanel::on_row_activated));
+    }
+
+    // Path, 0-based line and column of an activated match
+    sigc::signal<void, const std::string&, int, int>& signal_open() { return m_signal_open; }
+
+    void focus_pattern() { m_pattern_entry.grab_focus(); }
+    void set_folder(const std::string& folder) { m_folder_button.set_filename(folder); }
+
+    // Lists matches found by someone else, e.g. the symbol index, in place of the last search
+    void show_matches(const std::string& root, const std::vector<FileSearch::Match>& matches, const std::string& status) 
+    {
+      m_search.reset();
+      m_search_button.set_label("Search");
+      m_store->clear();
+      m_root = root;
+      for (const auto& match : matches) 
+      {
+        auto row = *m_store->append();
+        row[m_columns.file] = match.file;
+        row[m_columns.line] = match.line + 1;
+        row[m_columns.column] = match.column;
+        row[m_columns.text] = match.text;
+      }
+      m_status.set_text(status);
+    }
+
+  private:
+    void on_search_clicked() 
+    {
+      if (m_search && !m_search->finished()) 
+      {
+        m_search->cancel();
+        return;
+      }
+      start_search();
+    }
+
+    void start_search() 
+    {
+      std::string folder = m_folder_button.get_filename();
+      m_search.reset(); // Stops the previous search first
+      m_store->clear();
+      if (m_pattern_entry.get_text().empty() || folder.empty()) return;
+
+      FileSearch::Query query = {m_pattern_entry.get_text(), m_regex_check.get_active(), m_case_check.get_active()};
+      m_search = std::make_unique<FileSearch>(folder, query);
+      m_root = folder;
+      if (!m_search->error().empty()) 
+      {
+        m_status.set_text("Invalid pattern: " + m_search->error());
+        m_search.reset();
+        return;
+      }
+      m_search->signal_results().connect(sigc::mem_fun(*this, &FindInFilesPanel::on_results));
+      m_search_button.set_label("Stop");
+      m_status.set_text("Searching...");
+    }
+
+    void on_results() 
+    {
+      for (auto& match : m_search->take_results()) 
+      {
+        auto row = *m_store->append();
+        row[m_columns.file] = match.file;
+        row[m_columns.line] = match.line + 1;
+        row[m_columns.column] = match.column;
+        row[m_columns.text] = match.text;
+      }
+
+      std::ostringstream status;
+      status.precision(0);
+      status << std::fixed << m_search->match_count() << " matches in " << m_search->files_matched() << " files, "
+             << m_search->files_searched() << " files searched";
+      if (m_search->finished()) 
+      {
+        status << " in " << m_search->elapsed_ms() << " ms";
+        if (m_search->first_result_ms() >= 0) status << ", first result after " << m_search->first_result_ms() << " ms";
+        if (m_search->truncated()) status << " (stopped at the match limit)";
+        m_search_button.set_label("Search");
+      } 
+      else 
+      {
+        status << "...";
+      }
+      m_status.set_text(status.str());
+    }
+
+    void on_row_activated(const Gtk::TreeModel::Path& path, Gtk::TreeViewColumn* column) 
+    {
+      auto iter = m_store->get_iter(path);
+      if (!iter || m_root.empty()) return;
+      auto row = *iter;
+      Glib::ustring file = row[m_columns.file];
+      m_signal_open.emit(m_root + "/" + file, row[m_columns.line] - 1, row[m_columns.column]);
+    }
+
+    class Columns : public Gtk::TreeModel::ColumnRecord 
+    {
+      public:
+        Columns()
+        {
+          add(file); add(line); add(column); add(text);
+        }
+        Gtk::TreeModelColumn<Glib::ustring> file, text;
+        Gtk::TreeModelColumn<int> line, column;
+    };
+
+    Gtk::Box m_toolbar;
+    Gtk::FileChooserButton m_folder_button;
+    Gtk::Entry m_pattern_entry;
+    Gtk::CheckButton m_regex_check;
+    Gtk::CheckButton m_case_check;
+    Gtk::Button m_search_button;
+    Columns m_columns;
+    Glib::RefPtr<Gtk::ListStore> m_store;
+    Gtk::ScrolledWindow m_scroll;
+    Gtk::TreeView m_tree;
+    Gtk::Label m_status;
+    std::unique_ptr<FileSearch> m_search; // Latest search, its matches fill the list
+    std::string m_root; // Listed paths are relative to this
+    sigc::signal<void, const std::string&, int, int> m_signal_open;
+};
+
+// In-memory index of a directory tree. A background thread scans it once, then keeps it current
+// from inotify events, rescanning only the directories that appear. Entries are numbered and never
+// renumbered; the root is entry 0. All methods may be called from the main loop while the thread runs.
+class DirectoryIndex 
+{
+  public:
+    struct Child 
+    {
+      int id;
+      std::string name;
+      bool is_directory;
+    };
+
+    static constexpr int root_id = 0;
+
+    explicit DirectoryIndex(const std::string& root) :
+      m_root(root),
+      m_inotify(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)),
+      m_stopping(false),
+      m_ready(false),
+      m_unwatched(0),
+      m_live_entries(1),
+      m_build_ms(0),
+      m_notified(false)
+    {
+      m_entries.push_back({"", -1, true, {}, -1});
+      m_stop_pipe[0] = m_stop_pipe[1] = -1;
+      if (pipe2(m_stop_pipe, O_CLOEXEC) != 0) m_stop_pipe[0] = m_stop_pipe[1] = -1;
+      m_dispatcher.connect([this] { m_signal_changed.emit(); });
+      m_thread = std::thread(&DirectoryIndex::run, this);
+    }
+
+    ~DirectoryIndex() 
+    {
+      m_stopping = true;
+      if (m_stop_pipe[1] >= 0 && write(m_stop_pipe[1], "x", 1) < 0) {} // Wakes the poll()
+      m_thread.join();
+      for (int fd : {m_inotify, m_stop_pipe[0], m_stop_pipe[1]}) 
+      {
+        if (fd >= 0) ::close(fd);
+      }
+    }
+
+    DirectoryIndex(const DirectoryIndex&) = delete;
+    DirectoryIndex& operator=(const DirectoryIndex&) = delete;
+
+    // Emitted on the main loop when directories have changed, see take_changed_directories()
+    sigc::signal<void>& signal_changed() { return m_signal_changed; }
+
+    std::vector<int> take_changed_directories() 
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_notified = false;
+      std::vector<int> changed(m_changed.begin(), m_changed.end());
+      m_changed.clear();
+      return changed;
+    }
+
+    // Directories first, then by name
+    std::vector<Child> children(int directory) const 
+    {
+      std::vector<Child> children; 
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (directory < 0 || directory >= static_cast<int>(m_entries.size())) return children;
+        for (int id : m_entries[directory].children) 
+        {
+          children.push_back({id, m_entries[id].name, m_entries[id].is_directory});
+        }
+      }
+      std::sort(children.begin(), children.end(), [](const Child& a, const Child& b) 
+      {
+        if (a.is_directory != b.is_directory) return a.is_directory;
+        int order = strcasecmp(a.name.c_str(), b.name.c_str());
+        return order != 0 ? order < 0 : a.name < b.name;
+      });
+      return children;
+    }
+
+    std::string path_of(int id) const 
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      std::string path;
+      for (; id > root_id; id = m_entries[id].parent) path = "/" + m_entries[id].name + path;
+      return m_root + path;
+    }
+
+    const std::string& root() const { return m_root; }
+    bool ready() const { return m_ready; } // The first scan is complete
+    size_t entry_count() const { return m_live_entries; }
+    size_t unwatched() const { return m_unwatched; } // Directories inotify had no watch left for
+    double build_ms() const { return m_build_ms; }
+
+  private:
+    struct Entry 
+    {
+      std::string name;
+      int parent;
+      bool is_directory;
+      std::vector<int> children;
+      int watch; // inotify watch descriptor of a directory, -1 if none
+    };
+
+    void run() 
+    {
+      auto start = std::chrono::steady_clock::now();
+      scan(root_id, m_root);
+      m_build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      m_ready = true;
+      mark_changed(root_id);
+
+      std::vector<char> events(64 * 1024);
+      while (!m_stopping && m_inotify >= 0) 
+      {
+        struct pollfd fds[2] = {{m_inotify, POLLIN, 0}, {m_stop_pipe[0], POLLIN, 0}};
+        if (poll(fds, m_stop_pipe[0] >= 0 ? 2 : 1, -1) < 0 && errno != EINTR) break;
+        ssize_t got;
+        while ((got = read(m_inotify, events.data(), events.size())) > 0) 
+        {
+          for (char* p = events.data(); p < events.data() + got;) 
+          {
+            auto event = reinterpret_cast<struct inotify_event*>(p);
+            handle(*event);
+            p += sizeof(struct inotify_event) + event->len;
+          }
+        }
+      }
+    }
+
+    void handle(const struct inotify_event& event) 
+    {
+      if (event.mask & IN_Q_OVERFLOW) // Events were lost, start over
+      {
+        std::vector<int> children; 
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          children = m_entries[root_id].children;
+        }
+        for (int child : children) remove(child);
+        scan(root_id, m_root);
+        mark_changed(root_id);
+        return;
+      }
+      if (event.mask & IN_IGNORED) // The directory is gone, or we stopped watching it
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto watch = m_watches.find(event.wd);
+        if (watch == m_watches.end()) return;
+        m_entries[watch->second].watch = -1;
+        m_watches.erase(watch);
+        return;
+      }
+      if (event.len == 0) return;
+
+      int directory;
+      int existing = -1; 
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto watch = m_watches.find(event.wd);
+        if (watch == m_watches.end()) return;
+        directory = watch->second;
+        for (int id : m_entries[directory].children) 
+        {
+          if (m_entries[id].name == event.name) existing = id;
+        }
+      }
+      if (existing >= 0 && (event.mask & (IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CREATE))) 
+      {
+        remove(existing); // A rename onto an existing name replaces it
+      }
+      if (event.mask & (IN_CREATE | IN_MOVED_TO)) 
+      {
+        int id = add(directory, event.name, event.mask & IN_ISDIR);
+        if (event.mask & IN_ISDIR) scan(id, path_of(id)); // A directory moved in arrives with its contents
+      }
+      mark_changed(directory);
+    }
+
+    int add(int parent, const std::string& name, bool is_directory) 
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      int id = m_entries.size();
+      m_entries.push_back({name, parent, is_directory, {}, -1});
+      m_entries[parent].children.push_back(id);
+      ++m_live_entries;
+      return id;
+    }
+
+    // Drops an entry and everything below it. Its number is not reused, rows may still show it.
+    void remove(int id) 
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      auto& siblings = m_entries[m_entries[id].parent].children;
+      siblings.erase(std::remove(siblings.begin(), siblings.end(), id), siblings.end());
+      std::vector<int> pending = {id};
+      while (!pending.empty()) 
+      {
+        Entry& entry = m_entries[pending.back()];
+        pending.pop_back();
+        pending.insert(pending.end(), entry.children.begin(), entry.children.end());
+        entry.children.clear();
+        entry.children.shrink_to_fit();
+        --m_live_entries;
+        if (entry.watch >= 0) // Moved out of the tree, inotify would keep reporting on it
+        {
+          inotify_rm_watch(m_inotify, entry.watch);
+          m_watches.erase(entry.watch);
+          entry.watch = -1;
+        }
+      }
+    }
+
+    // Indexes everything below directory. The watch goes on before the listing, so whatever is
+    // created meanwhile shows up as an event rather than falling through the gap.
+    void scan(int directory, const std::string& path) 
+    {
+      std::vector<std::pair<int, std::string>> pending = {{directory, path}};
+      while (!pending.empty() && !m_stopping) 
+      {
+        auto current = std::move(pending.back());
+        pending.pop_back();
+        watch(current.first, current.second);
+        DIR* handle = opendir(current.second.c_str());
+        if (!handle) continue;
+        std::vector<Child> found;
+        while (struct dirent* entry = readdir(handle)) 
+        {
+          const char* name = entry->d_name;
+          if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || strcmp(name, ".git") == 0) continue;
+          bool is_directory = entry->d_type == DT_DIR;
+          if (entry->d_type == DT_UNKNOWN) 
+          {
+            struct stat st;
+            is_directory = lstat((current.second + "/" + name).c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+          }
+          found.push_back({-1, name, is_directory});
+        }
+        closedir(handle);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& child : found) 
+        {
+          int id = m_entries.size();
+          m_entries.push_back({child.name, current.first, child.is_directory, {}, -1});
+          m_entries[current.first].children.push_back(id);
+          ++m_live_entries;
+          if (child.is_directory) pending.push_back({id, current.second + "/" + child.name});
+        }
+        m_changed.insert(current.first); // Expanded rows fill in while the scan runs
+        if (!m_notified) 
+        {
+          m_notified = true;
+          m_dispatcher.emit();
+        }
+      }
+    }
+
+    void watch(int directory, const std::string& path) 
+    {
+      if (m_inotify < 0) return;
+      int wd = inotify_add_watch(m_inotify, path.c_str(), IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK);
+      if (wd < 0) 
+      {
+        ++m_unwatched; // Usually fs.inotify.max_user_watches
+        return;
+      }
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_watches[wd] = directory;
+      m_entries[directory].watch = wd;
+    }
+
+    void mark_changed(int directory) 
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_changed.insert(directory);
+      if (!m_notified) 
+      {
+        m_notified = true;
+        m_dispatcher.emit();
+      }
+    }
+
+    std::string m_root;
+    int m_inotify;
+    int m_stop_pipe[2];
+    std::atomic<bool> m_stopping;
+    std::atomic<bool> m_ready;
+    std::atomic<size_t> m_unwatched;
+    std::atomic<size_t> m_live_entries;
+    std::atomic<double> m_build_ms;
+
+    mutable std::mutex m_mutex; // Guards everything below
+    std::vector<Entry> m_entries; // Indexed by entry number
+    std::unordered_map<int, int> m_watches; // inotify watch descriptor to directory entry
+    std::set<int> m_changed; // Directories whose children changed since the main loop last looked
+    bool m_notified;
+
+    Glib::Dispatcher m_dispatcher;
+    sigc::signal<void> m_signal_changed;
+    std::thread m_thread; // Last, so it starts after everything it uses
+};
+
+// Project sidebar over a DirectoryIndex. A directory gets its rows only when it is first
+// expanded; until then it holds a single placeholder so that it shows an expander.
+class FileTreePanel : public Gtk::Box 
+{
+  public:
+    FileTreePanel() :
+      Gtk::Box(Gtk::ORIENTATION_VERTICAL),
+      m_scanned(false)
+    {
+      m_store = Gtk::TreeStore::create(m_columns);
+      m_tree.set_model(m_store);
+      m_tree.set_headers_visible(false);
+      m_tree.set_enable_search(true);
+      m_tree.set_search_column(m_columns.name);
+      auto column = Gtk::manage(new Gtk::TreeViewColumn("Files"));
+      auto icon = Gtk::manage(new Gtk::CellRendererPixbuf());
+      column->pack_start(*icon, false);
+      column->add_attribute(icon->property_icon_name(), m_columns.icon);
+      column->pack_start(m_columns.name);
+      m_tree.append_column(*column);
+
+      m_status.set_xalign(0);
+      m_status.set_ellipsize(Pango::ELLIPSIZE_START);
+      m_status.set_text("No folder, use File > Open Folder...");
+      pack_start(m_status, Gtk::PACK_SHRINK, 2);
+      m_scroll.add(m_tree);
+      m_scroll.set_policy(Gtk::POLICY_AUTOMATIC, Gtk::POLICY_AUTOMATIC);
+      pack_start(m_scroll, true, true, 0);
+
+      m_tree.signal_test_expand_row().connect(sigc::mem_fun(*this, &FileTreePanel::on_test_expand_row), false);
+      m_tree.signal_row_activated().connect(sigc::mem_fun(*this, &FileTreePanel::on_row_activated));
+    }
+
+    // Path of an activated file
+    sigc::signal<void, const std::string&>& signal_open() { return m_signal_open; }
+
+    // Something in the folder was created, deleted or renamed after the first scan
+    sigc::signal<void>& signal_changed() { return m_signal_changed; }
+
+    std::string get_root() const { return m_index ? m_index->root() : ""; }
+
+    void set_root(const std::string& root) 
+    {
+      m_index.reset(); // Stops the old watcher first
+      m_scanned = false;
+      m_populated.clear();
+      m_store->clear();
+      m_index = std::make_unique<DirectoryIndex>(root);
+      m_index->signal_changed().connect(sigc::mem_fun(*this, &FileTreePanel::on_index_changed));
+      update_status();
+    }
+
+  private:
+    void on_index_changed() 
+    {
+      for (int directory : m_index->take_changed_directories()) 
+      {
+        if (directory == DirectoryIndex::root_id) // Top level rows are always shown
+        {
+          sync(directory, m_store->children());
+          continue;
+        }
+        auto row = m_populated.find(directory);
+        if (row != m_populated.end()) sync(directory, row->second->children());
+      }
+      update_status();
+      if (m_scanned) m_signal_changed.emit();
+      m_scanned = m_index->ready();
+    }
+
+    void update_status() 
+    {
+      std::ostringstream status;
+      status << Glib::path_get_basename(m_index->root()) << ": ";
+      if (!m_index->ready()) 
+      {
+        status << "indexing, " << m_index->entry_count() << " entries...";
+      } 
+      else 
+      {
+        status.precision(0);
+        status << std::fixed << m_index->entry_count() << " entries, indexed in " << m_index->build_ms() << " ms";
+        if (m_index->unwatched()) status << " (" << m_index->unwatched() << " folders not watched, raise fs.inotify.max_user_watches)";
+      }
+      m_status.set_text(status.str());
+      m_status.set_tooltip_text(m_index->root());
+    }
+
+    // Makes the rows under a directory match the index: drops what is gone, inserts what is new.
+    // Both are in the same order, so one pass does it, and rows that stay keep their expansion.
+    void sync(int directory, const Gtk::TreeNodeChildren& rows) 
+    {
+      auto wanted = m_index->children(directory);
+      std::set<int> wanted_ids;
+      for (const auto& child : wanted) wanted_ids.insert(child.id);
+      for (auto row = rows.begin(); row != rows.end();) 
+      {
+        if (wanted_ids.count((*row)[m_columns.id])) 
+        {
+          ++row;
+          continue;
+        }
+        forget(row);
+        row = m_store->erase(row);
+      }
+
+      auto row = rows.begin();
+      for (const auto& child : wanted) 
+      {
+        if (row != rows.end() && (*row)[m_columns.id] == child.id) 
+        {
+          ++row;
+          continue;
+        }
+        auto added = row != rows.end() ? m_store->insert(row) : m_store->append(rows);
+        (*added)[m_columns.id] = child.id;
+        std::string carry;
+        (*added)[m_columns.name] = make_valid_utf8(carry, child.name); // The index keeps the real name for the path
+        (*added)[m_columns.is_directory] = child.is_directory;
+        (*added)[m_columns.icon] = child.is_directory ? "folder" : "text-x-generic";
+        if (child.is_directory) 
+        {
+          (*m_store->append(added->children()))[m_columns.id] = -1; // Placeholder
+        }
+      }
+    }
+
+    // Stops tracking the expanded directories in a subtree that is about to be removed
+    void forget(const Gtk::TreeModel::iterator& row) 
+    {
+      m_populated.erase((*row)[m_columns.id]);
+      for (auto child = row->children().begin(); child != row->children().end(); ++child) forget(child);
+    }
+
+    bool on_test_expand_row(const Gtk::TreeModel::iterator& row, const Gtk::TreeModel::Path& path) 
+    {
+      int id = (*row)[m_columns.id];
+      if (m_populated.count(id)) return false;
+      m_populated[id] = row; // TreeStore iterators stay valid while the row exists
+      sync(id, row->children()); // Also removes the placeholder
+      return false; // Allows the expansion
+    }
+
+    void on_row_activated(const Gtk::TreeModel::Path& path, Gtk::TreeViewColumn* column) 
+    {
+      auto row = m_store->get_iter(path);
+      if (!row || (*row)[m_columns.id] < 0) return;
+      if ((*row)[m_columns.is_directory]) 
+      {
+        if (m_tree.row_expanded(path)) m_tree.collapse_row(path);
+        else m_tree.expand_row(path, false);
+        return;
+      }
+      m_signal_open.emit(m_index->path_of((*row)[m_columns.id]));
+    }
+
+    class Columns : public Gtk::TreeModel::ColumnRecord 
+    {
+      public:
+        Columns()
+        {
+          add(id); add(name); add(icon); add(is_directory);
+        }
+        Gtk::TreeModelColumn<int> id; // Entry number in the index, -1 for a placeholder
+        Gtk::TreeModelColumn<Glib::ustring> name, icon;
+        Gtk::TreeModelColumn<bool> is_directory;
+    };
+
+    Columns m_columns;
+    Glib::RefPtr<Gtk::TreeStore> m_store;
+    Gtk::Label m_status;
+    Gtk::ScrolledWindow m_scroll;
+    Gtk::TreeView m_tree;
+    std::unique_ptr<DirectoryIndex> m_index;
+    std::unordered_map<int, Gtk::TreeModel::iterator> m_populated; // Expanded-once directories and their rows
+    bool m_scanned; // The index had completed its first scan when we last looked
+    sigc::signal<void, const std::string&> m_signal_open;
+    sigc::signal<void> m_signal_changed;
+};
+
+// Files below root, relative to it, in no particular order. Skips .git and whatever .gitignore
+// excludes; stops early, with what it has, once cancelled is set.
+static std::vector<std::string> list_project_files(const std::string& root, const std::atomic<bool>& cancelled) 
+{
+  std::vector<std::string> files;
+  std::vector<std::pair<std::string, std::shared_ptr<const IgnoreRules>>> pending = {{"", IgnoreRules::load(nullptr, root, "")}};
+  while (!pending.empty() && !cancelled) 
+  {
+    auto current = std::move(pending.back());
+    pending.pop_back();
+    DIR* handle = opendir((current.first.empty() ? root : root + "/" + current.first).c_str());
+    if (!handle) continue;
+    while (struct dirent* entry = readdir(handle)) 
+    {
+      const char* name = entry->d_name;
+      if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || strcmp(name, ".git") == 0) continue;
+      std::string relative = current.first.empty() ? name : current.first + "/" + name;
+      bool is_directory = entry->d_type == DT_DIR;
+      if (entry->d_type == DT_UNKNOWN) 
+      {
+        struct stat st;
+        is_directory = lstat((root + "/" + relative).c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+      }
+      if (current.second && current.second->ignored(relative, is_directory)) continue;
+      if (is_directory) pending.push_back({relative, IgnoreRules::load(current.second, root + "/" + relative, relative + "/")});
+      else files.push_back(std::move(relative));
+    }
+    closedir(handle);
+  }
+  return files;
+}
+
+// Every file below a project folder, for Quick Open. Paths are relative to the root and sorted.
+// Each lowercased path is broken into trigrams with a posting list of the paths holding it, so a
+// query of three or more letters only looks at the paths that contain all of its trigrams.
+class PathIndex 
+{
+  public:
+    struct Match 
+    {
+      uint32_t id;
+      int score;
+    };
+
+    // Walks root on the calling thread, skipping .git and whatever .gitignore excludes
+    static std::shared_ptr<PathIndex> scan(const std::string& root, const std::atomic<bool>& cancelled) 
+    {
+      auto index = std::make_shared<PathIndex>();
+      index->m_root = root;
+      index->m_paths = list_project_files(root, cancelled);
+      if (cancelled) return nullptr;
+      std::sort(index->m_paths.begin(), index->m_paths.end());
+      index->build();
+      return index;
+    }
+
+    // The index save() wrote for root, nullptr if there is none or it is unreadable
+    static std::shared_ptr<PathIndex> load(const std::string& file, const std::string& root) 
+    {
+      MappedFile source;
+      if (!source.open(file) || source.size() < sizeof(file_magic)) return nullptr;
+      const char* p = source.data();
+      const char* end = p + source.size();
+      if (memcmp(p, file_magic, sizeof(file_magic)) != 0) return nullptr;
+      p += sizeof(file_magic);
+
+      auto index = std::make_shared<PathIndex>();
+      auto get_count = [&](uint32_t& count) 
+      {
+        if (end - p < static_cast<ptrdiff_t>(sizeof(count))) return false;
+        memcpy(&count, p, sizeof(count));
+        p += sizeof(count);
+        return true;
+      };
+      auto get_array = [&](std::vector<uint32_t>& array, uint32_t count) 
+      {
+        if (static_cast<uint64_t>(end - p) < static_cast<uint64_t>(count) * sizeof(uint32_t)) return false;
+        array.resize(count);
+        memcpy(array.data(), p, count * sizeof(uint32_t));
+        p += count * sizeof(uint32_t);
+        return true;
+      };
+      uint32_t count;
+      if (!get_count(count)) return nullptr;
+      for (uint32_t i = 0; i <= count; ++i) // The root, then the paths, each ending in a NUL
+      {
+        const char* nul = static_cast<const char*>(memchr(p, '\0', end - p));
+        if (!nul) return nullptr;
+        if (i == 0 && std::string(p, nul) != root) return nullptr;
+        if (i > 0) index->m_paths.emplace_back(p, nul);
+        p = nul + 1;
+      }
+      uint32_t keys, postings;
+      if (!get_count(keys) || keys == UINT32_MAX || !get_array(index->m_keys, keys) || !get_array(index->m_starts, keys + 1)) return nullptr;
+      if (!get_count(postings) || !get_array(index->m_postings, postings) || index->m_starts.front() != 0 || index->m_starts.back() != postings) return nullptr;
+      // find() indexes with these unchecked, so a truncated or corrupt file must not get through
+      for (uint32_t k = 0; k < keys; ++k) 
+      {
+        if (index->m_starts[k] > index->m_starts[k + 1]) return nullptr;
+      }
+      for (uint32_t id : index->m_postings) 
+      {
+        if (id >= index->m_paths.size()) return nullptr;
+      }
+      index->m_root = root;
+      index->fold_paths();
+      return index;
+    }
+
+    std::string save(const std::string& file) const 
+    {
+      std::string data(file_magic, sizeof(file_magic));
+      auto put_array = [&data](const std::vector<uint32_t>& array) 
+      {
+        data.append(reinterpret_cast<const char*>(array.data()), array.size() * sizeof(uint32_t));
+      };
+      auto put_count = [&data](uint32_t count) { data.append(reinterpret_cast<const char*>(&count), sizeof(count)); };
+      put_count(m_paths.size());
+      data.append(m_root.c_str(), m_root.size() + 1);
+      for (const auto& path : m_paths) data.append(path.c_str(), path.size() + 1);
+      put_count(m_keys.size());
+      put_array(m_keys);
+      put_array(m_starts);
+      put_count(m_postings.size());
+      put_array(m_postings);
+      return make_directories(Glib::path_get_dirname(file)) ? write_file_atomically(file, data) : "could not create its directory";
+    }
+
+    const std::string& root() const { return m_root; }
+    size_t size() const { return m_paths.size(); }
+    const std::string& path(uint32_t id) const { return m_paths[id]; }
+
+    // Id of a relative path, size() if it is not in the index
+    uint32_t find_path(const std::string& relative) const 
+    {
+      auto it = std::lower_bound(m_paths.begin(), m_paths.end(), relative);
+      return it != m_paths.end() && *it == relative ? it - m_paths.begin() : m_paths.size();
+    }
+
+    // The limit best matches of query (lowercase), best first, with boost added to the score of
+    // the paths in it. Only the ids in candidates are looked at if given. complete is false if
+    // the trigrams alone settled the result; otherwise narrowed receives every id that matched,
+    // so the next, longer query can start from those.
+    std::vector<Match> find(const std::string& query, const std::unordered_map<uint32_t, int>& boost, size_t limit, const std::vector<uint32_t>* candidates, std::vector<uint32_t>& narrowed, bool& complete) const 
+    {
+      std::vector<Match> matches;
+      narrowed.clear();
+      complete = false;
+      auto consider = [&](uint32_t id) 
+      {
+        int score = PathIndex::score(m_paths[id], m_folded[id], query, nullptr);
+        if (score < 0) return false;
+        auto bonus = boost.empty() ? boost.end() : boost.find(id);
+        matches.push_back({id, score + (bonus != boost.end() ? bonus->second : 0)});
+        return true;
+      };
+      auto best_first = [&matches, limit]() 
+      {
+        size_t keep = std::min(limit, matches.size());
+        std::partial_sort(matches.begin(), matches.begin() + keep, matches.end(), [](const Match& a, const Match& b) 
+        {
+          return a.score != b.score ? a.score > b.score : a.id < b.id;
+        });
+        matches.resize(keep);
+        return matches;
+      };
+
+      // Whole substrings outrank every scattered match, so if the trigrams turn up enough of those,
+      // nothing else can make the list
+      if (query.size() >= 3) 
+      {
+        for (uint32_t id : substring_candidates(query)) consider(id);
+        if (matches.size() >= limit) return best_first();
+        matches.clear();
+      }
+
+      complete = true;
+      uint64_t mask = letter_mask(query);
+      size_t count = candidates ? candidates->size() : m_paths.size();
+      for (size_t i = 0; i < count; ++i) 
+      {
+        uint32_t id = candidates ? (*candidates)[i] : i;
+        if ((m_masks[id] & mask) == mask && consider(id)) narrowed.push_back(id);
+      }
+      return best_first();
+    }
+
+    // Lowercase copy of a path, as score() wants it (ASCII only, like the query)
+    static std::string fold_case(const std::string& path) 
+    {
+      std::string folded = path;
+      for (char& c : folded) c = fold(c);
+      return folded;
+    }
+
+    // How well query (lowercase) matches path, -1 if it does not; positions receives the matched
+    // characters. A whole substring beats scattered letters. Within each, matches in the file
+    // name, at the start of words and in short paths score higher. folded is fold_case(path).
+    static int score(const std::string& path, const std::string& folded, const std::string& query, std::vector<int>* positions) 
+    {
+      if (query.empty()) return 0;
+      const char* text = folded.data();
+      size_t size = folded.size();
+      size_t name = path.rfind('/') + 1; // npos + 1 is 0
+      size_t found = std::string::npos;
+      for (size_t limit = size >= query.size() ? size - query.size() + 1 : 0; limit > 0;) // The last, closest to the name
+      {
+        auto hit = static_cast<const char*>(memrchr(text, query[0], limit));
+        if (!hit) break;
+        limit = hit - text;
+        if (memcmp(hit + 1, query.data() + 1, query.size() - 1) == 0) 
+        {
+          found = limit;
+          break;
+        }
+      }
+      if (found != std::string::npos) 
+      {
+        int score = 100000 - static_cast<int>(size);
+        if (found >= name) score += 2000;
+        if (found == name) score += size == name + query.size() || path[name + query.size()] == '.' ? 3000 : 1000; // The whole name, or its stem
+        else if (at_word_start(path, found)) score += 500;
+        for (size_t i = 0; positions && i < query.size(); ++i) positions->push_back(found + i);
+        return score;
+      }
+
+      // Scattered letters: the first place the query completes, then back to the latest start,
+      // which gives the tightest window
+      size_t end = 0;
+      for (char c : query) 
+      {
+        auto hit = static_cast<const char*>(memchr(text + end, c, size - end));
+        if (!hit) return -1;
+        end = hit - text + 1;
+      }
+      size_t start = end--;
+      for (size_t q = query.size(); q-- > 0;) 
+      {
+        start = static_cast<const char*>(memrchr(text, query[q], start)) - text;
+      }
+      int score = 0;
+      size_t previous = std::string::npos;
+      for (size_t i = start, q = 0; i <= end && q < query.size(); ++i) 
+      {
+        if (text[i] != query[q]) continue;
+        score += 16;
+        if (previous != std::string::npos && i == previous + 1) score += 12;
+        if (at_word_start(path, i)) score += q == 0 ? 16 : 8;
+        if (i >= name) score += 4;
+        if (positions) positions->push_back(i);
+        previous = i;
+        ++q;
+      }
+      score -= static_cast<int>(end - start + 1 - query.size()) + static_cast<int>(size) / 4;
+      return std::max(score, 0);
+    }
+
+  private:
+    static constexpr char file_magic[8] = {'M', 'P', 'Q', 'O', 'P', 'E', 'N', '1'};
+
+    static unsigned char fold(char c) 
+    {
+      return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : static_cast<unsigned char>(c);
+    }
+
+    static bool at_word_start(const std::string& path, size_t i) 
+    {
+      if (i == 0) return true;
+      char before = path[i - 1];
+      return strchr("/_-. ", before) || (islower(static_cast<unsigned char>(before)) && isupper(static_cast<unsigned char>(path[i])));
+    }
+
+    // One bit per letter, digit or group of other bytes; a path lacking a bit of the query cannot match
+    static uint64_t letter_mask(const std::string& text) 
+    {
+      uint64_t mask = 0;
+      for (char c : text) 
+      {
+        unsigned char f = fold(c);
+        int bit = f >= 'a' && f <= 'z' ? f - 'a' : f >= '0' && f <= '9' ? 26 + f - '0' : 36 + f % 28;
+        mask |= 1ULL << bit;
+      }
+      return mask;
+    }
+
+    static uint32_t trigram(const std::string& text, size_t i) 
+    {
+      return fold(text[i]) << 16 | fold(text[i + 1]) << 8 | fold(text[i + 2]);
+    }
+
+    void fold_paths() 
+    {
+      m_folded.reserve(m_paths.size());
+      m_masks.reserve(m_paths.size());
+      for (const auto& path : m_paths) 
+      {
+        m_folded.push_back(fold_case(path));
+        m_masks.push_back(letter_mask(m_folded.back()));
+      }
+    }
+
+    // Posting lists in compressed row form: m_postings[m_starts[k], m_starts[k + 1]) are the
+    // sorted ids of the paths holding trigram m_keys[k]
+    void build() 
+    {
+      fold_paths();
+      std::vector<uint64_t> pairs; // Trigram << 32 | id, sorted into posting lists
+      std::vector<uint32_t> grams;
+      for (uint32_t id = 0; id < m_paths.size(); ++id) 
+      {
+        const std::string& path = m_folded[id];
+        grams.clear();
+        for (size_t i = 0; i + 2 < path.size(); ++i) grams.push_back(trigram(path, i));
+        std::sort(grams.begin(), grams.end());
+        grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+        for (uint32_t gram : grams) pairs.push_back(static_cast<uint64_t>(gram) << 32 | id);
+      }
+      std::sort(pairs.begin(), pairs.end());
+      m_postings.reserve(pairs.size());
+      for (uint64_t pair : pairs) 
+      {
+        uint32_t gram = pair >> 32;
+        if (m_keys.empty() || m_keys.back() != gram) 
+        {
+          m_keys.push_back(gram);
+          m_starts.push_back(m_postings.size());
+        }
+        m_postings.push_back(static_cast<uint32_t>(pair));
+      }
+      m_starts.push_back(m_postings.size());
+    }
+
+    // Paths holding every trigram of query, shortest posting list first
+    std::vector<uint32_t> substring_candidates(const std::string& query) const 
+    {
+      std::vector<std::pair<const uint32_t*, const uint32_t*>> lists;
+      for (size_t i = 0; i + 2 < query.size(); ++i) 
+      {
+        auto key = std::lower_bound(m_keys.begin(), m_keys.end(), trigram(query, i));
+        if (key == m_keys.end() || *key != trigram(query, i)) return {};
+        size_t k = key - m_keys.begin();
+        lists.push_back({m_postings.data() + m_starts[k], m_postings.data() + m_starts[k + 1]});
+      }
+      std::sort(lists.begin(), lists.end(), [](const auto& a, const auto& b) { return a.second - a.first < b.second - b.first; });
+      std::vector<uint32_t> result(lists[0].first, lists[0].second);
+      for (size_t i = 1; i < lists.size() && !result.empty(); ++i) 
+      {
+        auto end = std::set_intersection(result.begin(), result.end(), lists[i].first, lists[i].second, result.begin());
+        result.erase(end, result.end());
+      }
+      return result;
+    }
+
+    std::string m_root;
+    std::vector<std::string> m_paths;
+    std::vector<std::string> m_folded; // fold_case() of each path
+    std::vector<uint64_t> m_masks; // letter_mask() of each path
+    std::vector<uint32_t> m_keys;
+    std::vector<uint32_t> m_starts;
+    std::vector<uint32_t> m_postings;
+};
+
+constexpr char PathIndex::file_magic[8];
+
+// Ctrl+P popup: type part of a path, Enter opens the best match. The index for the folder is read
+// from the cache right away and rebuilt in the background whenever the folder changes.
+class QuickOpenWindow : public Gtk::Window 
+{
+  public:
+    explicit QuickOpenWindow(Gtk::Window& parent) :
+      m_box(Gtk::ORIENTATION_VERTICAL),
+      m_build_ms(0),
+      m_cancelled(false),
+      m_build_done(true),
+      m_rebuild_pending(false)
+    {
+      set_transient_for(parent);
+      set_modal(true);
+      set_decorated(false);
+      set_position(Gtk::WIN_POS_CENTER_ON_PARENT);
+      set_default_size(640, 420);
+
+      m_entry.set_placeholder_text("File name, fuzzy: \"mcpp\" finds main.cpp");
+      m_box.pack_start(m_entry, Gtk::PACK_SHRINK, 4);
+      m_store = Gtk::ListStore::create(m_columns);
+      m_tree.set_model(m_store);
+      m_tree.set_headers_visible(false);
+      auto renderer = Gtk::manage(new Gtk::CellRendererText());
+      auto column = Gtk::manage(new Gtk::TreeViewColumn("Path"));
+      column->pack_start(*renderer, true);
+      column->add_attribute(renderer->property_markup(), m_columns.markup);
+      m_tree.append_column(*column);
+      m_scroll.add(m_tree);
+      m_scroll.set_policy(Gtk::POLICY_NEVER, Gtk::POLICY_AUTOMATIC);
+      m_box.pack_start(m_scroll, true, true, 0);
+      m_status.set_xalign(0);
+      m_box.pack_start(m_status, Gtk::PACK_SHRINK, 2);
+      add(m_box);
+      show_all_children();
+
+      m_dispatcher.connect(sigc::mem_fun(*this, &QuickOpenWindow::on_index_built));
+      m_entry.signal_changed().connect(sigc::mem_fun(*this, &QuickOpenWindow::refilter));
+      m_entry.signal_activate().connect(sigc::mem_fun(*this, &QuickOpenWindow::open_selected));
+      m_entry.signal_key_press_event().connect(sigc::mem_fun(*this, &QuickOpenWindow::on_entry_key), false);
+      m_tree.signal_row_activated().connect([this](const Gtk::TreeModel::Path&, Gtk::TreeViewColumn*) { open_selected(); });
+      signal_focus_out_event().connect([this](GdkEventFocus*) 
+      {
+        hide();
+        return false;
+      });
+    }
+
+    ~QuickOpenWindow() 
+    {
+      stop_build();
+    }
+
+    // Absolute path of the chosen file
+    sigc::signal<void, const std::string&>& signal_open() { return m_signal_open; }
+
+    void set_root(const std::string& root) 
+    {
+      if (root == m_root) return;
+      stop_build();
+      m_root = root;
+      m_index.reset();
+      m_narrowed.clear();
+      m_narrowed_query.clear();
+      start_build(true);
+    }
+
+    // The folder changed on disk, a rebuild follows once it has been quiet for a while
+    void folder_changed() 
+    {
+      if (m_root.empty()) return;
+      m_rebuild_timer.disconnect();
+      m_rebuild_timer = Glib::signal_timeout().connect([this]() 
+      {
+        start_build(false);
+        return false;
+      }, 2000);
+    }
+
+    // Files opened most recently, newest first, for ranking and the empty query
+    void note_opened(const std::string& path) 
+    {
+      m_recent.erase(std::remove(m_recent.begin(), m_recent.end(), path), m_recent.end());
+      m_recent.insert(m_recent.begin(), path);
+      if (m_recent.size() > max_recent) m_recent.resize(max_recent);
+      m_boost_index.reset(); // Recomputes the boosts on the next query
+    }
+    const std::vector<std::string>& get_recent() const { return m_recent; }
+    void set_recent(const std::vector<std::string>& recent) 
+    {
+      m_recent.assign(recent.begin(), recent.begin() + std::min(recent.size(), max_recent));
+      m_boost_index.reset();
+    }
+
+    void popup() 
+    {
+      m_entry.set_text("");
+      refilter();
+      show();
+      present();
+      m_entry.grab_focus();
+    }
+
+  private:
+    static constexpr size_t max_recent = 100;
+    static constexpr size_t max_rows = 50;
+
+    std::string cache_path() const 
+    {
+      return Glib::get_user_cache_dir() + "/mint_pad/quickopen/" + BuildCache::make_key(m_root, "quickopen", "");
+    }
+
+    // Reads the cached index first when there is no index yet, then walks the folder
+    void start_build(bool from_cache) 
+    {
+      if (m_builder.joinable() && !m_build_done) 
+      {
+        m_rebuild_pending = true; // After the running one, which may have missed the change
+        return;
+      }
+      stop_build();
+      m_cancelled = false;
+      m_build_done = false;
+      m_builder = std::thread([this, from_cache, root = m_root, cache = cache_path()]() 
+      {
+        if (from_cache) 
+        {
+          auto cached = PathIndex::load(cache, root);
+          if (cached) publish(cached, 0);
+        }
+        auto start = std::chrono::steady_clock::now();
+        auto scanned = PathIndex::scan(root, m_cancelled);
+        if (scanned) 
+        {
+          publish(scanned, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+          scanned->save(cache); // Failing that only costs the next start its head start
+        }
+        m_build_done = true;
+        m_dispatcher.emit();
+      });
+    }
+
+    void stop_build() 
+    {
+      m_cancelled = true;
+      if (m_builder.joinable()) m_builder.join();
+      m_rebuild_pending = false;
+    }
+
+    void publish(const std::shared_ptr<const PathIndex>& index, double milliseconds) 
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_built = index;
+      m_build_ms = milliseconds;
+      m_dispatcher.emit();
+    }
+
+    void on_index_built() 
+    {
+      std::shared_ptr<const PathIndex> built; 
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        built.swap(m_built);
+      }
+      if (built) 
+      {
+        m_index = built;
+        m_index_status = std::to_string(m_index->size()) + " files";
+        if (m_build_ms > 0) m_index_status += ", indexed in " + std::to_string(static_cast<int>(m_build_ms)) + " ms";
+        else m_index_status += " (cached, refreshing)";
+        m_narrowed.clear();
+        m_narrowed_query.clear();
+        m_boost_index.reset();
+        if (get_visible()) refilter();
+      }
+      if (m_build_done && m_rebuild_pending) 
+      {
+        m_rebuild_pending = false;
+        start_build(false);
+      }
+    }
+
+    // Recent files get a bonus that fades with age; it reorders within each kind of match only
+    void update_boosts() 
+    {
+      if (m_boost_index == m_index) return;
+      m_boost_index = m_index;
+      m_boost.clear();
+      m_recent_ids.clear();
+      std::string prefix = m_root + "/";
+      for (size_t rank = 0; rank < m_recent.size(); ++rank) 
+      {
+        if (m_recent[rank].compare(0, prefix.size(), prefix) != 0) continue;
+        uint32_t id = m_index->find_path(m_recent[rank].substr(prefix.size()));
+        if (id == m_index->size()) continue;
+        m_boost[id] = static_cast<int>(max_recent - rank) * 30;
+        m_recent_ids.push_back(id);
+      }
+    }
+
+    void refilter() 
+    {
+      m_store->clear();
+      if (!m_index) 
+      {
+        m_status.set_text(m_root.empty() ? "No folder, use File > Open Folder..." : "Indexing " + m_root + "...");
+        return;
+      }
+      update_boosts();
+      std::string query;
+      for (char c : std::string(m_entry.get_text())) // Spaces are only for readability
+      {
+        if (c != ' ') query += c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+      }
+
+      auto start = std::chrono::steady_clock::now();
+      std::vector<PathIndex::Match> matches;
+      if (query.empty()) 
+      {
+        for (size_t i = 0; i < m_recent_ids.size() && i < max_rows; ++i) matches.push_back({m_recent_ids[i], 0});
+        for (uint32_t id = 0; matches.size() < max_rows && id < m_index->size(); ++id) 
+        {
+          if (!m_boost.count(id)) matches.push_back({id, 0});
+        }
+      } 
+      else 
+      {
+        // A query that extends the last one can only match what that one matched
+        bool narrows = !m_narrowed_query.empty() && query.compare(0, m_narrowed_query.size(), m_narrowed_query) == 0;
+        std::vector<uint32_t> narrowed;
+        bool complete;
+        matches = m_index->find(query, m_boost, max_rows, narrows ? &m_narrowed : nullptr, narrowed, complete);
+        if (complete) // Otherwise the trigrams settled it, and the older list still narrows later queries
+        {
+          m_narrowed.swap(narrowed);
+          m_narrowed_query = query;
+        }
+      }
+      double microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+      for (const auto& match : matches) 
+      {
+        const std::string& path = m_index->path(match.id);
+        std::vector<int> positions;
+        PathIndex::score(path, PathIndex::fold_case(path), query, &positions);
+        std::string markup; // Matched characters in bold, in runs so multibyte characters stay whole
+        size_t next = 0;
+        for (size_t i = 0; i < path.size();) 
+        {
+          bool bold = next < positions.size() && positions[next] == static_cast<int>(i);
+          size_t j = i;
+          while (j < path.size() && (next < positions.size() && positions[next] == static_cast<int>(j)) == bold) 
+          {
+            if (bold) ++next;
+            ++j;
+          }
+          std::string text = Glib::Markup::escape_text(path.substr(i, j - i));
+          markup += bold ? "<b>" + text + "</b>" : text;
+          i = j;
+        }
+        auto row = *m_store->append();
+        row[m_columns.id] = match.id;
+        row[m_columns.markup] = markup;
+      }
+      if (!m_store->children().empty()) m_tree.get_selection()->select(m_store->children().begin());
+
+      std::ostringstream status;
+      status.precision(0);
+      status << std::fixed << m_index_status << ", filtered in " << microseconds << " us";
+      m_status.set_text(status.str());
+    }
+
+    bool on_entry_key(GdkEventKey* event) 
+    {
+      int move = 0;
+      switch (event->keyval) 
+      {
+        case GDK_KEY_Escape: hide(); return true;
+        case GDK_KEY_Down: move = 1; break;
+        case GDK_KEY_Up: move = -1; break;
+        case GDK_KEY_Page_Down: move = 10; break;
+        case GDK_KEY_Page_Up: move = -10; break;
+        default: return false;
+      }
+      int rows = m_store->children().size();
+      if (rows == 0) return true;
+      auto selected = m_tree.get_selection()->get_selected();
+      int current = selected ? m_store->get_path(selected)[0] : 0;
+      Gtk::TreeModel::Path path;
+      path.push_back(std::max(0, std::min(rows - 1, current + move)));
+      m_tree.get_selection()->select(path);
+      m_tree.scroll_to_row(path);
+      return true;
+    }
+
+    void open_selected() 
+    {
+      auto selected = m_tree.get_selection()->get_selected();
+      if (!selected || !m_index) return;
+      std::string path = m_root + "/" + m_index->path((*selected)[m_columns.id]);
+      hide();
+      m_signal_open.emit(path);
+    }
+
+    class Columns : public Gtk::TreeModel::ColumnRecord 
+    {
+      public:
+        Columns()
+        {
+          add(id); add(markup);
+        }
+        Gtk::TreeModelColumn<unsigned> id;
+        Gtk::TreeModelColumn<Glib::ustring> markup;
+    };
+
+    Gtk::Box m_box;
+    Gtk::Entry m_entry;
+    Columns m_columns;
+    Glib::RefPtr<Gtk::ListStore> m_store;
+    Gtk::ScrolledWindow m_scroll;
+    Gtk::TreeView m_tree;
+    Gtk::Label m_status;
+    sigc::signal<void, const std::string&> m_signal_open;
+
+    std::string m_root;
+    std::shared_ptr<const PathIndex> m_index; // Latest built or cached index
+    std::string m_index_status;
+    std::vector<std::string> m_recent; // Absolute paths, newest first
+    std::shared_ptr<const PathIndex> m_boost_index; // Index m_boost was computed for
+    std::unordered_map<uint32_t, int> m_boost;
+    std::vector<uint32_t> m_recent_ids;
+    std::string m_narrowed_query; // Query whose full match list m_narrowed is
+    std::vector<uint32_t> m_narrowed;
+    sigc::connection m_rebuild_timer;
+
+    // Background builds
+    std::mutex m_mutex; // Guards m_built and m_build_ms
+    std::shared_ptr<const PathIndex> m_built;
+    double m_build_ms;
+    std::atomic<bool> m_cancelled;
+    std::atomic<bool> m_build_done;
+    bool m_rebuild_pending;
+    Glib::Dispatcher m_dispatcher;
+    std::thread m_builder;
+};
+
+// Latency HUD: keystroke-to-paint latency and the time spent in the window's busiest signal
+// handlers, shown in the status bar when turned on from the File menu. Costs nothing when off.
+class LatencyHud : public Gtk::Label 
+{
+  public:
+    LatencyHud() :
+      m_enabled(false),
+      m_key_pending(false),
+      m_next_latency(0)
+    {
+      set_xalign(1);
+      set_no_show_all(true); // Hidden until enabled, show_all() must not reveal it
+    }
+
+    bool enabled() const { return m_enabled; }
+
+    void set_enabled(bool enabled) 
+    {
+      m_enabled = enabled;
+      m_latencies.clear();
+      m_handlers.clear();
+      m_key_pending = false;
+      if (enabled) 
+      {
+        m_refresh_connection = Glib::signal_timeout().connect(sigc::mem_fun(*this, &LatencyHud::refresh), 500);
+        refresh();
+        show();
+      } 
+      else 
+      {
+        m_refresh_connection.disconnect();
+        hide();
+      }
+    }
+
+    // The first unpainted key press is the one the latency is measured from
+    void key_pressed() 
+    {
+      if (!m_enabled || m_key_pending) return;
+      m_key_time = std::chrono::steady_clock::now();
+      m_key_pending = true;
+    }
+
+    // Called after every frame is painted
+    void frame_painted() 
+    {
+      if (!m_key_pending) return;
+      m_key_pending = false;
+      double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_key_time).count();
+      if (m_latencies.size() < latency_window) m_latencies.push_back(ms);
+      else m_latencies[m_next_latency] = ms;
+      m_next_latency = (m_next_latency + 1) % latency_window;
+    }
+
+    void record(const char* handler, double ms) 
+    {
+      HandlerStats& stats = m_handlers[handler];
+      ++stats.calls;
+      stats.total_ms += ms;
+      stats.max_ms = std::max(stats.max_ms, ms);
+    }
+
+    // Times one signal handler invocation, when the HUD is on
+    class Scope 
+    {
+      public:
+        Scope(LatencyHud& hud, const char* handler) :
+          m_hud(hud.m_enabled ? &hud : nullptr),
+          m_handler(handler)
+        {
+          if (m_hud) m_start = std::chrono::steady_clock::now();
+        }
+
+        ~Scope() 
+        {
+          if (m_hud) m_hud->record(m_handler, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count());
+        }
+
+      private:
+        LatencyHud* m_hud;
+        const char* m_handler;
+        std::chrono::steady_clock::time_point m_start;
+    };
+
+  private:
+    struct HandlerStats
+    {
+      size_t calls = 0;
+      double total_ms = 0;
+      double max_ms = 0;
+    };
+
+    // Redrawn on a timer rather than per frame, otherwise the HUD would keep causing the frames it measures
+    bool refresh() 
+    {
+      std::ostringstream text;
+      text.precision(1);
+      text << std::fixed << "key→paint ";
+      if (m_latencies.empty()) 
+      {
+        text << "-";
+      } 
+      else 
+      {
+        std::vector<double> sorted = m_latencies;
+        std::sort(sorted.begin(), sorted.end());
+        text << "p50 " << sorted[sorted.size() / 2] << " p95 " << sorted[sorted.size() * 95 / 100] << " max " << sorted.back() << " ms";
+      }
+      for (const auto& handler : m_handlers) // Calls per refresh, mean and worst time
+      {
+        text.precision(3);
+        text << " | " << handler.first << " " << handler.second.calls << "× " << handler.second.total_ms / handler.second.calls
+             << "/" << handler.second.max_ms << " ms";
+      }
+      m_handlers.clear();
+      set_text(text.str());
+      return true;
+    }
+
+    static const size_t latency_window = 256; // Last key presses the percentiles cover
+
+    bool m_enabled;
+    bool m_key_pending;
+    std::chrono::steady_clock::time_point m_key_time;
+    std::vector<double> m_latencies; // Ring buffer of the last latency_window latencies
+    size_t m_next_latency;
+    std::map<std::string, HandlerStats> m_handlers;
+    sigc::connection m_refresh_connection;
+};
+
+// One replaced stretch of text: old_length characters at old_offset become text
+struct TextHunk 
+{
+  size_t old_offset; // In characters, as Gtk::TextBuffer counts them
+  size_t old_length;
+  std::string text;
+};
+
+// Line diff of two texts as the hunks that turn old_text into new_text, in order. Common leading
+// and trailing lines are skipped first, so a small edit to a large file costs little more than a
+// compare; the rest goes through Myers' O(ND) algorithm. Past max_edits line edits the whole middle
+// becomes a single hunk.
+static std::vector<TextHunk> diff_lines(const std::string& old_text, const std::string& new_text, const std::atomic<bool>& cancelled) 
+{
+  const int max_edits = 1000;
+  auto split = [](const std::string& text) // Line start offsets, plus the end
+  {
+    std::vector<size_t> starts = {0};
+    for (const char* p = text.data(); (p = static_cast<const char*>(memchr(p, '\n', text.data() + text.size() - p))); ++p) 
+    {
+      starts.push_back(p - text.data() + 1);
+    }
+    if (starts.back() != text.size()) starts.push_back(text.size());
+    return starts;
+  };
+  std::vector<size_t> a = split(old_text), b = split(new_text);
+  auto line = [](const std::string& text, const std::vector<size_t>& starts, size_t i) 
+  {
+    return std::make_pair(text.data() + starts[i], starts[i + 1] - starts[i]);
+  };
+  auto equal = [&](size_t i, size_t j) 
+  {
+    auto x = line(old_text, a, i), y = line(new_text, b, j);
+    return x.second == y.second && memcmp(x.first, y.first, x.second) == 0;
+  };
+
+  size_t old_lines = a.size() - 1, new_lines = b.size() - 1;
+  size_t prefix = 0;
+  while (prefix < old_lines && prefix < new_lines && equal(prefix, prefix)) ++prefix;
+  size_t suffix = 0;
+  while (suffix < old_lines - prefix && suffix < new_lines - prefix && equal(old_lines - 1 - suffix, new_lines - 1 - suffix)) ++suffix;
+
+  // Myers over the middle, keeping each round's V to walk the path back
+  int n = old_lines - prefix - suffix, m = new_lines - prefix - suffix;
+  int limit = std::min(n + m, max_edits);
+  std::vector<int> v(2 * limit + 3, 0);
+  std::vector<std::vector<int>> trace;
+  int offset = limit + 1;
+  int found = -1;
+  for (int d = 0; d <= limit && found < 0 && !cancelled; ++d) 
+  {
+    trace.push_back(v);
+    for (int k = -d; k <= d; k += 2) 
+    {
+      int x = (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1])) ? v[offset + k + 1] : v[offset + k - 1] + 1;
+      int y = x - k;
+      while (x < n && y < m && equal(prefix + x, prefix + y)) ++x, ++y;
+      v[offset + k] = x;
+      if (x >= n && y >= m) 
+      {
+        found = d;
+        break;
+      }
+    }
+  }
+
+  std::vector<std::pair<int, int>> matches; // Equal line pairs within the middle, back to front
+  if (found >= 0) 
+  {
+    int x = n, y = m;
+    for (int d = found; d > 0; --d) 
+    {
+      const std::vector<int>& previous = trace[d];
+      int k = x - y;
+      int previous_k = (k == -d || (k != d && previous[offset + k - 1] < previous[offset + k + 1])) ? k + 1 : k - 1;
+      int previous_x = previous[offset + previous_k];
+      int previous_y = previous_x - previous_k;
+      while (x > previous_x && y > previous_y) matches.push_back({--x, --y});
+      x = previous_x;
+      y = previous_y;
+    }
+    while (x > 0 && y > 0) matches.push_back({--x, --y});
+  }
+  std::reverse(matches.begin(), matches.end());
+  matches.push_back({n, m}); // Sentinel, closes the last gap
+
+  // Character offsets of the old lines, for the buffer
+  auto characters = [](const char* p, size_t length) 
+  {
+    size_t count = 0;
+    for (size_t i = 0; i < length; ++i) count += (static_cast<unsigned char>(p[i]) & 0xC0) != 0x80;
+    return count;
+  };
+  std::vector<size_t> old_chars(n + 1);
+  old_chars[0] = characters(old_text.data(), a[prefix]);
+  for (int i = 0; i < n; ++i) 
+  {
+    auto text = line(old_text, a, prefix + i);
+    old_chars[i + 1] = old_chars[i] + characters(text.first, text.second);
+  }
+
+  std::vector<TextHunk> hunks;
+  int x = 0, y = 0;
+  for (const auto& match : matches) 
+  {
+    if (match.first > x || match.second > y) 
+    {
+      TextHunk hunk;
+      hunk.old_offset = old_chars[x];
+      hunk.old_length = old_chars[match.first] - old_chars[x];
+      hunk.text.assign(new_text, b[prefix + y], b[prefix + match.second] - b[prefix + y]);
+      hunks.push_back(std::move(hunk));
+    }
+    x = match.first + 1;
+    y = match.second + 1;
+  }
+  return hunks;
+}
+
+// Reads a tab's file on a background thread and diffs it against the text the tab holds
+class ReloadDiff 
+{
+  public:
+    ReloadDiff(const std::string& path, std::string old_text) :
+      m_path(path),
+      m_old_text(std::move(old_text)),
+      m_cancelled(false),
+      m_finished(false),
+      m_ok(false)
+    {
+      m_dispatcher.connect([this] { m_signal_done.emit(); });
+      m_thread = std::thread(&ReloadDiff::run, this);
+    }
+
+    ~ReloadDiff() 
+    {
+      m_cancelled = true;
+      m_thread.join();
+    }
+
+    ReloadDiff(const ReloadDiff&) = delete;
+    ReloadDiff& operator=(const ReloadDiff&) = delete;
+
+    // Emitted on the main loop once the hunks are ready, or the file could not be read
+    sigc::signal<void>& signal_done() { return m_signal_done; }
+
+    bool finished() const { return m_finished; }
+    bool ok() const { return m_ok; }
+    const std::vector<TextHunk>& hunks() const { return m_hunks; }
+    const std::string& encoding() const { return m_encoding; } // Of the file as it is now
+    double milliseconds() const { return m_milliseconds; }
+
+  private:
+    void run() 
+    {
+      auto start = std::chrono::steady_clock::now();
+      MappedFile file;
+      if (file.open(m_path)) 
+      {
+        const char* data = file.data() ? file.data() : "";
+        m_encoding = detect_encoding(data, file.size()); // The buffer only takes UTF-8
+        m_hunks = diff_lines(m_old_text, decode_text(data, file.size(), m_encoding), m_cancelled);
+        m_ok = !m_cancelled;
+      }
+      m_old_text.clear();
+      m_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      m_finished = true;
+      m_dispatcher.emit();
+    }
+
+    std::string m_path;
+    std::string m_old_text;
+    std::atomic<bool> m_cancelled;
+    std::atomic<bool> m_finished;
+    bool m_ok;
+    std::vector<TextHunk> m_hunks;
+    std::string m_encoding;
+    double m_milliseconds;
+    Glib::Dispatcher m_dispatcher;
+    sigc::signal<void> m_signal_done;
+    std::thread m_thread; // Last, it starts in the constructor
+};
+
+// One syntax check of a buffer snapshot: gcc or g++ with -fsyntax-only, or Python's compile(),
+// reads the text from stdin on a worker thread and its diagnostics are parsed there. cancel()
+// kills the compiler at once; destroying a check cancels it and waits for the worker.
+class SyntaxCheck 
+{
+  public:
+    struct Diagnostic 
+    {
+      int line; // 0-based, in the snapshot
+      int column; // 0-based, in characters
+      bool error; // Otherwise a warning
+      std::string message;
+    };
+
+    SyntaxCheck(const std::vector<std::string>& argv, std::string text, const std::string& cwd) :
+      m_argv(argv),
+      m_text(std::move(text)),
+      m_cwd(cwd),
+      m_process(nullptr),
+      m_exited(false),
+      m_cancelled(false),
+      m_finished(false),
+      m_milliseconds(0)
+    {
+      m_dispatcher.connect([this] { m_signal_done.emit(); });
+      m_thread = std::thread(&SyntaxCheck::run, this);
+    }
+
+    ~SyntaxCheck() 
+    {
+      cancel();
+      m_thread.join();
+    }
+
+    SyntaxCheck(const SyntaxCheck&) = delete;
+    SyntaxCheck& operator=(const SyntaxCheck&) = delete;
+
+    // Command line for a language, "" for one that cannot be checked. directory is searched for
+    // "quoted" includes; pch_header, when not empty, is the precompiled preamble to use.
+    static std::vector<std::string> command_for(const std::string& language, const std::string& flags, const std::string& directory, const std::string& pch_header) 
+    {
+      if (language == "python") // Reported in the compiler's format, so one parser does
+      {
+        return {"python3", "-c", 
+          "import sys, warnings\n"
+          "with warnings.catch_warnings(record=True) as caught:\n"
+          "    warnings.simplefilter('always')\n"
+          "    try:\n"
+          "        compile(sys.stdin.buffer.read(), '<stdin>', 'exec')\n"
+          "    except (SyntaxError, ValueError) as e:\n"
+          "        print('<stdin>:%d:%d: error: %s' % (getattr(e, 'lineno', 1) or 1, getattr(e, 'offset', 1) or 1, getattr(e, 'msg', e)), file=sys.stderr)\n"
+          "for w in caught:\n"
+          "    print('<stdin>:%d:1: warning: %s' % (w.lineno, w.message), file=sys.stderr)\n"};
+      }
+      if (language != "c" && language != "cpp") return {};
+      std::vector<std::string> argv = {language == "c" ? "gcc" : "g++"};
+      for (const auto& flag : split_flags(flags)) argv.push_back(flag);
+      argv.insert(argv.end(), {"-fsyntax-only", "-Wall", "-fmax-errors=100", "-fno-diagnostics-show-caret", "-fdiagnostics-color=never"});
+      if (!directory.empty()) argv.insert(argv.end(), {"-iquote", directory});
+      if (!pch_header.empty()) argv.insert(argv.end(), {"-include", pch_header, "-Winvalid-pch"});
+      argv.insert(argv.end(), {"-x", language == "c" ? "c" : "c++", "-"});
+      return argv;
+    }
+
+    // Emitted on the main loop when the check is over, also after cancel()
+    sigc::signal<void>& signal_done() { return m_signal_done; }
+
+    void cancel() 
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_cancelled = true;
+      if (m_process) m_process->kill();
+    }
+
+    bool finished() const { return m_finished; }
+    bool cancelled() const { return m_cancelled; }
+    const std::string& error() const { return m_error; } // Why the checker could not run
+    const std::vector<Diagnostic>& diagnostics() const { return m_diagnostics; }
+    double milliseconds() const { return m_milliseconds; }
+
+  private:
+    // "<stdin>:12:5: error: message" lines. Problems inside included files are put on the
+    // #include line that brought them in.
+    static std::vector<Diagnostic> parse(const std::string& output) 
+    {
+      const std::string source = "<stdin>:";
+      std::vector<Diagnostic> diagnostics;
+      int include_line = -1; // Of the file the next diagnostics are in, -1 for the source itself
+      std::istringstream stream(output);
+      std::string line;
+      while (std::getline(stream, line) && diagnostics.size() < 200) 
+      {
+        size_t from = line.find("from " + source);
+        if (line.compare(0, 21, "In file included from") == 0 || (from != std::string::npos && line.find_first_not_of(' ') == from)) 
+        {
+          if (from != std::string::npos) include_line = atoi(line.c_str() + from + 5 + source.size()) - 1; // The outermost comes last
+          continue;
+        }
+        size_t kind = std::string::npos;
+        bool error = false;
+        for (const char* label : {": error: ", ": fatal error: ", ": warning: "}) 
+        {
+          size_t at = line.find(label);
+          if (at != std::string::npos && at < kind) 
+          {
+            kind = at;
+            error = label[2] != 'w';
+          }
+        }
+        if (kind == std::string::npos) continue; // Notes, "In function" headers and the like
+        std::string location = line.substr(0, kind);
+        std::string message = line.substr(line.find(": ", kind + 2) + 2);
+        if (location.compare(0, source.size(), source) == 0) 
+        {
+          int number = 0, column = 0;
+          sscanf(location.c_str() + source.size(), "%d:%d", &number, &column);
+          diagnostics.push_back({std::max(number - 1, 0), std::max(column - 1, 0), error, message});
+          include_line = -1;
+        } 
+        else if (include_line >= 0) 
+        {
+          diagnostics.push_back({include_line, 0, error, location + ": " + message});
+        }
+      }
+      return diagnostics;
+    }
+
+    void run() 
+    {
+      auto start = std::chrono::steady_clock::now();
+      auto output = std::make_shared<RingBuffer>(256 * 1024); 
+      {
+        Subprocess process(output);
+        process.set_exit_callback([this] 
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_exited = true;
+          m_exit.notify_all();
+        });
+        Subprocess::Options options;
+        options.argv = m_argv;
+        options.cwd = m_cwd;
+        bool started = false; 
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          if (!m_cancelled) started = process.start(options, m_error);
+          if (started) m_process = &process;
+        }
+        if (started) 
+        {
+          process.write_stdin(m_text); // Cut short by EPIPE if it is killed meanwhile
+          process.close_stdin();
+          std::unique_lock<std::mutex> lock(m_mutex);
+          m_exit.wait(lock, [this] { return m_exited; });
+          m_process = nullptr;
+        }
+      }
+
+      if (!m_cancelled && m_error.empty()) 
+      {
+        std::string text;
+        uint64_t skipped;
+        output->read_since(0, text, 256 * 1024, skipped);
+        m_diagnostics = parse(text);
+
+        // Compilers count bytes, the buffer counts characters
+        std::vector<size_t> line_starts = {0};
+        for (size_t at = 0; (at = m_text.find('\n', at)) != std::string::npos; ++at) line_starts.push_back(at + 1);
+        for (auto& diagnostic : m_diagnostics) 
+        {
+          if (diagnostic.line >= static_cast<int>(line_starts.size())) continue;
+          size_t begin = line_starts[diagnostic.line];
+          size_t end = m_text.find('\n', begin);
+          size_t bytes = std::min<size_t>(diagnostic.column, (end == std::string::npos ? m_text.size() : end) - begin);
+          diagnostic.column = static_cast<int>(g_utf8_strlen(m_text.data() + begin, bytes));
+        }
+      }
+      m_text.clear();
+      m_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      m_finished = true;
+      m_dispatcher.emit();
+    }
+
+    std::vector<std::string> m_argv;
+    std::string m_text;
+    std::string m_cwd;
+    std::mutex m_mutex; // Guards m_process and m_exited
+    std::condition_variable m_exit;
+    Subprocess* m_process; // While the checker runs
+    bool m_exited;
+    std::atomic<bool> m_cancelled;
+    std::atomic<bool> m_finished;
+    std::string m_error;
+    std::vector<Diagnostic> m_diagnostics;
+    double m_milliseconds;
+    Glib::Dispatcher m_dispatcher;
+    sigc::signal<void> m_signal_done;
+    std::thread m_thread; // Last, it starts in the constructor
+};
+
+// Little-endian base 128 integers and length-prefixed strings, for the compact on-disk formats
+static void put_varint(std::string& out, uint64_t value) 
+{
+  while (value >= 0x80) 
+  {
+    out += static_cast<char>((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  out += static_cast<char>(value);
+}
+
+static void put_string(std::string& out, const std::string& text) 
+{
+  put_varint(out, text.size());
+  out += text;
+}
+
+static bool get_varint(const char*& p, const char* end, uint64_t& value) 
+{
+  value = 0;
+  for (int shift = 0; p < end && shift < 64; shift += 7) 
+  {
+    unsigned char byte = *p++;
+    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+static bool get_string(const char*& p, const char* end, std::string& text) 
+{
+  uint64_t size;
+  if (!get_varint(p, end, size) || size > static_cast<uint64_t>(end - p)) return false;
+  text.assign(p, size);
+  p += size;
+  return true;
+}
+
+// Append-only journals of buffer edits, one file per tab, for recovering unsaved work after a
+// crash. Tabs hand in encoded records from the main loop; a background thread appends them and
+// fdatasync()s every flush interval, so the cost follows the edits, not the size of the file.
+//
+// A journal is a header (file path, disk_stamp() of the file the edits apply to, language), an
+// optional snapshot of the whole text for buffers that differ from their file, then insert and
+// erase records with character offsets. Every record carries a checksum, replay stops at the first
+// torn one. Journals of live editors are flock()ed, so recover() only sees those left behind.
+class EditJournal 
+{
+  public:
+    struct Recovered 
+    {
+      std::string journal_path;
+      std::string path; // "" for an untitled buffer
+      std::string language;
+      std::string text;
+    };
+
+    explicit EditJournal(const std::string& directory) :
+      m_directory(directory),
+      m_next_id(1),
+      m_stop(false)
+    {
+      m_worker = std::thread(&EditJournal::run, this);
+    }
+
+    ~EditJournal() 
+    {
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+      }
+      m_wake.notify_all();
+      m_worker.join(); // Writes whatever is still pending first
+    }
+
+    EditJournal(const EditJournal&) = delete;
+    EditJournal& operator=(const EditJournal&) = delete;
+
+    const std::string& get_directory() const { return m_directory; }
+
+    // A new, empty journal; its file appears with the first flush
+    int open() 
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      int id = m_next_id++;
+      m_journals[id].path = m_directory + "/" + std::to_string(getpid()) + "-" + std::to_string(id) + "-" + std::to_string(time(nullptr)) + ".journal";
+      return id;
+    }
+
+    void append(int id, const std::string& records) 
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_journals[id].pending += records;
+    }
+
+    // Replaces everything in the journal with records, e.g. a new header after a save
+    void reset(int id, const std::string& records) 
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      Journal& journal = m_journals[id];
+      journal.pending = records;
+      journal.truncate = true;
+    }
+
+    // Deletes the journal, the buffer has nothing left to recover
+    void discard(int id) 
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      Journal& journal = m_journals[id];
+      journal.pending.clear();
+      journal.discard = true;
+    }
+
+    static std::string header_record(const std::string& path, const std::string& stamp, const std::string& language) 
+    {
+      std::string payload;
+      put_string(payload, path);
+      put_string(payload, stamp);
+      put_string(payload, language);
+      return record('H', payload);
+    }
+
+    static std::string snapshot_record(const std::string& text) 
+    {
+      return record('S', text);
+    }
+
+    static std::string insert_record(size_t offset, const char* text, size_t bytes) 
+    {
+      std::string payload;
+      put_varint(payload, offset);
+      payload.append(text, bytes);
+      return record('I', payload);
+    }
+
+    static std::string erase_record(size_t offset, size_t length) 
+    {
+      std::string payload;
+      put_varint(payload, offset);
+      put_varint(payload, length);
+      return record('E', payload);
+    }
+
+    // Replays the journals in directory that no running editor holds. Those that cannot be
+    // replayed, because the file they apply to has changed since, are reported in skipped.
+    static std::vector<Recovered> recover(const std::string& directory, std::vector<std::string>& skipped) 
+    {
+      std::vector<Recovered> recovered;
+      DIR* handle = opendir(directory.c_str());
+      if (!handle) return recovered;
+      std::vector<std::string> files;
+      while (struct dirent* entry = readdir(handle)) 
+      {
+        std::string name = entry->d_name;
+        if (name.size() > 8 && name.compare(name.size() - 8, 8, ".journal") == 0) files.push_back(directory + "/" + name);
+      }
+      closedir(handle);
+      std::sort(files.begin(), files.end());
+
+      for (const auto& file : files) 
+      {
+        int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+        bool ours = flock(fd, LOCK_EX | LOCK_NB) == 0; // Otherwise a running editor is still writing it
+        ::close(fd);
+        if (!ours) continue;
+
+        Recovered result;
+        result.journal_path = file;
+        bool edited = false;
+        std::string problem;
+        if (replay(file, result, edited, problem) && edited) 
+        {
+          recovered.push_back(std::move(result));
+        } 
+        else 
+        {
+          if (!problem.empty()) skipped.push_back(problem);
+          unlink(file.c_str()); // Nothing, or nothing usable, to recover
+        }
+      }
+      return recovered;
+    }
+
+  private:
+    static constexpr int flush_interval_ms = 1000;
+
+    struct Journal 
+    {
+      std::string path;
+      std::string pending; // Records not yet written
+      bool truncate = false;
+      bool discard = false;
+      int fd = -1;
+    };
+
+    static uint32_t checksum(char type, const char* data, size_t size) // FNV-1a
+    {
+      uint32_t hash = 2166136261u;
+      hash = (hash ^ static_cast<unsigned char>(type)) * 16777619u;
+      for (size_t i = 0; i < size; ++i) hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+      return hash;
+    }
+
+    // Type, payload size, payload, checksum
+    static std::string record(char type, const std::string& payload) 
+    {
+      std::string out(1, type);
+      put_varint(out, payload.size());
+      out += payload;
+      uint32_t sum = checksum(type, payload.data(), payload.size());
+      out.append(reinterpret_cast<const char*>(&sum), sizeof(sum));
+      return out;
+    }
+
+    // Byte position of a character offset. Edits cluster, so the search starts from where the
+    // previous one ended rather than from the top.
+    static size_t byte_position(const std::string& text, size_t offset, size_t& hint_chars, size_t& hint_bytes) 
+    {
+      if (offset < hint_chars / 2) hint_chars = hint_bytes = 0;
+      while (hint_chars > offset) 
+      {
+        do --hint_bytes; while (hint_bytes > 0 && (static_cast<unsigned char>(text[hint_bytes]) & 0xC0) == 0x80);
+        --hint_chars;
+      }
+      while (hint_chars < offset && hint_bytes < text.size()) 
+      {
+        do ++hint_bytes; while (hint_bytes < text.size() && (static_cast<unsigned char>(text[hint_bytes]) & 0xC0) == 0x80);
+        ++hint_chars;
+      }
+      return hint_bytes;
+    }
+
+    static bool replay(const std::string& file, Recovered& result, bool& edited, std::string& problem) 
+    {
+      MappedFile journal;
+      if (!journal.open(file) || journal.size() == 0) return false;
+      const char* p = journal.data();
+      const char* end = p + journal.size();
+      size_t hint_chars = 0, hint_bytes = 0;
+      bool have_text = false;
+      std::string stamp;
+      while (p < end) 
+      {
+        char type = *p++;
+        uint64_t size;
+        if (!get_varint(p, end, size) || size + sizeof(uint32_t) > static_cast<uint64_t>(end - p)) break; // Torn at the end
+        const char* payload = p;
+        const char* payload_end = p + size;
+        uint32_t sum;
+        memcpy(&sum, payload_end, sizeof(sum));
+        if (sum != checksum(type, payload, size)) break;
+        p = payload_end + sizeof(sum);
+
+        if (type == 'H') 
+        {
+          if (!get_string(payload, payload_end, result.path) || !get_string(payload, payload_end, stamp) || !get_string(payload, payload_end, result.language)) return false;
+        } 
+        else if (type == 'S') 
+        {
+          result.text.assign(payload, size);
+          have_text = true;
+          hint_chars = hint_bytes = 0;
+        } 
+        else if (type == 'I' || type == 'E') 
+        {
+          if (!have_text) // The edits start from the file as it was on disk
+          {
+            MappedFile base;
+            if (!result.path.empty() && (disk_stamp(result.path) != stamp || !base.open(result.path))) 
+            {
+              problem = result.path + " changed on disk after the unsaved edits were made";
+              return false;
+            }
+            result.text.assign(base.data() ? base.data() : "", base.size());
+            have_text = true;
+          }
+          uint64_t offset, length;
+          if (!get_varint(payload, payload_end, offset)) break;
+          size_t start = byte_position(result.text, offset, hint_chars, hint_bytes);
+          if (type == 'I') 
+          {
+            result.text.insert(start, payload, payload_end - payload);
+            hint_bytes += payload_end - payload;
+            hint_chars += g_utf8_strlen(payload, payload_end - payload);
+          } 
+          else 
+          {
+            if (!get_varint(payload, payload_end, length)) break;
+            size_t stop = byte_position(result.text, offset + length, hint_chars, hint_bytes);
+            result.text.erase(start, stop - start);
+            hint_chars = offset;
+            hint_bytes = start;
+          }
+          edited = true;
+        }
+      }
+      edited = edited || (have_text && result.path.empty() && !result.text.empty()); // An untitled snapshot alone is worth keeping
+      return have_text;
+    }
+
+    void run() 
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      while (true) 
+      {
+        m_wake.wait_for(lock, std::chrono::milliseconds(flush_interval_ms), [this] { return m_stop; });
+        bool stopping = m_stop;
+
+        // Takes the work out under the lock, then writes without it
+        struct Work 
+        {
+          int id;
+          std::string path;
+          std::string data;
+          bool truncate;
+          bool discard;
+          int fd;
+        };
+        std::vector<Work> work;
+        for (auto it = m_journals.begin(); it != m_journals.end();) 
+        {
+          Journal& journal = it->second;
+          if (!journal.pending.empty() || journal.truncate || journal.discard) 
+          {
+            work.push_back({it->first, journal.path, std::move(journal.pending), journal.truncate, journal.discard, journal.fd});
+            journal.pending.clear();
+            journal.truncate = false;
+          }
+          if (journal.discard) it = m_journals.erase(it);
+          else ++it;
+        }
+        lock.unlock();
+
+        std::vector<std::pair<int, int>> opened; // Journal id, new descriptor
+        for (auto& item : work) 
+        {
+          if (item.discard) 
+          {
+            if (item.fd >= 0) ::close(item.fd);
+            unlink(item.path.c_str());
+            continue;
+          }
+          if (item.fd < 0) 
+          {
+            make_directories(m_directory);
+            item.fd = ::open(item.path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+            if (item.fd < 0) continue;
+            flock(item.fd, LOCK_EX | LOCK_NB);
+            opened.push_back({item.id, item.fd});
+          }
+          if (item.truncate && ftruncate(item.fd, 0) != 0) continue;
+          size_t written = 0;
+          while (written < item.data.size()) 
+          {
+            ssize_t result = write(item.fd, item.data.data() + written, item.data.size() - written);
+            if (result < 0 && errno == EINTR) continue;
+            if (result <= 0) break;
+            written += result;
+          }
+          fdatasync(item.fd);
+        }
+
+        lock.lock();
+        for (const auto& entry : opened) 
+        {
+          auto journal = m_journals.find(entry.first);
+          if (journal != m_journals.end()) journal->second.fd = entry.second;
+          else // Discarded while we wrote
+          {
+            ::close(entry.second);
+          }
+        }
+        if (stopping) break;
+      }
+      for (auto& entry : m_journals) // Journals of tabs that were not closed, they stay for the next start
+      {
+        if (entry.second.fd >= 0) ::close(entry.second.fd);
+      }
+    }
+
+    std::string m_directory;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::map<int, Journal> m_journals;
+    int m_next_id;
+    bool m_stop;
+    std::thread m_worker;
+};
+
+// Tokens of C, C++ or Python source for the symbol index: identifiers ('i'), names defined by
+// #define ('m') and single punctuation characters ('p'). Comments, string and character literals,
+// numbers and other preprocessor lines are skipped. emit(kind, start, length, line, line_start)
+// gets the 0-based line and where it starts, for working out columns.
+template <class Emit> 
+static void lex_source(const char* p, const char* end, bool python, Emit&& emit) 
+{
+  uint32_t line = 0;
+  const char* line_start = p;
+  bool first_on_line = true;
+  auto newline = [&](const char* at) 
+  {
+    ++line;
+    line_start = at + 1;
+  };
+  auto is_word = [](char c) { return isalnum(static_cast<unsigned char>(c)) || c == '_' || static_cast<unsigned char>(c) >= 0x80; };
+
+  // A quoted literal, from p at its opening quote; Python's triple quotes span lines
+  auto skip_literal = [&](char quote) 
+  {
+    bool triple = python && end - p >= 3 && p[1] == quote && p[2] == quote;
+    p += triple ? 3 : 1;
+    while (p < end) 
+    {
+      if (*p == '\\' && p + 1 < end) 
+      {
+        if (p[1] == '\n') newline(p + 1);
+        p += 2;
+        continue;
+      }
+      if (*p == '\n') 
+      {
+        if (!triple) return; // Unterminated, the line ends it
+        newline(p);
+      }
+      if (*p == quote && (!triple || (end - p >= 3 && p[1] == quote && p[2] == quote))) 
+      {
+        p += triple ? 3 : 1;
+        return;
+      }
+      ++p;
+    }
+  };
+
+  while (p < end) 
+  {
+    char c = *p;
+    if (c == '\n') 
+    {
+      newline(p++);
+      first_on_line = true;
+      continue;
+    }
+    if (c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v') 
+    {
+      ++p;
+      continue;
+    }
+    bool directive = c == '#' && first_on_line && !python;
+    first_on_line = false;
+    if (c == '#' && python) 
+    {
+      while (p < end && *p != '\n') ++p;
+    } 
+    else if (directive) // Only the name of a #define is kept, the rest of the line goes
+    {
+      ++p;
+      while (p < end && (*p == ' ' || *p == '\t')) ++p;
+      if (end - p > 6 && memcmp(p, "define", 6) == 0 && !is_word(p[6])) 
+      {
+        p += 6;
+        while (p < end && (*p == ' ' || *p == '\t')) ++p;
+        const char* name = p;
+        while (p < end && is_word(*p)) ++p;
+        if (p > name) emit('m', name, static_cast<uint32_t>(p - name), line, line_start);
+      }
+      while (p < end && *p != '\n') 
+      {
+        if (*p == '\\' && p + 1 < end && p[1] == '\n') newline(++p); // Continued on the next line
+        ++p;
+      }
+    } 
+    else if (c == '/' && !python && p + 1 < end && p[1] == '/') 
+    {
+      while (p < end && *p != '\n') ++p;
+    } 
+    else if (c == '/' && !python && p + 1 < end && p[1] == '*') 
+    {
+      for (p += 2; p < end && !(*p == '*' && p + 1 < end && p[1] == '/'); ++p) 
+      {
+        if (*p == '\n') newline(p);
+      }
+      p = std::min(end, p + 2);
+    } 
+    else if (c == '"' || c == '\'') 
+    {
+      skip_literal(c);
+    } 
+    else if (is_word(c) && !isdigit(static_cast<unsigned char>(c))) 
+    {
+      const char* word = p;
+      while (p < end && is_word(*p)) ++p;
+      size_t length = p - word;
+      bool prefix = p < end && (*p == '"' || *p == '\''); // r"", b'', u8"", L'' and the like
+      if (prefix && !python && word[length - 1] == 'R' && *p == '"') // Raw string: R"delim( ... )delim"
+      {
+        const char* open = static_cast<const char*>(memchr(p, '(', std::min<size_t>(end - p, 18)));
+        std::string closing = ")" + std::string(p + 1, open ? open : p + 1) + "\"";
+        const char* close = open ? static_cast<const char*>(memmem(open, end - open, closing.data(), closing.size())) : nullptr;
+        const char* stop = close ? close + closing.size() : end;
+        for (; p < stop; ++p) 
+        {
+          if (*p == '\n') newline(p);
+        }
+      } 
+      else if (prefix && length <= 3) 
+      {
+        skip_literal(*p);
+      } 
+      else 
+      {
+        emit('i', word, static_cast<uint32_t>(length), line, line_start);
+      }
+    } 
+    else if (isdigit(static_cast<unsigned char>(c)) || (c == '.' && p + 1 < end && isdigit(static_cast<unsigned char>(p[1])))) 
+    {
+      while (p < end && (is_word(*p) || *p == '.' || *p == '\'' || ((*p == '+' || *p == '-') && (p[-1] == 'e' || p[-1] == 'E' || p[-1] == 'p' || p[-1] == 'P')))) ++p;
+    } 
+    else 
+    {
+      emit('p', p, 1, line, line_start);
+      ++p;
+    }
+  }
+}
+
+// Functions, classes, enums and macros of a project's C, C++ and Python files, kept current by
+// worker threads and cached on disk between runs. Files are reindexed when their disk_stamp()
+// changes: at startup, when the folder changes and when a file is saved. Besides definitions,
+// every file keeps the set of identifiers it uses, so find_references() only reads the files
+// that can contain the name.
+class SymbolIndex 
+{
+  public:
+    struct Definition 
+    {
+      std::string file; // Relative to the root
+      std::string name;
+      char kind; // 'f' function, 'c' class, struct or union, 'e' enum, 'm' macro
+      int line; // 0-based
+      int column; // In characters
+    };
+
+    explicit SymbolIndex(const std::string& cache_dir) :
+      m_cache_dir(cache_dir),
+      m_generation(0),
+      m_stop(false),
+      m_busy(false),
+      m_done_files(0),
+      m_total_files(0),
+      m_notified(false)
+    {
+      m_dispatcher.connect([this] 
+      {
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_notified = false;
+        }
+        m_signal_progress.emit();
+      });
+      m_thread = std::thread(&SymbolIndex::run, this);
+    }
+
+    ~SymbolIndex() 
+    {
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+      }
+      m_wake.notify_all();
+      m_thread.join();
+    }
+
+    SymbolIndex(const SymbolIndex&) = delete;
+    SymbolIndex& operator=(const SymbolIndex&) = delete;
+
+    // Emitted on the main loop as indexing progresses and when it is done
+    sigc::signal<void>& signal_progress() { return m_signal_progress; }
+
+    static bool indexable(const std::string& path) 
+    {
+      static const char* const extensions[] = {".c", ".cc", ".cpp", ".cxx", ".h", ".hh", ".hpp", ".hxx", ".py"};
+      for (const char* extension : extensions) 
+      {
+        size_t length = strlen(extension);
+        if (path.size() > length && path.compare(path.size() - length, length, extension) == 0) return true;
+      }
+      return false;
+    }
+
+    // Indexes a new folder, starting from its cache
+    void set_root(const std::string& root) 
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_root = root;
+      ++m_generation;
+      m_rescan = true;
+      m_pending.clear();
+      m_wake.notify_all();
+    }
+
+    // Files were created, removed or renamed: the next pass walks the folder again
+    void folder_changed() 
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_rescan = true;
+      m_wake.notify_all();
+    }
+
+    // A file was written, by us or anyone else
+    void file_changed(const std::string& path) 
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_root.empty() || path.compare(0, m_root.size() + 1, m_root + "/") != 0 || !indexable(path)) return;
+      m_pending.insert(path.substr(m_root.size() + 1));
+      m_wake.notify_all();
+    }
+
+    const std::string root() const 
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      return m_root;
+    }
+    bool busy() const { return m_busy; }
+    size_t done_files() const { return m_done_files; }
+    size_t total_files() const { return m_total_files; }
+    double last_pass_ms() const { return m_last_pass_ms; }
+
+    size_t file_count() const 
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      return m_files.size();
+    }
+
+    size_t definition_count() const 
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      size_t count = 0;
+      for (const auto& file : m_files) count += file.second.definitions.size();
+      return count;
+    }
+
+    // Where name is defined; those in near_file (relative) first, then those in its directory
+    std::vector<Definition> find_definitions(const std::string& name, const std::string& near_file) const 
+    {
+      std::vector<Definition> found; 
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto id = m_name_ids.find(name);
+        if (id == m_name_ids.end()) return found;
+        for (const auto& file : m_files) 
+        {
+          for (const auto& definition : file.second.definitions) 
+          {
+            if (definition.name == id->second) found.push_back({file.first, name, definition.kind, static_cast<int>(definition.line), static_cast<int>(definition.column)});
+          }
+        }
+      }
+      std::string near_directory = near_file.substr(0, near_file.rfind('/') + 1);
+      auto distance = [&](const Definition& definition) 
+      {
+        if (definition.file == near_file) return 0;
+        return definition.file.compare(0, near_directory.size(), near_directory) == 0 && definition.file.find('/', near_directory.size()) == std::string::npos ? 1 : 2;
+      };
+      std::stable_sort(found.begin(), found.end(), [&](const Definition& a, const Definition& b) 
+      {
+        int da = distance(a), db = distance(b);
+        return da != db ? da < db : std::tie(a.file, a.line) < std::tie(b.file, b.line);
+      });
+      return found;
+    }
+
+    // Every use of name as an identifier, outside comments and strings, up to limit. Only the files
+    // whose identifier set holds the name are read, on all cores.
+    std::vector<FileSearch::Match> find_references(const std::string& name, size_t limit) const 
+    {
+      std::string root;
+      std::vector<std::string> files; 
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        root = m_root;
+        auto id = m_name_ids.find(name);
+        if (id == m_name_ids.end()) return {};
+        for (const auto& file : m_files) 
+        {
+          if (std::binary_search(file.second.identifiers.begin(), file.second.identifiers.end(), id->second)) files.push_back(file.first);
+        }
+      }
+      std::sort(files.begin(), files.end());
+
+      std::vector<std::vector<FileSearch::Match>> per_file(files.size());
+      std::atomic<size_t> next(0);
+      auto work = [&]() 
+      {
+        for (size_t i; (i = next++) < files.size();) 
+        {
+          MappedFile source;
+          if (!source.open(root + "/" + files[i]) || !source.data()) continue;
+          const char* data = source.data();
+          const char* end = data + source.size();
+          lex_source(data, end, is_python(files[i]), [&](char kind, const char* start, uint32_t length, uint32_t line, const char* line_start) 
+          {
+            if (kind == 'p' || length != name.size() || memcmp(start, name.data(), length) != 0 || per_file[i].size() >= limit) return;
+            const char* line_end = static_cast<const char*>(memchr(start, '\n', end - start));
+            std::string text(line_start, line_end ? line_end : end);
+            std::string carry;
+            text = make_valid_utf8(carry, text);
+            size_t first = text.find_first_not_of(" \t");
+            text = first == std::string::npos ? "" : text.substr(first, 200);
+            per_file[i].push_back({files[i], static_cast<int>(line), static_cast<int>(g_utf8_strlen(line_start, start - line_start)), text});
+          });
+        }
+      };
+      std::vector<std::thread> threads;
+      size_t count = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), (files.size() + 31) / 32);
+      for (size_t i = 1; i < count; ++i) threads.emplace_back(work);
+      work();
+      for (auto& thread : threads) thread.join();
+
+      std::vector<FileSearch::Match> matches;
+      for (auto& file : per_file) 
+      {
+        for (auto& match : file) 
+        {
+          if (matches.size() >= limit) return matches;
+          matches.push_back(std::move(match));
+        }
+      }
+      return matches;
+    }
+
+  private:
+    struct FileDefinition 
+    {
+      uint32_t name; // Into m_names
+      char kind;
+      uint32_t line;
+      uint32_t column;
+    };
+
+    struct FileSymbols 
+    {
+      std::string stamp; // disk_stamp() when indexed
+      std::vector<FileDefinition> definitions;
+      std::vector<uint32_t> identifiers; // Sorted, distinct
+    };
+
+    // What parse() finds, before the names are interned
+    struct Parsed 
+    {
+      std::string stamp;
+      std::vector<std::pair<std::string, FileDefinition>> definitions;
+      std::vector<std::string> identifiers;
+    };
+
+    static constexpr char file_magic[8] = {'M', 'P', 'S', 'Y', 'M', 'B', 'S', '1'};
+
+    static bool is_python(const std::string& path) 
+    {
+      return path.size() > 3 && path.compare(path.size() - 3, 3, ".py") == 0;
+    }
+
+    static bool is_keyword(const std::string& word) 
+    {
+      static const std::set<std::string> keywords = {"if", "for", "while", "switch", "catch", "return", "sizeof", "alignof", "decltype", "typeof",
+        "noexcept", "static_assert", "__attribute__", "__declspec", "alignas", "throw", "new", "delete", "operator", "defined", "do", "else"};
+      return keywords.count(word) > 0;
+    }
+
+    // Definitions of a C or C++ file. Statements are collected token by token at file, namespace and
+    // class scope and classified when a brace opens; function bodies and initializers are skipped.
+    static void parse_c(const char* data, const char* end, Parsed& parsed) 
+    {
+      struct Token // Points into the file, columns are only worked out for definitions
+      {
+        const char* start;
+        uint32_t length;
+        bool identifier;
+        uint32_t line;
+        const char* line_start;
+
+        bool is(const char* word) const { return strlen(word) == length && memcmp(start, word, length) == 0; }
+        std::string text() const { return std::string(start, length); }
+      };
+      std::vector<Token> statement;
+      std::vector<bool> init_braces; // Open scopes we descend into: true for a constructor's member init
+      int skipping = 0; // Depth inside a skipped body
+      bool skipped_init = false; // The skipped braces are a member initializer, the statement goes on
+
+      auto define = [&](const Token& token, char kind) 
+      {
+        uint32_t column = static_cast<uint32_t>(g_utf8_strlen(token.line_start, token.start - token.line_start));
+        parsed.definitions.push_back({token.text(), {0, kind, token.line, column}});
+      };
+      auto classify = [&]() -> char // 'f' function, 'c' class, 'e' enum, 'n' namespace like, 'i' member init, 'o' other
+      {
+        size_t begin = 0;
+        if (!statement.empty() && statement[0].is("template")) // Its parameter list may say class
+        {
+          int depth = 0;
+          for (begin = 1; begin < statement.size(); ++begin) 
+          {
+            if (statement[begin].is("<")) ++depth;
+            else if (statement[begin].is(">") && --depth <= 0) break;
+          }
+          ++begin;
+        }
+        if (begin >= statement.size()) return 'o';
+        if (statement[begin].is("namespace") || statement[begin].is("extern")) return 'n';
+
+        // Member initializers: "Foo() : a(1), b{2} {", the brace after b is not the body
+        bool after_parameters = false;
+        for (size_t i = begin; i + 1 < statement.size(); ++i) 
+        {
+          if (statement[i].is(")") && statement[i + 1].is(":") && (i + 2 >= statement.size() || !statement[i + 2].is(":"))) after_parameters = true;
+        }
+        if (after_parameters && statement.back().identifier) return 'i';
+
+        int depth = 0;
+        size_t equals = std::string::npos, paren = std::string::npos, keyword = std::string::npos;
+        for (size_t i = begin; i < statement.size(); ++i) 
+        {
+          const Token& token = statement[i];
+          if (token.is("(")) 
+          {
+            if (depth++ == 0 && paren == std::string::npos && i > begin && statement[i - 1].identifier && !is_keyword(statement[i - 1].text())) paren = i;
+          } 
+          else if (token.is(")")) 
+          {
+            --depth;
+          } 
+          else if (depth == 0 && token.is("=") && equals == std::string::npos) 
+          {
+            equals = i;
+          } 
+          else if (depth == 0 && keyword == std::string::npos && paren == std::string::npos && (token.is("class") || token.is("struct") || token.is("union") || token.is("enum"))) 
+          {
+            keyword = i;
+          }
+        }
+        if (keyword != std::string::npos && equals == std::string::npos && paren == std::string::npos) 
+        {
+          // The name is the last identifier before the base clause: "class API Foo final : Base"
+          const Token* name = nullptr;
+          for (size_t i = keyword + 1; i < statement.size(); ++i) 
+          {
+            if (statement[i].is(":") && !(i + 1 < statement.size() && statement[i + 1].is(":")) && !(i > 0 && statement[i - 1].is(":"))) break;
+            if (statement[i].identifier && !statement[i].is("final") && !statement[i].is("class") && !statement[i].is("struct")) name = &statement[i];
+          }
+          bool is_enum = statement[keyword].is("enum");
+          if (name) define(*name, is_enum ? 'e' : 'c');
+          return is_enum ? 'e' : 'c';
+        }
+        if (paren != std::string::npos && (equals == std::string::npos || equals > paren)) 
+        {
+          bool destructor = paren >= 2 && statement[paren - 2].is("~"); // Would only crowd its class
+          if (!destructor && !(paren >= 2 && statement[paren - 2].is("operator"))) define(statement[paren - 1], 'f');
+          return 'f';
+        }
+        return 'o';
+      };
+
+      lex_source(data, end, false, [&](char kind, const char* start, uint32_t length, uint32_t line, const char* line_start) 
+      {
+        if (kind == 'm') 
+        {
+          parsed.definitions.push_back({std::string(start, length), {0, 'm', line, static_cast<uint32_t>(g_utf8_strlen(line_start, start - line_start))}});
+          return;
+        }
+        char c = kind == 'p' ? *start : 0;
+        if (skipping > 0) 
+        {
+          if (c == '{') ++skipping;
+          else if (c == '}' && --skipping == 0) 
+          {
+            if (skipped_init) statement.push_back({start, 1, false, line, line_start}); // The next brace is the body
+            else statement.clear();
+          }
+          return;
+        }
+        if (c == ';') 
+        {
+          statement.clear();
+        } 
+        else if (c == '{') 
+        {
+          char what = classify();
+          if (what == 'n' || what == 'c') 
+          {
+            init_braces.push_back(false);
+            statement.clear();
+          } 
+          else 
+          {
+            skipping = 1;
+            skipped_init = what == 'i';
+          }
+        } 
+        else if (c == '}') 
+        {
+          if (!init_braces.empty()) init_braces.pop_back();
+          statement.clear();
+        } 
+        else if (c == ':' && statement.size() == 1 && (statement[0].is("public") || statement[0].is("private") || statement[0].is("protected"))) 
+        {
+          statement.clear();
+        } 
+        else if (statement.size() < 512) // A runaway statement is most likely not a declaration anyway
+        {
+          statement.push_back({start, length, kind == 'i', line, line_start});
+        }
+      });
+    }
+
+    // Definitions of a Python file: def and class statements, at any depth
+    static void parse_python(const char* data, const char* end, Parsed& parsed) 
+    {
+      std::string previous;
+      lex_source(data, end, true, [&](char kind, const char* start, uint32_t length, uint32_t line, const char* line_start) 
+      {
+        if (kind == 'i' && (previous == "def" || previous == "class")) 
+        {
+          parsed.definitions.push_back({std::string(start, length), {0, previous == "def" ? 'f' : 'c', line, static_cast<uint32_t>(g_utf8_strlen(line_start, start - line_start))}});
+        }
+        previous = kind == 'i' ? std::string(start, length) : "";
+      });
+    }
+
+    static bool parse(const std::string& path, const std::string& relative, Parsed& parsed) 
+    {
+      MappedFile source;
+      parsed.stamp = disk_stamp(path);
+      if (!source.open(path)) return false;
+      if (source.size() >= large_file_threshold) return true; // Data or generated code, nothing to look up in
+      const char* data = source.data() ? source.data() : "";
+      const char* end = data + source.size();
+      if (is_python(relative)) parse_python(data, end, parsed);
+      else parse_c(data, end, parsed);
+
+      std::set<std::string> identifiers;
+      lex_source(data, end, is_python(relative), [&](char kind, const char* start, uint32_t length, uint32_t, const char*) 
+      {
+        if (kind != 'p') identifiers.emplace(start, length);
+      });
+      parsed.identifiers.assign(identifiers.begin(), identifiers.end());
+      return true;
+    }
+
+    uint32_t intern(const std::string& name) // Under m_mutex
+    {
+      auto found = m_name_ids.find(name);
+      if (found != m_name_ids.end()) return found->second;
+      m_names.push_back(name);
+      m_name_ids.emplace(name, m_names.size() - 1);
+      return m_names.size() - 1;
+    }
+
+    void store(const std::string& relative, Parsed& parsed) // Under m_mutex
+    {
+      FileSymbols& file = m_files[relative];
+      file.stamp = std::move(parsed.stamp);
+      file.definitions.clear();
+      for (auto& definition : parsed.definitions) 
+      {
+        definition.second.name = intern(definition.first);
+        file.definitions.push_back(definition.second);
+      }
+      file.identifiers.clear();
+      for (const auto& identifier : parsed.identifiers) file.identifiers.push_back(intern(identifier));
+      std::sort(file.identifiers.begin(), file.identifiers.end());
+    }
+
+    std::string cache_path(const std::string& root) const 
+    {
+      return m_cache_dir + "/" + BuildCache::make_key(root, "symbols", "");
+    }
+
+    // Names are written once in a table, files refer to them by number; identifier sets are delta coded
+    std::string serialize() const // Under m_mutex
+    {
+      std::unordered_map<uint32_t, uint32_t> renumbered; // Names still in use get dense numbers
+      std::vector<uint32_t> order;
+      auto number = [&](uint32_t id) 
+      {
+        auto found = renumbered.emplace(id, order.size());
+        if (found.second) order.push_back(id);
+        return found.first->second;
+      };
+      std::string files;
+      put_varint(files, m_files.size());
+      for (const auto& entry : m_files) 
+      {
+        put_string(files, entry.first);
+        put_string(files, entry.second.stamp);
+        put_varint(files, entry.second.definitions.size());
+        for (const auto& definition : entry.second.definitions) 
+        {
+          put_varint(files, number(definition.name));
+          files += definition.kind;
+          put_varint(files, definition.line);
+          put_varint(files, definition.column);
+        }
+        std::vector<uint32_t> identifiers;
+        for (uint32_t id : entry.second.identifiers) identifiers.push_back(number(id));
+        std::sort(identifiers.begin(), identifiers.end());
+        put_varint(files, identifiers.size());
+        uint32_t previous = 0;
+        for (uint32_t id : identifiers) 
+        {
+          put_varint(files, id - previous);
+          previous = id;
+        }
+      }
+      std::string data(file_magic, sizeof(file_magic));
+      put_string(data, m_root);
+      put_varint(data, order.size());
+      for (uint32_t id : order) put_string(data, m_names[id]);
+      return data + files;
+    }
+
+    bool deserialize(const std::string& root, const char* p, const char* end) // Under m_mutex
+    {
+      if (end - p < static_cast<ptrdiff_t>(sizeof(file_magic)) || memcmp(p, file_magic, sizeof(file_magic)) != 0) return false;
+      p += sizeof(file_magic);
+      std::string saved_root;
+      uint64_t count;
+      if (!get_string(p, end, saved_root) || saved_root != root || !get_varint(p, end, count)) return false;
+      std::vector<uint32_t> ids;
+      for (uint64_t i = 0; i < count; ++i) 
+      {
+        std::string name;
+        if (!get_string(p, end, name)) return false;
+        ids.push_back(intern(name));
+      }
+      if (!get_varint(p, end, count)) return false;
+      for (uint64_t i = 0; i < count; ++i) 
+      {
+        std::string relative;
+        FileSymbols file;
+        uint64_t definitions, identifiers, name, line, column, delta;
+        if (!get_string(p, end, relative) || !get_string(p, end, file.stamp) || !get_varint(p, end, definitions)) return false;
+        for (uint64_t j = 0; j < definitions; ++j) 
+        {
+          if (!get_varint(p, end, name) || name >= ids.size() || p >= end) return false;
+          char kind = *p++;
+          if (!get_varint(p, end, line) || !get_varint(p, end, column)) return false;
+          file.definitions.push_back({ids[name], kind, static_cast<uint32_t>(line), static_cast<uint32_t>(column)});
+        }
+        if (!get_varint(p, end, identifiers)) return false;
+        uint64_t id = 0;
+        for (uint64_t j = 0; j < identifiers; ++j) 
+        {
+          if (!get_varint(p, end, delta) || (id += delta) >= ids.size()) return false;
+          file.identifiers.push_back(ids[id]);
+        }
+        std::sort(file.identifiers.begin(), file.identifiers.end());
+        m_files.emplace(std::move(relative), std::move(file));
+      }
+      return true;
+    }
+
+    void notify() 
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_notified) return;
+      m_notified = true;
+      m_dispatcher.emit();
+    }
+
+    // Waits for work: a new root (load its cache, then a full pass), a folder change (a full pass)
+    // or saved files (just those). A full pass stats every file and reparses what changed.
+    void run() 
+    {
+      unsigned loaded_generation = 0;
+      while (true) 
+      {
+        std::string root;
+        std::vector<std::string> paths;
+        bool full;
+        unsigned generation; 
+        {
+          std::unique_lock<std::mutex> lock(m_mutex);
+          m_wake.wait(lock, [this] { return m_stop || m_rescan || !m_pending.empty(); });
+          if (m_stop) return;
+          root = m_root;
+          generation = m_generation;
+          full = m_rescan;
+          m_rescan = false;
+          paths.assign(m_pending.begin(), m_pending.end());
+          m_pending.clear();
+          if (generation != loaded_generation) // A new folder: drop the old one, read the cache
+          {
+            m_files.clear();
+            m_names.clear();
+            m_name_ids.clear();
+            MappedFile cache;
+            if (cache.open(cache_path(root)) && cache.data() && !deserialize(root, cache.data(), cache.data() + cache.size())) 
+            {
+              m_files.clear(); // A damaged cache is no cache
+            }
+            loaded_generation = generation;
+          }
+        }
+        if (root.empty()) continue;
+        m_busy = true;
+        auto start = std::chrono::steady_clock::now();
+
+        std::vector<std::string> stale; // Gone from disk
+        if (full) 
+        {
+          std::set<std::string> present;
+          for (auto& path : list_project_files(root, m_stop)) 
+          {
+            if (indexable(path)) present.insert(std::move(path));
+          }
+          if (m_stop) return; // The walk was cut short
+          std::lock_guard<std::mutex> lock(m_mutex);
+          for (const auto& file : m_files) 
+          {
+            if (!present.count(file.first)) stale.push_back(file.first);
+          }
+          paths.clear();
+          for (const auto& path : present) 
+          {
+            auto known = m_files.find(path);
+            if (known == m_files.end() || known->second.stamp != disk_stamp(root + "/" + path)) paths.push_back(path);
+          }
+        }
+
+        m_done_files = 0;
+        m_total_files = paths.size();
+        notify();
+        std::atomic<size_t> next(0);
+        auto work = [&]() 
+        {
+          for (size_t i; (i = next++) < paths.size();) 
+          {
+            Parsed parsed;
+            bool ok = parse(root + "/" + paths[i], paths[i], parsed); 
+            {
+              std::lock_guard<std::mutex> lock(m_mutex);
+              if (m_generation != generation || m_stop) return; // Another folder now
+              if (ok) store(paths[i], parsed);
+              else m_files.erase(paths[i]);
+            }
+            if (++m_done_files % 256 == 0) notify();
+          }
+        };
+        std::vector<std::thread> workers;
+        for (unsigned i = 1; i < std::max(1u, std::thread::hardware_concurrency()); ++i) workers.emplace_back(work);
+        work();
+        for (auto& worker : workers) worker.join();
+
+        std::string data; 
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          if (m_stop) return;
+          if (m_generation != generation) continue;
+          for (const auto& path : stale) m_files.erase(path);
+          if (!paths.empty() || !stale.empty() || full) data = serialize();
+        }
+        if (!data.empty() && make_directories(m_cache_dir)) write_file_atomically(cache_path(root), data);
+        m_last_pass_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        m_busy = false;
+        notify();
+      }
+    }
+
+    std::string m_cache_dir;
+    mutable std::mutex m_mutex; // Guards everything below up to the counters
+    std::condition_variable m_wake;
+    std::string m_root;
+    unsigned m_generation; // Bumped by set_root(), so a pass for an older root drops its results
+    std::atomic<bool> m_stop;
+    bool m_rescan = false;
+    std::set<std::string> m_pending; // Saved files, relative
+    std::map<std::string, FileSymbols> m_files; // By relative path
+    std::vector<std::string> m_names; // Interned definition names and identifiers
+    std::unordered_map<std::string, uint32_t> m_name_ids;
+
+    std::atomic<bool> m_busy;
+    std::atomic<size_t> m_done_files;
+    std::atomic<size_t> m_total_files;
+    std::atomic<double> m_last_pass_ms{0};
+    bool m_notified; // Under m_mutex
+    Glib::Dispatcher m_dispatcher;
+    sigc::signal<void> m_signal_progress;
+    std::thread m_thread; // Last, it starts in the constructor
+};
+
+constexpr char SymbolIndex::file_magic[8];
+
+// Line positions of a mapped file for large-file mode. A background thread scans the file once and
+// keeps a checkpoint every 1024 lines, or every MB for files with very long lines, so the index
+// stays small for a file of any size. Between checkpoints, lines are counted on demand with memchr().
+class LineIndex 
+{
+  public:
+    LineIndex(const char* data, size_t size) :
+      m_data(data),
+      m_size(size),
+      m_scanned(0),
+      m_cancelled(false)
+    {
+      m_checkpoints.push_back({0, 0});
+      m_dispatcher.connect([this] { m_signal_progress.emit(); });
+      m_thread = std::thread(&LineIndex::run, this);
+    }
+
+    ~LineIndex() 
+    {
+      m_cancelled = true;
+      m_thread.join();
+    }
+
+    LineIndex(const LineIndex&) = delete;
+    LineIndex& operator=(const LineIndex&) = delete;
+
+    // Emitted on the main loop every few dozen MB scanned, and when done
+    sigc::signal<void>& signal_progress() { return m_signal_progress; }
+
+    bool done() const { return m_scanned == m_size; }
+    double progress() const { return m_size ? static_cast<double>(m_scanned) / m_size : 1.0; }
+
+    // Newlines in [0, offset), -1 while the scan has not got that far
+    int64_t newlines_before(uint64_t offset) const 
+    {
+      if (offset > m_scanned) return -1;
+      Checkpoint checkpoint = find([offset](const Checkpoint& c) { return c.offset <= offset; });
+      return checkpoint.lines + count(m_data + checkpoint.offset, m_data + offset);
+    }
+
+    // Where line (0-based) starts, -1 if the scan has not got that far or there is no such line
+    int64_t line_start(uint64_t line) const 
+    {
+      if (line == 0) return 0;
+      Checkpoint checkpoint = find([line](const Checkpoint& c) { return c.lines < line; });
+      const char* end = m_data + m_scanned;
+      const char* p = m_data + checkpoint.offset;
+      for (uint64_t lines = checkpoint.lines; p < end; ++lines) 
+      {
+        const char* newline = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!newline) break;
+        p = newline + 1;
+        if (lines + 1 == line) return p - m_data;
+      }
+      return -1;
+    }
+
+  private:
+    struct Checkpoint 
+    {
+      uint64_t offset;
+      uint64_t lines; // Newlines before offset
+    };
+
+    static uint64_t count(const char* p, const char* end) 
+    {
+      uint64_t lines = 0;
+      while (p < end && (p = static_cast<const char*>(memchr(p, '\n', end - p)))) 
+      {
+        ++lines;
+        ++p;
+      }
+      return lines;
+    }
+
+    // The last checkpoint that still satisfies before(), checkpoints being ordered
+    template <class Before> 
+    Checkpoint find(Before before) const 
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      auto after = std::partition_point(m_checkpoints.begin(), m_checkpoints.end(), before);
+      return *(after - 1); // The first one, {0, 0}, satisfies both uses
+    }
+
+    void run() 
+    {
+      const size_t max_gap = 1024 * 1024;
+      const size_t progress_step = 64 * 1024 * 1024;
+      const char* p = m_data;
+      const char* end = m_data + m_size;
+      uint64_t lines = 0;
+      uint64_t last = 0; // Offset of the newest checkpoint
+      size_t next_progress = progress_step;
+      while (p < end && !m_cancelled) 
+      {
+        const char* limit = std::min(end, m_data + last + max_gap);
+        const char* newline = static_cast<const char*>(memchr(p, '\n', limit - p));
+        p = newline ? newline + 1 : limit;
+        lines += newline != nullptr;
+        if (p < end && (!newline || lines % 1024 == 0)) 
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_checkpoints.push_back({static_cast<uint64_t>(p - m_data), lines});
+          last = p - m_data;
+          m_scanned = last; // Published with the checkpoint that covers it
+        }
+        if (static_cast<size_t>(p - m_data) >= next_progress) 
+        {
+          // The pages scanned so far leave the process, they stay in the page cache for the view
+          madvise(const_cast<char*>(m_data) + next_progress - progress_step, progress_step, MADV_DONTNEED);
+          next_progress += progress_step;
+          m_dispatcher.emit();
+        }
+      }
+      if (m_cancelled) return;
+      m_scanned = m_size;
+      m_dispatcher.emit();
+    }
+
+    const char* m_data;
+    size_t m_size;
+    mutable std::mutex m_mutex; // Guards m_checkpoints
+    std::vector<Checkpoint> m_checkpoints;
+    std::atomic<uint64_t> m_scanned; // Lines are known up to here
+    std::atomic<bool> m_cancelled;
+    Glib::Dispatcher m_dispatcher;
+    sigc::signal<void> m_signal_progress;
+    std::thread m_thread; // Last, it starts in the constructor
+};
+
+// The text of a large file as a piece table: spans of the read-only mapping of the file and of an
+// append-only buffer of typed text, in document order. Opening costs the mmap() and nothing more;
+// an edit only splits a span and adds one, whatever the size of the file.
+class PieceTable 
+{
+  public:
+    PieceTable() : m_size(0) {}
+
+    void reset(std::shared_ptr<const MappedFile> original) 
+    {
+      m_original = original;
+      m_added.clear();
+      m_pieces.clear();
+      if (original->size() > 0) m_pieces.push_back({false, 0, original->size(), -1});
+      m_size = original->size();
+    }
+
+    uint64_t size() const { return m_size; }
+
+    void insert(uint64_t offset, const std::string& text) 
+    {
+      if (text.empty()) return;
+      size_t index = split(offset);
+      if (index > 0 && m_pieces[index - 1].added && m_pieces[index - 1].start + m_pieces[index - 1].length == m_added.size()) 
+      {
+        m_pieces[index - 1].length += text.size(); // Typing on: the last span grows
+        m_pieces[index - 1].newlines = -1;
+      } 
+      else 
+      {
+        m_pieces.insert(m_pieces.begin() + index, {true, m_added.size(), text.size(), -1});
+      }
+      m_added += text;
+      m_size += text.size();
+    }
+
+    void erase(uint64_t offset, uint64_t length) 
+    {
+      length = std::min(length, m_size - std::min(offset, m_size));
+      if (length == 0) return;
+      size_t first = split(offset);
+      size_t last = split(offset + length);
+      m_pieces.erase(m_pieces.begin() + first, m_pieces.begin() + last);
+      m_size -= length;
+    }
+
+    // Appends length bytes from offset on, or what there is of them, to out
+    void read(uint64_t offset, uint64_t length, std::string& out) const 
+    {
+      uint64_t start = 0;
+      for (const auto& piece : m_pieces) 
+      {
+        if (length == 0) break;
+        if (offset < start + piece.length) 
+        {
+          uint64_t skip = offset - start;
+          uint64_t take = std::min(length, piece.length - skip);
+          out.append(data(piece) + skip, take);
+          offset += take;
+          length -= take;
+        }
+        start += piece.length;
+      }
+    }
+
+    // Position of the first c in [from, from + limit), or from + limit clamped to size()
+    uint64_t find_forward(uint64_t from, char c, uint64_t limit) const 
+    {
+      uint64_t end = std::min(m_size, from + limit);
+      uint64_t start = 0;
+      for (const auto& piece : m_pieces) 
+      {
+        if (from >= end) break;
+        if (from < start + piece.length) 
+        {
+          const char* base = data(piece);
+          uint64_t stop = std::min(end, start + piece.length);
+          if (const void* found = memchr(base + (from - start), c, stop - from)) return start + (static_cast<const char*>(found) - base);
+          from = stop;
+        }
+        start += piece.length;
+      }
+      return end;
+    }
+
+    // Position just after the last c in [before - limit, before), or before - limit clamped to 0
+    uint64_t find_backward(uint64_t before, char c, uint64_t limit) const 
+    {
+      uint64_t begin = before - std::min(before, limit);
+      uint64_t end = m_size;
+      for (size_t i = m_pieces.size(); i-- > 0 && before > begin;) 
+      {
+        uint64_t start = end - m_pieces[i].length;
+        if (before > start) // And before <= end, the pieces after this one lie past it
+        {
+          const char* base = data(m_pieces[i]);
+          uint64_t from = std::max(begin, start);
+          if (const void* found = memrchr(base + (from - start), c, before - from)) return start + (static_cast<const char*>(found) - base) + 1;
+          before = from;
+        }
+        end = start;
+      }
+      return begin;
+    }
+
+    // Newlines before offset, -1 while the index has not got that far into the original
+    int64_t newlines_before(uint64_t offset, const LineIndex& index) const 
+    {
+      int64_t lines = 0;
+      uint64_t start = 0;
+      for (const auto& piece : m_pieces) 
+      {
+        if (offset <= start) break;
+        int64_t count = offset >= start + piece.length ? piece_newlines(piece, index) : newlines_in(piece, offset - start, index);
+        if (count < 0) return -1;
+        lines += count;
+        start += piece.length;
+      }
+      return lines;
+    }
+
+    // Where line starts, -1 if it is not indexed yet or past the end
+    int64_t line_start(uint64_t line, const LineIndex& index) const 
+    {
+      if (line == 0) return 0;
+      uint64_t start = 0;
+      for (const auto& piece : m_pieces) 
+      {
+        int64_t count = piece_newlines(piece, index);
+        if (count < 0) return -1;
+        if (static_cast<uint64_t>(count) >= line) // The line begins after one of this span's newlines
+        {
+          if (piece.added) 
+          {
+            const char* base = data(piece);
+            const char* p = base;
+            for (uint64_t i = 0; i < line; ++i) p = static_cast<const char*>(memchr(p, '\n', base + piece.length - p)) + 1;
+            return start + (p - base);
+          }
+          int64_t before = index.newlines_before(piece.start);
+          int64_t found = before < 0 ? -1 : index.line_start(before + line);
+          return found < 0 ? -1 : found - piece.start + start;
+        }
+        line -= count;
+        start += piece.length;
+      }
+      return -1;
+    }
+
+    // The spans to write, in order. They point into the mapping and into a copy of the typed text,
+    // which keep_alive owns, so the document may go on changing while they are written.
+    std::vector<std::pair<const char*, size_t>> spans(std::shared_ptr<const void>& keep_alive) const 
+    {
+      auto added = std::make_shared<std::pair<std::shared_ptr<const MappedFile>, std::string>>(m_original, m_added);
+      std::vector<std::pair<const char*, size_t>> spans;
+      for (const auto& piece : m_pieces) 
+      {
+        const char* base = piece.added ? added->second.data() : m_original->data();
+        spans.push_back({base + piece.start, piece.length});
+      }
+      keep_alive = added;
+      return spans;
+    }
+
+  private:
+    struct Piece 
+    {
+      bool added; // In m_added, otherwise in the original
+      uint64_t start;
+      uint64_t length;
+      mutable int64_t newlines; // Cached count, -1 until known
+    };
+
+    const char* data(const Piece& piece) const 
+    {
+      return (piece.added ? m_added.data() : m_original->data()) + piece.start;
+    }
+
+    int64_t piece_newlines(const Piece& piece, const LineIndex& index) const 
+    {
+      if (piece.newlines < 0) piece.newlines = newlines_in(piece, piece.length, index);
+      return piece.newlines;
+    }
+
+    // Newlines in the first length bytes of piece
+    int64_t newlines_in(const Piece& piece, uint64_t length, const LineIndex& index) const 
+    {
+      if (!piece.added) 
+      {
+        int64_t end = index.newlines_before(piece.start + length);
+        return end < 0 ? -1 : end - index.newlines_before(piece.start);
+      }
+      int64_t lines = 0;
+      for (const char* p = data(piece), *end = p + length; (p = static_cast<const char*>(memchr(p, '\n', end - p))); ++p) ++lines;
+      return lines;
+    }
+
+    // Index of the piece that starts at offset, splitting the one it falls in
+    size_t split(uint64_t offset) 
+    {
+      uint64_t start = 0;
+      for (size_t i = 0; i < m_pieces.size(); ++i) 
+      {
+        if (offset == start) return i;
+        if (offset < start + m_pieces[i].length) 
+        {
+          Piece tail = {m_pieces[i].added, m_pieces[i].start + (offset - start), m_pieces[i].length - (offset - start), -1};
+          m_pieces[i].length = offset - start;
+          m_pieces[i].newlines = -1;
+          m_pieces.insert(m_pieces.begin() + i + 1, tail);
+          return i + 1;
+        }
+        start += m_pieces[i].length;
+      }
+      return m_pieces.size();
+    }
+
+    std::shared_ptr<const MappedFile> m_original;
+    std::string m_added; // Everything ever typed, spans refer into it
+    std::vector<Piece> m_pieces;
+    uint64_t m_size;
+};
+
+// The editor of a large-file tab. Only the rows on screen are read from the PieceTable and laid
+// out, so scrolling, typing and jumping cost the same at any file size. The scrollbar runs over
+// bytes, since line numbers are only known as far as the LineIndex has got; until then the gutter
+// stays blank. Lines longer than 64 KB are shown as 64 KB rows. There is no highlighting,
+// selection or undo.
+class LargeFileView : public Gtk::Box 
+{
+  public:
+    LargeFileView() :
+      Gtk::Box(Gtk::ORIENTATION_HORIZONTAL),
+      m_adjustment(Gtk::Adjustment::create(0, 0, 1, 1, 1, 1)),
+      m_scrollbar(m_adjustment, Gtk::ORIENTATION_VERTICAL),
+      m_top(0),
+      m_cursor(0),
+      m_goal_column(-1),
+      m_x_offset(0),
+      m_gutter(0),
+      m_line_height(1),
+      m_digit_width(1),
+      m_scroll_delta(0),
+      m_pending_line(-1),
+      m_pending_column(0),
+      m_modified(false),
+      m_updating_scrollbar(false)
+    {
+      m_area.set_name("my-ide-large-view");
+      m_area.get_style_context()->add_class("view"); // Text view colors, in any theme
+      m_area.set_can_focus(true);
+      m_area.add_events(Gdk::KEY_PRESS_MASK | Gdk::BUTTON_PRESS_MASK | Gdk::SCROLL_MASK | Gdk::SMOOTH_SCROLL_MASK);
+      m_area.signal_draw().connect(sigc::mem_fun(*this, &LargeFileView::on_draw_area));
+      m_area.signal_realize().connect(sigc::mem_fun(*this, &LargeFileView::measure_font)); // On the screen's resolution
+      m_area.signal_size_allocate().connect([this](Gtk::Allocation&) { relayout(); });
+      m_area.signal_key_press_event().connect(sigc::mem_fun(*this, &LargeFileView::on_area_key_press));
+      m_area.signal_button_press_event().connect(sigc::mem_fun(*this, &LargeFileView::on_area_button_press));
+      m_area.signal_scroll_event().connect(sigc::mem_fun(*this, &LargeFileView::on_area_scroll));
+      m_adjustment->signal_value_changed().connect(sigc::mem_fun(*this, &LargeFileView::on_scrollbar_moved));
+      pack_start(m_area, Gtk::PACK_EXPAND_WIDGET);
+      pack_start(m_scrollbar, Gtk::PACK_SHRINK);
+      set_font("");
+    }
+
+    // Shows file from the top, unmodified, and starts indexing its lines
+    void open(std::shared_ptr<const MappedFile> file) 
+    {
+      m_index.reset(); // Its scan must end before the old mapping can go
+      m_text.reset(file);
+      m_index = std::make_unique<LineIndex>(file->data(), file->size());
+      m_index->signal_progress().connect(sigc::mem_fun(*this, &LargeFileView::on_index_progress));
+      m_top = 0;
+      m_cursor = 0;
+      m_goal_column = -1;
+      m_x_offset = 0;
+      set_modified(false);
+      relayout();
+      m_signal_cursor_moved.emit();
+    }
+
+    // Like open(), but keeps the scroll position and the cursor, e.g. after saving or a reload
+    void reopen(std::shared_ptr<const MappedFile> file) 
+    {
+      uint64_t top = m_top;
+      uint64_t cursor = m_cursor;
+      open(file);
+      m_cursor = std::min<uint64_t>(cursor, file->size());
+      m_top = row_start(std::min<uint64_t>(top, file->size()));
+      ensure_cursor_visible();
+    }
+
+    // The text to write out, see PieceTable::spans()
+    std::vector<std::pair<const char*, size_t>> snapshot(std::shared_ptr<const void>& keep_alive) const 
+    {
+      return m_text.spans(keep_alive);
+    }
+
+    bool is_modified() const { return m_modified; }
+    void set_modified(bool modified) 
+    {
+      if (modified == m_modified) return;
+      m_modified = modified;
+      m_signal_modified_changed.emit();
+    }
+
+    uint64_t size() const { return m_text.size(); }
+    bool index_done() const { return !m_index || m_index->done(); }
+    double index_progress() const { return m_index ? m_index->progress() : 1.0; }
+
+    // Line (-1 while not indexed that far) and column of the cursor, 0-based
+    void get_cursor(int64_t& line, int& column) const 
+    {
+      line = m_index ? m_text.newlines_before(m_cursor, *m_index) : -1;
+      column = count_chars(row_start(m_cursor), m_cursor);
+    }
+
+    // Moves the cursor to line and column, once the index has got that far
+    void go_to(int line, int column) 
+    {
+      m_pending_line = line;
+      m_pending_column = column;
+      apply_pending_cursor();
+    }
+
+    void set_font(const std::string& font_desc) 
+    {
+      m_font = Pango::FontDescription(font_desc.empty() ? "Monospace 10" : font_desc);
+      measure_font();
+    }
+
+    sigc::signal<void>& signal_modified_changed() { return m_signal_modified_changed; }
+    sigc::signal<void>& signal_cursor_moved() { return m_signal_cursor_moved; }
+    sigc::signal<void>& signal_index_progress() { return m_signal_index_progress; }
+
+  private:
+    static constexpr uint64_t max_row = 64 * 1024; // Longer lines are cut into rows of this many bytes
+    static constexpr int padding = 6; // Pixels around the line numbers
+
+    // Bytes [start, end) of a row and where the next one starts, after its newline if it has one
+    struct Row 
+    {
+      uint64_t start;
+      uint64_t end;
+      uint64_t next;
+      int64_t line; // For the rows on screen: 0-based line, or -1 if it continues a line or is not indexed yet
+    };
+
+    Row row_at(uint64_t start) const 
+    {
+      uint64_t end = m_text.find_forward(start, '\n', max_row);
+      bool newline = end < std::min(m_text.size(), start + max_row);
+      return {start, end, newline ? end + 1 : end, -1};
+    }
+
+    bool is_last(const Row& row) const { return row.next == row.end && row.end == m_text.size(); }
+
+    // Whether the cursor at offset is drawn in row; at a cut between two rows it is in the second
+    bool contains(const Row& row, uint64_t offset) const 
+    {
+      return offset >= row.start && (offset < row.end || (offset == row.end && (row.next > row.end || is_last(row))));
+    }
+
+    // Start of the row holding offset. row_at() cuts a long line every max_row bytes from its start, so
+    // past one row's worth without a newline this finds the line start and snaps down to that grid.
+    uint64_t row_start(uint64_t offset) const 
+    {
+      uint64_t start = m_text.find_backward(offset, '\n', max_row);
+      if (offset - start < max_row) return start;
+      start = m_text.find_backward(start, '\n', start); // Only long lines pay for the unbounded search
+      uint64_t rows = (offset - start) / max_row;
+      if (offset == m_text.size() && (offset - start) % max_row == 0) --rows; // The walk ends at the text, no empty row after
+      return start + rows * max_row;
+    }
+
+    uint64_t previous_row(uint64_t start) const { return start == 0 ? 0 : row_start(start - 1); }
+
+    uint64_t previous_char(uint64_t offset) const 
+    {
+      uint64_t from = offset - std::min<uint64_t>(offset, 4);
+      std::string bytes;
+      m_text.read(from, offset - from, bytes);
+      size_t i = bytes.size();
+      while (i > 1 && (static_cast<unsigned char>(bytes[i - 1]) & 0xC0) == 0x80) --i;
+      return i > 0 ? from + i - 1 : offset;
+    }
+
+    uint64_t next_char(uint64_t offset) const 
+    {
+      std::string bytes;
+      m_text.read(offset, 4, bytes);
+      size_t i = bytes.empty() ? 0 : 1;
+      while (i < bytes.size() && (static_cast<unsigned char>(bytes[i]) & 0xC0) == 0x80) ++i;
+      return offset + i;
+    }
+
+    int count_chars(uint64_t from, uint64_t to) const 
+    {
+      std::string bytes;
+      m_text.read(from, to - from, bytes);
+      return g_utf8_strlen(bytes.data(), bytes.size());
+    }
+
+    // Offset of the column'th character of row, or its end
+    uint64_t advance(const Row& row, int column) const 
+    {
+      std::string bytes;
+      m_text.read(row.start, row.end - row.start, bytes);
+      size_t i = 0;
+      for (int n = 0; n < column && i < bytes.size(); ++n) 
+      {
+        ++i;
+        while (i < bytes.size() && (static_cast<unsigned char>(bytes[i]) & 0xC0) == 0x80) ++i;
+      }
+      return row.start + i;
+    }
+
+    // The row as Pango can take it: invalid UTF-8 and NULs become '?', byte for byte, so offsets
+    // into the text are offsets into the row
+    std::string row_text(const Row& row) const 
+    {
+      std::string bytes;
+      m_text.read(row.start, row.end - row.start, bytes);
+      std::string carry;
+      std::string text = make_valid_utf8(carry, bytes);
+      text.append(carry.size(), '?');
+      for (char& c : text) 
+      {
+        if (c == '\0') c = '?';
+        else if (c == '\r') c = ' '; // CRLF files
+      }
+      return text;
+    }
+
+    Glib::RefPtr<Pango::Layout> row_layout(const Row& row) 
+    {
+      auto layout = m_area.create_pango_layout(row_text(row));
+      layout->set_font_description(m_font);
+      layout->set_single_paragraph_mode(true); // One row, whatever separators it holds
+      return layout;
+    }
+
+    int visible_rows() const { return std::max(1, m_area.get_allocated_height() / m_line_height); }
+
+    void measure_font() 
+    {
+      auto layout = m_area.create_pango_layout("0");
+      layout->set_font_description(m_font);
+      layout->get_pixel_size(m_digit_width, m_line_height);
+      m_line_height = std::max(m_line_height, 1);
+      relayout();
+    }
+
+    // Works out the rows on screen from m_top, the gutter and the scrollbar
+    void relayout() 
+    {
+      uint64_t size = m_text.size();
+      m_top = std::min(m_top, size);
+      m_rows.clear();
+      std::string before;
+      if (m_top > 0) m_text.read(m_top - 1, 1, before);
+      bool line_start = before.empty() || before[0] == '\n';
+      int64_t line = m_index ? m_text.newlines_before(m_top, *m_index) : -1;
+      uint64_t start = m_top;
+      for (int y = 0; y < m_area.get_allocated_height() || m_rows.empty(); y += m_line_height) 
+      {
+        Row row = row_at(start);
+        row.line = line_start ? line : -1;
+        m_rows.push_back(row);
+        if (is_last(row)) break;
+        line_start = row.next > row.end;
+        if (line >= 0 && line_start) ++line;
+        start = row.next;
+      }
+      int digits = std::max<int>(4, std::to_string(line + 1).size());
+      m_gutter = digits * m_digit_width + 2 * padding;
+
+      double visible = std::max<double>(1, m_rows.back().next - m_top);
+      m_updating_scrollbar = true;
+      m_adjustment->configure(m_top, 0, std::max<double>(size, visible), visible / m_rows.size(), visible, visible);
+      m_updating_scrollbar = false;
+      m_area.queue_draw();
+    }
+
+    void scroll_rows(int rows) 
+    {
+      for (; rows < 0 && m_top > 0; ++rows) m_top = previous_row(m_top);
+      for (; rows > 0; --rows) 
+      {
+        Row row = row_at(m_top);
+        if (is_last(row)) break;
+        m_top = row.next;
+      }
+      relayout();
+    }
+
+    // Scrolls so that the cursor is on screen, vertically and horizontally
+    void ensure_cursor_visible() 
+    {
+      int rows = visible_rows();
+      Row row = row_at(m_top);
+      int i = 0;
+      while (!contains(row, m_cursor) && ++i < rows && !is_last(row)) row = row_at(row.next);
+      if (!contains(row, m_cursor)) 
+      {
+        bool below = m_cursor > m_top;
+        m_top = row_start(m_cursor);
+        for (int j = 1; below && j < rows; ++j) m_top = previous_row(m_top); // Cursor on the bottom row
+        row = row_at(row_start(m_cursor));
+      }
+
+      int x = row_layout(row)->index_to_pos(m_cursor - row.start).get_x() / Pango::SCALE;
+      int width = std::max(1, m_area.get_allocated_width() - m_gutter - 2 * padding);
+      if (x < m_x_offset) m_x_offset = std::max(0, x - width / 4);
+      else if (x >= m_x_offset + width) m_x_offset = x - width * 3 / 4;
+      relayout();
+    }
+
+    void move_cursor(uint64_t offset, bool keep_goal = false) 
+    {
+      m_cursor = std::min(offset, m_text.size());
+      if (!keep_goal) m_goal_column = -1;
+      ensure_cursor_visible();
+      m_signal_cursor_moved.emit();
+    }
+
+    // Up or down by rows, keeping to the column the cursor started from
+    void move_vertically(int rows) 
+    {
+      uint64_t start = row_start(m_cursor);
+      if (m_goal_column < 0) m_goal_column = count_chars(start, m_cursor);
+      for (; rows < 0 && start > 0; ++rows) start = previous_row(start);
+      for (; rows > 0; --rows) 
+      {
+        Row row = row_at(start);
+        if (is_last(row)) break;
+        start = row.next;
+      }
+      move_cursor(advance(row_at(start), m_goal_column), true);
+    }
+
+    void insert(const std::string& text) 
+    {
+      m_text.insert(m_cursor, text);
+      set_modified(true);
+      move_cursor(m_cursor + text.size());
+    }
+
+    void erase(uint64_t from, uint64_t to) 
+    {
+      if (from >= to) return;
+      m_text.erase(from, to - from);
+      if (m_top > from) m_top = row_start(from); // Joined to the row above
+      set_modified(true);
+      move_cursor(from);
+    }
+
+    void apply_pending_cursor() 
+    {
+      if (m_pending_line < 0 || !m_index) return;
+      int64_t start = m_text.line_start(m_pending_line, *m_index);
+      if (start < 0 && !m_index->done()) return; // on_index_progress() tries again
+      Row row = row_at(start < 0 ? row_start(m_text.size()) : start); // Past the end goes to the last line
+      m_pending_line = -1;
+      m_cursor = advance(row, m_pending_column);
+      m_goal_column = -1;
+      m_top = row.start;
+      for (int i = visible_rows() / 4; i > 0 && m_top > 0; --i) m_top = previous_row(m_top); // Some context above
+      ensure_cursor_visible();
+      m_signal_cursor_moved.emit();
+    }
+
+    void on_index_progress() 
+    {
+      apply_pending_cursor();
+      relayout(); // Line numbers for more of the file
+      m_signal_index_progress.emit();
+    }
+
+    void on_scrollbar_moved() 
+    {
+      if (m_updating_scrollbar) return;
+      m_top = row_start(std::min<uint64_t>(m_adjustment->get_value(), m_text.size()));
+      relayout();
+    }
+
+    bool on_draw_area(const Cairo::RefPtr<Cairo::Context>& cr) 
+    {
+      int width = m_area.get_allocated_width();
+      int height = m_area.get_allocated_height();
+      auto style = m_area.get_style_context();
+      style->render_background(cr, 0, 0, width, height);
+      Gdk::RGBA color = style->get_color(style->get_state());
+
+      auto numbers = m_area.create_pango_layout("");
+      numbers->set_font_description(m_font);
+      cr->set_source_rgba(color.get_red(), color.get_green(), color.get_blue(), 0.5);
+      for (size_t i = 0; i < m_rows.size(); ++i) 
+      {
+        if (m_rows[i].line < 0) continue;
+        int number_width, number_height;
+        numbers->set_text(std::to_string(m_rows[i].line + 1));
+        numbers->get_pixel_size(number_width, number_height);
+        cr->move_to(m_gutter - padding - number_width, i * m_line_height);
+        numbers->show_in_cairo_context(cr);
+      }
+
+      cr->rectangle(m_gutter, 0, width - m_gutter, height);
+      cr->clip();
+      Gdk::Cairo::set_source_rgba(cr, color);
+      for (size_t i = 0; i < m_rows.size(); ++i) 
+      {
+        auto layout = row_layout(m_rows[i]);
+        int x = m_gutter + padding - m_x_offset;
+        cr->move_to(x, i * m_line_height);
+        layout->show_in_cairo_context(cr);
+        if (contains(m_rows[i], m_cursor)) 
+        {
+          cr->rectangle(x + layout->index_to_pos(m_cursor - m_rows[i].start).get_x() / Pango::SCALE, i * m_line_height, 1, m_line_height);
+          cr->fill();
+        }
+      }
+      return true;
+    }
+
+    bool on_area_key_press(GdkEventKey* event) 
+    {
+      if (event->state & GDK_MOD1_MASK) return false; // Alt combinations open menus
+      bool control = event->state & GDK_CONTROL_MASK;
+      switch (event->keyval) 
+      {
+        case GDK_KEY_Left: move_cursor(previous_char(m_cursor)); return true;
+        case GDK_KEY_Right: move_cursor(next_char(m_cursor)); return true;
+        case GDK_KEY_Up: move_vertically(-1); return true;
+        case GDK_KEY_Down: move_vertically(1); return true;
+        case GDK_KEY_Page_Up:
+          scroll_rows(1 - visible_rows());
+          move_vertically(1 - visible_rows());
+          return true;
+        case GDK_KEY_Page_Down:
+          scroll_rows(visible_rows() - 1);
+          move_vertically(visible_rows() - 1);
+          return true;
+        case GDK_KEY_Home: move_cursor(control ? 0 : row_start(m_cursor)); return true;
+        case GDK_KEY_End: move_cursor(control ? m_text.size() : row_at(row_start(m_cursor)).end); return true;
+        case GDK_KEY_Return:
+        case GDK_KEY_KP_Enter: insert("\n"); return true;
+        case GDK_KEY_Tab: insert("    "); return true; // Spaces, like the text view
+        case GDK_KEY_BackSpace: erase(previous_char(m_cursor), m_cursor); return true;
+        case GDK_KEY_Delete: erase(m_cursor, next_char(m_cursor)); return true;
+      }
+      gunichar c = gdk_keyval_to_unicode(event->keyval);
+      if (control || c < 0x20 || c == 0x7F) return false; // Shortcuts are the window's
+      char utf8[6];
+      insert(std::string(utf8, g_unichar_to_utf8(c, utf8)));
+      return true;
+    }
+
+    bool on_area_button_press(GdkEventButton* event) 
+    {
+      m_area.grab_focus();
+      if (event->button != 1 || m_rows.empty()) return false;
+      const Row& row = m_rows[std::min<size_t>(std::max(0.0, event->y) / m_line_height, m_rows.size() - 1)];
+      int index = 0;
+      int trailing = 0;
+      row_layout(row)->xy_to_index((event->x - m_gutter - padding + m_x_offset) * Pango::SCALE, 0, index, trailing);
+      uint64_t offset = row.start + index;
+      for (; trailing > 0 && offset < row.end; --trailing) offset = next_char(offset); // The right half of a character
+      move_cursor(std::min(offset, row.end));
+      return true;
+    }
+
+    bool on_area_scroll(GdkEventScroll* event) 
+    {
+      if (event->direction == GDK_SCROLL_SMOOTH) m_scroll_delta += event->delta_y * 3;
+      else if (event->direction == GDK_SCROLL_UP) m_scroll_delta -= 3;
+      else if (event->direction == GDK_SCROLL_DOWN) m_scroll_delta += 3;
+      int rows = static_cast<int>(m_scroll_delta);
+      m_scroll_delta -= rows; // Touchpads scroll by fractions of a row
+      if (rows != 0) scroll_rows(rows);
+      return true;
+    }
+
+    PieceTable m_text;
+    std::unique_ptr<LineIndex> m_index;
+    Gtk::DrawingArea m_area;
+    Glib::RefPtr<Gtk::Adjustment> m_adjustment; // In bytes
+    Gtk::Scrollbar m_scrollbar;
+    Pango::FontDescription m_font;
+    std::vector<Row> m_rows; // On screen, from m_top down
+    uint64_t m_top; // First row on screen
+    uint64_t m_cursor;
+    int m_goal_column; // Column that Up and Down keep to, -1 for the cursor's own
+    int m_x_offset; // Pixels scrolled to the right
+    int m_gutter;
+    int m_line_height;
+    int m_digit_width;
+    double m_scroll_delta;
+    int m_pending_line; // go_to() waiting for the index, -1 for none
+    int m_pending_column;
+    bool m_modified;
+    bool m_updating_scrollbar;
+    sigc::signal<void> m_signal_modified_changed;
+    sigc::signal<void> m_signal_cursor_moved;
+    sigc::signal<void> m_signal_index_progress;
+};
+
+// Forward declaration of the class
+class IdeWindow;
+
+// A custom widget to hold one editor tab and its associated controls
+class EditorTab : public Gtk::ScrolledWindow 
+{
+  public:
+    // Passing a reference to the main window for callbacks. A deferred tab is only a label until
+    // materialize() creates its view, which is how restored session tabs stay cheap.
+    EditorTab(IdeWindow& parent_window, bool deferred = false):
+      m_parent_window(parent_window),
+      m_file_path(""),
+      m_language_id("cpp"),
+      m_build_profile("debug"),
+      m_project_build(false),
+      m_encoding("UTF-8"),
+      m_pending_line(-1),
+      m_pending_column(0),
+      m_saves_in_flight(0),
+      m_edit_serial(0),
+      m_reload_serial(0),
+      m_disk_prompt_open(false),
+      m_journal_id(-1),
+      m_journal_bytes(0),
+      m_journal_paused(false),
+      m_check_serial(0),
+      m_loading(false),
+      m_load_decoded(false),
+      m_load_offset(0),
+      m_tab_box(Gtk::ORIENTATION_HORIZONTAL)
+    {
+      if (!deferred) 
+      {
+        create_view();
+      }
+
+      // Custom tab label widget (Label + Close Button with Icon)
+      m_tab_label.set_text("Untitled");
+      m_tab_box.pack_start(m_tab_label, Gtk::PACK_SHRINK); 
+
+      // Close button
+      Gtk::Image* close_icon = Gtk::manage(new Gtk::Image());
+      close_icon->set_from_icon_name("window-close-symbolic", Gtk::ICON_SIZE_SMALL_TOOLBAR); // Standard small 'x' icon
+      m_close_button.set_image(*close_icon);
+      m_close_button.set_relief(Gtk::RELIEF_NONE); 
+      m_close_button.set_tooltip_text("Close Tab");
+
+      m_tab_box.pack_start(m_close_button, Gtk::PACK_SHRINK); 
+      m_tab_box.show_all();
+
+      // Connecting the close button signal
+      m_close_button.signal_clicked().connect(sigc::mem_fun(*this, &EditorTab::on_close_button_clicked));
+    }
+
+    ~EditorTab(); // Implementation requires IdeWindow, defined later
+
+    // Getters
+    Gsv::View& get_view() 
+    {
+      materialize();
+      return *m_source_view;
+    }
+    bool is_materialized() const { return m_source_view != nullptr; }
+    bool is_large() const { return m_large != nullptr; }
+    LargeFileView* get_large_view() { return m_large.get(); } // Null unless is_large()
+    std::string get_path() const { return m_file_path; }
+    std::string get_language() const { return m_language_id; }
+    std::string get_build_profile() const { return m_build_profile; }
+    bool is_project_build() const { return m_project_build; }
+    const std::string& get_encoding() const { return m_encoding; } // Of the file, see detect_encoding()
+    const std::string& get_check_status() const { return m_check_status; }
+    std::string get_training_input() const { return m_training_input; }
+    std::string get_tests_dir() const { return m_tests_dir; }
+    Gtk::Widget& get_tab_widget() { return m_tab_box; }
+
+    std::string get_base_filename() const 
+    {
+      if (m_file_path.empty()) 
+      {
+        return "Untitled";
+      }
+      size_t pos = m_file_path.find_last_of("/");
+      return (pos == std::string::npos) ? m_file_path : m_file_path.substr(pos + 1);
+    }
+
+    bool is_modified() const 
+    {
+      if (m_loading) 
+      {
+        return false; // Partially inserted file contents are not user edits
+      }
+      if (m_large) return m_large->is_modified();
+      if(auto buffer = get_buffer()) 
+      {
+        return buffer->get_modified();
+      }
+      return false;
+    }
+
+    bool is_loading() const { return m_loading; }
+
+    // Head of the file, enough to find its #include block without copying the whole buffer
+    std::string get_preamble_text() 
+    {
+      if(auto buffer = get_buffer()) 
+      {
+        return buffer->get_text(buffer->begin(), buffer->get_iter_at_line(200));
+      }
+      return "";
+    }
+    size_t get_load_offset() const { return m_load_offset; }
+
+    // Cursor position for the session file; a tab that is not loaded yet reports where it will go
+    void get_cursor(int& line, int& column) const 
+    {
+      line = std::max(m_pending_line, 0);
+      column = m_pending_column;
+      if (m_large) 
+      {
+        int64_t large_line;
+        m_large->get_cursor(large_line, column);
+        line = std::max<int64_t>(large_line, 0);
+        return;
+      }
+      auto buffer = get_buffer();
+      if (buffer && m_pending_line < 0) 
+      {
+        auto iter = buffer->get_iter_at_mark(buffer->get_insert());
+        line = iter.get_line();
+        column = iter.get_line_offset();
+      }
+    }
+    size_t get_load_size() const { return !m_load_source ? 0 : m_load_decoded ? m_load_text.size() : m_load_source->size(); }
+
+    // Setters
+    void set_path(const std::string& path) 
+    {
+      m_file_path = path;
+      watch_file();
+      update_tab_label_widget();
+    }
+
+    void set_language(const std::string& lang_id) 
+    {
+      m_language_id = lang_id;
+      auto lang_manager = Gsv::LanguageManager::get_default();
+      auto lang = lang_manager->get_language(m_language_id);
+      if(auto buffer = get_buffer()) 
+      {
+        buffer->set_language(lang);
+        buffer->set_modified(buffer->get_modified()); // Treats language change similar to loading new content regarding modification
+      }
+      update_tab_label_widget(); // Ensure label updates
+      schedule_check();
+    }
+
+    void set_build_profile(const std::string& profile) 
+    {
+      m_build_profile = profile;
+      schedule_check(); // The flags may change the warnings
+    }
+    void set_project_build(bool project) { m_project_build = project; }
+    void set_training_input(const std::string& path) { m_training_input = path; }
+    void set_tests_dir(const std::string& path) { m_tests_dir = path; }
+
+    void set_font(const std::string& font_desc) 
+    {
+      m_font_desc = font_desc;
+      if (m_source_view) m_source_view->override_font(Pango::FontDescription(font_desc));
+      if (m_large) m_large->set_font(font_desc);
+    }
+
+    // Where the cursor goes once the file has loaded, for restored tabs
+    void set_pending_cursor(int line, int column) 
+    {
+      m_pending_line = line;
+      m_pending_column = column;
+    }
+
+    // Moves the cursor now, or once the file is in if it is still loading. A negative line changes
+    // nothing, so a restored tab or one still streaming in keeps the cursor it is waiting to get.
+    void go_to(int line, int column) 
+    {
+      if (line < 0) return;
+      set_pending_cursor(line, column);
+      if ((m_source_view || m_large) && !m_loading) apply_pending_cursor();
+    }
+
+    // Where a profiled run spent its time, as marks in the gutter, until cleared
+    void show_heat_map(const ProfileReport& report);
+    void clear_heat_map();
+
+    // The identifier the cursor is in or just after, "" if there is none
+    std::string get_word_at_cursor() const 
+    {
+      auto buffer = get_buffer();
+      if (!buffer || m_loading) return "";
+      auto is_word = [](gunichar c) { return g_unichar_isalnum(c) || c == '_'; };
+      auto start = buffer->get_iter_at_mark(buffer->get_insert());
+      auto end = start;
+      while (!start.starts_line()) 
+      {
+        auto previous = start;
+        previous.backward_char();
+        if (!is_word(previous.get_char())) break;
+        start = previous;
+      }
+      while (!end.ends_line() && is_word(end.get_char())) end.forward_char();
+      if (start == end || g_unichar_isdigit(start.get_char())) return "";
+      return buffer->get_text(start, end, false);
+    }
+
+    // Creates the view and starts loading the file of a deferred tab; nothing to do for others.
+    // Returns false if the file could not be opened.
+    bool materialize() 
+    {
+      if (m_source_view) return true;
+      create_view();
+      return m_file_path.empty() || load_file(m_file_path);
+    }
+    
+    // File Operations
+    // Maps the file and streams it into the buffer from idle callbacks, so the main loop
+    // keeps running while large files load. Files from large_file_threshold on are not copied
+    // into a buffer at all, see open_large(). Returns false if the file cannot be opened.
+    bool load_file(const std::string& path) 
+    {
+      auto source = std::make_unique<MappedFile>();
+      if (!source->open(path)) 
+      {
+        return false;
+      }
+      if (source->size() >= large_file_threshold) 
+      {
+        open_large(path, std::move(source));
+        return true;
+      }
+
+      if (!m_source_view) create_view();
+      if (m_large) close_large();
+      auto buffer = get_buffer();
+      if (!buffer) return false;
+
+      cancel_load(); // A previous load into this tab is superseded
+      discard_journal(); // The file replaces whatever the buffer held
+      set_path(path);
+      m_disk_stamp = disk_stamp(path); // What is on disk as of the mapping
+      set_language(detect_language_from_path(path));
+
+      // UTF-8 streams in straight from the mapping, anything else is decoded into m_load_text first
+      const char* data = source->data() ? source->data() : "";
+      m_encoding = detect_encoding(data, source->size());
+      m_load_decoded = m_encoding != "UTF-8";
+      if (m_load_decoded) m_load_text = decode_text(data, source->size(), m_encoding);
+      m_load_source = std::move(source);
+      m_load_offset = 0;
+      m_loading = true;
+      m_source_view->set_editable(false); // Viewable and scrollable while loading, but not editable
+
+      buffer->begin_not_undoable_action(); // Loading is not something the user should be able to undo
+      buffer->set_text("");
+      update_tab_label_widget();
+
+      m_load_connection = Glib::signal_idle().connect(sigc::mem_fun(*this, &EditorTab::on_load_idle));
+      return true;
+    }
+
+    // Stops a running load and drops the mapping, leaving whatever was inserted so far
+    void cancel_load() 
+    {
+      if (!m_loading) return;
+      m_load_connection.disconnect();
+      finish_load();
+    }
+
+    // Snapshots the buffer and hands it to the window's save engine. Returns false if nothing was
+    // queued; write errors arrive later through on_save_failed().
+    bool save_file(const std::string& path); // Implementation requires IdeWindow, defined later
+
+    // Save engine could not write the snapshot, so the buffer no longer matches the disk
+    void on_save_failed() 
+    {
+      if (m_large) m_large->set_modified(true);
+      else if(auto buffer = get_buffer()) 
+      {
+        buffer->set_modified(true);
+      }
+    }
+
+    // Save engine is done with a snapshot from save_file()
+    void on_save_finished(bool saved); // Implementation requires IdeWindow, defined later
+
+    // Fills the tab with text recovered from a journal, as unsaved changes to path ("" for untitled)
+    void recover(const std::string& path, const std::string& language, const std::string& text); // Likewise
+
+    // Snapshots the text, in the file's encoding, into a save of path and marks the tab clean, until on_save_failed()
+    SaveEngine::Request take_snapshot_for_save(const std::string& path); // Implementation requires IdeWindow, defined later
+
+    // Signal Handlers
+    void on_close_button_clicked(); // Implementation requires IdeWindow, defined later
+    void on_modified_changed(); // Likewise
+    void check_disk(); // Likewise
+    void apply_reload(); // Likewise
+
+    // Updates the Gtk::Label in the tab widget
+    void update_tab_label_widget() 
+    {
+      std::string label_text = get_base_filename();
+      if (is_modified()) 
+      {
+        label_text += "*"; // Adds * for modified files
+      }
+      if (m_tab_label.get_text() != label_text) m_tab_label.set_text(label_text); // Skips relayouts for no change
+    }
+
+  protected:
+    // Incremental loading, implementations require IdeWindow, defined later
+    bool on_load_idle();
+    void finish_load();
+
+    Glib::RefPtr<Gsv::Buffer> get_buffer() const 
+    {
+      return m_source_view ? m_source_view->get_source_buffer() : Glib::RefPtr<Gsv::Buffer>();
+    }
+
+    // Follows the file on disk: whatever changes it makes check_disk() run once things settle
+    void watch_file() 
+    {
+      if (m_file_path == m_watched_path) return;
+      m_watched_path = m_file_path;
+      m_monitor.reset();
+      if (m_file_path.empty()) return;
+      try 
+      {
+        m_monitor = Gio::File::create_for_path(m_file_path)->monitor_file();
+        m_monitor->signal_changed().connect(sigc::mem_fun(*this, &EditorTab::on_file_changed));
+      }
+      catch (const Glib::Error&) 
+      {
+        m_monitor.reset(); // E.g. a file system without notifications, changes go unnoticed there
+      }
+    }
+
+    void on_file_changed(const Glib::RefPtr<Gio::File>& file, const Glib::RefPtr<Gio::File>& other_file, Gio::FileMonitorEvent event) 
+    {
+      schedule_disk_check();
+    }
+
+    // Formatters, git and code generators write in bursts, one look after they are done is enough
+    void schedule_disk_check() 
+    {
+      m_disk_check.disconnect();
+      m_disk_check = Glib::signal_timeout().connect(sigc::mem_fun(*this, &EditorTab::on_disk_check_timeout), 150);
+    }
+
+    bool on_disk_check_timeout() 
+    {
+      check_disk();
+      return false;
+    }
+
+    // Background syntax check. Edits cancel a running check at once, a new one starts once typing pauses.
+    void schedule_check() 
+    {
+      if (m_check) m_check->cancel();
+      m_check_timer.disconnect();
+      if (m_loading || m_large || !get_buffer()) return; // Nor for large files, far too big to check as you type
+      m_check_timer = Glib::signal_timeout().connect([this] 
+      {
+        start_check();
+        return false;
+      }, 500);
+    }
+
+    // Large-file mode, implementations require IdeWindow, defined later
+    void open_large(const std::string& path, std::unique_ptr<MappedFile> file);
+    void close_large();
+    void check_disk_large(const std::string& stamp);
+
+    // Implementations require IdeWindow, defined later
+    void start_check();
+    void on_check_done();
+    void clear_diagnostics();
+
+    // Crash recovery journal, implementations require IdeWindow, defined later
+    void on_buffer_insert(const Gtk::TextBuffer::iterator& position, const Glib::ustring& text, int bytes);
+    void on_buffer_erase(const Gtk::TextBuffer::iterator& start, const Gtk::TextBuffer::iterator& end);
+    void journal_record(const std::string& record);
+    void start_journal();
+    void discard_journal();
+
+    void apply_pending_cursor() 
+    {
+      if (m_large && m_pending_line >= 0) 
+      {
+        m_large->go_to(m_pending_line, m_pending_column); // Done once the line index gets there
+        m_pending_line = -1;
+        return;
+      }
+      auto buffer = get_buffer();
+      if (!buffer || m_pending_line < 0) return;
+      auto iter = buffer->get_iter_at_line(std::min(m_pending_line, buffer->get_line_count() - 1));
+      if (m_pending_column < iter.get_chars_in_line()) iter.set_line_offset(m_pending_column);
+      buffer->place_cursor(iter);
+      m_source_view->scroll_to(buffer->get_insert(), 0.25);
+      m_pending_line = -1;
+    }
+
+    void create_view() 
+    {
+      m_source_view = std::make_unique<Gsv::View>();
+      m_source_view->set_show_line_numbers(true);
+      m_source_view->set_highlight_current_line(true);
+      m_source_view->set_auto_indent(true);
+      m_source_view->set_smart_home_end(Gsv::SMART_HOME_END_ALWAYS);
+      m_source_view->set_insert_spaces_instead_of_tabs(true);
+      m_source_view->set_indent_width(4);
+      m_source_view->set_name("my-ide-editor");
+      if (!m_font_desc.empty()) m_source_view->override_font(Pango::FontDescription(m_font_desc));
+      add(*m_source_view); // Adds the view to the ScrolledWindow
+      m_source_view->show();
+
+      // Syntax check results: an icon in the gutter with the messages as its tooltip, and a squiggle
+      m_source_view->set_show_line_marks(true);
+      for (const char* category : {"error", "warning"}) 
+      {
+        auto attributes = Gsv::MarkAttributes::create();
+        attributes->set_icon_name(category == std::string("error") ? "dialog-error" : "dialog-warning");
+        attributes->signal_query_tooltip_text().connect([this](const Glib::RefPtr<Gsv::Mark>& mark) -> Glib::ustring 
+        {
+          size_t index = strtoul(mark->get_name().c_str() + strlen("diagnostic"), nullptr, 10);
+          return index < m_diagnostics.size() ? m_diagnostics[index].message : "";
+        });
+        m_source_view->set_mark_attributes(category, attributes, category == std::string("error") ? 2 : 1);
+      }
+
+      // Profile results: a swatch in the gutter and a tinted line, from pale yellow to red as lines get hotter
+      static const guint32 heat_colors[] = {0xf5e6a0, 0xf2c46d, 0xee9a4a, 0xe86c35, 0xd93b2b};
+      for (int level = 0; level < 5; ++level) 
+      {
+        guint32 rgb = heat_colors[level];
+        auto swatch = Gdk::Pixbuf::create(Gdk::COLORSPACE_RGB, true, 8, 12, 12);
+        swatch->fill(rgb << 8 | 0xff);
+        Gdk::RGBA tint;
+        tint.set_rgba((rgb >> 16) / 255.0, (rgb >> 8 & 0xff) / 255.0, (rgb & 0xff) / 255.0, 0.3);
+        auto attributes = Gsv::MarkAttributes::create();
+        attributes->set_pixbuf(swatch);
+        attributes->set_background(tint);
+        attributes->signal_query_tooltip_text().connect([this](const Glib::RefPtr<Gsv::Mark>& mark) -> Glib::ustring 
+        {
+          size_t index = strtoul(mark->get_name().c_str() + strlen("hotline"), nullptr, 10);
+          return index < m_heat_tips.size() ? m_heat_tips[index] : "";
+        });
+        m_source_view->set_mark_attributes("heat" + std::to_string(level), attributes, 0); // Under diagnostics
+      }
+
+      // Connecting buffer modified signal to update tab label
+      if(auto buffer = get_buffer()) 
+      {
+      	buffer->signal_modified_changed().connect(sigc::mem_fun(*this, &EditorTab::on_modified_changed));
+        buffer->signal_changed().connect([this] 
+        {
+          ++m_edit_serial; // Tells a reload diff or a syntax check whether it is stale
+          schedule_check();
+        });
+        buffer->signal_insert().connect(sigc::mem_fun(*this, &EditorTab::on_buffer_insert), false); // Before the change, so
+        buffer->signal_erase().connect(sigc::mem_fun(*this, &EditorTab::on_buffer_erase), false); // snapshots predate it
+        buffer->set_language(Gsv::LanguageManager::get_default()->get_language(m_language_id));
+        m_error_tag = buffer->create_tag();
+        m_error_tag->property_underline().set_value(Pango::UNDERLINE_ERROR);
+        m_warning_tag = buffer->create_tag();
+        m_warning_tag->property_underline().set_value(Pango::UNDERLINE_ERROR);
+        m_warning_tag->property_underline_rgba().set_value(Gdk::RGBA("#e0a000"));
+      }
+    }
+
+    IdeWindow& m_parent_window; // References to parent
+    std::unique_ptr<Gsv::View> m_source_view; // Created on first use for deferred tabs
+    std::string m_file_path;
+    std::string m_language_id;
+    std::string m_build_profile; // "debug", "release", "max" or "pgo"
+    bool m_project_build; // Run builds every C/C++ file of the folder, not just this one
+    std::string m_encoding; // Written back on save
+    std::string m_training_input; // stdin of the PGO training run, empty for /dev/null
+    std::string m_tests_dir; // Input/expected output pairs for Tests
+    std::string m_font_desc;
+    int m_pending_line; // Cursor to restore after loading, -1 for none
+    int m_pending_column;
+
+    // Watching the file for changes made by others
+    Glib::RefPtr<Gio::FileMonitor> m_monitor;
+    std::string m_watched_path;
+    std::string m_disk_stamp; // disk_stamp() of the file as the buffer last matched it
+    int m_saves_in_flight;
+    unsigned m_edit_serial; // Counts buffer changes
+    unsigned m_reload_serial; // m_edit_serial when the running reload took its snapshot
+    bool m_disk_prompt_open;
+    std::unique_ptr<ReloadDiff> m_reload; // Latest reload, kept until the next one
+    sigc::connection m_disk_check;
+
+    // Journal of the edits since the buffer last matched its file
+    int m_journal_id; // -1 until the first edit
+    size_t m_journal_bytes; // Written since the journal last started over
+    bool m_journal_paused; // Changes that are not edits, like a reload
+    std::deque<std::string> m_journal_saves; // Records since each save still in flight, oldest first
+
+    // Syntax check of the buffer
+    std::unique_ptr<SyntaxCheck> m_check; // Latest check, kept until the next one
+    unsigned m_check_serial; // m_edit_serial when it took its snapshot
+    sigc::connection m_check_timer;
+    std::vector<SyntaxCheck::Diagnostic> m_diagnostics; // Shown now, the mark "diagnostic<i>" is number i
+    std::vector<std::string> m_heat_tips; // Tooltip of the mark "hotline<i>"
+    std::string m_check_status; // Outcome of the last check, for the status bar
+    Glib::RefPtr<Gtk::TextTag> m_error_tag;
+    Glib::RefPtr<Gtk::TextTag> m_warning_tag;
+
+    // Large-file mode: the view over the mapped file that replaces the text view, see open_large()
+    std::unique_ptr<LargeFileView> m_large;
+
+    // Incremental loading state
+    std::unique_ptr<MappedFile> m_load_source;
+    bool m_load_decoded; // Loading m_load_text, the file decoded to UTF-8, rather than the mapping
+    std::string m_load_text;
+    bool m_loading;
+    size_t m_load_offset;
+    sigc::connection m_load_connection;
+
+    // Widgets for the custom tab label
+    Gtk::Box m_tab_box;
+    Gtk::Label m_tab_label;
+    Gtk::Button m_close_button;
+};
+
+// What it takes to run a tab: its source in a private work directory, an optional build step
+// and the command that runs the result
+// Main application window
+class IdeWindow : public Gtk::Window 
+{
+  public:
+    IdeWindow();
+    void close_tab(EditorTab* tab_to_close); // Close tab
+    void on_tab_load_progress(EditorTab* tab); // Called by tabs while a file streams in
+    void on_tab_disk_event(EditorTab* tab, const std::string& message); // A tab's file changed on disk
+    void on_tab_checked(EditorTab* tab); // A tab's syntax check finished
+    SaveEngine& get_save_engine() { return m_save_engine; }
+    EditJournal& get_journal() { return m_journal; }
+    PchServer& get_pch_server() { return m_pch_server; }
+    void open_file_at(const std::string& path, int line = 0, int column = 0);
+
+    // Status bar, title and tab label refreshes are batched into one per frame
+    enum UiUpdate { UI_STATUSBAR = 1, UI_TITLE = 2, UI_TAB_LABELS = 4 };
+    void schedule_ui_update(unsigned what, EditorTab* tab = nullptr); // tab: whose label is stale
+
+  protected:
+    // Override the window delete event for save prompts
+    bool on_delete_event(GdkEventAny* event) override;
+    void on_hide() override; // Saves the session on the way out
+
+    // Signal handlers
+    void on_run_button_clicked();
+    void on_benchmark_clicked();
+    void on_profile_clicked();
+    void on_tests_clicked();
+    void on_language_changed();
+    void on_profile_changed();
+    void on_project_toggled();
+    void on_new_clicked();
+    void on_open_clicked();
+    void on_save_clicked();
+    void on_save_as_clicked();
+    void on_exit_clicked();
+    void on_quit_button_clicked(); 
+    void on_dark_theme_toggled();
+    void on_font_clicked();
+    void on_hud_toggled();
+    void on_python_zygote_clicked();
+    void apply_python_zygote();
+    void on_find_in_files_clicked();
+    void on_quick_open_clicked();
+    void on_go_to_definition_clicked();
+    void on_find_references_clicked();
+    bool on_shortcut(GdkEventKey* event);
+    void on_open_folder_clicked();
+    void open_folder(const std::string& folder);
+    bool on_ui_tick(const Glib::RefPtr<Gdk::FrameClock>& clock);
+    void on_cursor_position_changed(const Gtk::TextBuffer::iterator& iter, const Glib::RefPtr<Gtk::TextBuffer::Mark>& mark);
+    void on_tab_changed(Gtk::Widget* page, guint page_num);
+    void on_save_finished(const SaveEngine::Result& result);
+    void on_pch_ready(const PchServer::Info& info);
+    void on_symbols_progress();
+
+    // Helper functions
+    EditorTab* get_current_tab();
+    EditorTab* create_new_tab(const std::string& file_path = ""); // nullptr if the file could not be opened
+    void update_title();
+    void update_statusbar();
+    void update_load_status();
+    void update_check_status();
+    bool save_current_tab_if_needed(EditorTab* tab); // Helper for save logic
+    bool prepare_build(EditorTab* tab, BuildPlan& plan, const std::string& extra_flags = "");
+    void materialize_tab(EditorTab* tab);
+    void save_session();
+    bool restore_session();
+    void recover_journals();
+    EditorTab* find_tab(const void* tab); // Returns the tab if it is still open
+    
+    // Child Widgets
+    Gtk::HeaderBar m_header_bar;
+    Gtk::Button m_run_button;
+    Gtk::Button m_benchmark_button;
+    Gtk::Button m_profile_button;
+    Gtk::Button m_tests_button;
+    Gtk::ComboBoxText m_language_combo;
+    Gtk::ComboBoxText m_profile_combo;
+    Gtk::ToggleButton m_project_toggle;
+    Gtk::MenuButton m_file_menu_button;
+    Gtk::Popover m_file_popover;
+    Gtk::Box m_file_menu_box;
+    Gtk::ModelButton m_new_button;
+    Gtk::ModelButton m_open_button;
+    Gtk::ModelButton m_open_folder_button;
+    Gtk::ModelButton m_save_button;
+    Gtk::ModelButton m_save_as_button;
+    Gtk::ModelButton m_dark_theme_button;
+    Gtk::ModelButton m_font_button;
+    Gtk::ModelButton m_find_in_files_button;
+    Gtk::ModelButton m_quick_open_button;
+    Gtk::ModelButton m_definition_button;
+    Gtk::ModelButton m_references_button;
+    Gtk::ModelButton m_hud_button;
+    Gtk::ModelButton m_zygote_button;
+    Gtk::ModelButton m_exit_button;
+    Gtk::Button m_quit_button;
+    Gtk::Box m_main_box;
+
+    Glib::Dispatcher m_jobs_dispatcher; // Runs the scheduler's bookkeeping on the main loop
+    JobScheduler m_jobs; // Declared before the output panel that shows them
+    EditJournal m_journal; // Declared before the notebook, tabs discard their journals as they close
+    Gtk::Paned m_side_paned; // File tree on the left, everything else on the right
+    FileTreePanel m_file_tree;
+    Gtk::Paned m_editor_paned; // Notebook above, run output and search results below
+    Gtk::Notebook m_notebook;
+    Gtk::Notebook m_bottom_notebook;
+    OutputPanel m_output_panel;
+    FindInFilesPanel m_find_panel;
+    Gtk::Statusbar m_statusbar;
+    LatencyHud m_hud;
+    QuickOpenWindow m_quick_open;
+    SymbolIndex m_symbols;
+
+    // State variables
+    std::string m_font_desc;
+    bool m_dark_theme_active;
+    bool m_restoring_session; // Tabs are being added from the session file, none is loaded yet
+    Gtk::Widget* m_current_page; // Last page get_current_tab() looked at, and the tab it is
+    EditorTab* m_current_tab;
+    unsigned m_ui_dirty; // UiUpdate flags waiting for the next frame
+    guint m_ui_tick_id; // Pending tick callback, 0 if none
+    std::vector<const void*> m_stale_labels; // Tabs may close before the frame comes
+    std::string m_cursor_status; // Status bar text last pushed for the cursor
+    guint m_load_context_id; // Status bar context for file loading progress
+    guint m_save_context_id; // Status bar context for save results
+    guint m_run_context_id; // Status bar context for run and build cache results
+    guint m_symbols_context_id; // Status bar context for symbol indexing and lookups
+    guint m_check_context_id; // Status bar context for the current tab's syntax check
+    Glib::Dispatcher m_save_dispatcher; // Hands finished background saves to the main loop
+    SaveEngine m_save_engine;
+    BuildCache m_build_cache;
+    PchServer m_pch_server;
+    Glib::RefPtr<Gtk::CssProvider> m_css_provider;
+    std::unique_ptr<BenchmarkResultsWindow> m_benchmark_window;
+    int m_benchmark_iterations;
+    int m_benchmark_warmups;
+    std::string m_benchmark_input;
+    std::unique_ptr<ProfileResultsWindow> m_profile_window;
+    sigc::connection m_profile_hidden; // Clears the heat map as the profile window closes
+    std::unique_ptr<TestBatch> m_test_batch; // Latest test run, replaced by the next
+    std::unique_ptr<TestResultsWindow> m_test_window;
+    TestBatch::Limits m_test_limits;
+    PythonZygote m_python_zygote;
+    bool m_python_zygote_enabled;
+    std::string m_python_preload; // Modules the zygote imports, e.g. "numpy, pandas"
+};
+
+// IdeWindow Implementation
+IdeWindow::IdeWindow() :
+  m_main_box(Gtk::ORIENTATION_VERTICAL),
+  m_jobs(std::thread::hardware_concurrency(), [this] { m_jobs_dispatcher.emit(); }),
+  m_journal(Glib::get_user_data_dir() + "/mint_pad/journal"),
+  m_side_paned(Gtk::ORIENTATION_HORIZONTAL),
+  m_editor_paned(Gtk::ORIENTATION_VERTICAL),
+  m_output_panel(m_jobs),
+  m_run_button("Run"),
+  m_benchmark_button("Benchmark"),
+  m_profile_button("Profile"),
+  m_project_toggle("Project"),
+  m_tests_button("Tests"),
+  m_file_menu_box(Gtk::ORIENTATION_VERTICAL),
+  m_dark_theme_active(false),
+  m_restoring_session(false),
+  m_current_page(nullptr),
+  m_current_tab(nullptr),
+  m_ui_dirty(0),
+  m_ui_tick_id(0),
+  m_quick_open(*this),
+  m_symbols(Glib::get_user_cache_dir() + "/mint_pad/symbols"),
+  m_benchmark_iterations(10),
+  m_benchmark_warmups(2),
+  m_test_limits{2, 256, 5.0},
+  m_python_zygote_enabled(false),
+  m_save_engine([this] { m_save_dispatcher.emit(); }),
+  m_build_cache(Glib::get_user_cache_dir() + "/mint_pad/build", 512ULL * 1024 * 1024), // 512 MB of cached binaries
+  m_pch_server(Glib::get_user_cache_dir() + "/mint_pad/pch") 
+{
+  set_default_size(800, 600);
+  set_titlebar(m_header_bar);
+
+  // "File" Menu Setup
+  m_file_menu_button.set_label("File");
+  m_new_button.set_label("New");
+  m_open_button.set_label("Open...");
+  m_open_folder_button.set_label("Open Folder...");
+  m_save_button.set_label("Save");
+  m_save_as_button.set_label("Save As...");
+  m_dark_theme_button.set_label("Toggle Dark Theme");
+  m_font_button.set_label("Preferences...");
+  m_find_in_files_button.set_label("Find in Files...");
+  m_quick_open_button.set_label("Quick Open...    Ctrl+P");
+  m_definition_button.set_label("Go to Definition    F12");
+  m_references_button.set_label("Find References    Shift+F12");
+  m_hud_button.set_label("Toggle Latency HUD");
+  m_zygote_button.set_label("Python Zygote...");
+  m_exit_button.set_label("Exit");
+
+  m_file_menu_button.set_popover(m_file_popover);
+  m_file_popover.add(m_file_menu_box);
+  m_file_menu_box.pack_start(m_new_button, true, true, 0);
+  m_file_menu_box.pack_start(m_open_button, true, true, 0);
+  m_file_menu_box.pack_start(m_open_folder_button, true, true, 0);
+  m_file_menu_box.pack_start(m_quick_open_button, true, true, 0);
+  m_file_menu_box.pack_start(m_save_button, true, true, 0);
+  m_file_menu_box.pack_start(m_save_as_button, true, true, 0);
+  m_file_menu_box.pack_start(m_dark_theme_button, true, true, 0);
+  m_file_menu_box.pack_start(m_find_in_files_button, true, true, 0);
+  m_file_menu_box.pack_start(m_definition_button, true, true, 0);
+  m_file_menu_box.pack_start(m_references_button, true, true, 0);
+  m_file_menu_box.pack_start(m_font_button, true, true, 0);
+  m_file_menu_box.pack_start(m_hud_button, true, true, 0);
+  m_file_menu_box.pack_start(m_zygote_button, true, true, 0);
+  m_file_menu_box.pack_start(m_exit_button, true, true, 0);
+
+  m_new_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_new_clicked));
+  m_open_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_open_clicked));
+  m_open_folder_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_open_folder_clicked));
+  m_save_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_save_clicked));
+  m_save_as_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_save_as_clicked));
+  m_dark_theme_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_dark_theme_toggled));
+  m_font_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_font_clicked));
+  m_find_in_files_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_find_in_files_clicked));
+  m_quick_open_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_quick_open_clicked));
+  m_definition_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_go_to_definition_clicked));
+  m_references_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_find_references_clicked));
+  m_hud_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_hud_toggled));
+  m_zygote_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_python_zygote_clicked));
+  m_exit_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_exit_clicked));
+  m_file_menu_box.show_all();
+
+  // Language Selector
+  m_language_combo.append("cpp", "C++");
+  m_language_combo.append("c", "C");
+  m_language_combo.append("python", "Python");
+  m_language_combo.signal_changed().connect(sigc::mem_fun(*this, &IdeWindow::on_language_changed));
+
+  // Build Profile Selector
+  m_profile_combo.append("debug", "Debug");
+  m_profile_combo.append("release", "Release");
+  m_profile_combo.append("max", "Max");
+  m_profile_combo.append("pgo", "PGO");
+  m_profile_combo.set_tooltip_text("Debug: -O0 -g\nRelease: -O2\nMax: -O3 -march=native -flto\nPGO: -O2, trained on an input file, then rebuilt with -fprofile-use");
+  m_profile_combo.signal_changed().connect(sigc::mem_fun(*this, &IdeWindow::on_profile_changed));
+  m_project_toggle.set_tooltip_text("Build every C/C++ file in this file's folder together, recompiling only the files that changed");
+  m_project_toggle.signal_toggled().connect(sigc::mem_fun(*this, &IdeWindow::on_project_toggled));
+
+  // Quit Button
+  Gtk::Image* quit_icon = Gtk::manage(new Gtk::Image());
+  quit_icon->set_from_icon_name("window-close-symbolic", Gtk::ICON_SIZE_BUTTON); 
+  m_quit_button.set_image(*quit_icon);
+  m_quit_button.set_relief(Gtk::RELIEF_NONE);
+  m_quit_button.set_tooltip_text("Quit Application");
+
+  // HeaderBar Layout
+  m_header_bar.pack_start(m_file_menu_button);
+  m_header_bar.pack_start(m_language_combo);
+  m_header_bar.pack_start(m_profile_combo);
+  m_header_bar.pack_start(m_project_toggle);
+  m_header_bar.pack_start(m_run_button); 
+  m_header_bar.pack_start(m_benchmark_button);
+  m_benchmark_button.set_tooltip_text("Build once, then time repeated runs");
+  m_benchmark_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_benchmark_clicked));
+  m_header_bar.pack_start(m_profile_button);
+  m_profile_button.set_tooltip_text("Build with debug info, run under a sampling profiler and show the hot lines");
+  m_profile_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_profile_clicked));
+  m_header_bar.pack_start(m_tests_button);
+  m_tests_button.set_tooltip_text("Build once, then run every test case in a folder in parallel");
+  m_tests_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_tests_clicked));
+  m_header_bar.pack_end(m_quit_button); 
+  m_run_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_run_button_clicked));
+  m_quit_button.signal_clicked().connect(sigc::mem_fun(*this, &IdeWindow::on_quit_button_clicked)); // Connecting quit
+
+  add(m_main_box);
+
+  // Notebook (Tabs) Setup 
+  m_notebook.set_scrollable(true);
+  m_notebook.signal_switch_page().connect(sigc::mem_fun(*this, &IdeWindow::on_tab_changed));
+
+  m_editor_paned.pack1(m_notebook, true, false);
+  m_bottom_notebook.append_page(m_output_panel, "Output");
+  m_bottom_notebook.append_page(m_find_panel, "Find in Files");
+  m_find_panel.signal_open().connect(sigc::mem_fun(*this, &IdeWindow::open_file_at));
+  m_editor_paned.pack2(m_bottom_notebook, false, true);
+  m_editor_paned.set_position(420);
+  m_side_paned.pack1(m_file_tree, false, true);
+  m_side_paned.pack2(m_editor_paned, true, false);
+  m_side_paned.set_position(220);
+  m_file_tree.signal_open().connect([this](const std::string& path) { open_file_at(path, -1); }); // -1: an open tab keeps its cursor
+  m_file_tree.signal_changed().connect(sigc::mem_fun(m_quick_open, &QuickOpenWindow::folder_changed));
+  m_file_tree.signal_changed().connect(sigc::mem_fun(m_symbols, &SymbolIndex::folder_changed));
+  m_symbols.signal_progress().connect(sigc::mem_fun(*this, &IdeWindow::on_symbols_progress));
+  m_quick_open.signal_open().connect([this](const std::string& path) { open_file_at(path, -1); });
+  m_main_box.pack_start(m_side_paned, true, true, 0);
+  m_main_box.pack_start(m_statusbar, false, false, 0);
+  m_statusbar.pack_end(m_hud, false, false, 6);
+
+  // Latency HUD hooks: key presses are seen before any widget handles them, paints come from the frame clock
+  signal_key_press_event().connect([this](GdkEventKey*) 
+  {
+    m_hud.key_pressed();
+    return false;
+  }, false);
+  signal_key_press_event().connect(sigc::mem_fun(*this, &IdeWindow::on_shortcut), false); // Before the focused editor sees it
+  signal_realize().connect([this]() 
+  {
+    get_frame_clock()->signal_after_paint().connect(sigc::mem_fun(m_hud, &LatencyHud::frame_painted));
+  });
+
+  m_css_provider = Gtk::CssProvider::create();
+  m_load_context_id = m_statusbar.get_context_id("load");
+  m_save_context_id = m_statusbar.get_context_id("save");
+  m_run_context_id = m_statusbar.get_context_id("run");
+  m_symbols_context_id = m_statusbar.get_context_id("symbols");
+  m_check_context_id = m_statusbar.get_context_id("check");
+  m_jobs_dispatcher.connect(sigc::mem_fun(m_jobs, &JobScheduler::dispatch));
+  m_save_dispatcher.connect([this] 
+  {
+    for (const auto& result : m_save_engine.take_results()) on_save_finished(result);
+  });
+  m_pch_server.signal_ready().connect(sigc::mem_fun(*this, &IdeWindow::on_pch_ready));
+  m_pch_server.header_for({"<bits/stdc++.h>"}, "cpp", "g++", profile_flags("debug")); // The usual competitive programming preamble, built once per compiler
+
+  restore_session();
+  recover_journals(); // After the session, so recovered files land in their restored tabs
+  if (m_notebook.get_n_pages() == 0) 
+  {
+    create_new_tab(); // Creates the first tab
+  }
+  std::string folder = Glib::get_current_dir();
+  if (m_file_tree.get_root().empty() && folder != "/" && folder != Glib::get_home_dir()) // Not from a desktop launcher
+  {
+    open_folder(folder);
+  }
+
+  show_all_children();
+}
+
+// Overrides delete event (called when window close button is pressed or hide() is called)
+bool IdeWindow::on_delete_event(GdkEventAny* event) 
+{
+  bool has_unsaved = false;
+  std::list<EditorTab*> unsaved_tabs; // Store pointers to unsaved tabs
+
+  for (int i = 0; i < m_notebook.get_n_pages(); ++i) 
+  {
+    auto tab = dynamic_cast<EditorTab*>(m_notebook.get_nth_page(i));
+    if (tab && tab->is_modified()) 
+    {
+      has_unsaved = true;
+      unsaved_tabs.push_back(tab);
+    }
+  }
+
+  if (has_unsaved) 
+  {
+    Gtk::MessageDialog dialog(*this, "You have unsaved changes.", false, Gtk::MESSAGE_QUESTION, Gtk::BUTTONS_NONE);
+    // Using stock IDs for standard button text and order
+    dialog.add_button(Gtk::Stock::SAVE, Gtk::RESPONSE_YES); // Label: "Save"
+    dialog.add_button("_Discard Changes", Gtk::RESPONSE_NO); // Label: "Discard Changes"
+    dialog.add_button(Gtk::Stock::CANCEL, Gtk::RESPONSE_CANCEL); // Label: "Cancel"
+    dialog.set_secondary_text("Do you want to save the changes before quitting?");
+
+    int result = dialog.run();
+
+    if (result == Gtk::RESPONSE_YES) 
+    { 
+      // Untitled tabs need a Save As dialog first, one after another
+      for (EditorTab* tab : unsaved_tabs) 
+      {
+        if (tab->get_path().empty() && !save_current_tab_if_needed(tab)) 
+        {
+          int page_num = m_notebook.page_num(*tab);
+          if (page_num >= 0) 
+          {
+            m_notebook.set_current_page(page_num);
+          }
+          return true; // Prevents closing if save failed/cancelled
+        }
+      }
+
+      // Everything else is flushed concurrently
+      std::vector<SaveEngine::Request> requests;
+      for (EditorTab* tab : unsaved_tabs) 
+      {
+        if (tab->is_modified()) 
+        {
+          requests.push_back(tab->take_snapshot_for_save(tab->get_path()));
+        }
+      }
+      m_save_engine.wait_idle(); // Earlier background saves must land before we overwrite them
+      auto total_start = std::chrono::steady_clock::now();
+      auto results = SaveEngine::write_all(std::move(requests));
+      double total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - total_start).count();
+
+      // The write latencies go to stderr, next to what save_session() reports on the way out
+      std::string errors;
+      for (const auto& save : results) 
+      {
+        if (save.error.empty()) 
+        {
+          std::cerr << "Saved " << save.path << " in " << save.milliseconds << " ms" << std::endl;
+        } 
+        else 
+        {
+          errors += save.error + "\n";
+          if (EditorTab* tab = find_tab(save.owner)) tab->on_save_failed();
+        }
+      }
+      if (!results.empty()) 
+      {
+        std::cerr << "Flushed " << results.size() << " file(s) in " << total_ms << " ms" << std::endl;
+      }
+      if (!errors.empty()) 
+      {
+        Gtk::MessageDialog err_dialog(*this, "Error saving files.", false, Gtk::MESSAGE_ERROR, Gtk::BUTTONS_OK);
+        err_dialog.set_secondary_text(errors);
+        err_dialog.run();
+        return true; // Prevents closing if save failed
+      }
+      // If all saved successfully
+    } 
+    else if (result == Gtk::RESPONSE_CANCEL) 
+    {
+      return true; // Prevents closing
+    }
+    // If "Discard Changes" (RESPONSE_NO)
+  }
+
+  return false; // Allow closing (either no unsaved files or user chooses Discard/Save All succeeded)
+}
+
+
+void IdeWindow::on_hide() 
+{
+  m_profile_hidden.disconnect(); // The tabs go before the profile window does
+  save_session();
+  Gtk::Window::on_hide();
+}
+
+// Where the open tabs, font and theme are kept between runs
+static std::string session_path() 
+{
+  return Glib::get_user_config_dir() + "/mint_pad/session.ini";
+}
+
+// Writes the open files with their cursor, language and build profile, plus the font and theme
+void IdeWindow::save_session() 
+{
+  Glib::KeyFile session;
+  session.set_string("Session", "font", m_font_desc);
+  session.set_boolean("Session", "dark_theme", m_dark_theme_active);
+  session.set_string("Session", "folder", m_file_tree.get_root());
+  session.set_boolean("Session", "python_zygote", m_python_zygote_enabled);
+  session.set_string("Session", "python_preload", m_python_preload);
+  session.set_string_list("Session", "recent", std::vector<Glib::ustring>(m_quick_open.get_recent().begin(), m_quick_open.get_recent().end()));
+  int saved = 0;
+  int current = 0;
+  for (int i = 0; i < m_notebook.get_n_pages(); ++i) 
+  {
+    auto tab = dynamic_cast<EditorTab*>(m_notebook.get_nth_page(i));
+    if (!tab || tab->get_path().empty()) continue; // Untitled buffers have nothing to reopen
+    if (i == m_notebook.get_current_page()) current = saved;
+    int line, column;
+    tab->get_cursor(line, column);
+    std::string group = "Tab" + std::to_string(saved++);
+    session.set_string(group, "path", tab->get_path());
+    session.set_integer(group, "line", line);
+    session.set_integer(group, "column", column);
+    session.set_string(group, "language", tab->get_language());
+    session.set_string(group, "profile", tab->get_build_profile());
+    session.set_boolean(group, "project", tab->is_project_build());
+  }
+  session.set_integer("Session", "tabs", saved);
+  session.set_integer("Session", "current", current);
+
+  std::string path = session_path();
+  std::string error = make_directories(Glib::path_get_dirname(path)) ? write_file_atomically(path, session.to_data()) : "could not create its directory";
+  if (!error.empty()) 
+  {
+    std::cerr << "Could not save the session to " << path << ": " << error << std::endl;
+  }
+}
+
+// Reopens the tabs of the last session as deferred tabs: each is only a label until it is first
+// shown, so startup costs the same however many tabs there are. Returns false if there was nothing.
+bool IdeWindow::restore_session() 
+{
+  Glib::KeyFile session;
+  int count = 0;
+  int current = 0;
+  try 
+  {
+    session.load_from_file(session_path());
+    m_font_desc = session.get_string("Session", "font");
+    if (session.get_boolean("Session", "dark_theme") && !m_dark_theme_active) 
+    {
+      on_dark_theme_toggled();
+    }
+    count = session.get_integer("Session", "tabs");
+    current = session.get_integer("Session", "current");
+    if (session.has_key("Session", "recent")) 
+    {
+      auto recent = session.get_string_list("Session", "recent");
+      m_quick_open.set_recent(std::vector<std::string>(recent.begin(), recent.end()));
+    }
+    if (session.has_key("Session", "python_zygote")) 
+    {
+      m_python_zygote_enabled = session.get_boolean("Session", "python_zygote");
+      m_python_preload = session.get_string("Session", "python_preload");
+      apply_python_zygote();
+    }
+    std::string folder = session.has_key("Session", "folder") ? session.get_string("Session", "folder") : "";
+    if (!folder.empty() && Glib::file_test(folder, Glib::FILE_TEST_IS_DIR)) 
+    {
+      open_folder(folder);
+    }
+  } 
+  catch (const Glib::Error&) 
+  {
+    return false; // First start, or a session file from something else
+  }
+
+  m_restoring_session = true;
+  int current_page = 0;
+  for (int i = 0; i < count; ++i) 
+  {
+    std::string group = "Tab" + std::to_string(i);
+    try 
+    {
+      std::string path = session.get_string(group, "path");
+      if (!Glib::file_test(path, Glib::FILE_TEST_IS_REGULAR)) continue; // Deleted or moved since
+      EditorTab* tab = Gtk::manage(new EditorTab(*this, true));
+      tab->set_path(path);
+      tab->set_language(session.get_string(group, "language"));
+      tab->set_build_profile(session.get_string(group, "profile"));
+      tab->set_project_build(session.has_key(group, "project") && session.get_boolean(group, "project"));
+      tab->set_pending_cursor(session.get_integer(group, "line"), session.get_integer(group, "column"));
+      if (!m_font_desc.empty()) tab->set_font(m_font_desc);
+      if (i == current) current_page = m_notebook.get_n_pages();
+      m_notebook.append_page(*tab, tab->get_tab_widget());
+    } 
+    catch (const Glib::Error& ex) 
+    {
+      std::cerr << "Skipping " << group << " of the session: " << ex.what() << std::endl;
+    }
+  }
+  m_restoring_session = false;
+
+  if (m_notebook.get_n_pages() == 0) return false;
+  m_notebook.show_all();
+  m_notebook.set_current_page(current_page);
+  on_tab_changed(nullptr, current_page); // Page 0 was current all along, so there may have been no switch
+  return true;
+}
+
+// Creates the view of a restored tab and starts loading its file
+void IdeWindow::materialize_tab(EditorTab* tab) 
+{
+  bool opened = tab->materialize();
+  if(auto buffer = tab->get_view().get_source_buffer()) 
+  {
+    buffer->signal_mark_set().connect(sigc::mem_fun(*this, &IdeWindow::on_cursor_position_changed));
+  }
+  if (!opened) 
+  {
+    Gtk::MessageDialog err_dialog(*this, "Error opening file: " + tab->get_path(), false, Gtk::MESSAGE_ERROR, Gtk::BUTTONS_OK);
+    err_dialog.run();
+    tab->set_path(""); // Saving must not overwrite the file with an empty buffer
+  }
+}
+
+// Get current tab
+EditorTab* IdeWindow::get_current_tab()  
+{
+  if (m_notebook.get_n_pages() == 0) return nullptr;
+  int current_page_index = m_notebook.get_current_page();
+  if (current_page_index < 0) return nullptr;
+  auto current_page = m_notebook.get_nth_page(current_page_index);
+  if (current_page != m_current_page) // Called for every cursor move, the dynamic_cast only on a switch
+  {
+    m_current_page = current_page;
+    m_current_tab = dynamic_cast<EditorTab*>(current_page);
+  }
+  return m_current_tab;
+}
+
+// Looks a tab up among the open pages, it may have been closed since it was handed out
+EditorTab* IdeWindow::find_tab(const void* tab) 
+{
+  for (int i = 0; i < m_notebook.get_n_pages(); ++i) 
+  {
+    if (m_notebook.get_nth_page(i) == tab) 
+    {
+      return dynamic_cast<EditorTab*>(m_notebook.get_nth_page(i));
+    }
+  }
+  return nullptr;
+}
+
+// Creating new tab
+EditorTab* IdeWindow::create_new_tab(const std::string& file_path) 
+{
+  EditorTab* tab = Gtk::manage(new EditorTab(*this));
+
+  if(auto buffer = tab->get_view().get_source_buffer()) 
+  {
+    buffer->signal_mark_set().connect(sigc::mem_fun(*this, &IdeWindow::on_cursor_position_changed));
+  }
+
+  if (!m_font_desc.empty()) 
+  {
+    tab->set_font(m_font_desc);
+  }
+
+  std::string initial_language = "cpp";
+  if (!file_path.empty()) 
+  {
+    if (!tab->load_file(file_path)) 
+    {
+      Gtk::MessageDialog err_dialog(*this, "Error opening file: " + file_path, false, Gtk::MESSAGE_ERROR, Gtk::BUTTONS_OK); // Error loading file (e.g., doesn't exist)
+      err_dialog.run();
+      // Gtk::manage will delete the tab when it goes out of scope here if load fails
+      // No need to explicitly delete managed widget
+      return nullptr;
+    }
+    initial_language = tab->get_language();
+    m_quick_open.note_opened(file_path); // Recently opened files rank first in Quick Open
+  }  
+  else 
+  {
+    tab->set_language(initial_language);
+  }
+
+  m_notebook.append_page(*tab, tab->get_tab_widget());
+  m_notebook.show_all();
+  m_notebook.set_current_page(-1); // Switching focus to the new tab
+  return tab;
+}
+
+// Opens a file given on the command line, or switches to its tab if it is open already, and puts
+// the cursor on line and column (both 0-based)
+void IdeWindow::open_file_at(const std::string& path, int line, int column) 
+{
+  for (int i = 0; i < m_notebook.get_n_pages(); ++i) 
+  {
+    auto tab = dynamic_cast<EditorTab*>(m_notebook.get_nth_page(i));
+    if (tab && tab->get_path() == path) 
+    {
+      m_notebook.set_current_page(i);
+      tab->go_to(line, column);
+      return;
+    }
+  }
+
+  // The empty tab a fresh start comes up with is replaced rather than left behind
+  EditorTab* blank = get_current_tab();
+  if (m_notebook.get_n_pages() != 1 || !blank || !blank->get_path().empty() || blank->is_modified() || blank->get_view().get_source_buffer()->get_char_count() != 0) 
+  {
+    blank = nullptr;
+  }
+  if (EditorTab* tab = create_new_tab(path)) 
+  {
+    tab->go_to(line, column);
+    if (blank) m_notebook.remove_page(*blank);
+  }
+}
+
+// Handles "New"
+void IdeWindow::on_new_clicked() 
+{
+  create_new_tab();
+}
+
+// Handles "Open"
+void IdeWindow::on_open_clicked() 
+{
+  Gtk::FileChooserDialog dialog("Please choose a file", Gtk::FILE_CHOOSER_ACTION_OPEN);
+  dialog.set_transient_for(*this);
+  dialog.add_button("_Cancel", Gtk::RESPONSE_CANCEL); 
+  dialog.add_button("_Open", Gtk::RESPONSE_ACCEPT);
+
+  if (!m_file_tree.get_root().empty()) 
+  {
+    dialog.set_current_folder(m_file_tree.get_root());
+  }
+
+  int result = dialog.run();
+
+  if (result == Gtk::RESPONSE_ACCEPT) 
+  {
+    create_new_tab(dialog.get_filename());
+  }
+}
+
+// Handles "Open Folder": the folder goes into the sidebar and becomes the Find in Files default
+void IdeWindow::on_open_folder_clicked() 
+{
+  Gtk::FileChooserDialog dialog("Please choose a folder", Gtk::FILE_CHOOSER_ACTION_SELECT_FOLDER);
+  dialog.set_transient_for(*this);
+  dialog.add_button("_Cancel", Gtk::RESPONSE_CANCEL);
+  dialog.add_button("_Open", Gtk::RESPONSE_ACCEPT);
+  if (dialog.run() == Gtk::RESPONSE_ACCEPT) 
+  {
+    open_folder(dialog.get_filename());
+  }
+}
+
+void IdeWindow::open_folder(const std::string& folder) 
+{
+  m_file_tree.set_root(folder);
+  m_find_panel.set_folder(folder);
+  m_quick_open.set_root(folder);
+  m_symbols.set_root(folder);
+}
+
+// Handles "Save"
+void IdeWindow::on_save_clicked() 
+{
+  EditorTab* tab = get_current_tab();
+  save_current_tab_if_needed(tab); // Use the helper
+}
+
+// Handles "Save As" logic, returns true if save succeeded or wasn't needed, false if cancelled/failed
+bool IdeWindow::save_current_tab_if_needed(EditorTab* tab) 
+{
+  if (!tab) return false;
+
+  if (tab->get_path().empty() || tab->is_modified()) // Only prompt/save if the file is untitled or modified
+  {
+    if (tab->get_path().empty()) 
+    {
+      Gtk::FileChooserDialog dialog("Save File As", Gtk::FILE_CHOOSER_ACTION_SAVE);
+      dialog.set_transient_for(*this);
+      dialog.set_do_overwrite_confirmation(true); // Warns if overwriting
+      dialog.add_button("_Cancel", Gtk::RESPONSE_CANCEL);
+      dialog.add_button("_Save", Gtk::RESPONSE_ACCEPT);
+
+      std::string default_name = "untitled";
+      if (tab->get_language() == "cpp") default_name += ".cpp";
+      else if (tab->get_language() == "c") default_name += ".c";
+      else if (tab->get_language() == "python") default_name += ".py";
+      dialog.set_current_name(default_name);
+
+      int result = dialog.run();
+      if (result == Gtk::RESPONSE_ACCEPT) 
+      {
+        std::string filename = dialog.get_filename();
+        if (tab->save_file(filename)) 
+        {
+          update_title(); // Updates title after successful save as
+          return true;
+        } 
+        else 
+        {
+          Gtk::MessageDialog err_dialog(*this, "Error saving file.", false, Gtk::MESSAGE_ERROR, Gtk::BUTTONS_OK);
+          err_dialog.run();
+          return false; // Save failed
+        }
+      } 
+      else 
+      {
+        return false; // User cancelled Save As
+      }
+    } 
+    else 
+    {
+      return tab->save_file(tab->get_path()); // Already has a path, just save
+    }
+  }
+  return true; // Not modified, "save succeeded"
+}
+
+
+// Reports the outcome of a background save
+void IdeWindow::on_save_finished(const SaveEngine::Result& result) 
+{
+  m_statusbar.remove_all_messages(m_save_context_id);
+  EditorTab* tab = find_tab(result.owner);
+  if (tab) 
+  {
+    tab->on_save_finished(result.error.empty());
+  }
+  if (result.error.empty()) 
+  {
+    m_symbols.file_changed(result.path); // Reindexed in the background
+    std::ostringstream status;
+    status.precision(1);
+    status << std::fixed << "Saved " << result.path << " (" << result.milliseconds << " ms)";
+    m_statusbar.push(status.str(), m_save_context_id);
+    return;
+  }
+
+  update_title();
+  Gtk::MessageDialog err_dialog(*this, "Error saving file.", false, Gtk::MESSAGE_ERROR, Gtk::BUTTONS_OK);
+  err_dialog.set_secondary_text(result.error);
+  err_dialog.run();
+}
+
+// Brings back the unsaved work of an editor that crashed or was killed, from the journals it left
+// behind. A file that is open already gets it in its tab, anything else in a new one.
+void IdeWindow::recover_journals() 
+{
+  std::vector<std::string> skipped;
+  auto recovered = EditJournal::recover(m_journal.get_directory(), skipped);
+  for (const auto& problem : skipped) 
+  {
+    std::cerr << "Not recovering unsaved edits: " << problem << std::endl;
+  }
+  if (recovered.empty()) return;
+
+  for (const auto& file : recovered) 
+  {
+    EditorTab* tab = nullptr;
+    for (int i = 0; i < m_notebook.get_n_pages() && !file.path.empty(); ++i) 
+    {
+      auto open_tab = dynamic_cast<EditorTab*>(m_notebook.get_nth_page(i));
+      if (open_tab && open_tab->get_path() == file.path) tab = open_tab;
+    }
+    bool deferred = tab && !tab->is_materialized();
+    if (!tab) tab = create_new_tab();
+    tab->recover(file.path, file.language, file.text);
+    if (deferred) materialize_tab(tab); // Hooks up its cursor signals, there is nothing left to load
+    unlink(file.journal_path.c_str()); // Journaled again by the tab from here on
+  }
+  m_statusbar.push("Recovered unsaved changes to " + std::to_string(recovered.size()) + " file(s)", m_save_context_id);
+}
+
+void IdeWindow::on_tab_disk_event(EditorTab* tab, const std::string& message) 
+{
+  m_statusbar.remove_all_messages(m_save_context_id);
+  m_statusbar.push(message, m_save_context_id);
+}
+
+// Reports a precompiled header that finished building in the background
+void IdeWindow::on_pch_ready(const PchServer::Info& info) 
+{
+  std::ostringstream status;
+  status.precision(1);
+  status << std::fixed << "Precompiled header for " << info.label << " ready: built in " << info.build_ms / 1000.0 
+         << " s, header compile time " << info.parse_ms << " ms -> " << info.pch_ms << " ms";
+  m_statusbar.remove_all_messages(m_run_context_id);
+  m_statusbar.push(status.str(), m_run_context_id);
+}
+
+// "Save As" menu item just forces the "Save As" part of the helper
+void IdeWindow::on_save_as_clicked() 
+{
+  EditorTab* tab = get_current_tab();
+  if (!tab) return;
+
+  std::string original_path = tab->get_path();
+  tab->set_path(""); // Temporarily clear path to force "Save As" dialog
+  bool saved = save_current_tab_if_needed(tab);
+  if (!saved && !original_path.empty()) // Restore original path only if save was cancelled and it had an original path
+  {
+    tab->set_path(original_path);
+    tab->update_tab_label_widget();
+  }
+  // If saved is true, save_current_tab_if_needed already updated the path and label
+}
+
+
+// Public method to actually close a tab, handles prompts
+void IdeWindow::close_tab(EditorTab* tab_to_close) 
+{
+  if (!tab_to_close) return;
+
+  bool do_close = true; // Assume we will close unless cancelled
+
+  if (tab_to_close->is_modified()) 
+  {
+    Gtk::MessageDialog dialog(*this, "Save changes before closing?", false, Gtk::MESSAGE_QUESTION, Gtk::BUTTONS_NONE);
+    dialog.set_secondary_text("\"" + tab_to_close->get_base_filename() + "*\" has unsaved changes.");
+    dialog.add_button(Gtk::Stock::SAVE, Gtk::RESPONSE_YES);
+    dialog.add_button("_Don't Save", Gtk::RESPONSE_NO); 
+    dialog.add_button(Gtk::Stock::CANCEL, Gtk::RESPONSE_CANCEL);
+
+    int result = dialog.run();
+
+    if (result == Gtk::RESPONSE_YES) 
+    { 
+      if (!save_current_tab_if_needed(tab_to_close)) // Save
+      {
+        do_close = false; // Save failed or cancelled
+      }
+    } 
+    else if (result == Gtk::RESPONSE_CANCEL) 
+    {
+      do_close = false; // User cancelled
+    }
+    // If "Don't Save" (RESPONSE_NO), do_close remains true
+  }
+
+  if (do_close) 
+  {
+    tab_to_close->cancel_load(); // Stops streaming into a tab that is going away
+    int page_num = m_notebook.page_num(*tab_to_close);
+    if (page_num >= 0) 
+    {
+      m_notebook.remove_page(page_num);
+      // Gtk::manage handles deletion automatically
+
+      if (m_notebook.get_n_pages() == 0) 
+      {
+        create_new_tab(); // Ensures at least one tab remains
+      } 
+      else 
+      {
+         on_tab_changed(nullptr, m_notebook.get_current_page()); // Trigger updates for the potentially new current tab
+      }
+    }
+  }
+}
+
+// Other Handlers
+
+void IdeWindow::on_font_clicked() 
+{
+  Gtk::FontChooserDialog dialog("Choose Font", *this);
+  if (!m_font_desc.empty()) 
+  {
+    dialog.set_font(m_font_desc);
+  }
+
+  int result = dialog.run();
+
+  if (result == Gtk::RESPONSE_OK) 
+  {
+    m_font_desc = dialog.get_font();
+    for (int i = 0; i < m_notebook.get_n_pages(); ++i) 
+    {
+      auto tab = dynamic_cast<EditorTab*>(m_notebook.get_nth_page(i));
+      if (tab) tab->set_font(m_font_desc);
+    }
+  }
+}
+
+void IdeWindow::on_cursor_position_changed(const Gtk::TextBuffer::iterator& iter, const Glib::RefPtr<Gtk::TextBuffer::Mark>& mark) 
+{
+  LatencyHud::Scope timing(m_hud, "mark_set");
+  auto buffer = mark->get_buffer();
+  if (mark != buffer->get_insert()) return; // Selection bound, source marks, ... fire far more often than the cursor
+  EditorTab* current_tab = get_current_tab(); // Background tabs move their cursor while loading
+  if (current_tab && buffer == current_tab->get_view().get_source_buffer()) 
+  {
+    schedule_ui_update(UI_STATUSBAR);
+  }
+}
+
+void IdeWindow::schedule_ui_update(unsigned what, EditorTab* tab) 
+{
+  if (tab && (what & UI_TAB_LABELS)) m_stale_labels.push_back(tab);
+  m_ui_dirty |= what;
+  if (!m_ui_tick_id) 
+  {
+    m_ui_tick_id = add_tick_callback(sigc::mem_fun(*this, &IdeWindow::on_ui_tick));
+  }
+}
+
+// Runs once per frame while updates are pending, however many were scheduled since the last one
+bool IdeWindow::on_ui_tick(const Glib::RefPtr<Gdk::FrameClock>& clock) 
+{
+  LatencyHud::Scope timing(m_hud, "ui update");
+  unsigned what = m_ui_dirty;
+  m_ui_dirty = 0;
+  m_ui_tick_id = 0;
+  if (what & UI_TAB_LABELS) 
+  {
+    for (const void* stale : m_stale_labels) 
+    {
+      if (EditorTab* tab = find_tab(stale)) tab->update_tab_label_widget();
+    }
+    m_stale_labels.clear();
+  }
+  if (what & UI_TITLE) update_title();
+  if (what & UI_STATUSBAR) update_statusbar();
+  return false; // Removes the callback until something is scheduled again
+}
+
+void IdeWindow::on_quick_open_clicked() 
+{
+  m_quick_open.popup();
+}
+
+// Window-wide shortcuts: Ctrl+P, F12 and Shift+F12
+bool IdeWindow::on_shortcut(GdkEventKey* event) 
+{
+  if ((event->state & GDK_CONTROL_MASK) && (event->keyval == GDK_KEY_p || event->keyval == GDK_KEY_P)) on_quick_open_clicked();
+  else if (event->keyval == GDK_KEY_F12 && (event->state & GDK_SHIFT_MASK)) on_find_references_clicked();
+  else if (event->keyval == GDK_KEY_F12) on_go_to_definition_clicked();
+  else return false;
+  return true;
+}
+
+// Jumps to where the identifier at the cursor is defined. With several definitions the nearest
+// comes first and all are listed in the search panel; pressing F12 again on one moves to the next.
+void IdeWindow::on_go_to_definition_clicked() 
+{
+  EditorTab* tab = get_current_tab();
+  std::string name = tab ? tab->get_word_at_cursor() : "";
+  if (name.empty()) return;
+  std::string root = m_symbols.root();
+  std::string relative = tab->get_path();
+  if (!root.empty() && relative.compare(0, root.size() + 1, root + "/") == 0) relative = relative.substr(root.size() + 1);
+
+  auto definitions = m_symbols.find_definitions(name, relative);
+  m_statusbar.remove_all_messages(m_symbols_context_id);
+  if (definitions.empty()) 
+  {
+    m_statusbar.push("No definition of " + name + (m_symbols.busy() ? " yet, still indexing" : " in the project"), m_symbols_context_id);
+    return;
+  }
+  int line, column;
+  tab->get_cursor(line, column);
+  size_t next = 0;
+  for (size_t i = 0; i < definitions.size(); ++i) 
+  {
+    if (definitions[i].file == relative && definitions[i].line == line) next = (i + 1) % definitions.size();
+  }
+  const auto& target = definitions[next];
+  if (definitions.size() > 1) 
+  {
+    static const std::map<char, std::string> kinds = {{'f', "function"}, {'c', "class"}, {'e', "enum"}, {'m', "macro"}};
+    std::vector<FileSearch::Match> matches;
+    for (const auto& definition : definitions) matches.push_back({definition.file, definition.line, definition.column, kinds.at(definition.kind) + " " + name});
+    m_find_panel.show_matches(root, matches, std::to_string(definitions.size()) + " definitions of " + name);
+    m_bottom_notebook.set_current_page(m_bottom_notebook.page_num(m_find_panel));
+    m_statusbar.push("Definition " + std::to_string(next + 1) + " of " + std::to_string(definitions.size()) + ", F12 again for the next", m_symbols_context_id);
+  }
+  open_file_at(root + "/" + target.file, target.line, target.column);
+}
+
+// Lists every use of the identifier at the cursor in the search panel
+void IdeWindow::on_find_references_clicked() 
+{
+  EditorTab* tab = get_current_tab();
+  std::string name = tab ? tab->get_word_at_cursor() : "";
+  if (name.empty()) return;
+  const size_t max_references = 5000;
+  auto start = std::chrono::steady_clock::now();
+  auto references = m_symbols.find_references(name, max_references);
+  double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  std::set<std::string> files;
+  for (const auto& reference : references) files.insert(reference.file);
+  std::ostringstream status;
+  status.precision(1);
+  status << std::fixed << references.size() << " references to " << name << " in " << files.size() << " files (" << milliseconds << " ms)";
+  if (references.size() >= max_references) status << ", stopped at the limit";
+  if (m_symbols.busy()) status << ", still indexing";
+  m_find_panel.show_matches(m_symbols.root(), references, status.str());
+  m_bottom_notebook.set_current_page(m_bottom_notebook.page_num(m_find_panel));
+}
+
+// Indexing progress for passes big enough to notice, then a summary
+void IdeWindow::on_symbols_progress() 
+{
+  m_statusbar.remove_all_messages(m_symbols_context_id);
+  if (m_symbols.total_files() < 100) return; // Saves and small changes are quick
+  std::ostringstream status;
+  status.precision(0);
+  if (m_symbols.busy()) 
+  {
+    status << "Indexing symbols... " << m_symbols.done_files() << " of " << m_symbols.total_files() << " files";
+  } 
+  else 
+  {
+    status << std::fixed << "Indexed " << m_symbols.definition_count() << " symbols in " << m_symbols.file_count() << " files (" << m_symbols.last_pass_ms() << " ms)";
+  }
+  m_statusbar.push(status.str(), m_symbols_context_id);
+}
+
+void IdeWindow::on_hud_toggled()  
+{
+  m_hud.set_enabled(!m_hud.enabled());
+}
+
+// Python runs can fork from a warm interpreter with heavy imports already done
+void IdeWindow::on_python_zygote_clicked() 
+{
+  Gtk::Dialog dialog("Python Zygote", *this, true);
+  dialog.add_button("_Cancel", Gtk::RESPONSE_CANCEL);
+  dialog.add_button("_OK", Gtk::RESPONSE_OK);
+  dialog.set_default_response(Gtk::RESPONSE_OK);
+
+  Gtk::Grid grid;
+  grid.set_row_spacing(6);
+  grid.set_column_spacing(12);
+  grid.set_border_width(12);
+  Gtk::CheckButton enabled("Run Python programs in a warm interpreter");
+  enabled.set_active(m_python_zygote_enabled);
+  Gtk::Label preload_label("Preload modules:");
+  preload_label.set_xalign(0);
+  Gtk::Entry preload;
+  preload.set_text(m_python_preload);
+  preload.set_placeholder_text("numpy, pandas");
+  preload.set_tooltip_text("Imported once when the interpreter starts; every run then finds them already loaded");
+  preload.set_activates_default(true);
+  grid.attach(enabled, 0, 0, 2, 1);
+  grid.attach(preload_label, 0, 1);
+  grid.attach(preload, 1, 1);
+  dialog.get_content_area()->pack_start(grid, true, true, 0);
+  dialog.show_all_children();
+
+  if (dialog.run() != Gtk::RESPONSE_OK) return;
+  m_python_zygote_enabled = enabled.get_active();
+  m_python_preload = preload.get_text();
+  apply_python_zygote();
+}
+
+// Starts, restarts (on a different module list) or stops the zygote to match the settings
+void IdeWindow::apply_python_zygote() 
+{
+  if (!m_python_zygote_enabled) 
+  {
+    m_python_zygote.stop();
+    return;
+  }
+  std::string names = m_python_preload;
+  std::replace(names.begin(), names.end(), ',', ' ');
+  std::vector<std::string> modules = split_flags(names);
+  if (m_python_zygote.running() && m_python_zygote.modules() == modules) return;
+  if (!m_python_zygote.start("python3", modules)) 
+  {
+    std::cerr << "Could not start the Python zygote: " << std::strerror(errno) << std::endl;
+  }
+}
+
+void IdeWindow::on_find_in_files_clicked() 
+{
+  m_bottom_notebook.set_current_page(m_bottom_notebook.page_num(m_find_panel));
+  m_find_panel.focus_pattern();
+}
+
+void IdeWindow::on_tab_changed(Gtk::Widget* page, guint page_num) 
+{
+  LatencyHud::Scope timing(m_hud, "switch_page");
+  EditorTab* tab = get_current_tab();
+  if (tab && !tab->is_materialized()) 
+  {
+    if (m_restoring_session) return; // Only the tab that ends up current gets loaded
+    materialize_tab(tab);
+  }
+  if (tab) 
+  {
+    update_statusbar();
+    update_title();
+    m_language_combo.set_active_id(tab->get_language());
+    m_profile_combo.set_active_id(tab->get_build_profile());
+    m_profile_combo.set_sensitive(tab->get_language() != "python");
+    m_project_toggle.set_active(tab->is_project_build());
+    m_project_toggle.set_sensitive(tab->get_language() != "python");
+    update_load_status();
+    update_check_status();
+    if (auto job = m_jobs.latest_for(tab)) // Output follows the tab
+    {
+      m_output_panel.show_job(job->id);
+    }
+  } 
+  else 
+  {
+    update_title(); // Updates to default title
+    update_statusbar(); // Clears status bar
+  }
+}
+
+void IdeWindow::update_statusbar() 
+{
+  EditorTab* tab = get_current_tab();
+  if (tab) 
+  {
+    std::string status;
+    if (LargeFileView* large = tab->get_large_view()) 
+    {
+      int64_t line;
+      int col;
+      large->get_cursor(line, col);
+      status = (line < 0 ? std::string("Line: ?") : "Line: " + std::to_string(line + 1)) + ", Col: " + std::to_string(col + 1); // Until the index gets there
+    } 
+    else 
+    {
+      auto buffer = tab->get_view().get_source_buffer();
+      if(!buffer) return;
+      auto iter = buffer->get_iter_at_mark(buffer->get_insert());
+      int line = iter.get_line() + 1;
+      int col = iter.get_line_offset() + 1;
+      status = "Line: " + std::to_string(line) + ", Col: " + std::to_string(col);
+    }
+    if (tab->get_encoding() != "UTF-8") status += "   " + tab->get_encoding(); // Only worth a mention when unusual
+    if (status == m_cursor_status) return; // E.g. typing over a selection, or a tab switch to the same spot
+    m_cursor_status = status;
+    m_statusbar.pop(); // Removes previous message context id 0
+    m_statusbar.push(status); // Pushes new message context id 0
+  } 
+  else 
+  {
+    m_cursor_status.clear();
+    m_statusbar.pop(); // Clears status bar if no tab
+  }
+}
+
+void IdeWindow::on_tab_load_progress(EditorTab* tab) 
+{
+  LatencyHud::Scope timing(m_hud, "load progress");
+  if (tab == get_current_tab()) // Background tabs load silently
+  {
+    update_load_status();
+  }
+  if (tab->is_large()) 
+  {
+    if (tab == get_current_tab()) update_statusbar(); // Line numbers known further into the file
+  } 
+  else if (!tab->is_loading()) // Get the file's precompiled header built before the first Run
+  {
+    std::string flags = profile_flags(tab->get_build_profile());
+    if (tab->get_language() == "cpp") m_pch_server.header_for(scan_include_preamble(tab->get_preamble_text()), "cpp", "g++", flags);
+    else if (tab->get_language() == "c") m_pch_server.header_for(scan_include_preamble(tab->get_preamble_text()), "c", "gcc", flags);
+  }
+}
+
+void IdeWindow::on_tab_checked(EditorTab* tab) 
+{
+  if (tab == get_current_tab()) update_check_status(); // Background tabs show theirs when switched to
+}
+
+// Shows how the current tab's last syntax check went and how long it took
+void IdeWindow::update_check_status() 
+{
+  m_statusbar.remove_all_messages(m_check_context_id);
+  EditorTab* tab = get_current_tab();
+  if (tab && !tab->get_check_status().empty()) m_statusbar.push(tab->get_check_status(), m_check_context_id);
+}
+
+// Shows the loading progress of the current tab, or clears it once done
+void IdeWindow::update_load_status() 
+{
+  m_statusbar.remove_all_messages(m_load_context_id);
+  EditorTab* tab = get_current_tab();
+  if (tab && tab->is_loading()) 
+  {
+    size_t total = tab->get_load_size();
+    int percent = total ? static_cast<int>(tab->get_load_offset() * 100 / total) : 100;
+    std::ostringstream status;
+    status.precision(1);
+    status << std::fixed << "Loading " << tab->get_base_filename() << "... " << percent << "% (" 
+           << tab->get_load_offset() / 1048576.0 << " of " << total / 1048576.0 << " MB)";
+    m_statusbar.push(status.str(), m_load_context_id);
+  } 
+  else if (tab && tab->is_large()) 
+  {
+    LargeFileView* large = tab->get_large_view();
+    std::ostringstream status;
+    status.precision(1);
+    status << std::fixed << "Large file mode, " << large->size() / 1048576.0 << " MB";
+    if (!large->index_done()) status << ", indexing lines... " << static_cast<int>(large->index_progress() * 100) << "%";
+    m_statusbar.push(status.str(), m_load_context_id);
+  }
+}
+
+void IdeWindow::update_title() 
+{
+  std::string title_base = "Mint_Pad"; // It's your own, personal editor, name it whatever you want. I went with Mint_Pad since it is developed in Linux Mint.
+  EditorTab* tab = get_current_tab();
+  std::string title = tab ? tab->get_base_filename() + (tab->is_modified() ? "*" : "") + " - " + title_base : title_base; // Default title if no tabs
+  if (get_title() != title) // The window manager hears about every set_title
+  {
+    set_title(title);
+  }
+}
+
+void IdeWindow::on_language_changed() 
+{
+  EditorTab* tab = get_current_tab();
+  if (tab) 
+  {
+    tab->set_language(m_language_combo.get_active_id());
+    tab->update_tab_label_widget(); // Update tab title if needed (like Untitled -> Untitled*)
+    update_title(); // Also update main window title if needed
+    m_profile_combo.set_sensitive(tab->get_language() != "python"); // Nothing to optimize for the interpreter
+    m_project_toggle.set_sensitive(tab->get_language() != "python");
+  }
+}
+
+void IdeWindow::on_project_toggled() 
 {
-  bool has_unsaved = false;
-  std::list<EditorTab*> unsaved_tabs; // Store pointers to unsaved tabs
+  EditorTab* tab = get_current_tab();
+  if (!tab || m_project_toggle.get_active() == tab->is_project_build()) return; // Also filters out tab switches
+  tab->set_project_build(m_project_toggle.get_active());
+  if (tab->is_project_build() && tab->get_path().empty()) 
+  {
+    Gtk::MessageDialog dialog(*this, "Save the file into its project folder first; until then Run builds only this buffer.", false, Gtk::MESSAGE_INFO, Gtk::BUTTONS_OK);
+    dialog.run();
+  }
+}
 
-  for (int i = 0; i < m_notebook.get_n_pages(); ++i) 
+void IdeWindow::on_profile_changed() 
+{
+  EditorTab* tab = get_current_tab();
+  std::string profile = m_profile_combo.get_active_id();
+  if (!tab || profile.empty() || profile == tab->get_build_profile()) return; // Also filters out tab switches
+
+  tab->set_build_profile(profile);
+  if (profile == "pgo") // The training run needs a representative input
   {
-    auto tab = dynamic_cast<EditorTab*>(m_notebook.get_nth_page(i));
-    if (tab && tab->is_modified()) 
-    {
-      has_unsaved = true;
-      unsaved_tabs.push_back(tab);
-    }
+    Gtk::FileChooserDialog dialog("Choose a training input for PGO", Gtk::FILE_CHOOSER_ACTION_OPEN);
+    dialog.set_transient_for(*this);
+    dialog.add_button("_No Input", Gtk::RESPONSE_CANCEL);
+    dialog.add_button("_Select", Gtk::RESPONSE_ACCEPT);
+    if (!tab->get_training_input().empty()) dialog.set_filename(tab->get_training_input());
+    tab->set_training_input(dialog.run() == Gtk::RESPONSE_ACCEPT ? dialog.get_filename() : "");
   }
+}
 
-  if (has_unsaved) 
+// Writes the tab's code into a fresh work directory and works out how to build and run it.
+// Shows an error and returns false if that is not possible.
+// extra_flags are added to the profile's compile flags, and so to the build cache and PCH keys
+bool IdeWindow::prepare_build(EditorTab* tab, BuildPlan& plan, const std::string& extra_flags) 
+{
+  if (tab->is_large()) 
   {
-    Gtk::MessageDialog dialog(*this, "You have unsaved changes.", false, Gtk::MESSAGE_QUESTION, Gtk::BUTTONS_NONE);
-    // Using stock IDs for standard button text and order
-    dialog.add_button(Gtk::Stock::SAVE, Gtk::RESPONSE_YES); // Label: "Save"
-    dialog.add_button("_Discard Changes", Gtk::RESPONSE_NO); // Label: "Discard Changes"
-    dialog.add_button(Gtk::Stock::CANCEL, Gtk::RESPONSE_CANCEL); // Label: "Cancel"
-    dialog.set_secondary_text("Do you want to save the changes before quitting?");
+    Gtk::MessageDialog dialog(*this, tab->get_base_filename() + " is too large to build or run from the editor.", false, Gtk::MESSAGE_INFO, Gtk::BUTTONS_OK);
+    dialog.run();
+    return false;
+  }
+  if (tab->is_modified() && !tab->get_path().empty()) // Saves current file if needed before running 
+  {
+    tab->save_file(tab->get_path());
+  }
 
-    int result = dialog.run();
+  if (tab->is_loading()) return false; // Nothing sensible to run until the whole file is in
 
-    if (result == Gtk::RESPONSE_YES) 
-    { 
-      bool all_saved = true; // Corresponds to "Save"
-      for (EditorTab* tab : unsaved_tabs) 
+  std::string current_language = tab->get_language();
+  std::string source_filename_base; // Just the name part
+  std::string compiler; // Empty for interpreted languages
+
+  if (current_language == "cpp") 
+  {
+    source_filename_base = "main.cpp";
+    compiler = "g++";
+  } 
+  else if (current_language == "c") 
+  {
+    source_filename_base = "main.c";
+    compiler = "gcc";
+  } 
+  else if (current_language == "python") 
+  {
+    source_filename_base = tab->get_path().empty() ? "main.py" : tab->get_base_filename(); // Keeps __file__ and tracebacks recognisable
+  } 
+  else 
+  {
+    return false; // Unknown language
+  }
+
+  auto buffer = tab->get_view().get_source_buffer();
+  if (!buffer) return false; // Should not happen
+  std::string code = buffer->get_text();
+
+  // Every job gets its own directory, so runs of different tabs never share files
+  plan.work_dir = JobScheduler::make_work_dir();
+  if (plan.work_dir.empty()) 
+  {
+    Gtk::MessageDialog err_dialog(*this, "Error: Could not create a work directory in " + Glib::get_tmp_dir() + ".", false, Gtk::MESSAGE_ERROR, Gtk::BUTTONS_OK);
+    err_dialog.run();
+    return false;
+  }
+  plan.source_path = plan.work_dir + "/" + source_filename_base;
+  // Programs run next to their file, so relative paths in them work; untitled ones in the work directory
+  plan.run_cwd = tab->get_path().empty() ? plan.work_dir : Glib::path_get_dirname(tab->get_path());
+
+  // Project builds compile the files on disk, every C/C++ file of the tab's folder, not the buffer
+  if (!compiler.empty() && tab->is_project_build() && !tab->get_path().empty()) 
+  {
+    std::string dir = Glib::path_get_dirname(tab->get_path());
+    for (int i = 0; i < m_notebook.get_n_pages(); ++i) 
+    {
+      auto other = dynamic_cast<EditorTab*>(m_notebook.get_nth_page(i));
+      if (other && other->is_modified() && !other->is_loading() && !other->get_path().empty() && Glib::path_get_dirname(other->get_path()) == dir) 
       {
-        if (!save_current_tab_if_needed(tab)) // Try to save each unsaved tab
-        {
-          all_saved = false;
-          int page_num = m_notebook.page_num(*tab);
-          if (page_num >= 0) 
-          {
-            m_notebook.set_current_page(page_num);
-          }
-          break; // Stops saving if one fails/cancels
-        }
+        other->save_file(other->get_path());
       }
-      if (!all_saved) 
+    }
+    m_save_engine.wait_idle(); // The compilers read the files, so the saves must have landed
+
+    // Objects are cached per folder, compilers and flags; PGO has no training step here, so it is -O2
+    std::string profile = tab->get_build_profile();
+    std::string compile_flags = profile_flags(profile) + (extra_flags.empty() ? "" : " " + extra_flags);
+    std::string object_dir = Glib::get_user_cache_dir() + "/mint_pad/objects/" + 
+                             BuildCache::make_key(dir, "project", compiler_identity("gcc") + " " + compiler_identity("g++") + " " + compile_flags);
+    std::string binary = object_dir + "/program";
+    add_project_build_steps(plan, dir, compile_flags, object_dir, binary, std::thread::hardware_concurrency());
+    plan.run_argv = {binary};
+    plan.source_path = tab->get_path(); // What Profile maps the samples to
+
+    m_statusbar.remove_all_messages(m_run_context_id);
+    m_statusbar.push(m_profile_combo.get_active_text() + " profile, project build of " + std::to_string(find_translation_units(dir).size()) + " files in " + dir + 
+                     (profile == "pgo" ? " (no PGO training for projects)" : ""), m_run_context_id);
+    return true;
+  }
+
+  bool cache_hit = false;
+  if (!compiler.empty()) 
+  {
+    // The binary lands in the build cache; the compiler writes a private temp name that is renamed
+    // into place only on success, so a failed or interrupted build never leaves a bad cache entry
+    std::string profile = tab->get_build_profile();
+    std::string compile_flags = profile_flags(profile) + (extra_flags.empty() ? "" : " " + extra_flags); // Part of both the cache and the PCH key
+    std::string build_identity = compiler_identity(compiler) + " " + compile_flags;
+    std::string training_input = tab->get_training_input().empty() ? "/dev/null" : tab->get_training_input();
+    if (profile == "pgo") 
+    {
+      build_identity += " pgo " + file_identity(training_input); // A different training input makes a different binary
+    }
+    std::string key = BuildCache::make_key(code, current_language, build_identity);
+    std::string exec_filepath = m_build_cache.path_for(key);
+    cache_hit = m_build_cache.lookup(key);
+    plan.run_argv = {exec_filepath}; // Run the executable straight from the cache
+    std::ostringstream pch_status;
+    pch_status.precision(1);
+    pch_status << std::fixed;
+    if (!cache_hit) 
+    {
+      // Reuse a precompiled header for the include preamble when one is ready, or get one built for next
+      // time; PGO compiles with instrumentation first, which no precompiled header fits
+      std::string pch_header;
+      if (profile != "pgo") 
       {
-        return true; // Prevents closing if save failed/cancelled
+        PchServer::Info pch;
+        pch_header = m_pch_server.header_for(scan_include_preamble(code), current_language, compiler, compile_flags, &pch);
+        if (!pch_header.empty()) 
+        {
+          pch_status << ", precompiled header saves ~" << std::max(0.0, pch.parse_ms - pch.pch_ms) << " ms (built in " << pch.build_ms / 1000.0 << " s)";
+        }
       }
-      // If all saved successfully
-    } 
-    else if (result == Gtk::RESPONSE_CANCEL) 
+      add_build_steps(plan, compiler, compile_flags, profile == "pgo", training_input, exec_filepath, pch_header, [this] { m_build_cache.added(); });
+    }
+
+    m_statusbar.remove_all_messages(m_run_context_id);
+    std::ostringstream status;
+    status.precision(1);
+    status << std::fixed << m_profile_combo.get_active_text() << " profile, " << (cache_hit ? "build cache hit" : "build cache miss, compiling") << " (" << m_build_cache.hits() << " hits, " 
+           << m_build_cache.misses() << " misses, " << m_build_cache.bytes() / 1048576.0 << " MB cached)" << pch_status.str();
+    m_statusbar.push(status.str(), m_run_context_id);
+  } 
+  else 
+  {
+    plan.run_argv = {"python3", "-u", plan.source_path}; // Unbuffered, so output shows up as it is printed
+    if (m_python_zygote_enabled) 
     {
-      return true; // Prevents closing
+      plan.run_zygote = m_python_zygote.socket_path();
+      m_statusbar.remove_all_messages(m_run_context_id);
+      m_statusbar.push(plan.run_zygote.empty() ? "Python zygote still starting, running a fresh python3" 
+                                               : "Running in the warm Python interpreter" + (m_python_preload.empty() ? "" : " (" + m_python_preload + " preloaded)"), 
+                       m_run_context_id);
     }
-    // If "Discard Changes" (RESPONSE_NO)
   }
 
-  return false; // Allow closing (either no unsaved files or user chooses Discard/Save All succeeded)
+  if (!cache_hit) // Save the current tab's buffer into the work directory, a cached binary needs no source
+  {
+    std::ofstream outfile(plan.source_path);
+    if (outfile.is_open()) 
+    {
+      outfile << code;
+      outfile.close();
+    } 
+    else 
+    {
+      remove_tree(plan.work_dir);
+      Gtk::MessageDialog err_dialog(*this, "Error: Could not write temporary file in " + plan.work_dir + ".", false, Gtk::MESSAGE_ERROR, Gtk::BUTTONS_OK);
+      err_dialog.run();
+      return false;
+    }
+  } 
+  return true;
 }
 
-
-// Get current tab
-EditorTab* IdeWindow::get_current_tab() 
+void IdeWindow::on_run_button_clicked() 
 {
-  if (m_notebook.get_n_pages() == 0) return nullptr;
-  int current_page_index = m_notebook.get_current_page();
-  if (current_page_index < 0) return nullptr;
-  auto current_page = m_notebook.get_nth_page(current_page_index);
-  return dynamic_cast<EditorTab*>(current_page);
+  EditorTab* tab = get_current_tab();
+  if (!tab) return;
+
+  BuildPlan plan;
+  if (!prepare_build(tab, plan)) return;
+
+  std::string name = tab->get_base_filename();
+  std::vector<Job::Step> steps = plan.build_steps;
+  Job::Step run;
+  run.label = "Running";
+  run.options.argv = plan.run_argv;
+  run.options.cwd = plan.run_cwd;
+  run.options.zygote_socket = plan.run_zygote;
+  run.on_exit = [name](Job& job, const Subprocess::ExitInfo& info)  
+  {
+    std::ostringstream note;
+    note.precision(1);
+    note << std::fixed << "--- " << name << " " << describe_exit(info) << " after " << info.wall_ms << " ms ---";
+    job.note(note.str());
+    return true;
+  };
+  steps.push_back(run);
+
+  auto job = m_jobs.submit(tab, name, plan.work_dir, steps);
+  m_output_panel.show_job(job->id);
+  m_bottom_notebook.set_current_page(m_bottom_notebook.page_num(m_output_panel));
 }
 
-// Creating new tab
-void IdeWindow::create_new_tab(const std::string& file_path) 
+// Builds the current tab once, then runs it repeatedly and shows timing and resource statistics
+void IdeWindow::on_benchmark_clicked() 
 {
-  EditorTab* tab = Gtk::manage(new EditorTab(*this));
+  EditorTab* tab = get_current_tab();
+  if (!tab) return;
 
-  if(auto buffer = tab->get_view().get_source_buffer()) 
+  Gtk::Dialog dialog("Benchmark", *this, true);
+  dialog.add_button("_Cancel", Gtk::RESPONSE_CANCEL);
+  dialog.add_button("_Run", Gtk::RESPONSE_OK);
+  dialog.set_default_response(Gtk::RESPONSE_OK);
+
+  Gtk::Grid grid;
+  grid.set_row_spacing(6);
+  grid.set_column_spacing(12);
+  grid.set_border_width(12);
+  Gtk::Label iterations_label("Measured runs:"), warmups_label("Warm-up runs:"), input_label("Input file:");
+  iterations_label.set_xalign(0);
+  warmups_label.set_xalign(0);
+  input_label.set_xalign(0);
+  Gtk::SpinButton iterations, warmups;
+  iterations.set_range(1, 10000);
+  iterations.set_increments(1, 10);
+  iterations.set_value(m_benchmark_iterations);
+  warmups.set_range(0, 1000);
+  warmups.set_increments(1, 10);
+  warmups.set_value(m_benchmark_warmups);
+  Gtk::FileChooserButton input("Choose an input file", Gtk::FILE_CHOOSER_ACTION_OPEN);
+  input.set_tooltip_text("Fed to stdin on every run, none means /dev/null");
+  if (!m_benchmark_input.empty()) input.set_filename(m_benchmark_input);
+  grid.attach(iterations_label, 0, 0);
+  grid.attach(iterations, 1, 0);
+  grid.attach(warmups_label, 0, 1);
+  grid.attach(warmups, 1, 1);
+  grid.attach(input_label, 0, 2);
+  grid.attach(input, 1, 2);
+  dialog.get_content_area()->pack_start(grid, true, true, 0);
+  dialog.show_all_children();
+
+  if (dialog.run() != Gtk::RESPONSE_OK) return;
+  m_benchmark_iterations = iterations.get_value_as_int();
+  m_benchmark_warmups = warmups.get_value_as_int();
+  m_benchmark_input = input.get_filename();
+  dialog.hide();
+
+  BuildPlan plan;
+  if (!prepare_build(tab, plan)) return;
+
+  std::string name = tab->get_base_filename();
+  int measured = m_benchmark_iterations;
+  int total = m_benchmark_warmups + measured;
+  auto runs = std::make_shared<std::vector<Subprocess::ExitInfo>>();
+
+  // Every iteration is its own step, so each is reaped separately and gets its own rusage
+  std::vector<Job::Step> steps = plan.build_steps;
+  for (int i = 0; i < total; ++i) 
   {
-    buffer->signal_mark_set().connect(sigc::mem_fun(*this, &IdeWindow::on_cursor_position_changed));
+    bool warmup = i < m_benchmark_warmups;
+    Job::Step step;
+    step.label = warmup ? "Warm-up " + std::to_string(i + 1) : "Run " + std::to_string(i - m_benchmark_warmups + 1) + "/" + std::to_string(measured);
+    step.options.argv = plan.run_argv;
+    step.options.cwd = plan.run_cwd;
+    step.options.stdin_path = m_benchmark_input.empty() ? "/dev/null" : m_benchmark_input;
+    step.on_exit = [this, warmup, runs, measured, name](Job& job, const Subprocess::ExitInfo& info) 
+    {
+      if (!info.exited || info.code != 0) 
+      {
+        job.note("--- Benchmark aborted: " + name + " " + describe_exit(info) + " ---");
+        return false;
+      }
+      if (warmup) return true;
+      runs->push_back(info);
+      if (static_cast<int>(runs->size()) == measured) 
+      {
+        job.note("--- Benchmark of " + name + " finished, " + std::to_string(measured) + " measured runs ---");
+        m_benchmark_window = std::make_unique<BenchmarkResultsWindow>(*this, name, *runs);
+        m_benchmark_window->show();
+      }
+      return true;
+    };
+    steps.push_back(step);
   }
 
-  if (!m_font_desc.empty()) 
+  auto job = m_jobs.submit(tab, name + " (benchmark)", plan.work_dir, steps);
+  m_output_panel.show_job(job->id);
+  m_bottom_notebook.set_current_page(m_bottom_notebook.page_num(m_output_panel));
+}
+
+// Builds the current tab with debug info, runs it under a sampling profiler (perf if installed, else
+// a ProfileSampler in the launcher) and maps the samples to lines with addr2line: a heat map in the
+// tab's gutter and a table of the hottest functions
+void IdeWindow::on_profile_clicked() 
+{
+  EditorTab* tab = get_current_tab();
+  if (!tab) return;
+  if (tab->get_language() != "c" && tab->get_language() != "cpp") 
   {
-    tab->set_font(m_font_desc);
+    Gtk::MessageDialog dialog(*this, "Profiling is only available for C and C++.", false, Gtk::MESSAGE_INFO, Gtk::BUTTONS_OK);
+    dialog.set_secondary_text("Samples are mapped back to source lines through the debug info of the compiled binary.");
+    dialog.run();
+    return;
   }
 
-  std::string initial_language = "cpp";
-  if (!file_path.empty()) 
+  BuildPlan plan;
+  if (!prepare_build(tab, plan, "-g -no-pie")) return; // Not position independent, so sampled addresses are the binary's own
+
+  std::string name = tab->get_base_filename();
+  std::string binary = plan.run_argv[0];
+  std::string source_name = Glib::path_get_basename(plan.source_path);
+  std::string perf = Glib::find_program_in_path("perf");
+  std::string sampler = perf.empty() ? "perf_event_open" : "perf";
+  std::string perf_data = plan.work_dir + "/perf.data";
+  std::string samples_path = plan.work_dir + "/samples";
+  std::string addresses_path = plan.work_dir + "/addresses";
+  std::string symbols_path = plan.work_dir + "/symbols";
+  auto counts = std::make_shared<std::map<uint64_t, uint64_t>>();
+
+  // Once the samples are in: the addresses inside the program go to addr2line, the rest are libraries
+  auto collect = [counts, binary, samples_path, addresses_path](Job& job) 
   {
-    if (!tab->load_file(file_path)) 
+    if (!read_sample_counts(samples_path, *counts) || counts->empty()) 
     {
-      Gtk::MessageDialog err_dialog(*this, "Error opening file: " + file_path, false, Gtk::MESSAGE_ERROR, Gtk::BUTTONS_OK); // Error loading file (e.g., doesn't exist)
-      err_dialog.run();
-      // Gtk::manage will delete the tab when it goes out of scope here if load fails
-      // No need to explicitly delete managed widget
-      return;
+      job.note("--- No samples were recorded ---");
+      return false;
     }
-    initial_language = tab->get_language();
+    uint64_t begin = 0, end = 0;
+    executable_range(binary, begin, end);
+    std::ofstream addresses(addresses_path);
+    for (const auto& count : *counts) 
+    {
+      if (count.first >= begin && count.first < end) addresses << "0x" << std::hex << count.first << "\n";
+    }
+    return static_cast<bool>(addresses);
+  };
+
+  std::vector<Job::Step> steps = plan.build_steps;
+  Job::Step run;
+  run.label = "Profiling";
+  run.options.argv = plan.run_argv;
+  run.options.cwd = plan.run_cwd;
+  if (perf.empty()) 
+  {
+    run.options.sample_path = samples_path;
   } 
   else 
   {
-    tab->set_language(initial_language);
+    std::vector<std::string> record = {perf, "record", "-q", "-e", "cycles:u", "-F", "4000", "-o", perf_data, "--"};
+    run.options.argv.insert(run.options.argv.begin(), record.begin(), record.end());
   }
+  run.on_exit = [name, sampler, perf, collect](Job& job, const Subprocess::ExitInfo& info) 
+  {
+    std::ostringstream note;
+    note.precision(1);
+    note << std::fixed << "--- " << name << " " << describe_exit(info) << " after " << info.wall_ms << " ms, sampled with " << sampler << " ---";
+    job.note(note.str());
+    return !perf.empty() || collect(job); // A failed run still has a profile up to where it failed
+  };
+  steps.push_back(run);
 
-  m_notebook.append_page(*tab, tab->get_tab_widget());
-  m_notebook.show_all();
-  m_notebook.set_current_page(-1); // Switching focus to the new tab
-}
+  if (!perf.empty()) 
+  {
+    Job::Step script;
+    script.label = "Reading samples";
+    script.options.argv = {perf, "script", "-i", perf_data, "-F", "ip"};
+    script.options.stdin_path = "/dev/null";
+    script.options.stdout_path = samples_path;
+    script.on_exit = [collect](Job& job, const Subprocess::ExitInfo& info) 
+    {
+      if (info.exited && info.code == 0) return collect(job);
+      job.note("--- perf recorded no samples, /proc/sys/kernel/perf_event_paranoid may not allow it ---");
+      return false;
+    };
+    steps.push_back(script);
+  }
 
-// Handles "New"
-void IdeWindow::on_new_clicked() 
-{
-  create_new_tab();
+  Job::Step symbolize;
+  symbolize.label = "Mapping samples to lines";
+  symbolize.options.argv = {"addr2line", "-e", binary, "-a", "-f", "-i", "-C"};
+  symbolize.options.stdin_path = addresses_path;
+  symbolize.options.stdout_path = symbols_path;
+  symbolize.on_exit = [this, tab, name, sampler, source_name, symbols_path, counts](Job& job, const Subprocess::ExitInfo& info) 
+  {
+    MappedFile symbols;
+    if (!info.exited || info.code != 0 || !symbols.open(symbols_path)) 
+    {
+      job.note("--- addr2line failed, the samples cannot be mapped to lines ---");
+      return false;
+    }
+    ProfileReport report = make_profile_report(*counts, std::string(symbols.data() ? symbols.data() : "", symbols.size()), source_name);
+    std::ostringstream note;
+    note.precision(1);
+    note << std::fixed << "--- Profile of " << name << ": " << report.total << " samples, " << 100.0 * report.in_source / report.total << " % in its lines ---";
+    job.note(note.str());
+
+    m_profile_hidden.disconnect();
+    m_profile_window.reset();
+    EditorTab* target = find_tab(tab);
+    if (!target) return true; // Closed meanwhile
+    target->show_heat_map(report);
+    m_profile_window = std::make_unique<ProfileResultsWindow>(*this, name, sampler, report);
+    m_profile_window->signal_line_activated().connect([this, tab](int line) 
+    {
+      if (EditorTab* target = find_tab(tab)) 
+      {
+        m_notebook.set_current_page(m_notebook.page_num(*target));
+        target->go_to(line, 0);
+      }
+    });
+    m_profile_hidden = m_profile_window->signal_hide().connect([this, tab] 
+    {
+      if (EditorTab* target = find_tab(tab)) target->clear_heat_map();
+    });
+    m_profile_window->show();
+    return true;
+  };
+  steps.push_back(symbolize);
+
+  auto job = m_jobs.submit(tab, name + " (profile)", plan.work_dir, steps);
+  m_output_panel.show_job(job->id);
+  m_bottom_notebook.set_current_page(m_bottom_notebook.page_num(m_output_panel));
 }
 
-// Handles "Open"
-void IdeWindow::on_open_clicked() 
+// Builds the current tab once, then runs it over every test case in a folder, in parallel
+void IdeWindow::on_tests_clicked() 
 {
-  Gtk::FileChooserDialog dialog("Please choose a file", Gtk::FILE_CHOOSER_ACTION_OPEN);
-  dialog.set_transient_for(*this);
-  dialog.add_button("_Cancel", Gtk::RESPONSE_CANCEL); 
-  dialog.add_button("_Open", Gtk::RESPONSE_ACCEPT);
+  EditorTab* tab = get_current_tab();
+  if (!tab) return;
 
-  int result = dialog.run();
+  Gtk::Dialog dialog("Tests", *this, true);
+  dialog.add_button("_Cancel", Gtk::RESPONSE_CANCEL);
+  dialog.add_button("_Run", Gtk::RESPONSE_OK);
+  dialog.set_default_response(Gtk::RESPONSE_OK);
 
-  if (result == Gtk::RESPONSE_ACCEPT) 
+  Gtk::Grid grid;
+  grid.set_row_spacing(6);
+  grid.set_column_spacing(12);
+  grid.set_border_width(12);
+  Gtk::Label folder_label("Test folder:"), cpu_label("CPU time limit (s):"), memory_label("Memory limit (MB):"), wall_label("Wall clock timeout (s):");
+  folder_label.set_xalign(0);
+  cpu_label.set_xalign(0);
+  memory_label.set_xalign(0);
+  wall_label.set_xalign(0);
+  Gtk::FileChooserButton folder("Choose the test folder", Gtk::FILE_CHOOSER_ACTION_SELECT_FOLDER);
+  folder.set_tooltip_text("Pairs like 1.in and 1.out (or .ans), or input1.txt and output1.txt");
+  if (!tab->get_tests_dir().empty()) folder.set_filename(tab->get_tests_dir());
+  else if (!tab->get_path().empty()) folder.set_filename(Glib::path_get_dirname(tab->get_path()));
+  Gtk::SpinButton cpu, memory, wall;
+  cpu.set_range(1, 3600);
+  cpu.set_increments(1, 10);
+  cpu.set_value(m_test_limits.cpu_seconds);
+  memory.set_range(16, 65536);
+  memory.set_increments(64, 256);
+  memory.set_value(m_test_limits.memory_mb);
+  wall.set_digits(1);
+  wall.set_range(0.1, 3600);
+  wall.set_increments(0.5, 10);
+  wall.set_value(m_test_limits.wall_seconds);
+  grid.attach(folder_label, 0, 0);
+  grid.attach(folder, 1, 0);
+  grid.attach(cpu_label, 0, 1);
+  grid.attach(cpu, 1, 1);
+  grid.attach(memory_label, 0, 2);
+  grid.attach(memory, 1, 2);
+  grid.attach(wall_label, 0, 3);
+  grid.attach(wall, 1, 3);
+  dialog.get_content_area()->pack_start(grid, true, true, 0);
+  dialog.show_all_children();
+
+  if (dialog.run() != Gtk::RESPONSE_OK) return;
+  m_test_limits.cpu_seconds = cpu.get_value_as_int();
+  m_test_limits.memory_mb = memory.get_value_as_int();
+  m_test_limits.wall_seconds = wall.get_value();
+  std::string dir = folder.get_filename();
+  dialog.hide();
+  if (dir.empty()) return;
+  tab->set_tests_dir(dir);
+
+  std::vector<TestCase> cases = find_test_cases(dir);
+  if (cases.empty()) 
   {
-    create_new_tab(dialog.get_filename());
+    Gtk::MessageDialog err_dialog(*this, "No test cases in " + dir + ".", false, Gtk::MESSAGE_ERROR, Gtk::BUTTONS_OK);
+    err_dialog.set_secondary_text("Tests are pairs of an input and an expected output file, like 1.in and 1.out (or 1.ans), or input1.txt and output1.txt.");
+    err_dialog.run();
+    return;
   }
+
+  BuildPlan plan;
+  if (!prepare_build(tab, plan)) return;
+
+  // The batch owns the work directory from here, it holds the outputs and, for Python, the source
+  std::string name = tab->get_base_filename();
+  m_test_window.reset();
+  m_test_batch = std::make_unique<TestBatch>(cases, plan.run_argv, plan.run_cwd, plan.work_dir, m_test_limits);
+  m_test_window = std::make_unique<TestResultsWindow>(*this, name, *m_test_batch);
+  m_test_window->show();
+  if (plan.build_steps.empty()) 
+  {
+    m_test_batch->start();
+    return;
+  }
+
+  // Otherwise the build runs as a job of the tab, so its output shows up in the output pane as usual
+  TestBatch* batch = m_test_batch.get();
+  for (size_t i = 0; i < plan.build_steps.size(); ++i) 
+  {
+    bool last = i + 1 == plan.build_steps.size();
+    auto step_exit = plan.build_steps[i].on_exit;
+    plan.build_steps[i].on_exit = [this, batch, last, step_exit](Job& job, const Subprocess::ExitInfo& info) 
+    {
+      bool proceed = step_exit ? step_exit(job, info) : (info.exited && info.code == 0);
+      if (m_test_batch.get() != batch) return proceed; // Superseded by a newer test run
+      if (!proceed) m_test_window->set_status("Build failed, see the output pane");
+      else if (last) batch->start();
+      return proceed;
+    };
+  }
+  auto job = m_jobs.submit(tab, name + " (tests)", "", plan.build_steps);
+  m_output_panel.show_job(job->id);
+  m_bottom_notebook.set_current_page(m_bottom_notebook.page_num(m_output_panel));
 }
 
-// Handles "Save"
-void IdeWindow::on_save_clicked() 
+// Exit button and Quit button both just trigger the window close
+void IdeWindow::on_exit_clicked() 
 {
-  EditorTab* tab = get_current_tab();
-  save_current_tab_if_needed(tab); // Use the helper
+  hide(); // This will trigger on_delete_event
 }
 
-// Handles "Save As" logic, returns true if save succeeded or wasn't needed, false if cancelled/failed
-bool IdeWindow::save_current_tab_if_needed(EditorTab* tab) 
+void IdeWindow::on_quit_button_clicked() 
 {
-  if (!tab) return false;
+  hide(); // This will trigger on_delete_event
+}
 
-  if (tab->get_path().empty() || tab->is_modified()) // Only prompt/save if the file is untitled or modified
+void IdeWindow::on_dark_theme_toggled() 
+{
+  auto screen = Gdk::Screen::get_default();
+  if (m_dark_theme_active) 
   {
-    if (tab->get_path().empty()) 
-    {
-      Gtk::FileChooserDialog dialog("Save File As", Gtk::FILE_CHOOSER_ACTION_SAVE);
-      dialog.set_transient_for(*this);
-      dialog.set_do_overwrite_confirmation(true); // Warns if overwriting
-      dialog.add_button("_Cancel", Gtk::RESPONSE_CANCEL);
-      dialog.add_button("_Save", Gtk::RESPONSE_ACCEPT);
-
-      std::string default_name = "untitled";
-      if (tab->get_language() == "cpp") default_name += ".cpp";
-      else if (tab->get_language() == "c") default_name += ".c";
-      else if (tab->get_language() == "python") default_name += ".py";
-      dialog.set_current_name(default_name);
-
-      int result = dialog.run();
-      if (result == Gtk::RESPONSE_ACCEPT) 
-      {
-        std::string filename = dialog.get_filename();
-        if (tab->save_file(filename)) 
-        {
-          update_title(); // Updates title after successful save as
-          return true;
-        } 
-        else 
-        {
-          Gtk::MessageDialog err_dialog(*this, "Error saving file.", false, Gtk::MESSAGE_ERROR, Gtk::BUTTONS_OK);
-          err_dialog.run();
-          return false; // Save failed
-        }
-      } 
-      else 
-      {
-        return false; // User cancelled Save As
-      }
+    Gtk::StyleContext::remove_provider_for_screen(screen, m_css_provider);
+    m_dark_theme_active = false;
+  } 
+  else 
+  {
+    try 
+    {
+      m_css_provider->load_from_path("dark.css");
+      Gtk::StyleContext::add_provider_for_screen(screen, m_css_provider, GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
+      m_dark_theme_active = true;
     } 
-    else 
+    catch (const Gtk::CssProviderError& ex) 
     {
-      return tab->save_file(tab->get_path()); // Already has a path, just save
+      std::cerr << "CssProviderError: " << ex.what() << std::endl;
+    } 
+    catch (const Glib::FileError& ex) 
+    {
+      std::cerr << "FileError: " << ex.what() << ". Make sure 'dark.css' is in the same directory." << std::endl;
     }
   }
-  return true; // Not modified, "save succeeded"
 }
 
+// EditorTab::on_close_button_clicked Implementation 
+// Needs to be defined after IdeWindow is fully defined
+void EditorTab::on_close_button_clicked() 
+{
+  m_parent_window.close_tab(this);
+}
 
-// "Save As" menu item just forces the "Save As" part of the helper
-void IdeWindow::on_save_as_clicked() 
+// The label and the window title follow with the next frame
+void EditorTab::on_modified_changed() 
 {
-  EditorTab* tab = get_current_tab();
-  if (!tab) return;
+  m_parent_window.schedule_ui_update(IdeWindow::UI_TAB_LABELS | IdeWindow::UI_TITLE, this);
+}
 
-  std::string original_path = tab->get_path();
-  tab->set_path(""); // Temporarily clear path to force "Save As" dialog
-  bool saved = save_current_tab_if_needed(tab);
-  if (!saved && !original_path.empty()) // Restore original path only if save was cancelled and it had an original path
+SaveEngine::Request EditorTab::take_snapshot_for_save(const std::string& path) 
+{
+  SaveEngine::Request request{this, path, ""};
+  if (m_large) 
   {
-    tab->set_path(original_path);
-    tab->update_tab_label_widget();
+    request.spans = m_large->snapshot(request.keep_alive); // Copies the typed text, not the file
+    m_large->set_modified(false);
+  } 
+  else if(auto buffer = get_buffer()) 
+  {
+    size_t unencodable = 0;
+    request.data = buffer->get_text();
+    if (m_encoding != "UTF-8") request.data = encode_text(request.data, m_encoding, unencodable);
+    if (unencodable > 0) // Rather than lose them, the file becomes UTF-8
+    {
+      m_parent_window.on_tab_disk_event(this, get_base_filename() + " has " + std::to_string(unencodable) + " characters " + m_encoding + " cannot hold, saved as UTF-8");
+      m_encoding = "UTF-8";
+      request.data = buffer->get_text();
+      m_parent_window.schedule_ui_update(IdeWindow::UI_STATUSBAR);
+    }
+    buffer->set_modified(false);
   }
-  // If saved is true, save_current_tab_if_needed already updated the path and label
+  return request;
 }
 
+bool EditorTab::save_file(const std::string& path) 
+{
+  if (m_loading) 
+  {
+    return false; // Never write out a half loaded file
+  }
+  if (get_buffer() || m_large) 
+  {
+    m_parent_window.get_save_engine().submit(take_snapshot_for_save(path)); // Marked as saved, reverted by on_save_failed() if the write fails
+    ++m_saves_in_flight;
+    m_journal_saves.emplace_back(); // Collects the edits the file will not have
+    set_path(path); // Update path once the save is queued
+    update_tab_label_widget();
+    return true;
+  }
+  return false;
+}
 
-// Public method to actually close a tab, handles prompts
-void IdeWindow::close_tab(EditorTab* tab_to_close) 
+// Inserts the next slice of the mapped file, bounded by a time budget per callback
+bool EditorTab::on_load_idle() 
 {
-  if (!tab_to_close) return;
+  const size_t piece_size = 64 * 1024;
+  const auto budget = std::chrono::milliseconds(8); // Leaves most of a 60 Hz frame for input and redraws
+  auto start = std::chrono::steady_clock::now();
 
-  bool do_close = true; // Assume we will close unless cancelled
+  auto buffer = get_buffer();
+  const char* data = m_load_decoded ? m_load_text.data() : m_load_source->data();
+  size_t size = get_load_size();
 
-  if (tab_to_close->is_modified()) 
+  while (m_load_offset < size && std::chrono::steady_clock::now() - start < budget) 
   {
-    Gtk::MessageDialog dialog(*this, "Save changes before closing?", false, Gtk::MESSAGE_QUESTION, Gtk::BUTTONS_NONE);
-    dialog.set_secondary_text("\"" + tab_to_close->get_base_filename() + "*\" has unsaved changes.");
-    dialog.add_button(Gtk::Stock::SAVE, Gtk::RESPONSE_YES);
-    dialog.add_button("_Don't Save", Gtk::RESPONSE_NO); 
-    dialog.add_button(Gtk::Stock::CANCEL, Gtk::RESPONSE_CANCEL);
-
-    int result = dialog.run();
-
-    if (result == Gtk::RESPONSE_YES) 
-    { 
-      if (!save_current_tab_if_needed(tab_to_close)) // Save
+    size_t length = std::min(piece_size, size - m_load_offset);
+    if (m_load_offset + length < size) 
+    {
+      // Never split a UTF-8 sequence across two inserts
+      while (length > 0 && (static_cast<unsigned char>(data[m_load_offset + length]) & 0xC0) == 0x80) 
       {
-        do_close = false; // Save failed or cancelled
+        --length;
       }
-    } 
-    else if (result == Gtk::RESPONSE_CANCEL) 
-    {
-      do_close = false; // User cancelled
+      if (length == 0) length = std::min(piece_size, size - m_load_offset); // Not UTF-8 at all, insert as is
+      // Nor a \r\n pair, which split across two inserts would count as two line breaks
+      if (length > 1 && data[m_load_offset + length - 1] == '\r' && data[m_load_offset + length] == '\n') --length;
     }
-    // If "Don't Save" (RESPONSE_NO), do_close remains true
+    buffer->insert(buffer->end(), data + m_load_offset, data + m_load_offset + length);
+    m_load_offset += length;
   }
 
-  if (do_close) 
+  if (m_load_offset < size) 
   {
-    int page_num = m_notebook.page_num(*tab_to_close);
-    if (page_num >= 0) 
-    {
-      m_notebook.remove_page(page_num);
-      // Gtk::manage handles deletion automatically
-
-      if (m_notebook.get_n_pages() == 0) 
-      {
-        create_new_tab(); // Ensures at least one tab remains
-      } 
-      else 
-      {
-         on_tab_changed(nullptr, m_notebook.get_current_page()); // Trigger updates for the potentially new current tab
-      }
-    }
+    m_parent_window.on_tab_load_progress(this);
+    return true; // Keep the idle source alive
   }
-}
 
-// Other Handlers
+  finish_load();
+  m_parent_window.on_tab_load_progress(this);
+  return false;
+}
 
-void IdeWindow::on_font_clicked() 
+// Ends a load, whether complete or cancelled
+void EditorTab::finish_load() 
 {
-  Gtk::FontChooserDialog dialog("Choose Font", *this);
-  if (!m_font_desc.empty()) 
+  m_loading = false;
+  m_load_source.reset(); // Unmaps the file
+  std::string().swap(m_load_text);
+  m_source_view->set_editable(true);
+  if(auto buffer = get_buffer()) 
   {
-    dialog.set_font(m_font_desc);
+    buffer->end_not_undoable_action();
+    buffer->place_cursor(buffer->begin());
+    apply_pending_cursor(); // E.g. back to where it was when the session was saved
+    buffer->set_modified(false); // File loaded, not modified
   }
+  update_tab_label_widget();
+  if (!m_file_path.empty()) schedule_disk_check(); // It may have changed while it streamed in
+  schedule_check();
+}
 
-  int result = dialog.run();
+// Looks at the file after a change notification and reloads it if someone else wrote it
+void EditorTab::check_disk() 
+{
+  if (m_file_path.empty() || m_loading || m_saves_in_flight > 0 || m_disk_prompt_open) return; // Saves settle the stamp themselves
+  if (m_reload && !m_reload->finished()) return; // It looks again when done
+  std::string stamp = disk_stamp(m_file_path);
+  if (stamp == m_disk_stamp) return;
+  if (m_large) 
+  {
+    check_disk_large(stamp);
+    return;
+  }
 
-  if (result == Gtk::RESPONSE_OK) 
+  auto buffer = get_buffer();
+  if (!buffer) // A restored tab that has not loaded yet reads the new contents anyway
   {
-    m_font_desc = dialog.get_font();
-    for (int i = 0; i < m_notebook.get_n_pages(); ++i) 
+    m_disk_stamp = stamp;
+    return;
+  }
+  if (stamp.empty()) // Deleted or moved away, the next save writes it back
+  {
+    m_disk_stamp = stamp;
+    buffer->set_modified(true);
+    start_journal(); // Keeps the text, the file to replay onto is gone
+    m_parent_window.on_tab_disk_event(this, get_base_filename() + " was removed from disk");
+    return;
+  }
+  if (buffer->get_modified()) 
+  {
+    Gtk::MessageDialog dialog(m_parent_window, get_base_filename() + " has changed on disk", false, Gtk::MESSAGE_QUESTION, Gtk::BUTTONS_NONE);
+    dialog.set_secondary_text("Reload it? This replaces your unsaved changes, Undo brings them back.");
+    dialog.add_button("Keep Mine", Gtk::RESPONSE_CANCEL);
+    dialog.add_button("Reload", Gtk::RESPONSE_ACCEPT);
+    m_disk_prompt_open = true;
+    int response = dialog.run();
+    m_disk_prompt_open = false;
+    if (response != Gtk::RESPONSE_ACCEPT) 
     {
-      auto tab = dynamic_cast<EditorTab*>(m_notebook.get_nth_page(i));
-      if (tab) tab->set_font(m_font_desc);
+      m_disk_stamp = stamp; // Saving overwrites it, as asked
+      start_journal(); // The old file the journal builds on is gone
+      return;
     }
   }
+
+  m_disk_stamp = stamp;
+  m_reload_serial = m_edit_serial;
+  m_reload = std::make_unique<ReloadDiff>(m_file_path, buffer->get_text());
+  m_reload->signal_done().connect(sigc::mem_fun(*this, &EditorTab::apply_reload));
 }
 
-void IdeWindow::on_cursor_position_changed(const Gtk::TextBuffer::iterator& iter, const Glib::RefPtr<Gtk::TextBuffer::Mark>& mark) 
+// Applies a finished reload diff hunk by hunk. The rest of the buffer, the cursor, the scroll
+// position and the undo history stay as they are; the reload itself is one undoable step.
+void EditorTab::apply_reload() 
 {
-  EditorTab* current_tab = get_current_tab(); // Checks if the mark is the insert cursor and if the currently focused tab is the one emitting the signal
-  if (current_tab && mark->get_name() == "insert" && mark->get_buffer() == current_tab->get_view().get_source_buffer()) 
+  auto buffer = get_buffer();
+  if (!buffer || !m_reload->ok()) return;
+  if (m_edit_serial != m_reload_serial) // Typed into while the diff ran, the hunks no longer fit
   {
-    update_statusbar();
-    update_title(); // Updates title to potentially show/hide * (asterisk)
+    m_disk_stamp.clear();
+    schedule_disk_check();
+    return;
   }
+
+  const auto& hunks = m_reload->hunks();
+  m_journal_paused = true;
+  buffer->begin_user_action();
+  for (auto hunk = hunks.rbegin(); hunk != hunks.rend(); ++hunk) // Back to front, so earlier offsets stay valid
+  {
+    auto position = buffer->erase(buffer->get_iter_at_offset(hunk->old_offset), buffer->get_iter_at_offset(hunk->old_offset + hunk->old_length));
+    buffer->insert(position, hunk->text.data(), hunk->text.data() + hunk->text.size());
+  }
+  buffer->end_user_action();
+  m_journal_paused = false;
+  buffer->set_modified(false);
+  m_encoding = m_reload->encoding();
+  m_parent_window.schedule_ui_update(IdeWindow::UI_STATUSBAR);
+  discard_journal(); // The buffer is the file again
+
+  std::ostringstream status;
+  status.precision(1);
+  status << std::fixed << "Reloaded " << get_base_filename() << " from disk, " << hunks.size() << (hunks.size() == 1 ? " change" : " changes")
+         << " (" << m_reload->milliseconds() << " ms)";
+  m_parent_window.on_tab_disk_event(this, status.str());
+  schedule_disk_check(); // In case it changed again meanwhile
 }
 
-void IdeWindow::on_tab_changed(Gtk::Widget* page, guint page_num) 
+// Shows a file too large for a text buffer in a LargeFileView over its mapping. Highlighting, syntax
+// checks, the journal and builds are off for it; the hidden text view stays, empty, for the code
+// that asks any tab for its buffer.
+void EditorTab::open_large(const std::string& path, std::unique_ptr<MappedFile> file) 
 {
-  EditorTab* tab = get_current_tab();
-  if (tab) 
-  {
-    update_statusbar();
-    update_title();
-    m_language_combo.set_active_id(tab->get_language());
-  } 
-  else 
+  cancel_load();
+  discard_journal();
+  m_encoding = "UTF-8"; // Large files are shown and saved byte for byte
+  if (!m_source_view) create_view();
+  if (!m_large) 
   {
-    update_title(); // Updates to default title
-    update_statusbar(); // Clears status bar
+    m_large = std::make_unique<LargeFileView>();
+    m_large->set_font(m_font_desc);
+    m_large->signal_modified_changed().connect(sigc::mem_fun(*this, &EditorTab::on_modified_changed));
+    m_large->signal_cursor_moved().connect([this] { m_parent_window.schedule_ui_update(IdeWindow::UI_STATUSBAR); });
+    m_large->signal_index_progress().connect([this] { m_parent_window.on_tab_load_progress(this); });
+    remove(); // The text view
+    set_policy(Gtk::POLICY_NEVER, Gtk::POLICY_NEVER); // The view scrolls itself
+    add(*m_large);
+    m_large->show_all();
   }
+  m_journal_paused = true;
+  get_buffer()->set_text("");
+  get_buffer()->set_modified(false);
+  m_journal_paused = false;
+  clear_diagnostics();
+  m_check.reset();
+  m_check_status.clear();
+
+  set_path(path);
+  m_disk_stamp = disk_stamp(path);
+  set_language(detect_language_from_path(path));
+  m_large->open(std::shared_ptr<MappedFile>(std::move(file)));
+  apply_pending_cursor();
+  update_tab_label_widget();
+  m_parent_window.on_tab_load_progress(this);
 }
 
-void IdeWindow::update_statusbar() 
+// Back to the text view, for a file that has shrunk below large_file_threshold
+void EditorTab::close_large() 
 {
-  EditorTab* tab = get_current_tab();
-  if (tab) 
+  remove_with_viewport();
+  m_large.reset();
+  set_policy(Gtk::POLICY_AUTOMATIC, Gtk::POLICY_AUTOMATIC);
+  add(*m_source_view);
+}
+
+// check_disk() for a large file: there is no undo to fall back on, so a modified tab always asks
+void EditorTab::check_disk_large(const std::string& stamp) 
+{
+  if (stamp.empty()) // Deleted or moved away, the mapping still holds the text
   {
-    auto buffer = tab->get_view().get_source_buffer();
-    if(!buffer) return;
-    auto iter = buffer->get_iter_at_mark(buffer->get_insert());
-    int line = iter.get_line() + 1;
-    int col = iter.get_line_offset() + 1;
-    std::string status = "Line: " + std::to_string(line) + ", Col: " + std::to_string(col);
-    m_statusbar.pop(); // Removes previous message context id 0
-    m_statusbar.push(status); // Pushes new message context id 0
-  } 
-  else 
+    m_disk_stamp = stamp;
+    m_large->set_modified(true);
+    m_parent_window.on_tab_disk_event(this, get_base_filename() + " was removed from disk");
+    return;
+  }
+  if (m_large->is_modified()) 
   {
-    m_statusbar.pop(); // Clears status bar if no tab
+    Gtk::MessageDialog dialog(m_parent_window, get_base_filename() + " has changed on disk", false, Gtk::MESSAGE_QUESTION, Gtk::BUTTONS_NONE);
+    dialog.set_secondary_text("Reload it? Your unsaved changes to this large file will be lost.");
+    dialog.add_button("Keep Mine", Gtk::RESPONSE_CANCEL);
+    dialog.add_button("Reload", Gtk::RESPONSE_ACCEPT);
+    m_disk_prompt_open = true;
+    int response = dialog.run();
+    m_disk_prompt_open = false;
+    m_disk_stamp = stamp;
+    if (response != Gtk::RESPONSE_ACCEPT) return; // Saving overwrites it, as asked
   }
+  m_disk_stamp = stamp;
+  auto file = std::make_unique<MappedFile>();
+  if (!file->open(m_file_path)) return;
+  if (file->size() < large_file_threshold) 
+  {
+    load_file(m_file_path); // Small enough for the text view now
+    return;
+  }
+  m_large->reopen(std::shared_ptr<MappedFile>(std::move(file)));
+  m_parent_window.on_tab_disk_event(this, "Reloaded " + get_base_filename() + " from disk");
 }
 
-void IdeWindow::update_title() 
+// Snapshots the buffer and runs the checker for its language on it, replacing the previous check
+void EditorTab::start_check() 
 {
-  std::string title_base = "Mint_Pad"; // It's your own, personal editor, name it whatever you want. I went with Mint_Pad since it is developed in Linux Mint.
-  EditorTab* tab = get_current_tab();
-  if (tab) 
+  auto buffer = get_buffer();
+  if (!buffer || m_loading) return;
+  std::string directory = m_file_path.empty() ? "" : Glib::path_get_dirname(m_file_path);
+  std::string text = buffer->get_text();
+  std::string pch_header;
+  if (m_language_id == "c" || m_language_id == "cpp") // The preamble a Run would precompile, with the same flags
   {
-    set_title(tab->get_base_filename() + (tab->is_modified() ? "*" : "") + " - " + title_base);
-  } 
-  else 
+    pch_header = m_parent_window.get_pch_server().header_for(scan_include_preamble(text), m_language_id, m_language_id == "c" ? "gcc" : "g++", profile_flags(m_build_profile));
+  }
+  auto argv = SyntaxCheck::command_for(m_language_id, profile_flags(m_build_profile), directory, pch_header);
+  m_check.reset(); // Only one check per tab runs
+  if (argv.empty() || text.size() > 4 * 1024 * 1024) // Nothing to check it with, or too big to check on every pause
   {
-    set_title(title_base); // Default title if no tabs
+    clear_diagnostics();
+    m_check_status.clear();
+    m_parent_window.on_tab_checked(this);
+    return;
   }
+  m_check_serial = m_edit_serial;
+  m_check = std::make_unique<SyntaxCheck>(argv, std::move(text), directory.empty() ? Glib::get_tmp_dir() : directory);
+  m_check->signal_done().connect(sigc::mem_fun(*this, &EditorTab::on_check_done));
 }
 
-void IdeWindow::on_language_changed() 
+// Shows the diagnostics of a finished check, unless the buffer has changed since its snapshot
+void EditorTab::on_check_done() 
 {
-  EditorTab* tab = get_current_tab();
-  if (tab) 
+  auto buffer = get_buffer();
+  if (!buffer || !m_check || m_check->cancelled() || m_check_serial != m_edit_serial) return; // A newer check is on its way
+  clear_diagnostics();
+  std::ostringstream status;
+  status.precision(0);
+  if (!m_check->error().empty()) 
   {
-    tab->set_language(m_language_combo.get_active_id());
-    tab->update_tab_label_widget(); // Update tab title if needed (like Untitled -> Untitled*)
-    update_title(); // Also update main window title if needed
+    m_check_status = "Syntax check unavailable: " + m_check->error();
+    m_parent_window.on_tab_checked(this);
+    return;
+  }
+
+  m_diagnostics = m_check->diagnostics();
+  int errors = 0;
+  for (size_t i = 0; i < m_diagnostics.size(); ++i) 
+  {
+    const auto& diagnostic = m_diagnostics[i];
+    errors += diagnostic.error;
+    auto start = buffer->get_iter_at_line(std::min(diagnostic.line, buffer->get_line_count() - 1));
+    buffer->create_source_mark("diagnostic" + std::to_string(i), diagnostic.error ? "error" : "warning", start);
+    if (diagnostic.column < start.get_chars_in_line()) start.set_line_offset(diagnostic.column);
+    if (start.ends_line() && !start.starts_line()) start.backward_char(); // E.g. a missing ';' is reported after the last character
+    auto end = start;
+    if (start.inside_word()) end.forward_word_end();
+    else if (!end.ends_line()) end.forward_char();
+    buffer->apply_tag(diagnostic.error ? m_error_tag : m_warning_tag, start, end);
   }
+  int warnings = static_cast<int>(m_diagnostics.size()) - errors;
+  status << std::fixed << "Syntax check: ";
+  if (m_diagnostics.empty()) status << "no problems";
+  else status << errors << (errors == 1 ? " error, " : " errors, ") << warnings << (warnings == 1 ? " warning" : " warnings");
+  status << " (" << m_check->milliseconds() << " ms)";
+  m_check_status = status.str();
+  m_parent_window.on_tab_checked(this);
 }
 
-void IdeWindow::on_run_button_clicked() 
+void EditorTab::clear_diagnostics() 
 {
-  EditorTab* tab = get_current_tab();
-  if (!tab) return;
+  auto buffer = get_buffer();
+  if (!buffer) return;
+  buffer->remove_source_marks(buffer->begin(), buffer->end(), "error");
+  buffer->remove_source_marks(buffer->begin(), buffer->end(), "warning");
+  buffer->remove_tag(m_error_tag, buffer->begin(), buffer->end());
+  buffer->remove_tag(m_warning_tag, buffer->begin(), buffer->end());
+  m_diagnostics.clear();
+}
 
-  if (tab->is_modified() && !tab->get_path().empty()) // Saves current file if needed before running 
+// Marks the lines the samples of a profiled run landed on, the hottest line at the top level
+void EditorTab::show_heat_map(const ProfileReport& report) 
+{
+  clear_heat_map();
+  auto buffer = get_buffer();
+  if (!buffer || m_large) return;
+  uint64_t hottest = 0;
+  for (const auto& line : report.line_samples) hottest = std::max(hottest, line.second);
+  for (const auto& line : report.line_samples) 
   {
-    tab->save_file(tab->get_path());
+    if (line.first >= buffer->get_line_count()) break; // Edited away since
+    int level = static_cast<int>(4 * line.second / hottest);
+    std::ostringstream tip;
+    tip.precision(1);
+    tip << std::fixed << 100.0 * line.second / report.total << " % of the samples (" << line.second << ")";
+    buffer->create_source_mark("hotline" + std::to_string(m_heat_tips.size()), "heat" + std::to_string(level), buffer->get_iter_at_line(line.first));
+    m_heat_tips.push_back(tip.str());
   }
+}
 
-  std::string current_language = tab->get_language();
-  std::string source_filename_base; // Just the name part
-  std::string exec_filename_base = "temp_ide_exec"; // Base name for executable
-  std::string build_command;
-  std::string run_command;
-  std::string cleanup_command;
+void EditorTab::clear_heat_map() 
+{
+  auto buffer = get_buffer();
+  if (!buffer) return;
+  for (int level = 0; level < 5; ++level) 
+  {
+    buffer->remove_source_marks(buffer->begin(), buffer->end(), "heat" + std::to_string(level));
+  }
+  m_heat_tips.clear();
+}
 
-  // Define filenames using /tmp directory
-  std::string temp_dir = "/tmp/"; // Standard Linux temporary directory
-  std::string source_filepath;
-  std::string exec_filepath = temp_dir + exec_filename_base;
+EditorTab::~EditorTab() 
+{
+  cancel_load(); // Tab closed while a file was still streaming in
+  discard_journal(); // Saved, or the user chose to drop the changes
+}
 
-  if (current_language == "cpp") 
-  {
-    source_filename_base = "temp_run.cpp";
-    source_filepath = temp_dir + source_filename_base;
-    build_command = "g++ " + source_filepath + " -o " + exec_filepath;
-    run_command = exec_filepath; // Run the executable from /tmp
-    cleanup_command = "rm -f " + source_filepath + " " + exec_filepath; // Removes both upon closing the terminal
-  } 
-  else if (current_language == "c") 
-  {
-    source_filename_base = "temp_run.c";
-    source_filepath = temp_dir + source_filename_base;
-    build_command = "gcc " + source_filepath + " -o " + exec_filepath;
-    run_command = exec_filepath;
-    cleanup_command = "rm -f " + source_filepath + " " + exec_filepath;
-  } 
-  else if (current_language == "python") 
+void EditorTab::on_save_finished(bool saved) 
+{
+  --m_saves_in_flight;
+  std::string since_save;
+  if (!m_journal_saves.empty()) 
   {
-    source_filename_base = "temp_run.py";
-    source_filepath = temp_dir + source_filename_base;
-    build_command = ""; // No build step for Python
-    run_command = "python3 " + source_filepath;
-    cleanup_command = "rm -f " + source_filepath; // Only remove source upon closing the terminal
-  } 
-  else 
+    since_save = std::move(m_journal_saves.front());
+    m_journal_saves.pop_front();
+  }
+  if (!saved) 
   {
-    return; // Unknown language
+    on_save_failed(); // The journal still builds on the last file that made it
+    return;
   }
-
-  if(auto buffer = tab->get_view().get_source_buffer()) // Save the current tab's buffer to the temporary file
+  m_disk_stamp = disk_stamp(m_file_path); // Our own write is not an external change
+  if (m_large && !m_large->is_modified() && m_saves_in_flight == 0) 
   {
-    std::string code = buffer->get_text();
-    std::ofstream outfile(source_filepath); // Save to /tmp/temp_run.*
-    if (outfile.is_open()) 
-    {
-      outfile << code;
-      outfile.close();
-    } 
-    else 
-    {
-      Gtk::MessageDialog err_dialog(*this, "Error: Could not write temporary file in /tmp.", false, Gtk::MESSAGE_ERROR, Gtk::BUTTONS_OK);
-      err_dialog.run();
-      return;
-    }
-  } 
-  else 
+    // The view still reads the replaced file, whose blocks stay allocated while mapped
+    auto file = std::make_shared<MappedFile>();
+    if (file->open(m_file_path)) m_large->reopen(file);
+  }
+  if (m_journal_id < 0) return;
+  if (since_save.empty()) 
   {
-    return; // Should not happen
+    discard_journal(); // The file has it all
+    return;
   }
 
-  // Construct the full command for gnome-terminal
-  std::string full_command_in_terminal;
-  std::string pause_part = "echo; read -p 'Press Enter to close...'"; // Added echo for spacing
+  // Compacts the journal to what was typed while the save ran, on top of the file it wrote
+  std::string records = EditJournal::header_record(m_file_path, m_disk_stamp, m_language_id) + since_save;
+  m_parent_window.get_journal().reset(m_journal_id, records);
+  m_journal_bytes = records.size();
+}
 
-  if (!build_command.empty()) 
-  { // For C/C++
-    // Compile && Run || Error ; Cleanup ; Pause
-    full_command_in_terminal = build_command + " && " + run_command + " || echo '--- COMPILATION FAILED ---'; " + cleanup_command + "; " + pause_part;
-  } 
-  else 
-  { // For Python
-    // Run ; Cleanup ; Pause
-    full_command_in_terminal = run_command + "; " + cleanup_command + "; " + pause_part;
-  }
-  
-  // Escapes double quotes inside the command string for the shell
-  size_t pos = 0; 
-  while ((pos = full_command_in_terminal.find('"', pos)) != std::string::npos) 
-  {
-    full_command_in_terminal.replace(pos, 1, "\\\"");
-    pos += 2; // Move past the replaced sequence
-  }
+void EditorTab::recover(const std::string& path, const std::string& language, const std::string& text) 
+{
+  if (!m_source_view) create_view(); // No load for a deferred tab, its text is here
+  cancel_load();
+  auto buffer = get_buffer();
+  set_path(path);
+  m_disk_stamp = disk_stamp(path);
+  set_language(language);
 
-  std::string terminal_command = "gnome-terminal -- bash -c \"" + full_command_in_terminal + "\"";
+  m_journal_paused = true;
+  buffer->begin_not_undoable_action();
+  buffer->set_text(text);
+  buffer->end_not_undoable_action();
+  m_journal_paused = false;
+  buffer->place_cursor(buffer->begin());
+  apply_pending_cursor();
+  buffer->set_modified(true);
+  start_journal(); // Our journal takes over from the recovered one
+  update_tab_label_widget();
+}
 
-  system((terminal_command + " &").c_str()); // Run the command in the background
+void EditorTab::on_buffer_insert(const Gtk::TextBuffer::iterator& position, const Glib::ustring& text, int bytes) 
+{
+  if (m_loading || m_journal_paused) return;
+  journal_record(EditJournal::insert_record(position.get_offset(), text.data(), bytes));
 }
 
-// Exit button and Quit button both just trigger the window close
-void IdeWindow::on_exit_clicked() 
+void EditorTab::on_buffer_erase(const Gtk::TextBuffer::iterator& start, const Gtk::TextBuffer::iterator& end) 
 {
-  hide(); // This will trigger on_delete_event
+  if (m_loading || m_journal_paused) return;
+  journal_record(EditJournal::erase_record(start.get_offset(), end.get_offset() - start.get_offset()));
 }
 
-void IdeWindow::on_quit_button_clicked() 
+// Journals an edit that is about to happen. The first edit starts the journal, and one that has
+// grown well past the text starts over from a snapshot, so replay stays short.
+void EditorTab::journal_record(const std::string& record) 
 {
-  hide(); // This will trigger on_delete_event
+  size_t limit = 4 * static_cast<size_t>(get_buffer()->get_char_count()) + 1024 * 1024;
+  if (m_journal_id < 0 || m_journal_bytes > limit) start_journal();
+  m_parent_window.get_journal().append(m_journal_id, record);
+  m_journal_bytes += record.size();
+  for (auto& pending : m_journal_saves) pending += record;
 }
 
-void IdeWindow::on_dark_theme_toggled() 
+// Starts the journal over from the buffer as it is: a header naming the file the edits apply to,
+// and a snapshot of the text unless it is exactly that file
+void EditorTab::start_journal() 
 {
-  auto screen = Gdk::Screen::get_default();
-  if (m_dark_theme_active) 
+  EditJournal& journal = m_parent_window.get_journal();
+  if (m_journal_id < 0) m_journal_id = journal.open();
+  auto buffer = get_buffer();
+  std::string records = EditJournal::header_record(m_file_path, m_disk_stamp, m_language_id);
+  bool matches_file = !m_file_path.empty() && !m_disk_stamp.empty() && !buffer->get_modified() && m_saves_in_flight == 0;
+  if (!matches_file) records += EditJournal::snapshot_record(buffer->get_text());
+  journal.reset(m_journal_id, records);
+  m_journal_bytes = records.size();
+}
+
+void EditorTab::discard_journal() 
+{
+  if (m_journal_id < 0) return;
+  m_parent_window.get_journal().discard(m_journal_id);
+  m_journal_id = -1;
+}
+
+// A file named on the command line, with the 1-based line and column to open it at (0 if not given)
+struct FileArgument 
+{
+  std::string path;
+  int line;
+  int column;
+};
+
+// Parses "file", "+line[:col] file" and "file:line[:col]" arguments. Relative paths are resolved
+// against cwd, the directory of the invocation, which for a forwarded one is not ours.
+static std::vector<FileArgument> parse_file_arguments(const std::vector<std::string>& args, const std::string& cwd) 
+{
+  auto parse_position = [](const std::string& text, int& line, int& column) 
   {
-    Gtk::StyleContext::remove_provider_for_screen(screen, m_css_provider);
-    m_dark_theme_active = false;
-  } 
-  else 
+    char* end = nullptr;
+    line = strtol(text.c_str(), &end, 10);
+    column = 0;
+    if (end == text.c_str() || line <= 0) return false;
+    if (*end == ':') column = strtol(end + 1, &end, 10);
+    return *end == '\0';
+  };
+
+  std::vector<FileArgument> files;
+  int line = 0, column = 0;
+  for (const auto& arg : args) 
   {
-    try 
-    {
-      m_css_provider->load_from_path("dark.css");
-      Gtk::StyleContext::add_provider_for_screen(screen, m_css_provider, GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
-      m_dark_theme_active = true;
-    } 
-    catch (const Gtk::CssProviderError& ex) 
-    {
-      std::cerr << "CssProviderError: " << ex.what() << std::endl;
-    } 
-    catch (const Glib::FileError& ex) 
+    if (arg.size() > 1 && arg[0] == '+' && parse_position(arg.substr(1), line, column)) continue; // Applies to the next file
+    FileArgument file = {Glib::path_is_absolute(arg) ? arg : Glib::build_filename(cwd, arg), line, column};
+    size_t colon = file.path.find(':', file.path.rfind('/') + 1);
+    if (colon != std::string::npos && !Glib::file_test(file.path, Glib::FILE_TEST_EXISTS) &&
+        parse_position(file.path.substr(colon + 1), file.line, file.column)) 
     {
-      std::cerr << "FileError: " << ex.what() << ". Make sure 'dark.css' is in the same directory." << std::endl;
+      file.path.erase(colon);
     }
+    files.push_back(file);
+    line = column = 0;
   }
+  return files;
 }
 
-// EditorTab::on_close_button_clicked Implementation 
-// Needs to be defined after IdeWindow is fully defined
-void EditorTab::on_close_button_clicked() 
-{
-  m_parent_window.close_tab(this);
-}
-
-// Main Function 
+// Main Function
 int main(int argc, char* argv[]) 
 {
-  auto app = Gtk::Application::create(argc, argv, "org.gtkmm.examples.ide");
-  Gsv::init();
-  IdeWindow window;
-  return app->run(window);
+  if (argc > 1 && strcmp(argv[1], Subprocess::launcher_flag) == 0) 
+  {
+    return Subprocess::launcher_main(argc, argv); // Started by Subprocess, not by the user
+  }
+  if (argc > 1 && strcmp(argv[1], project_build_flag) == 0) 
+  {
+    return project_build_main(argc, argv); // A project build step, see add_project_build_steps()
+  }
+  signal(SIGPIPE, SIG_IGN); // Writing to the stdin of a program that already exited must not kill the editor
+
+  // Single instance: a later "mint_pad file.cpp" finds the running editor on D-Bus and hands it its
+  // command line, then exits without ever setting up a window of its own
+  auto app = Gtk::Application::create("org.gtkmm.examples.ide", Gio::APPLICATION_HANDLES_COMMAND_LINE);
+  std::unique_ptr<IdeWindow> window; // Only the first instance gets one
+  app->signal_command_line().connect([&](const Glib::RefPtr<Gio::ApplicationCommandLine>& command_line) 
+  {
+    int count = 0;
+    char** arguments = command_line->get_arguments(count);
+    std::vector<std::string> args(arguments + std::min(count, 1), arguments + count); // Without the program name
+    g_strfreev(arguments);
+
+    if (!window) 
+    {
+      Gsv::init();
+      window = std::make_unique<IdeWindow>();
+      app->add_window(*window);
+      window->show();
+    }
+    for (const auto& file : parse_file_arguments(args, command_line->get_cwd())) 
+    {
+      // Without a line, -1 leaves the cursor of a tab that is already open where it was
+      window->open_file_at(file.path, file.line > 0 ? file.line - 1 : -1, std::max(file.column - 1, 0));
+    }
+    window->present();
+    return 0;
+  }, false);
+  return app->run(argc, argv);
 }